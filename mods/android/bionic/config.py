@@ -205,6 +205,7 @@ def _filter_libc_common(vars):
       'android/bionic/libc/arch-nacl/syscalls/mmap.c',
       'android/bionic/libc/arch-nacl/syscalls/mprotect.c',
       'android/bionic/libc/arch-nacl/syscalls/munmap.c',
+      'android/bionic/libc/arch-nacl/syscalls/nacl_fast_clock.c',
       'android/bionic/libc/arch-nacl/syscalls/nacl_stat.c',
       'android/bionic/libc/arch-nacl/syscalls/nacl_timespec.c',
       'android/bionic/libc/arch-nacl/syscalls/nacl_timeval.c',
@@ -843,7 +844,18 @@ def _generate_bionic_fundamental_test_runners(n):
       # If this passes, .ctors and .dtors with dlopen are working.
       ('dlopen_structors_test', [test_out_dir], [], {}),
       # If this passes, dlopen fails properly when there is a missing symbol.
-      ('dlopen_error_test', [test_out_dir], [], {})
+      ('dlopen_error_test', [test_out_dir], [], {}),
+      # If this passes, shared objects with DT_HASH and DT_GNU_HASH are
+      # loaded. This also prints the time to load them.
+      ('dlopen_benchmark', [test_out_dir], [], {}),
+      # Same as above, but without the symbol lookup cache in the loader.
+      ('dlopen_benchmark-nocache', [test_out_dir], [],
+       {'LD_DISABLE_SYMBOL_CACHE': '1'}),
+      # Same as above, but the second loads replay the symbol lookup
+      # results of the first loads. If this passes, the relocation cache
+      # files are written and read back.
+      ('dlopen_benchmark-relocation_cache', [test_out_dir], [],
+       {'LD_RELOCATION_CACHE': test_out_dir})
   ])
 
   for test_name, library_paths, test_argv, test_env in tests:
@@ -875,6 +887,31 @@ def _generate_bionic_fundamental_test_runners(n):
             variables={'test_name': test_name})
 
 
+# The number of the synthetic shared objects dlopen_benchmark loads for
+# each hash style.
+_DLOPEN_BENCHMARK_NUM_LIBS = 60
+
+
+def _get_dlopen_benchmark_lib_build_commands(hash_style):
+  # Each shared object depends on the three previous ones, so the loader
+  # looks up most symbols in several shared objects.
+  commands = []
+  for index in range(_DLOPEN_BENCHMARK_NUM_LIBS):
+    deps = range(index - 1, max(index - 4, -1), -1)
+    command = ['$cc', '$cflags', '-DLIB_INDEX=%d' % index]
+    command.extend('-DDEP%d=%d' % (i + 1, dep) for i, dep in enumerate(deps))
+    command.extend(['$ldflags', '-Wl,--hash-style=' + hash_style,
+                    '-Wl,--build-id', '-nostdlib', '$crtbegin_so',
+                    '$in_dir/dlopen_benchmark_lib.c', '-L$out_dir'])
+    command.extend('-ldlopen_benchmark_%s_%d' % (hash_style, dep)
+                   for dep in deps)
+    command.extend(['-L$lib_dir', '-lc', '$crtend_so', '$soflags', '-o',
+                    '$out_dir/libdlopen_benchmark_%s_%d.so' % (hash_style,
+                                                                index)])
+    commands.append(command)
+  return commands
+
+
 def _generate_bionic_fundamental_tests():
   n = ninja_generator.NinjaGenerator('bionic_fundamental_tests')
   bionic_tests = []
@@ -974,6 +1011,18 @@ def _generate_bionic_fundamental_tests():
             '$crtbegin_exe', '-L$lib_dir', '-lc'] +
            ninja_generator.get_libgcc_for_bionic() +
            ['-ldl', '$in_dir/$name.c', '$crtend_exe', '-o', '$$out']]),
+      BionicFundamentalTest(
+          'dlopen_benchmark',
+          ['$in_dir/$name.c', '$in_dir/dlopen_benchmark_lib.c'],
+          '$out',
+          _get_dlopen_benchmark_lib_build_commands('sysv') +
+          _get_dlopen_benchmark_lib_build_commands('gnu') +
+          [['$cc', '$cflags',
+            '-DNUM_LIBS=%d' % _DLOPEN_BENCHMARK_NUM_LIBS,
+            '$ldflags', '-Wl,--build-id', '$execflags', '-nostdlib',
+            '$crtbegin_exe', '-L$lib_dir', '-lc'] +
+           ninja_generator.get_libgcc_for_bionic() +
+           ['-ldl', '$in_dir/$name.c', '$crtend_exe', '-o', '$$out']]),
   ])
   for test in bionic_tests:
     test.emit(n)
@@ -1287,15 +1336,12 @@ def _generate_bionic_tests():
       'fcntl.fallocate_EINVAL',
       'fcntl.fcntl_smoke',
       'fcntl.posix_fadvise',
-      'fcntl.splice',
       'fcntl.tee',
       'fcntl.vmsplice',
       'sys_epoll.epoll_event_data',
       'sys_epoll.smoke',
       'sys_select.pselect_smoke',
       'sys_select.select_smoke',
-      'sys_sendfile.sendfile',
-      'sys_sendfile.sendfile64',
       'sys_socket.accept4_error',
       'sys_socket.accept4_smoke',
       'sys_socket.recvmmsg_error',
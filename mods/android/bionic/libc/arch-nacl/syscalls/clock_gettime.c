@@ -20,6 +20,7 @@
 #include <time.h>
 
 #include <irt_syscalls.h>
+#include <nacl_fast_clock.h>
 #include <nacl_timespec.h>
 
 int clock_gettime(clockid_t clk_id, struct timespec *tp) {
@@ -32,6 +33,8 @@ int clock_gettime(clockid_t clk_id, struct timespec *tp) {
         errno = EFAULT;
         return -1;
       }
+      if (!__nacl_fast_clock_gettime(clk_id, tp))
+        return 0;
       struct nacl_abi_timespec nacl_tp;
       int result = __nacl_irt_clock_gettime(clk_id, &nacl_tp);
       if (result != 0) {
@@ -39,6 +42,7 @@ int clock_gettime(clockid_t clk_id, struct timespec *tp) {
         return -1;
       }
       __nacl_abi_timespec_to_timespec(&nacl_tp, tp);
+      __nacl_fast_clock_adjust(clk_id, tp);
       return 0;
     }
     default:
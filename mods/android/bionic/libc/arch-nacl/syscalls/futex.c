@@ -16,65 +16,346 @@
 #include <errno.h>
 #include <irt_syscalls.h>
 #include <linux/futex.h>
+#include <nacl_fast_clock.h>
 #include <nacl_timespec.h>
 #include <nacl_timeval.h>
 #include <private/bionic_futex.h>
+#include <stdint.h>
 #include <thread_context.h>
 #include <unistd.h>
 
-int __nacl_futex(volatile void *ftx, int op, int val,
-                 const struct timespec *timeout) {
-  /* FUTEX_FD, FUTEX_REQUEUE, and FUTEX_CMP_REQUEUE are not used
-   * by android.
+// The IRT only provides wait and wake on a single address, so the wait
+// queues are managed here to support the operations which move waiters
+// between addresses. Each waiter blocks on its own |state| word with the
+// IRT futex, and wakers pick waiters from the queue of the address.
+
+enum {
+  FUTEX_WAITER_QUEUED,
+  FUTEX_WAITER_WOKEN,
+};
+
+struct futex_waiter {
+  struct futex_waiter *prev;
+  struct futex_waiter *next;
+  // The address the waiter is waiting on. Changed by requeue operations
+  // while the locks of both the old and new buckets are held.
+  volatile void *ftx;
+  volatile int state;
+};
+
+struct futex_bucket {
+  // 0: unlocked, 1: locked, 2: locked and there may be waiters.
+  volatile int lock;
+  struct futex_waiter *head;
+  struct futex_waiter *tail;
+};
+
+#define FUTEX_BUCKET_COUNT 256
+
+static struct futex_bucket g_buckets[FUTEX_BUCKET_COUNT];
+
+static struct futex_bucket *get_bucket(volatile void *ftx) {
+  uint32_t hash = (uint32_t)((uintptr_t)ftx >> 2) * 0x9e3779b1U;
+  return &g_buckets[hash >> 24];
+}
+
+static void lock_bucket(struct futex_bucket *bucket) {
+  if (__sync_val_compare_and_swap(&bucket->lock, 0, 1) == 0)
+    return;
+  while (__sync_lock_test_and_set(&bucket->lock, 2) != 0)
+    __nacl_irt_futex_wait_abs(&bucket->lock, 2, NULL);
+}
+
+static void unlock_bucket(struct futex_bucket *bucket) {
+  if (__sync_fetch_and_sub(&bucket->lock, 1) != 1) {
+    int count;
+    bucket->lock = 0;
+    __nacl_irt_futex_wake(&bucket->lock, 1, &count);
+  }
+}
+
+// Locks the buckets of |ftx| and |ftx2| in a fixed order to avoid
+// deadlocks. Returns the bucket of |ftx2|.
+static struct futex_bucket *lock_two_buckets(struct futex_bucket *bucket,
+                                             volatile void *ftx2) {
+  struct futex_bucket *bucket2 = get_bucket(ftx2);
+  if (bucket < bucket2) {
+    lock_bucket(bucket);
+    lock_bucket(bucket2);
+  } else if (bucket > bucket2) {
+    lock_bucket(bucket2);
+    lock_bucket(bucket);
+  } else {
+    lock_bucket(bucket);
+  }
+  return bucket2;
+}
+
+static void unlock_two_buckets(struct futex_bucket *bucket,
+                               struct futex_bucket *bucket2) {
+  unlock_bucket(bucket);
+  if (bucket2 != bucket)
+    unlock_bucket(bucket2);
+}
+
+static void append_waiter(struct futex_bucket *bucket,
+                          struct futex_waiter *waiter) {
+  waiter->next = NULL;
+  waiter->prev = bucket->tail;
+  if (bucket->tail)
+    bucket->tail->next = waiter;
+  else
+    bucket->head = waiter;
+  bucket->tail = waiter;
+}
+
+static void remove_waiter(struct futex_bucket *bucket,
+                          struct futex_waiter *waiter) {
+  if (waiter->prev)
+    waiter->prev->next = waiter->next;
+  else
+    bucket->head = waiter->next;
+  if (waiter->next)
+    waiter->next->prev = waiter->prev;
+  else
+    bucket->tail = waiter->prev;
+}
+
+// Wakes up to |count| waiters on |ftx|. The lock of |bucket| must be held.
+// Returns the number of woken waiters.
+static int wake_waiters(struct futex_bucket *bucket, volatile void *ftx,
+                        int count) {
+  int woken = 0;
+  struct futex_waiter *waiter = bucket->head;
+  while (waiter && woken < count) {
+    struct futex_waiter *next = waiter->next;
+    if (waiter->ftx == ftx) {
+      remove_waiter(bucket, waiter);
+      // The waiter may return as soon as it sees the new state, so this
+      // thread must not touch |waiter| after the store except for the
+      // address passed to the IRT. Waking an address which is no longer
+      // waited on is harmless.
+      volatile int *state = &waiter->state;
+      __sync_lock_test_and_set(state, FUTEX_WAITER_WOKEN);
+      int unused_count;
+      __nacl_irt_futex_wake(state, 1, &unused_count);
+      woken++;
+    }
+    waiter = next;
+  }
+  return woken;
+}
+
+// Moves up to |count| waiters on |ftx| in |bucket| to |ftx2| in |bucket2|.
+// The locks of both buckets must be held. Returns the number of moved
+// waiters.
+static int requeue_waiters(struct futex_bucket *bucket, volatile void *ftx,
+                           struct futex_bucket *bucket2, volatile void *ftx2,
+                           int count) {
+  int requeued = 0;
+  struct futex_waiter *waiter = bucket->head;
+  while (waiter && requeued < count) {
+    struct futex_waiter *next = waiter->next;
+    if (waiter->ftx == ftx) {
+      waiter->ftx = ftx2;
+      if (bucket2 != bucket) {
+        remove_waiter(bucket, waiter);
+        append_waiter(bucket2, waiter);
+      }
+      requeued++;
+    }
+    waiter = next;
+  }
+  return requeued;
+}
+
+// Converts a relative |timeout| to an absolute time for the IRT.
+static int get_abs_timeout(const struct timespec *timeout,
+                           struct nacl_abi_timespec *abs_timeout) {
+  static const int kNanosecondsPerSecond = 1000000000;
+  // NaClCommonSysCond_Timed_Wait_Abs does not validate timeout
+  // and it has a TODO instead. So we should check the value.
+  if (timeout->tv_nsec >= kNanosecondsPerSecond)
+    return -EINVAL;
+
+  // Functions from nacl-glibc expects absolute time for this. Try the
+  // userspace clock first to avoid an extra IRT call for each wait.
+  struct timespec now;
+  if (__nacl_fast_clock_gettime(CLOCK_REALTIME, &now)) {
+    struct nacl_abi_timeval tv;
+    int r = __nacl_irt_gettod(&tv);
+    if (r != 0) {
+      // Maybe this should not happen.
+      return -EFAULT;
+    }
+    now.tv_sec = tv.tv_sec;
+    now.tv_nsec = tv.tv_usec * 1000;
+  }
+
+  long sec = timeout->tv_sec + now.tv_sec;
+  long nsec = timeout->tv_nsec + now.tv_nsec;
+  sec += nsec / kNanosecondsPerSecond;
+  if (sec < 0 || nsec < 0)
+    return -EINVAL;
+  nsec %= kNanosecondsPerSecond;
+  abs_timeout->tv_sec = sec;
+  abs_timeout->tv_nsec = nsec;
+  return 0;
+}
+
+static int futex_wait(volatile void *ftx, int val,
+                      const struct timespec *timeout) {
+  struct nacl_abi_timespec abs_timeout;
+  if (timeout) {
+    int r = get_abs_timeout(timeout, &abs_timeout);
+    if (r)
+      return r;
+  }
+
+  struct futex_bucket *bucket = get_bucket(ftx);
+  struct futex_waiter waiter;
+  lock_bucket(bucket);
+  // Like the kernel, compare the value while the bucket is locked so that
+  // a wake after the value is changed never gets lost.
+  if (*(volatile int *)ftx != val) {
+    unlock_bucket(bucket);
+    return -EWOULDBLOCK;
+  }
+  waiter.ftx = ftx;
+  waiter.state = FUTEX_WAITER_QUEUED;
+  append_waiter(bucket, &waiter);
+  unlock_bucket(bucket);
+
+  int result = 0;
+  SAVE_CONTEXT_REGS();
+  while (waiter.state == FUTEX_WAITER_QUEUED) {
+    // NaCl returns positive error codes, while syscalls return negative.
+    result = -__nacl_irt_futex_wait_abs(&waiter.state, FUTEX_WAITER_QUEUED,
+                                        timeout ? &abs_timeout : NULL);
+    // EWOULDBLOCK means the state has just been changed.
+    if (result && result != -EWOULDBLOCK)
+      break;
+  }
+  CLEAR_CONTEXT_REGS();
+  if (waiter.state != FUTEX_WAITER_QUEUED)
+    return 0;
+
+  // The wait has timed out or failed. Dequeue the waiter unless it has
+  // been woken in the meantime. The
+  // waiter may have been requeued, so lock the bucket of its current
+  // address.
+  for (;;) {
+    volatile void *current_ftx = waiter.ftx;
+    bucket = get_bucket(current_ftx);
+    lock_bucket(bucket);
+    if (waiter.ftx == current_ftx)
+      break;
+    unlock_bucket(bucket);
+  }
+  if (waiter.state == FUTEX_WAITER_QUEUED)
+    remove_waiter(bucket, &waiter);
+  else
+    result = 0;
+  unlock_bucket(bucket);
+  return result;
+}
+
+static int futex_wake(volatile void *ftx, int count) {
+  struct futex_bucket *bucket = get_bucket(ftx);
+  lock_bucket(bucket);
+  int woken = wake_waiters(bucket, ftx, count);
+  unlock_bucket(bucket);
+  return woken;
+}
+
+static int futex_requeue(volatile void *ftx, int nr_wake, int nr_requeue,
+                         volatile void *ftx2, int check_val, int val3) {
+  if (nr_wake < 0 || nr_requeue < 0)
+    return -EINVAL;
+  struct futex_bucket *bucket = get_bucket(ftx);
+  struct futex_bucket *bucket2 = lock_two_buckets(bucket, ftx2);
+  if (check_val && *(volatile int *)ftx != val3) {
+    unlock_two_buckets(bucket, bucket2);
+    return -EAGAIN;
+  }
+  int result = wake_waiters(bucket, ftx, nr_wake);
+  result += requeue_waiters(bucket, ftx, bucket2, ftx2, nr_requeue);
+  unlock_two_buckets(bucket, bucket2);
+  return result;
+}
+
+static int futex_wake_op(volatile void *ftx, int nr_wake, int nr_wake2,
+                         volatile void *ftx2, int encoded_op) {
+  int op = (encoded_op >> 28) & 7;
+  int cmp = (encoded_op >> 24) & 15;
+  int oparg = (encoded_op << 8) >> 20;
+  int cmparg = (encoded_op << 20) >> 20;
+  if ((encoded_op >> 28) & FUTEX_OP_OPARG_SHIFT)
+    oparg = 1 << oparg;
+
+  struct futex_bucket *bucket = get_bucket(ftx);
+  struct futex_bucket *bucket2 = lock_two_buckets(bucket, ftx2);
+  volatile int *word = (volatile int *)ftx2;
+  int old_val, new_val;
+  do {
+    old_val = *word;
+    switch (op) {
+      case FUTEX_OP_SET: new_val = oparg; break;
+      case FUTEX_OP_ADD: new_val = old_val + oparg; break;
+      case FUTEX_OP_OR: new_val = old_val | oparg; break;
+      case FUTEX_OP_ANDN: new_val = old_val & ~oparg; break;
+      case FUTEX_OP_XOR: new_val = old_val ^ oparg; break;
+      default:
+        unlock_two_buckets(bucket, bucket2);
+        return -ENOSYS;
+    }
+  } while (__sync_val_compare_and_swap(word, old_val, new_val) != old_val);
+
+  int cmp_result;
+  switch (cmp) {
+    case FUTEX_OP_CMP_EQ: cmp_result = old_val == cmparg; break;
+    case FUTEX_OP_CMP_NE: cmp_result = old_val != cmparg; break;
+    case FUTEX_OP_CMP_LT: cmp_result = old_val < cmparg; break;
+    case FUTEX_OP_CMP_LE: cmp_result = old_val <= cmparg; break;
+    case FUTEX_OP_CMP_GT: cmp_result = old_val > cmparg; break;
+    case FUTEX_OP_CMP_GE: cmp_result = old_val >= cmparg; break;
+    default:
+      unlock_two_buckets(bucket, bucket2);
+      return -ENOSYS;
+  }
+
+  int result = wake_waiters(bucket, ftx, nr_wake);
+  if (cmp_result)
+    result += wake_waiters(bucket2, ftx2, nr_wake2);
+  unlock_two_buckets(bucket, bucket2);
+  return result;
+}
+
+int __nacl_futex_ex(volatile void *ftx, int op, int val,
+                    const struct timespec *timeout, volatile void *ftx2,
+                    int val3) {
+  /* FUTEX_FD and the PI operations are not used by android.
    * TODO(crbug.com/243244): Support these operations. In theory, NDK
    * apps can call this for the operations we do not support. */
+  // For the requeue and wake-op operations, |timeout| is actually an
+  // integer argument, like the kernel.
+  int val2 = (int)(intptr_t)timeout;
   switch (op) {
     case FUTEX_WAIT:
-    case FUTEX_WAIT_PRIVATE: {
-      // We need to convert the ABI of timespec from bionic's to NaCl's.
-      struct nacl_abi_timespec nacl_timeout;
-      struct nacl_abi_timespec *nacl_timeout_ptr = NULL;
-      if (timeout) {
-        // Functions from nacl-glibc expects absolute time for this.
-        struct nacl_abi_timeval tv;
-        int r = __nacl_irt_gettod(&tv);
-        if (r != 0) {
-          // Maybe this should not happen.
-          return -EFAULT;
-        }
-
-        static const int kNanosecondsPerSecond = 1000000000;
-        // NaClCommonSysCond_Timed_Wait_Abs does not validate timeout
-        // and it has a TODO instead. So we should check the value.
-        if (timeout->tv_nsec >= kNanosecondsPerSecond) {
-          return -EINVAL;
-        }
-        long sec = timeout->tv_sec + tv.tv_sec;
-        long nsec = timeout->tv_nsec + tv.tv_usec * 1000;
-        sec += nsec / kNanosecondsPerSecond;
-        if (sec < 0 || nsec < 0) {
-          return -EINVAL;
-        }
-        nsec %= kNanosecondsPerSecond;
-        nacl_timeout.tv_sec = sec;
-        nacl_timeout.tv_nsec = nsec;
-        nacl_timeout_ptr = &nacl_timeout;
-      }
-      SAVE_CONTEXT_REGS();
-      // NaCl returns positive error codes, while syscalls return negative.
-      int result = -__nacl_irt_futex_wait_abs(ftx, val, nacl_timeout_ptr);
-      CLEAR_CONTEXT_REGS();
-      return result;
-    }
+    case FUTEX_WAIT_PRIVATE:
+      return futex_wait(ftx, val, timeout);
     case FUTEX_WAKE:
-    case FUTEX_WAKE_PRIVATE: {
-      int count;
-      // NaCl returns positive error codes, while syscalls return negative.
-      int result = -__nacl_irt_futex_wake(ftx, val, &count);
-      if (!result)
-        return count;
-      return result;
-    }
+    case FUTEX_WAKE_PRIVATE:
+      return futex_wake(ftx, val);
+    case FUTEX_REQUEUE:
+    case FUTEX_REQUEUE_PRIVATE:
+      return futex_requeue(ftx, val, val2, ftx2, 0, 0);
+    case FUTEX_CMP_REQUEUE:
+    case FUTEX_CMP_REQUEUE_PRIVATE:
+      return futex_requeue(ftx, val, val2, ftx2, 1, val3);
+    case FUTEX_WAKE_OP:
+    case FUTEX_WAKE_OP_PRIVATE:
+      return futex_wake_op(ftx, val, val2, ftx2, val3);
     default: {
       static const int kStderrFd = 2;
       static const char kMsg[] = "futex syscall called with unexpected op!";
@@ -83,3 +364,8 @@ int __nacl_futex(volatile void *ftx, int op, int val,
     }
   }
 }
+
+int __nacl_futex(volatile void *ftx, int op, int val,
+                 const struct timespec *timeout) {
+  return __nacl_futex_ex(ftx, op, val, timeout, NULL, 0);
+}
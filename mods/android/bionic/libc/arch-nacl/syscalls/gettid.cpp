@@ -27,15 +27,24 @@ pthread_internal_t *__get_thread(void);
 
 #define MAX_THREAD_ID ((1 << 15) - 1)
 
-// 0 until the second thread other than the main thread is created.
-// 2 <= g_next_tid < 32768 after the second thread is created.
+// Thread IDs are allocated from a bitmap without a lock. A bit is set if
+// and only if the tid is allocated. Thread creation and exit only need a
+// few atomic operations on one word in the common case.
 // Note that bionic's mutex depends on 15 bit thread ID. See
 // libc/bionic/pthread.c for detail.
-static pid_t g_next_tid;
-// g_tid_map[tid] will be zero if and only if the tid is not allocated.
-static int8_t g_tid_map[MAX_THREAD_ID + 1];
-// Protects global variables above.
-static pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+#define TID_BITS_PER_WORD 32
+#define TID_WORD_COUNT ((MAX_THREAD_ID + 1) / TID_BITS_PER_WORD)
+
+// TID 0 is invalid and the main thread always uses TID=1, so they are
+// marked as allocated from the beginning.
+static uint32_t g_tid_bitmap[TID_WORD_COUNT] = { 3 };
+// A hint for the next tid to allocate. For pthread_create =>
+// pthread_join => pthread_create, Linux kernel creates the two threads
+// with different thread IDs. Starting the search from the tid after the
+// last allocated one emulates this behavior, and also lets the search
+// skip the words which were filled recently. This is only a hint, so
+// races on it are harmless.
+static volatile pid_t g_next_tid = 2;
 
 #endif  // !defined(BARE_METAL_BIONIC)
 
@@ -68,47 +77,55 @@ pid_t gettid() {
 
 __LIBC_HIDDEN__
 pid_t __allocate_tid() {
-  pthread_mutex_lock(&g_mu);
-
-  int cnt = 0;
-  // The main thread always uses TID=1.
-  while (g_next_tid < 2 || g_tid_map[g_next_tid]) {
-    g_next_tid++;
-    if (g_next_tid > MAX_THREAD_ID)
-      g_next_tid = 1;
-    // All thread IDs are being used.
-    if (++cnt > MAX_THREAD_ID) {
-      pthread_mutex_unlock(&g_mu);
-      return -1;
+  pid_t hint = g_next_tid;
+  if (hint < 2 || hint > MAX_THREAD_ID)
+    hint = 2;
+  int index = hint / TID_BITS_PER_WORD;
+  uint32_t start_mask = ~0U << (hint % TID_BITS_PER_WORD);
+
+  // Visit the word of |hint| twice so the bits before |hint| in the word
+  // are checked after all the other words.
+  for (int i = 0; i <= TID_WORD_COUNT; i++) {
+    uint32_t* word = &g_tid_bitmap[index];
+    uint32_t value = *word;
+    uint32_t free_bits;
+    while ((free_bits = ~value & start_mask) != 0) {
+      uint32_t bit = 1U << __builtin_ctz(free_bits);
+      uint32_t old_value = __sync_val_compare_and_swap(word, value, value | bit);
+      if (old_value == value) {
+        pid_t tid = index * TID_BITS_PER_WORD + __builtin_ctz(free_bits);
+        g_next_tid = tid + 1;
+        return tid;
+      }
+      // Another thread has changed the word. Retry with the new value.
+      value = old_value;
     }
+    start_mask = ~0U;
+    if (++index == TID_WORD_COUNT)
+      index = 0;
   }
-  // For pthread_create => pthread_join => pthread_create, Linux
-  // kernel creates the two threads with different thread
-  // IDs. Increment |g_next_tid| to emulate this behavior.
-  pid_t tid = g_next_tid++;
-  g_tid_map[tid] = 1;
-  pthread_mutex_unlock(&g_mu);
-  return tid;
+  // All thread IDs are being used.
+  return -1;
 }
 
 __LIBC_HIDDEN__
 void __deallocate_tid(pid_t tid) {
-  pthread_mutex_lock(&g_mu);
-  if (!g_tid_map[tid]) {
-    static const int kStderrFd = 2;
-    if (!tid) {
-      static const char kMsg[] = "__deallocate_tid is called for tid=0\n";
-      write(kStderrFd, kMsg, sizeof(kMsg) - 1);
-    } else {
-      static const char kMsg[] =
-          "__deallocate_tid is called for uninitialized thread\n";
-      write(kStderrFd, kMsg, sizeof(kMsg) - 1);
-    }
+  static const int kStderrFd = 2;
+  if (!tid) {
+    static const char kMsg[] = "__deallocate_tid is called for tid=0\n";
+    write(kStderrFd, kMsg, sizeof(kMsg) - 1);
     abort();
   }
 
-  g_tid_map[tid] = 0;
-  pthread_mutex_unlock(&g_mu);
+  uint32_t bit = 1U << (tid % TID_BITS_PER_WORD);
+  uint32_t old_value =
+      __sync_fetch_and_and(&g_tid_bitmap[tid / TID_BITS_PER_WORD], ~bit);
+  if (!(old_value & bit)) {
+    static const char kMsg[] =
+        "__deallocate_tid is called for uninitialized thread\n";
+    write(kStderrFd, kMsg, sizeof(kMsg) - 1);
+    abort();
+  }
 }
 
 #endif  // !defined(BARE_METAL_BIONIC)
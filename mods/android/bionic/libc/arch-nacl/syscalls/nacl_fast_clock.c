@@ -0,0 +1,406 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "nacl_fast_clock.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <stdint.h>
+
+#include <irt_syscalls.h>
+#include <nacl_timespec.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+// The first two calibration samples must be at least this far apart.
+#define MIN_CALIBRATION_INTERVAL_NS (50 * 1000 * 1000LL)
+// The parameters are recalibrated against the IRT clock after this.
+#define RECALIBRATION_INTERVAL_NS NSEC_PER_SEC
+// At a recalibration, the TSC based clock may be off from the IRT clock by
+// this plus MAX_DRIFT_PPM of the elapsed time. Otherwise, the TSC is
+// considered unreliable (e.g. its rate has changed, or the host has been
+// suspended) and the fast path is disabled.
+#define MAX_ERROR_NS (2 * 1000 * 1000LL)
+#define MAX_DRIFT_PPM 500
+// The number of attempts to take a calibration sample. The one which took
+// the fewest TSC ticks is used.
+#define MAX_SAMPLE_ATTEMPTS 5
+
+#define COMPILER_BARRIER() __asm__ __volatile__("" : : : "memory")
+
+enum {
+  FAST_CLOCK_UNINITIALIZED,
+  FAST_CLOCK_CALIBRATING,
+  FAST_CLOCK_ENABLED,
+  FAST_CLOCK_DISABLED,
+};
+
+struct clock_sample {
+  uint64_t tsc;
+  int64_t mono_ns;
+  int64_t real_ns;
+};
+
+static volatile int g_state = FAST_CLOCK_UNINITIALIZED;
+// 1 while a thread is changing |g_state| or the parameters below.
+static volatile int g_updating;
+
+// The first calibration sample. This is used to compute the long-term
+// frequency of the TSC.
+static struct clock_sample g_first_sample;
+
+// The parameters of the fast path, protected by a seqlock. |g_seq| is odd
+// while they are being updated. The monotonic time in nanoseconds is
+//   max(g_min_mono_ns, g_base_mono_ns + (((tsc - g_base_tsc) * g_mult) >> 32))
+// for g_base_tsc <= tsc < g_base_tsc + g_max_ticks. |g_max_ticks| is 0 when
+// there are no valid parameters.
+static volatile uint32_t g_seq;
+static uint64_t g_base_tsc;
+static int64_t g_base_mono_ns;
+static int64_t g_min_mono_ns;
+// CLOCK_REALTIME minus CLOCK_MONOTONIC.
+static int64_t g_real_offset_ns;
+static uint64_t g_mult;
+static uint64_t g_max_ticks;
+
+// The largest CLOCK_MONOTONIC time returned by the slow paths, or which the
+// fast path may have returned with the previous parameters. The TSC based
+// time may be ahead of the IRT clock by up to the allowed error, so the IRT
+// results are clamped to this and to the current fast time. New parameters
+// start from this. The fast path itself only reads |g_min_mono_ns|, so it
+// does not write to memory shared with the other threads.
+static volatile int64_t g_last_mono_ns;
+
+static inline uint64_t read_tsc(void) {
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *edx) {
+  uint32_t ebx, ecx;
+#if defined(__i386__)
+  // %ebx may be the PIC register.
+  __asm__ __volatile__("xchg %%ebx, %1\n"
+                       "cpuid\n"
+                       "xchg %%ebx, %1\n"
+                       : "=a"(*eax), "=r"(ebx), "=c"(ecx), "=d"(*edx)
+                       : "a"(leaf), "c"(0));
+#else
+  __asm__ __volatile__("cpuid"
+                       : "=a"(*eax), "=b"(ebx), "=c"(ecx), "=d"(*edx)
+                       : "a"(leaf), "c"(0));
+#endif
+}
+
+// Returns 1 if the TSC runs at a constant rate regardless of the power
+// state of the CPU.
+static int has_invariant_tsc(void) {
+  uint32_t eax, edx;
+  cpuid(0x80000000, &eax, &edx);
+  if (eax < 0x80000007)
+    return 0;
+  cpuid(0x80000007, &eax, &edx);
+  return (edx >> 8) & 1;
+}
+
+// Returns |mono_ns|, or |g_last_mono_ns| if it is larger. This is only
+// used by the slow paths, which already call the IRT.
+static int64_t clamp_monotonic(int64_t mono_ns) {
+#if defined(__x86_64__)
+  int64_t last = g_last_mono_ns;
+#else
+  // A plain 64-bit load is not atomic on i386.
+  int64_t last = __sync_fetch_and_add(&g_last_mono_ns, 0);
+#endif
+  while (mono_ns > last) {
+    const int64_t prev =
+        __sync_val_compare_and_swap(&g_last_mono_ns, last, mono_ns);
+    if (prev == last)
+      return mono_ns;
+    last = prev;
+  }
+  return last;
+}
+
+static int64_t nacl_abi_timespec_to_ns(const struct nacl_abi_timespec *ts) {
+  return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static void ns_to_timespec(int64_t ns, struct timespec *tp) {
+  tp->tv_sec = ns / NSEC_PER_SEC;
+  tp->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+// Reads the IRT clocks with the TSC. Returns 0 on success.
+static int take_sample(struct clock_sample *sample) {
+  uint64_t best_ticks = UINT64_MAX;
+  int i;
+  for (i = 0; i < MAX_SAMPLE_ATTEMPTS; i++) {
+    struct nacl_abi_timespec mono, real;
+    uint64_t start = read_tsc();
+    if (__nacl_irt_clock_gettime(CLOCK_MONOTONIC, &mono) ||
+        __nacl_irt_clock_gettime(CLOCK_REALTIME, &real))
+      return -1;
+    uint64_t end = read_tsc();
+    // The TSC went backwards, probably because the thread has moved to
+    // another CPU whose TSC is not synchronized.
+    if (end < start)
+      return -1;
+    if (end - start < best_ticks) {
+      best_ticks = end - start;
+      sample->tsc = start + (end - start) / 2;
+      sample->mono_ns = nacl_abi_timespec_to_ns(&mono);
+      sample->real_ns = nacl_abi_timespec_to_ns(&real);
+    }
+  }
+  return 0;
+}
+
+// Returns the largest time which the fast path may have returned so far with
+// the given parameters.
+static int64_t get_max_fast_mono_ns(uint64_t base_tsc, int64_t base_mono_ns,
+                                    int64_t min_mono_ns, uint64_t mult,
+                                    uint64_t max_ticks) {
+  const uint64_t tsc = read_tsc();
+  if (!max_ticks || tsc < base_tsc)
+    return min_mono_ns;
+  uint64_t ticks = tsc - base_tsc;
+  if (ticks > max_ticks)
+    ticks = max_ticks;
+  const int64_t ns = base_mono_ns + (int64_t)((ticks * mult) >> 32);
+  return ns > min_mono_ns ? ns : min_mono_ns;
+}
+
+// Raises |g_last_mono_ns| to the largest time which the fast path may have
+// returned with the current parameters, and returns it. |g_updating| must be
+// held and |g_seq| must be odd. Readers which passed the seqlock before
+// |g_seq| became odd read the TSC before this does.
+static int64_t retire_parameters(void) {
+  return clamp_monotonic(get_max_fast_mono_ns(g_base_tsc, g_base_mono_ns,
+                                              g_min_mono_ns, g_mult,
+                                              g_max_ticks));
+}
+
+// Publishes new parameters. |g_updating| must be held.
+static void set_parameters(const struct clock_sample *sample,
+                           int64_t base_mono_ns, double ns_per_tick) {
+  double mult = ns_per_tick * 4294967296.0;
+  double interval_ticks = RECALIBRATION_INTERVAL_NS / ns_per_tick;
+  // Keep (tsc - g_base_tsc) * g_mult within 64 bits.
+  double max_ticks = 18446744073709551615.0 / mult;
+  if (max_ticks > 2 * interval_ticks)
+    max_ticks = 2 * interval_ticks;
+
+  __sync_fetch_and_add(&g_seq, 1);
+  g_min_mono_ns = retire_parameters();
+  g_base_tsc = sample->tsc;
+  g_base_mono_ns = base_mono_ns;
+  g_real_offset_ns = sample->real_ns - sample->mono_ns;
+  g_mult = (uint64_t)mult;
+  g_max_ticks = (uint64_t)max_ticks;
+  __sync_fetch_and_add(&g_seq, 1);
+}
+
+// Adjusts the parameters to a new sample. |g_updating| must be held.
+// Returns 0 on success, or -1 if the TSC turned out to be unreliable.
+static int recalibrate(void) {
+  struct clock_sample sample;
+  if (take_sample(&sample) || sample.tsc <= g_base_tsc ||
+      sample.tsc <= g_first_sample.tsc)
+    return -1;
+
+  const double ticks = (double)(sample.tsc - g_base_tsc);
+  const double predicted_ns =
+      g_base_mono_ns + ticks * g_mult / 4294967296.0;
+  const double error_ns = sample.mono_ns - predicted_ns;
+  const double elapsed_ns = sample.mono_ns - g_base_mono_ns;
+  const double max_error_ns =
+      MAX_ERROR_NS + elapsed_ns * MAX_DRIFT_PPM / 1000000.0;
+  if (error_ns > max_error_ns || -error_ns > max_error_ns)
+    return -1;
+
+  // Use the frequency measured since the first sample, which is more
+  // accurate than the one between the last two samples.
+  double ns_per_tick = (double)(sample.mono_ns - g_first_sample.mono_ns) /
+      (sample.tsc - g_first_sample.tsc);
+  if (sample.tsc - g_base_tsc >= g_max_ticks) {
+    // The current parameters have expired, so the clock is reset to the IRT
+    // clock. This may be behind the time other threads have already got,
+    // but |g_min_mono_ns| keeps them from seeing it go backwards.
+    set_parameters(&sample, sample.mono_ns, ns_per_tick);
+    return 0;
+  }
+  // Otherwise, keep the clock continuous so it never goes backwards, and
+  // slew its rate so the error is absorbed in the next interval.
+  ns_per_tick *= (RECALIBRATION_INTERVAL_NS + error_ns) /
+      RECALIBRATION_INTERVAL_NS;
+  set_parameters(&sample, (int64_t)predicted_ns, ns_per_tick);
+  return 0;
+}
+
+// |g_updating| must be held.
+static void disable_fast_clock(void) {
+  g_state = FAST_CLOCK_DISABLED;
+  // Freeze the parameters so that __nacl_fast_clock_adjust() does not keep
+  // following the TSC, which is unreliable now.
+  __sync_fetch_and_add(&g_seq, 1);
+  g_min_mono_ns = retire_parameters();
+  g_max_ticks = 0;
+  __sync_fetch_and_add(&g_seq, 1);
+}
+
+// Handles the states other than FAST_CLOCK_ENABLED. Returns 0 if |tp| is
+// filled, 1 if the fast path has just been enabled, or -1 if the caller
+// should fall back to the IRT.
+static int update_state(clockid_t clk_id, struct timespec *tp) {
+  int result = -1;
+  if (!__sync_bool_compare_and_swap(&g_updating, 0, 1))
+    return -1;
+
+  if (g_state == FAST_CLOCK_UNINITIALIZED) {
+    if (!has_invariant_tsc() || take_sample(&g_first_sample)) {
+      disable_fast_clock();
+    } else {
+      __sync_synchronize();
+      g_state = FAST_CLOCK_CALIBRATING;
+    }
+  } else if (g_state == FAST_CLOCK_CALIBRATING) {
+    // Until the samples are far enough apart, use the IRT clock. This
+    // only needs one IRT call for CLOCK_MONOTONIC.
+    struct nacl_abi_timespec mono;
+    if (!__nacl_irt_clock_gettime(CLOCK_MONOTONIC, &mono)) {
+      const int64_t mono_ns = nacl_abi_timespec_to_ns(&mono);
+      struct clock_sample sample;
+      if (mono_ns - g_first_sample.mono_ns < MIN_CALIBRATION_INTERVAL_NS) {
+        if (clk_id == CLOCK_MONOTONIC) {
+          ns_to_timespec(clamp_monotonic(mono_ns), tp);
+          result = 0;
+        }
+      } else if (take_sample(&sample) || sample.tsc <= g_first_sample.tsc) {
+        disable_fast_clock();
+      } else {
+        const double ns_per_tick =
+            (double)(sample.mono_ns - g_first_sample.mono_ns) /
+            (sample.tsc - g_first_sample.tsc);
+        set_parameters(&sample, sample.mono_ns, ns_per_tick);
+        __sync_synchronize();
+        g_state = FAST_CLOCK_ENABLED;
+        result = 1;
+      }
+    }
+  }
+
+  __sync_lock_release(&g_updating);
+  return result;
+}
+
+int __nacl_fast_clock_gettime(clockid_t clk_id, struct timespec *tp) {
+  if (clk_id != CLOCK_MONOTONIC && clk_id != CLOCK_REALTIME)
+    return -1;
+
+  while (g_state != FAST_CLOCK_ENABLED) {
+    if (g_state == FAST_CLOCK_DISABLED)
+      return -1;
+    int result = update_state(clk_id, tp);
+    if (result <= 0)
+      return result;
+  }
+
+  for (;;) {
+    const uint32_t seq = g_seq;
+    // The writer only holds the seqlock while it copies the parameters.
+    if (seq & 1)
+      continue;
+    COMPILER_BARRIER();
+    const uint64_t base_tsc = g_base_tsc;
+    const int64_t base_mono_ns = g_base_mono_ns;
+    const int64_t min_mono_ns = g_min_mono_ns;
+    const int64_t real_offset_ns = g_real_offset_ns;
+    const uint64_t mult = g_mult;
+    const uint64_t max_ticks = g_max_ticks;
+    // Read the TSC in the read section so that the writer can bound the
+    // times computed with the old parameters. See retire_parameters().
+    const uint64_t tsc = read_tsc();
+    COMPILER_BARRIER();
+    if (g_seq != seq)
+      continue;
+    if (g_state != FAST_CLOCK_ENABLED)
+      return -1;
+
+    if (tsc < base_tsc)
+      return -1;
+    const uint64_t ticks = tsc - base_tsc;
+    if (ticks >= max_ticks / 2 &&
+        __sync_bool_compare_and_swap(&g_updating, 0, 1)) {
+      // Only one thread recalibrates. The others keep using the current
+      // parameters until they expire.
+      int result = g_state == FAST_CLOCK_ENABLED ? recalibrate() : -1;
+      if (result)
+        disable_fast_clock();
+      __sync_lock_release(&g_updating);
+      if (result)
+        return -1;
+      continue;
+    }
+    if (ticks >= max_ticks)
+      return -1;
+
+    int64_t ns = base_mono_ns + (int64_t)((ticks * mult) >> 32);
+    if (ns < min_mono_ns)
+      ns = min_mono_ns;
+    if (clk_id == CLOCK_REALTIME)
+      ns += real_offset_ns;
+    ns_to_timespec(ns, tp);
+    return 0;
+  }
+}
+
+void __nacl_fast_clock_adjust(clockid_t clk_id, struct timespec *tp) {
+  if (clk_id != CLOCK_MONOTONIC)
+    return;
+  // The fast path does not record the times it returns, so compute the
+  // largest one it may have returned with the current parameters.
+  int64_t fast_ns;
+  for (;;) {
+    const uint32_t seq = g_seq;
+    if (seq & 1)
+      continue;
+    COMPILER_BARRIER();
+    fast_ns = get_max_fast_mono_ns(g_base_tsc, g_base_mono_ns, g_min_mono_ns,
+                                   g_mult, g_max_ticks);
+    COMPILER_BARRIER();
+    if (g_seq == seq)
+      break;
+  }
+  int64_t ns = tp->tv_sec * NSEC_PER_SEC + tp->tv_nsec;
+  if (ns < fast_ns)
+    ns = fast_ns;
+  ns_to_timespec(clamp_monotonic(ns), tp);
+}
+
+#else  // defined(__i386__) || defined(__x86_64__)
+
+int __nacl_fast_clock_gettime(clockid_t clk_id __unused,
+                              struct timespec *tp __unused) {
+  // There is no counter which is known to be readable from userspace.
+  return -1;
+}
+
+void __nacl_fast_clock_adjust(clockid_t clk_id __unused,
+                              struct timespec *tp __unused) {
+}
+
+#endif  // defined(__i386__) || defined(__x86_64__)
@@ -0,0 +1,46 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A userspace clock source for CLOCK_MONOTONIC and CLOCK_REALTIME.
+//
+// ARC does not have vdso, so every clock_gettime and gettimeofday call
+// would go through the IRT. Instead, this reads the time stamp counter
+// and converts it to nanoseconds with parameters calibrated against the
+// IRT clock. The calibration is refreshed periodically, and the fast
+// path is disabled when the TSC does not look reliable.
+//
+
+#ifndef _NACL_FAST_CLOCK_H
+#define _NACL_FAST_CLOCK_H
+
+#include <sys/cdefs.h>
+#include <time.h>
+
+__BEGIN_DECLS
+
+// Fills |tp| and returns 0 if the time for |clk_id| can be computed in
+// userspace. Otherwise, returns -1 and the caller should ask the IRT.
+// Only CLOCK_MONOTONIC and CLOCK_REALTIME are supported.
+__LIBC_HIDDEN__
+int __nacl_fast_clock_gettime(clockid_t clk_id, struct timespec *tp);
+
+// Adjusts |tp| which the caller got from the IRT for |clk_id| so that
+// CLOCK_MONOTONIC never goes backwards from the times returned by
+// __nacl_fast_clock_gettime.
+__LIBC_HIDDEN__
+void __nacl_fast_clock_adjust(clockid_t clk_id, struct timespec *tp);
+
+__END_DECLS
+
+#endif  // _NACL_FAST_CLOCK_H
@@ -26,6 +26,9 @@
  * SUCH DAMAGE.
  */
 #include <new>
+/* ARC MOD BEGIN */
+#include <pthread.h>
+/* ARC MOD END */
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -156,12 +159,107 @@ static size_t pa_size;
 prop_area *__system_property_area__ = NULL;
 /* ARC MOD BEGIN */
 bool __system_property_area_used_malloc__ = false;
+
+// A per-process cache of __system_property_find results, keyed by the hash
+// of the name. Frameworks read the same properties very frequently, so a
+// lookup of a hot property becomes a hash probe and a name comparison
+// instead of a walk of the trie. An entry for a found property stays valid
+// as long as the property area is the same one, since a prop_info is never
+// moved or removed. An entry for a missing property is valid only while
+// the serial of the area is unchanged. Each entry is protected by its own
+// sequence counter, so readers never take a lock.
+struct prop_cache_entry {
+    // Odd while the entry is being updated.
+    volatile uint32_t seq;
+    uint32_t generation;
+    uint32_t area_serial;
+    const prop_area *area;
+    // NULL if the property was not found.
+    const prop_info *pi;
+    char name[PROP_NAME_MAX];
+};
+
+#define PROP_CACHE_SIZE 256
+
+static prop_cache_entry prop_cache[PROP_CACHE_SIZE];
+// Incremented when a property area is released, so entries which point
+// into a released area are never used even if a new area is allocated at
+// the same address.
+static volatile uint32_t prop_cache_generation;
+
+static uint32_t hash_prop_name(const char *name, size_t namelen)
+{
+    // FNV-1a.
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < namelen; i++) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// Returns true and fills |pi| if |prop_cache| has a valid entry for |name|.
+static bool find_cached_property(const char *name, size_t namelen,
+                                 uint32_t hash, const prop_info **pi)
+{
+    const prop_area *pa = __system_property_area__;
+    if (!pa)
+        return false;
+
+    const prop_cache_entry *entry = &prop_cache[hash % PROP_CACHE_SIZE];
+    const uint32_t seq = entry->seq;
+    if (seq & 1)
+        return false;
+    ANDROID_MEMBAR_FULL();
+    const bool hit = entry->area == pa &&
+        entry->generation == prop_cache_generation &&
+        memcmp(entry->name, name, namelen + 1) == 0 &&
+        (entry->pi || entry->area_serial == pa->serial);
+    const prop_info *result = entry->pi;
+    ANDROID_MEMBAR_FULL();
+    if (!hit || entry->seq != seq)
+        return false;
+    *pi = result;
+    return true;
+}
+
+static void cache_property(const char *name, size_t namelen, uint32_t hash,
+                           const prop_area *pa, uint32_t generation,
+                           uint32_t area_serial, const prop_info *pi)
+{
+    prop_cache_entry *entry = &prop_cache[hash % PROP_CACHE_SIZE];
+    const uint32_t seq = entry->seq;
+    // If another thread is updating the entry, just leave it to the thread.
+    if ((seq & 1) || !__sync_bool_compare_and_swap(&entry->seq, seq, seq + 1))
+        return;
+    entry->generation = generation;
+    entry->area_serial = area_serial;
+    entry->area = pa;
+    entry->pi = pi;
+    memcpy(entry->name, name, namelen + 1);
+    ANDROID_MEMBAR_FULL();
+    entry->seq = seq + 2;
+}
+
+// A snapshot of all properties in the order of __system_property_foreach,
+// so iterating properties with __system_property_find_nth does not walk
+// the whole trie for each property. It is rebuilt when the serial of the
+// area changes.
+static pthread_mutex_t prop_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static const prop_info **prop_list;
+static size_t prop_list_count;
+static size_t prop_list_capacity;
+static const prop_area *prop_list_area;
+static uint32_t prop_list_generation;
+static uint32_t prop_list_serial;
+static bool prop_list_valid;
 /* ARC MOD END */
 
 /* ARC MOD BEGIN */
 // TODO(crbug.com/354523): This problem goes away if mmap() is used.
 static void release_system_prop_area()
 {
+    __sync_fetch_and_add(&prop_cache_generation, 1);
     if (__system_property_area_used_malloc__) {
         // Keep valgrind happy, and free the memory.
         free(__system_property_area__);
@@ -624,6 +722,54 @@ static int foreach_property(const uint32_t off,
     return 0;
 }
 
+/* ARC MOD BEGIN */
+static void append_prop_list_fn(const prop_info *pi, void *cookie)
+{
+    bool *ok = reinterpret_cast<bool*>(cookie);
+    if (prop_list_count == prop_list_capacity) {
+        const size_t capacity = prop_list_capacity ? prop_list_capacity * 2 : 64;
+        void *list = realloc(prop_list, capacity * sizeof(prop_list[0]));
+        if (!list) {
+            *ok = false;
+            return;
+        }
+        prop_list = reinterpret_cast<const prop_info**>(list);
+        prop_list_capacity = capacity;
+    }
+    prop_list[prop_list_count++] = pi;
+}
+
+// Returns true and fills |pi| with the |n|th property, or NULL if there
+// are not that many properties. Returns false if the snapshot could not
+// be built.
+static bool find_nth_in_prop_list(unsigned n, const prop_info **pi)
+{
+    const prop_area *pa = __system_property_area__;
+    if (!pa)
+        return false;
+
+    pthread_mutex_lock(&prop_list_lock);
+    const uint32_t generation = prop_cache_generation;
+    const uint32_t serial = pa->serial;
+    if (!prop_list_valid || prop_list_area != pa ||
+        prop_list_generation != generation || prop_list_serial != serial) {
+        ANDROID_MEMBAR_FULL();
+        prop_list_count = 0;
+        bool ok = true;
+        prop_list_valid =
+            foreach_property(0, append_prop_list_fn, &ok) == 0 && ok;
+        prop_list_area = pa;
+        prop_list_generation = generation;
+        prop_list_serial = serial;
+    }
+    const bool valid = prop_list_valid;
+    if (valid)
+        *pi = n < prop_list_count ? prop_list[n] : NULL;
+    pthread_mutex_unlock(&prop_list_lock);
+    return valid;
+}
+
+/* ARC MOD END */
 int __system_properties_init()
 {
     return map_prop_area();
@@ -660,7 +806,29 @@ const prop_info *__system_property_find(const char *name)
     if (__predict_false(compat_mode)) {
         return __system_property_find_compat(name);
     }
-    return find_property(root_node(), name, strlen(name), NULL, 0, false);
+    /* ARC MOD BEGIN */
+    // Look up the cache first.
+    const size_t namelen = strlen(name);
+    if (namelen >= PROP_NAME_MAX)
+        return find_property(root_node(), name, namelen, NULL, 0, false);
+
+    const uint32_t hash = hash_prop_name(name, namelen);
+    const prop_info *pi;
+    if (find_cached_property(name, namelen, hash, &pi))
+        return pi;
+
+    const prop_area *pa = __system_property_area__;
+    if (!pa)
+        return NULL;
+    // Read them before walking the trie, so a property added during the
+    // walk invalidates the entry.
+    const uint32_t generation = prop_cache_generation;
+    const uint32_t area_serial = pa->serial;
+    ANDROID_MEMBAR_FULL();
+    pi = find_property(root_node(), name, namelen, NULL, 0, false);
+    cache_property(name, namelen, hash, pa, generation, area_serial, pi);
+    return pi;
+    /* ARC MOD END */
 }
 
 int __system_property_read(const prop_info *pi, char *name, char *value)
@@ -794,6 +962,14 @@ unsigned int __system_property_wait_any(unsigned int serial)
 
 const prop_info *__system_property_find_nth(unsigned n)
 {
+    /* ARC MOD BEGIN */
+    // Use the snapshot of the properties if possible.
+    if (__predict_true(!compat_mode)) {
+        const prop_info *pi;
+        if (find_nth_in_prop_list(n, &pi))
+            return pi;
+    }
+    /* ARC MOD END */
     find_nth_cookie cookie(n);
 
     const int err = __system_property_foreach(find_nth_fn, &cookie);
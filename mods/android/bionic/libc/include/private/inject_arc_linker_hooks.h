@@ -40,6 +40,12 @@ typedef struct {
   typeof(__nacl_irt_read) nacl_irt_read;
   typeof(__nacl_irt_write) nacl_irt_write;
   typeof(__nacl_irt_fstat) nacl_irt_fstat;
+  // Runs |func| with |arg| on |num_threads| threads concurrently,
+  // including the calling thread, and waits for all of them. The Bionic
+  // loader uses this to map shared objects in parallel when
+  // LD_PARALLEL_LOAD is set, as it cannot create threads by itself. This
+  // can be NULL.
+  void (*run_in_parallel)(void (*func)(void*), void* arg, int num_threads);
 } __arc_linker_hooks;
 
 // This function must be called before the first pthread_create.
@@ -44,6 +44,12 @@ struct timespec;
 // Returns >=0 on success, -errno on error.
 int __nacl_futex(volatile void *ftx, int op,
                  int val, const struct timespec *timeout);
+// Same as __nacl_futex, but also takes the extra arguments of the requeue
+// and wake-op operations. Like the kernel, |timeout| is used as an integer
+// argument for them.
+int __nacl_futex_ex(volatile void *ftx, int op, int val,
+                    const struct timespec *timeout, volatile void *ftx2,
+                    int val3);
 #endif
 // ARC MOD END
 
@@ -84,6 +90,25 @@ static inline int __futex_wait_ex(volatile void* ftx, bool shared, int value, co
   return __futex(ftx, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, value, timeout);
 }
 
+// ARC MOD BEGIN
+// Add a helper for FUTEX_CMP_REQUEUE, which wakes |nr_wake| waiters on
+// |ftx| and moves up to |nr_requeue| others to |ftx2| if |*ftx| is |value|.
+static inline int __futex_cmp_requeue_ex(volatile void* ftx, bool shared, int nr_wake, int nr_requeue, volatile void* ftx2, int value) {
+  int op = shared ? FUTEX_CMP_REQUEUE : FUTEX_CMP_REQUEUE_PRIVATE;
+#if defined(HAVE_ARC)
+  return __nacl_futex_ex(ftx, op, nr_wake, (const struct timespec*)(long)nr_requeue, ftx2, value);
+#else
+  int saved_errno = errno;
+  int result = syscall(__NR_futex, ftx, op, nr_wake, (long)nr_requeue, ftx2, value);
+  if (__predict_false(result == -1)) {
+    result = -errno;
+    errno = saved_errno;
+  }
+  return result;
+#endif
+}
+// ARC MOD END
+
 __END_DECLS
 
 #endif /* _BIONIC_FUTEX_H */
@@ -97,6 +97,7 @@ static soinfo* load_main_binary(KernelArgumentBlock& args);
 
 static void* (*g_resolve_symbol)(const char* symbol);
 static int (*g_is_statically_linked)(const char* filename);
+static void (*g_run_in_parallel)(void (*func)(void*), void* arg, int num_threads);
 
 // TODO(crbug.com/364344): Remove /vendor/lib.
 const char kVendorLibDir[] = "/vendor/lib/";
@@ -629,7 +630,157 @@ int dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void
     return rv;
 }
 
-static ElfW(Sym)* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name) {
+// ARC MOD BEGIN
+// Support DT_GNU_HASH. A lookup in the search order may visit libraries
+// with either hash style, so SymbolName computes each hash of the name at
+// most once and only when it is needed.
+static unsigned elfhash(const char* _name);
+
+static uint32_t gnuhash(const char* _name) {
+  const unsigned char* name = reinterpret_cast<const unsigned char*>(_name);
+  uint32_t h = 5381;
+
+  while (*name) {
+    h += (h << 5) + *name++;  // h*33 + c = h + h * 32 + c = h + h << 5 + c
+  }
+  return h;
+}
+
+class SymbolName {
+ public:
+  explicit SymbolName(const char* name)
+      : name_(name), has_elf_hash_(false), has_gnu_hash_(false),
+        elf_hash_(0), gnu_hash_(0) {
+  }
+
+  const char* get_name() const {
+    return name_;
+  }
+
+  uint32_t elf_hash() {
+    if (!has_elf_hash_) {
+      elf_hash_ = elfhash(name_);
+      has_elf_hash_ = true;
+    }
+    return elf_hash_;
+  }
+
+  uint32_t gnu_hash() {
+    if (!has_gnu_hash_) {
+      gnu_hash_ = gnuhash(name_);
+      has_gnu_hash_ = true;
+    }
+    return gnu_hash_;
+  }
+
+ private:
+  const char* name_;
+  bool has_elf_hash_;
+  bool has_gnu_hash_;
+  uint32_t elf_hash_;
+  uint32_t gnu_hash_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolName);
+};
+
+// Returns true if |s| is a definition which can be used to resolve a
+// reference from other libraries.
+static bool is_symbol_global_and_defined(const soinfo* si, const ElfW(Sym)* s) {
+  /* only concern ourselves with global and weak symbol definitions */
+  switch (ELF_ST_BIND(s->st_info)) {
+    case STB_GLOBAL:
+    case STB_WEAK:
+      // We treat STB_GNU_UNIQUE as STB_GLOBAL.
+      // TODO(crbug.com/306079): Check if this is OK and implement
+      // STB_GNU_UNIQUE support if necessary.
+#define STB_GNU_UNIQUE 10
+    case STB_GNU_UNIQUE:
+      return s->st_shndx != SHN_UNDEF;
+    case STB_LOCAL:
+      return false;
+    default:
+      __libc_fatal("ERROR: Unexpected ST_BIND value: %d for '%s' in '%s'",
+          ELF_ST_BIND(s->st_info), si->strtab + s->st_name, si->name);
+  }
+  return false;
+}
+
+static ElfW(Sym)* soinfo_gnu_lookup(soinfo* si, SymbolName& symbol_name) {
+  const char* name = symbol_name.get_name();
+  uint32_t hash = symbol_name.gnu_hash();
+  uint32_t h2 = hash >> si->gnu_shift2;
+
+  const uint32_t bloom_mask_bits = sizeof(ElfW(Addr)) * 8;
+  uint32_t word_num = (hash / bloom_mask_bits) & si->gnu_maskwords;
+  ElfW(Addr) bloom_word = si->gnu_bloom_filter[word_num];
+
+  TRACE_TYPE(LOOKUP, "SEARCH %s in %s@%p (gnu)",
+             name, si->name, reinterpret_cast<void*>(si->base));
+
+  // Test against the bloom filter first. Most of the libraries in the
+  // search order do not define the symbol, and the filter rejects them
+  // without touching the bucket, the chain, or the string table.
+  if ((1 & (bloom_word >> (hash % bloom_mask_bits)) &
+       (bloom_word >> (h2 % bloom_mask_bits))) == 0) {
+    TRACE_TYPE(LOOKUP, "NOT FOUND %s in %s@%p (bloom filter)",
+               name, si->name, reinterpret_cast<void*>(si->base));
+    return NULL;
+  }
+
+  uint32_t n = si->gnu_bucket[hash % si->gnu_nbucket];
+  if (n == 0) {
+    TRACE_TYPE(LOOKUP, "NOT FOUND %s in %s@%p (empty bucket)",
+               name, si->name, reinterpret_cast<void*>(si->base));
+    return NULL;
+  }
+
+  // The lowest bit of a chain entry marks the end of the chain, and the
+  // other bits are the hash of the symbol, which avoids most strcmp calls.
+  do {
+    ElfW(Sym)* s = si->symtab + n;
+    if (((si->gnu_chain[n] ^ hash) >> 1) == 0 &&
+        strcmp(si->strtab + s->st_name, name) == 0 &&
+        is_symbol_global_and_defined(si, s)) {
+      TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
+                 name, si->name, reinterpret_cast<void*>(s->st_value),
+                 static_cast<size_t>(s->st_size));
+      return s;
+    }
+  } while ((si->gnu_chain[n++] & 1) == 0);
+
+  TRACE_TYPE(LOOKUP, "NOT FOUND %s in %s@%p",
+             name, si->name, reinterpret_cast<void*>(si->base));
+  return NULL;
+}
+
+// Returns the number of the entries in the symbol table of |si|, which
+// uses DT_GNU_HASH. DT_GNU_HASH does not record the number, so this
+// finds the end of the last chain.
+static size_t soinfo_gnu_symbol_count(soinfo* si) {
+  uint32_t max_index = 0;
+  for (size_t i = 0; i < si->gnu_nbucket; ++i) {
+    if (si->gnu_bucket[i] > max_index) {
+      max_index = si->gnu_bucket[i];
+    }
+  }
+  if (max_index == 0) {
+    // No symbol is exported. All symbols are before |symndx|.
+    return si->gnu_bucket + si->gnu_nbucket - si->gnu_chain;
+  }
+  while ((si->gnu_chain[max_index] & 1) == 0) {
+    ++max_index;
+  }
+  return max_index + 1;
+}
+
+static ElfW(Sym)* soinfo_elf_lookup(soinfo* si, SymbolName& symbol_name) {
+  if (si->flags & FLAG_GNU_HASH) {
+    return soinfo_gnu_lookup(si, symbol_name);
+  }
+
+  const char* name = symbol_name.get_name();
+  unsigned hash = symbol_name.elf_hash();
+  // ARC MOD END
   ElfW(Sym)* symtab = si->symtab;
   const char* strtab = si->strtab;
 
@@ -640,31 +791,15 @@ static ElfW(Sym)* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name)
     ElfW(Sym)* s = symtab + n;
     if (strcmp(strtab + s->st_name, name)) continue;
 
-    /* only concern ourselves with global and weak symbol definitions */
-    switch (ELF_ST_BIND(s->st_info)) {
-      case STB_GLOBAL:
-      case STB_WEAK:
-        // ARC MOD BEGIN
-        // We treat STB_GNU_UNIQUE as STB_GLOBAL.
-        // TODO(crbug.com/306079): Check if this is OK and implement
-        // STB_GNU_UNIQUE support if necessary.
-#define STB_GNU_UNIQUE 10
-      case STB_GNU_UNIQUE:
-        // ARC MOD END
-        if (s->st_shndx == SHN_UNDEF) {
-          continue;
-        }
-
-        TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
+    // ARC MOD BEGIN
+    // Share the check of the binding with soinfo_gnu_lookup.
+    if (is_symbol_global_and_defined(si, s)) {
+      TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
                  name, si->name, reinterpret_cast<void*>(s->st_value),
                  static_cast<size_t>(s->st_size));
-        return s;
-      case STB_LOCAL:
-        continue;
-      default:
-        __libc_fatal("ERROR: Unexpected ST_BIND value: %d for '%s' in '%s'",
-            ELF_ST_BIND(s->st_info), name, si->name);
+      return s;
     }
+    // ARC MOD END
   }
 
   TRACE_TYPE(LOOKUP, "NOT FOUND %s in %s@%p %x %zd",
@@ -688,7 +823,10 @@ static unsigned elfhash(const char* _name) {
 }
 
 static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soinfo* needed[]) {
-    unsigned elf_hash = elfhash(name);
+    // ARC MOD BEGIN
+    // Support DT_GNU_HASH.
+    SymbolName symbol_name(name);
+    // ARC MOD END
     ElfW(Sym)* s = NULL;
 
     if (si != NULL && somain != NULL) {
@@ -698,7 +836,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
          */
 
         if (si == somain) {
-            s = soinfo_elf_lookup(si, elf_hash, name);
+            // ARC MOD BEGIN
+            // Support DT_GNU_HASH.
+            s = soinfo_elf_lookup(si, symbol_name);
+            // ARC MOD END
             if (s != NULL) {
                 *lsi = si;
                 goto done;
@@ -706,7 +847,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
 
             /* Next, look for it in the preloads list */
             for (int i = 0; g_ld_preloads[i] != NULL; i++) {
-                s = soinfo_elf_lookup(g_ld_preloads[i], elf_hash, name);
+                // ARC MOD BEGIN
+                // Support DT_GNU_HASH.
+                s = soinfo_elf_lookup(g_ld_preloads[i], symbol_name);
+                // ARC MOD END
                 if (s != NULL) {
                     *lsi = g_ld_preloads[i];
                     goto done;
@@ -734,7 +878,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
                 // ARC MOD END
                 DEBUG("%s: looking up %s in executable %s",
                       si->name, name, somain->name);
-                s = soinfo_elf_lookup(somain, elf_hash, name);
+                // ARC MOD BEGIN
+                // Support DT_GNU_HASH.
+                s = soinfo_elf_lookup(somain, symbol_name);
+                // ARC MOD END
                 if (s != NULL) {
                     *lsi = somain;
                     goto done;
@@ -745,7 +892,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
 
                 /* Next, look for it in the preloads list */
                 for (int i = 0; g_ld_preloads[i] != NULL; i++) {
-                    s = soinfo_elf_lookup(g_ld_preloads[i], elf_hash, name);
+                    // ARC MOD BEGIN
+                    // Support DT_GNU_HASH.
+                    s = soinfo_elf_lookup(g_ld_preloads[i], symbol_name);
+                    // ARC MOD END
                     if (s != NULL) {
                         *lsi = g_ld_preloads[i];
                         goto done;
@@ -763,7 +913,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
              * and some the first non-weak definition.   This is system dependent.
              * Here we return the first definition found for simplicity.  */
 
-            s = soinfo_elf_lookup(si, elf_hash, name);
+            // ARC MOD BEGIN
+            // Support DT_GNU_HASH.
+            s = soinfo_elf_lookup(si, symbol_name);
+            // ARC MOD END
             if (s != NULL) {
                 *lsi = si;
                 goto done;
@@ -780,7 +933,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
                 // ARC MOD END
                 DEBUG("%s: looking up %s in executable %s after local scope",
                       si->name, name, somain->name);
-                s = soinfo_elf_lookup(somain, elf_hash, name);
+                // ARC MOD BEGIN
+                // Support DT_GNU_HASH.
+                s = soinfo_elf_lookup(somain, symbol_name);
+                // ARC MOD END
                 if (s != NULL) {
                     *lsi = somain;
                     goto done;
@@ -791,7 +947,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
 
                 /* Next, look for it in the preloads list */
                 for (int i = 0; g_ld_preloads[i] != NULL; i++) {
-                    s = soinfo_elf_lookup(g_ld_preloads[i], elf_hash, name);
+                    // ARC MOD BEGIN
+                    // Support DT_GNU_HASH.
+                    s = soinfo_elf_lookup(g_ld_preloads[i], symbol_name);
+                    // ARC MOD END
                     if (s != NULL) {
                         *lsi = g_ld_preloads[i];
                         goto done;
@@ -804,7 +963,10 @@ static ElfW(Sym)* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, s
     for (int i = 0; needed[i] != NULL; i++) {
         DEBUG("%s: looking up %s in %s",
               si->name, name, needed[i]->name);
-        s = soinfo_elf_lookup(needed[i], elf_hash, name);
+        // ARC MOD BEGIN
+        // Support DT_GNU_HASH.
+        s = soinfo_elf_lookup(needed[i], symbol_name);
+        // ARC MOD END
         if (s != NULL) {
             *lsi = needed[i];
             goto done;
@@ -843,6 +1005,10 @@ class SoinfoListAllocatorRW {
 ElfW(Sym)* dlsym_handle_lookup(soinfo* si, soinfo** found, const char* name) {
   LinkedList<soinfo, SoinfoListAllocatorRW> visit_list;
   LinkedList<soinfo, SoinfoListAllocatorRW> visited;
+  // ARC MOD BEGIN
+  // Support DT_GNU_HASH.
+  SymbolName symbol_name(name);
+  // ARC MOD END
   visit_list.push_back(si);
   soinfo* current_soinfo;
   while ((current_soinfo = visit_list.pop_front()) != nullptr) {
@@ -850,7 +1016,10 @@ ElfW(Sym)* dlsym_handle_lookup(soinfo* si, soinfo** found, const char* name) {
       continue;
     }
 
-    ElfW(Sym)* result = soinfo_elf_lookup(current_soinfo, elfhash(name), name);
+    // ARC MOD BEGIN
+    // Support DT_GNU_HASH.
+    ElfW(Sym)* result = soinfo_elf_lookup(current_soinfo, symbol_name);
+    // ARC MOD END
 
     if (result != nullptr) {
       *found = current_soinfo;
@@ -876,7 +1045,10 @@ ElfW(Sym)* dlsym_handle_lookup(soinfo* si, soinfo** found, const char* name) {
    specified soinfo (for RTLD_NEXT).
  */
 ElfW(Sym)* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start) {
-  unsigned elf_hash = elfhash(name);
+  // ARC MOD BEGIN
+  // Support DT_GNU_HASH.
+  SymbolName symbol_name(name);
+  // ARC MOD END
 
   if (start == NULL) {
     start = solist;
@@ -884,7 +1056,10 @@ ElfW(Sym)* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start)
 
   ElfW(Sym)* s = NULL;
   for (soinfo* si = start; (s == NULL) && (si != NULL); si = si->next) {
-    s = soinfo_elf_lookup(si, elf_hash, name);
+    // ARC MOD BEGIN
+    // Support DT_GNU_HASH.
+    s = soinfo_elf_lookup(si, symbol_name);
+    // ARC MOD END
     if (s != NULL) {
       *found = si;
       break;
@@ -1082,6 +1257,197 @@ static int open_library(const char* name, int* is_in_vendor_lib) {
   // ARC MOD END
 }
 
+// ARC MOD BEGIN
+// Parallel loading of DT_NEEDED libraries. When LD_PARALLEL_LOAD is set to
+// the number of threads and the ARC runtime provides run_in_parallel,
+// soinfo_link_image opens the DT_NEEDED libraries which have not been
+// loaded yet and maps their segments on multiple threads before loading
+// them one by one. Mapping segments is the expensive part of loading on
+// NaCl, where the code is copied and validated. Everything else, such as
+// soinfo allocation, relocation, and constructors, still happens on the
+// calling thread in the original order.
+static int g_parallel_load_threads = 0;
+
+struct PrefetchedLibrary {
+  const char* name;
+  int fd;
+  int is_in_vendor_lib;
+  // True if the segments are mapped.
+  bool loaded;
+  // True if load_library has taken this library.
+  bool consumed;
+  ElfW(Addr) load_start;
+  size_t load_size;
+  ElfW(Addr) load_bias;
+  size_t phdr_count;
+  const ElfW(Phdr)* loaded_phdr;
+  ElfW(Addr) entry;
+};
+
+struct PrefetchTable {
+  PrefetchedLibrary* libraries;
+  size_t count;
+  // The index of the library to be loaded next by a worker.
+  size_t next;
+  // The table of the enclosing soinfo_link_image call.
+  PrefetchTable* parent;
+};
+
+// The stack of the tables of the nested soinfo_link_image calls.
+static PrefetchTable* g_prefetch_tables = NULL;
+
+static soinfo* find_loaded_library_by_name(const char* name);
+
+// Runs on worker threads while the calling thread of dlopen, which holds
+// the linker's mutex, waits for them. Workers only read the global state.
+// A library which fails here is loaded again by load_library, which
+// reports the error properly, so errors written to the shared error
+// buffer here do not matter.
+static void prefetch_libraries(void* arg) {
+  PrefetchTable* table = reinterpret_cast<PrefetchTable*>(arg);
+  for (;;) {
+    size_t index = __sync_fetch_and_add(&table->next, 1);
+    if (index >= table->count) {
+      return;
+    }
+    PrefetchedLibrary* library = &table->libraries[index];
+    int fd = open_library(library->name, &library->is_in_vendor_lib);
+    if (fd == -1) {
+      continue;
+    }
+    struct stat file_stat;
+    if (TEMP_FAILURE_RETRY(fstat(fd, &file_stat)) != 0) {
+      close(fd);
+      continue;
+    }
+    // Do not map a library which is already loaded under a different
+    // name. load_library will find it.
+    bool already_loaded = false;
+    for (soinfo* si = solist; si != NULL; si = si->next) {
+      if (si->get_st_dev() != 0 &&
+          si->get_st_ino() != 0 &&
+          si->get_st_dev() == file_stat.st_dev &&
+          si->get_st_ino() == file_stat.st_ino) {
+        already_loaded = true;
+        break;
+      }
+    }
+    if (already_loaded) {
+      close(fd);
+      continue;
+    }
+    ElfReader elf_reader(library->name, fd);
+    if (!elf_reader.Load(NULL)) {
+      close(fd);
+      continue;
+    }
+    library->load_start = elf_reader.load_start();
+    library->load_size = elf_reader.load_size();
+    library->load_bias = elf_reader.load_bias();
+    library->phdr_count = elf_reader.phdr_count();
+    library->loaded_phdr = elf_reader.loaded_phdr();
+    library->entry = elf_reader.header().e_entry;
+    library->fd = fd;
+    library->loaded = true;
+  }
+}
+
+// Returns the library which has been mapped for |name|. The caller owns
+// the file descriptor of the returned library.
+static PrefetchedLibrary* take_prefetched_library(const char* name) {
+  for (PrefetchTable* table = g_prefetch_tables; table != NULL; table = table->parent) {
+    for (size_t i = 0; i < table->count; ++i) {
+      PrefetchedLibrary* library = &table->libraries[i];
+      if (library->loaded && !library->consumed && !strcmp(library->name, name)) {
+        library->consumed = true;
+        return library;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Releases the segments of a library which turned out to be unnecessary.
+static void discard_prefetched_library(PrefetchedLibrary* library) {
+  TRACE("[ discarding prefetched library %s ]", library->name);
+#if defined(__native_client__)
+  // The code segments allocated by nacl_dyncode_alloc cannot be released.
+  // TODO(crbug.com/257546): Unmap data segments.
+#else
+  munmap(reinterpret_cast<void*>(library->load_start), library->load_size);
+#endif
+}
+
+// Maps the DT_NEEDED libraries of |si| in parallel while this object is
+// alive. This is a no-op unless parallel loading is enabled.
+class ScopedLibraryPrefetcher {
+ public:
+  ScopedLibraryPrefetcher(soinfo* si, size_t needed_count) : mapped_size_(0) {
+    memset(&table_, 0, sizeof(table_));
+    if (g_parallel_load_threads < 2 || !g_run_in_parallel || needed_count < 2) {
+      return;
+    }
+    size_t mapped_size = PAGE_END(needed_count * sizeof(PrefetchedLibrary));
+    void* libraries = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (libraries == MAP_FAILED) {
+      return;
+    }
+    table_.libraries = reinterpret_cast<PrefetchedLibrary*>(libraries);
+    mapped_size_ = mapped_size;
+    for (ElfW(Dyn)* d = si->dynamic; d->d_tag != DT_NULL; ++d) {
+      if (d->d_tag != DT_NEEDED) {
+        continue;
+      }
+      const char* library_name = si->strtab + d->d_un.d_val;
+      if ((g_is_statically_linked && g_is_statically_linked(library_name)) ||
+          find_loaded_library_by_name(library_name) != NULL) {
+        continue;
+      }
+      PrefetchedLibrary* library = &table_.libraries[table_.count++];
+      library->name = library_name;
+      library->fd = -1;
+    }
+    table_.parent = g_prefetch_tables;
+    g_prefetch_tables = &table_;
+    if (table_.count < 2) {
+      // There is nothing to do in parallel.
+      return;
+    }
+
+    ScopedElapsedTimePrinter<__LINE__> printer("Prefetched libraries for", si->name);
+    int num_threads = g_parallel_load_threads;
+    if (static_cast<size_t>(num_threads) > table_.count) {
+      num_threads = table_.count;
+    }
+    g_run_in_parallel(prefetch_libraries, &table_, num_threads);
+  }
+
+  ~ScopedLibraryPrefetcher() {
+    if (table_.libraries == NULL) {
+      return;
+    }
+    // Release the libraries which were not used because, for example,
+    // loading an earlier DT_NEEDED library failed.
+    for (size_t i = 0; i < table_.count; ++i) {
+      PrefetchedLibrary* library = &table_.libraries[i];
+      if (library->loaded && !library->consumed) {
+        close(library->fd);
+        discard_prefetched_library(library);
+      }
+    }
+    g_prefetch_tables = table_.parent;
+    munmap(table_.libraries, mapped_size_);
+  }
+
+ private:
+  PrefetchTable table_;
+  size_t mapped_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedLibraryPrefetcher);
+};
+// ARC MOD END
+
 static soinfo* load_library(const char* name, int dlflags, const android_dlextinfo* extinfo) {
     int fd = -1;
     ScopedFd file_guard(-1);
@@ -1089,8 +1455,21 @@ static soinfo* load_library(const char* name, int dlflags, const android_dlextin
     int is_in_vendor_lib = 0;
     // ARC MOD END
 
+    // ARC MOD BEGIN
+    // Use the library mapped by ScopedLibraryPrefetcher if available.
+    PrefetchedLibrary* prefetched = NULL;
+    if (extinfo == NULL) {
+      prefetched = take_prefetched_library(name);
+    }
+    // ARC MOD END
     if (extinfo != NULL && (extinfo->flags & ANDROID_DLEXT_USE_LIBRARY_FD) != 0) {
       fd = extinfo->library_fd;
+    // ARC MOD BEGIN
+    } else if (prefetched != NULL) {
+      fd = prefetched->fd;
+      is_in_vendor_lib = prefetched->is_in_vendor_lib;
+      file_guard.reset(fd);
+    // ARC MOD END
     } else {
       // Open the file.
       // ARC MOD BEGIN bionic-linker-ndk-detection
@@ -1122,18 +1501,52 @@ static soinfo* load_library(const char* name, int dlflags, const android_dlextin
           si->get_st_dev() == file_stat.st_dev &&
           si->get_st_ino() == file_stat.st_ino) {
         TRACE("library \"%s\" is already loaded under different name/path \"%s\" - will return existing soinfo", name, si->name);
+        // ARC MOD BEGIN
+        if (prefetched != NULL) {
+          discard_prefetched_library(prefetched);
+        }
+        // ARC MOD END
         return si;
       }
     }
 
     if ((dlflags & RTLD_NOLOAD) != 0) {
+      // ARC MOD BEGIN
+      if (prefetched != NULL) {
+        discard_prefetched_library(prefetched);
+      }
+      // ARC MOD END
       return NULL;
     }
 
+    // ARC MOD BEGIN
+    // Skip loading the segments if they have been mapped by
+    // ScopedLibraryPrefetcher.
+    ElfW(Addr) load_start, load_bias, entry;
+    size_t load_size, phdr_count;
+    const ElfW(Phdr)* loaded_phdr;
+    if (prefetched != NULL) {
+      load_start = prefetched->load_start;
+      load_size = prefetched->load_size;
+      load_bias = prefetched->load_bias;
+      phdr_count = prefetched->phdr_count;
+      loaded_phdr = prefetched->loaded_phdr;
+      entry = prefetched->entry;
+    } else {
+    // ARC MOD END
     // Read the ELF header and load the segments.
     if (!elf_reader.Load(extinfo)) {
         return NULL;
     }
+    // ARC MOD BEGIN
+      load_start = elf_reader.load_start();
+      load_size = elf_reader.load_size();
+      load_bias = elf_reader.load_bias();
+      phdr_count = elf_reader.phdr_count();
+      loaded_phdr = elf_reader.loaded_phdr();
+      entry = elf_reader.header().e_entry;
+    }
+    // ARC MOD END
 
     // ARC MOD BEGIN
     // SEARCH_NAME() returns the base name for 32-bit platforms.
@@ -1145,18 +1558,20 @@ static soinfo* load_library(const char* name, int dlflags, const android_dlextin
     if (si == NULL) {
         return NULL;
     }
-    si->base = elf_reader.load_start();
-    si->size = elf_reader.load_size();
-    si->load_bias = elf_reader.load_bias();
-    si->phnum = elf_reader.phdr_count();
-    si->phdr = elf_reader.loaded_phdr();
+    // ARC MOD BEGIN
+    // Use the values from ScopedLibraryPrefetcher or |elf_reader|.
+    si->base = load_start;
+    si->size = load_size;
+    si->load_bias = load_bias;
+    si->phnum = phdr_count;
+    si->phdr = loaded_phdr;
+    // ARC MOD END
     // ARC MOD BEGIN
 #if defined(HAVE_ARC)
     // Linux kernel sends the entry point using AT_ENTRY, but sel_ldr
     // does not send this info. Take this occasion and fill the field.
-    const ElfW(Ehdr)& header = elf_reader.header();
-    if (header.e_entry)
-      si->entry = header.e_entry + elf_reader.load_bias();
+    if (entry)
+      si->entry = entry + load_bias;
     if (!si->phdr)
       DL_ERR("Cannot locate a program header in \"%s\".", name);
     // ARC MOD END
@@ -1341,8 +1756,369 @@ void do_dlclose(soinfo* si) {
   protect_data(PROT_READ);
 }
 
+// ARC MOD BEGIN
+// A cache of the symbol lookups done while relocating a library. The
+// relocations of a library often refer to the same symbol (e.g.,
+// R_*_GLOB_DAT and R_*_JUMP_SLOT for a function whose address is taken,
+// or R_*_64 for a function referenced from many vtables), and each lookup
+// walks the hash tables of the libraries in the search order. The result
+// of a lookup only depends on the library being relocated and the symbol
+// index, so the cache is a direct-mapped array indexed by the symbol
+// index. Note that the cache cannot be shared between libraries as their
+// search orders differ. Set LD_DISABLE_SYMBOL_CACHE to disable it.
+static bool g_symbol_cache_enabled = true;
+
+class SymbolLookupCache {
+ public:
+  explicit SymbolLookupCache(soinfo* si)
+      : si_(si), entries_(NULL), size_(0), hit_count_(0), miss_count_(0) {
+    // The linker relocates itself before it can call mmap, and it does
+    // not look up any symbol anyway.
+    if (!g_symbol_cache_enabled || (si->flags & FLAG_LINKER) || si->nchain == 0) {
+      return;
+    }
+    void* entries = mmap(NULL, PAGE_END(si->nchain * sizeof(Entry)),
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (entries == MAP_FAILED) {
+      // Relocate the library without the cache.
+      return;
+    }
+    entries_ = reinterpret_cast<Entry*>(entries);
+    size_ = si->nchain;
+  }
+
+  ~SymbolLookupCache() {
+    if (entries_ == NULL) {
+      return;
+    }
+    DEBUG("%s: symbol lookup cache: %zu hits, %zu misses",
+          si_->name, hit_count_, miss_count_);
+    munmap(entries_, PAGE_END(size_ * sizeof(Entry)));
+  }
+
+  // Returns true and fills |s| and |lsi| if the lookup result of the
+  // symbol |sym| is cached. |s| is NULL if the symbol was not found.
+  bool Get(unsigned sym, ElfW(Sym)** s, soinfo** lsi) {
+    if (sym >= size_ || !entries_[sym].cached) {
+      ++miss_count_;
+      return false;
+    }
+    ++hit_count_;
+    *s = entries_[sym].s;
+    *lsi = entries_[sym].lsi;
+    return true;
+  }
+
+  void Put(unsigned sym, ElfW(Sym)* s, soinfo* lsi) {
+    if (sym >= size_) {
+      return;
+    }
+    entries_[sym].s = s;
+    entries_[sym].lsi = lsi;
+    entries_[sym].cached = true;
+  }
+
+  // Fills the cache with the lookup results recorded in |path| by
+  // SaveToFile. |scope| is the list of the libraries in which the symbols
+  // are looked up. Returns true if the results are loaded.
+  bool LoadFromFile(const char* path, soinfo* const scope[], size_t scope_count);
+
+  // Records the cached lookup results into |path|, which is replaced
+  // atomically.
+  void SaveToFile(const char* path, soinfo* const scope[], size_t scope_count);
+
+  size_t miss_count() const {
+    return miss_count_;
+  }
+
+ private:
+  struct Entry {
+    ElfW(Sym)* s;
+    soinfo* lsi;
+    bool cached;
+  };
+
+  soinfo* si_;
+  Entry* entries_;
+  size_t size_;
+  size_t hit_count_;
+  size_t miss_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolLookupCache);
+};
+
+// A persistent relocation cache. When LD_RELOCATION_CACHE names a
+// directory, the symbol lookup results of a library are saved into a file
+// in it after the library is relocated, and later loads of the library
+// replay the results instead of looking up the symbols again. A result is
+// recorded as a pair of a library in the lookup scope (the library itself,
+// the main executable, LD_PRELOAD libraries, and DT_NEEDED libraries) and
+// a symbol index in it. The file is named after the build ID of the
+// library, and it also records the build IDs of the lookup scope. The
+// results are replayed only when all of them match, which means the
+// libraries and their search order are identical to the ones when the
+// results were recorded. Libraries without a build ID are not cached.
+static const char* g_relocation_cache_dir = NULL;
+
+#if !defined(NT_GNU_BUILD_ID)
+#define NT_GNU_BUILD_ID 3
+#endif
+
+static const uint32_t kRelocationCacheMagic = 0x43524c41;  // "ALRC"
+static const uint32_t kRelocationCacheVersion = 1;
+// The maximum number of the libraries in a lookup scope.
+static const size_t kRelocationCacheMaxScope = 64;
+static const uint32_t kRelocationCacheNotFound = 0xffffffff;
+
+struct RelocationCacheBuildId {
+  uint32_t size;
+  uint8_t data[32];
+};
+
+struct RelocationCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t scope_count;
+  uint32_t record_count;
+  // Followed by |scope_count| RelocationCacheBuildIds and |record_count|
+  // RelocationCacheRecords.
+};
+
+struct RelocationCacheRecord {
+  uint32_t sym;
+  // An index in the scope, or kRelocationCacheNotFound.
+  uint32_t scope_index;
+  uint32_t target_sym;
+};
+
+// Reads the NT_GNU_BUILD_ID note of |si|.
+static bool soinfo_get_build_id(const soinfo* si, RelocationCacheBuildId* build_id) {
+  for (size_t i = 0; i < si->phnum; ++i) {
+    const ElfW(Phdr)* phdr = &si->phdr[i];
+    if (phdr->p_type != PT_NOTE) {
+      continue;
+    }
+    // Note that the words in notes are 32 bits even for ELF64.
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(si->load_bias + phdr->p_vaddr);
+    const uint8_t* end = p + phdr->p_memsz;
+    while (p + 12 <= end) {
+      const uint32_t* note = reinterpret_cast<const uint32_t*>(p);
+      const uint32_t name_size = note[0];
+      const uint32_t desc_size = note[1];
+      const uint32_t type = note[2];
+      const uint8_t* name = p + 12;
+      const uint8_t* desc = name + ((name_size + 3) & ~3);
+      p = desc + ((desc_size + 3) & ~3);
+      if (p > end) {
+        break;
+      }
+      if (type == NT_GNU_BUILD_ID && name_size == 4 && !memcmp(name, "GNU", 4) &&
+          desc_size > 0 && desc_size <= sizeof(build_id->data)) {
+        memset(build_id, 0, sizeof(*build_id));
+        build_id->size = desc_size;
+        memcpy(build_id->data, desc, desc_size);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Returns the libraries in which the symbols of |si| are looked up. The
+// order does not need to match the search order as this is used only to
+// identify the libraries.
+static size_t get_relocation_cache_scope(soinfo* si, soinfo* needed[], soinfo** scope) {
+  size_t count = 0;
+  scope[count++] = si;
+  if (somain != NULL) {
+    scope[count++] = somain;
+  }
+  for (int i = 0; g_ld_preloads[i] != NULL; ++i) {
+    scope[count++] = g_ld_preloads[i];
+  }
+  for (int i = 0; needed[i] != NULL; ++i) {
+    if (count == kRelocationCacheMaxScope) {
+      return 0;
+    }
+    scope[count++] = needed[i];
+  }
+  return count;
+}
+
+// Fills |path| with the name of the relocation cache file for |si|.
+// Returns false if |si| cannot be cached.
+static bool get_relocation_cache_path(soinfo* si, char* path, size_t path_size) {
+  RelocationCacheBuildId build_id;
+  if (!soinfo_get_build_id(si, &build_id)) {
+    return false;
+  }
+  char hex[sizeof(build_id.data) * 2 + 1];
+  static const char kHexDigits[] = "0123456789abcdef";
+  for (size_t i = 0; i < build_id.size; ++i) {
+    hex[i * 2] = kHexDigits[build_id.data[i] >> 4];
+    hex[i * 2 + 1] = kHexDigits[build_id.data[i] & 0xf];
+  }
+  hex[build_id.size * 2] = '\0';
+  int n = __libc_format_buffer(path, path_size, "%s/%s.relocs",
+                               g_relocation_cache_dir, hex);
+  return n > 0 && n < static_cast<int>(path_size);
+}
+
+bool SymbolLookupCache::LoadFromFile(const char* path, soinfo* const scope[],
+                                     size_t scope_count) {
+  if (entries_ == NULL) {
+    return false;
+  }
+  int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    return false;
+  }
+  struct stat file_stat;
+  if (TEMP_FAILURE_RETRY(fstat(fd, &file_stat)) != 0 ||
+      file_stat.st_size < static_cast<off_t>(sizeof(RelocationCacheHeader))) {
+    close(fd);
+    return false;
+  }
+  size_t file_size = file_stat.st_size;
+  void* buf = mmap(NULL, PAGE_END(file_size), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  ssize_t read_size = TEMP_FAILURE_RETRY(read(fd, buf, file_size));
+  close(fd);
+
+  bool loaded = false;
+  const RelocationCacheHeader* header = reinterpret_cast<RelocationCacheHeader*>(buf);
+  const RelocationCacheBuildId* build_ids =
+      reinterpret_cast<const RelocationCacheBuildId*>(header + 1);
+  const RelocationCacheRecord* records =
+      reinterpret_cast<const RelocationCacheRecord*>(build_ids + scope_count);
+  const size_t records_offset = sizeof(*header) + scope_count * sizeof(*build_ids);
+  // Compare |record_count| by division so that a broken count cannot
+  // overflow the size computation on 32-bit targets.
+  if (read_size == static_cast<ssize_t>(file_size) &&
+      header->magic == kRelocationCacheMagic &&
+      header->version == kRelocationCacheVersion &&
+      header->scope_count == scope_count &&
+      file_size >= records_offset &&
+      header->record_count <= (file_size - records_offset) / sizeof(*records) &&
+      file_size == records_offset + header->record_count * sizeof(*records)) {
+    loaded = true;
+    for (size_t i = 0; loaded && i < scope_count; ++i) {
+      RelocationCacheBuildId build_id;
+      loaded = (soinfo_get_build_id(scope[i], &build_id) &&
+                !memcmp(&build_id, &build_ids[i], sizeof(build_id)));
+    }
+    // Validate all records before using any of them so a broken file
+    // never leaves the cache half filled.
+    for (size_t i = 0; loaded && i < header->record_count; ++i) {
+      const RelocationCacheRecord& record = records[i];
+      if (record.sym >= size_) {
+        loaded = false;
+      } else if (record.scope_index != kRelocationCacheNotFound) {
+        const soinfo* target = record.scope_index < scope_count ?
+            scope[record.scope_index] : NULL;
+        loaded = (target != NULL && record.target_sym < target->nchain &&
+                  !strcmp(si_->strtab + si_->symtab[record.sym].st_name,
+                          target->strtab + target->symtab[record.target_sym].st_name));
+      }
+    }
+    for (size_t i = 0; loaded && i < header->record_count; ++i) {
+      const RelocationCacheRecord& record = records[i];
+      if (record.scope_index == kRelocationCacheNotFound) {
+        Put(record.sym, NULL, NULL);
+      } else {
+        soinfo* target = scope[record.scope_index];
+        Put(record.sym, &target->symtab[record.target_sym], target);
+      }
+    }
+  }
+  munmap(buf, PAGE_END(file_size));
+  DEBUG("%s: %s the relocation cache %s", si_->name,
+        loaded ? "loaded" : "ignored", path);
+  return loaded;
+}
+
+void SymbolLookupCache::SaveToFile(const char* path, soinfo* const scope[],
+                                   size_t scope_count) {
+  if (entries_ == NULL) {
+    return;
+  }
+  size_t record_count = 0;
+  for (size_t i = 0; i < size_; ++i) {
+    if (entries_[i].cached) {
+      ++record_count;
+    }
+  }
+  const size_t file_size = sizeof(RelocationCacheHeader) +
+      scope_count * sizeof(RelocationCacheBuildId) +
+      record_count * sizeof(RelocationCacheRecord);
+  void* buf = mmap(NULL, PAGE_END(file_size), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) {
+    return;
+  }
+
+  bool ok = true;
+  RelocationCacheHeader* header = reinterpret_cast<RelocationCacheHeader*>(buf);
+  header->magic = kRelocationCacheMagic;
+  header->version = kRelocationCacheVersion;
+  header->scope_count = scope_count;
+  header->record_count = record_count;
+  RelocationCacheBuildId* build_ids = reinterpret_cast<RelocationCacheBuildId*>(header + 1);
+  for (size_t i = 0; ok && i < scope_count; ++i) {
+    ok = soinfo_get_build_id(scope[i], &build_ids[i]);
+  }
+  RelocationCacheRecord* record =
+      reinterpret_cast<RelocationCacheRecord*>(build_ids + scope_count);
+  for (size_t i = 0; ok && i < size_; ++i) {
+    const Entry& entry = entries_[i];
+    if (!entry.cached) {
+      continue;
+    }
+    record->sym = i;
+    record->scope_index = kRelocationCacheNotFound;
+    record->target_sym = 0;
+    if (entry.s != NULL) {
+      for (size_t j = 0; j < scope_count; ++j) {
+        if (scope[j] == entry.lsi) {
+          record->scope_index = j;
+          record->target_sym = entry.s - entry.lsi->symtab;
+          break;
+        }
+      }
+      // The symbol was found out of the scope, which should not happen.
+      ok = record->scope_index != kRelocationCacheNotFound;
+    }
+    ++record;
+  }
+
+  // rename() is not available in the loader, so the file is rewritten in
+  // place. A reader racing with this sees a short file or mismatching
+  // records, and LoadFromFile rejects both.
+  if (ok) {
+    int fd = TEMP_FAILURE_RETRY(open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd != -1) {
+      ok = TEMP_FAILURE_RETRY(write(fd, buf, file_size)) == static_cast<ssize_t>(file_size);
+      close(fd);
+      if (ok) {
+        DEBUG("%s: saved %zu records to the relocation cache %s",
+              si_->name, record_count, path);
+      }
+    }
+  }
+  munmap(buf, PAGE_END(file_size));
+}
+// ARC MOD END
+
 #if defined(USE_RELA)
-static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo* needed[]) {
+// ARC MOD BEGIN
+// Add |symbol_cache|.
+static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo* needed[],
+                           SymbolLookupCache* symbol_cache) {
+// ARC MOD END
   // ARC MOD BEGIN
   // Initialize |s| by NULL.
   ElfW(Sym)* s = NULL;
@@ -1393,17 +2169,23 @@ static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo*
         }
 
         // Then look up the symbol following Android's default
-        // semantics.
-        s = soinfo_do_lookup(si, sym_name, &lsi, needed);
-        // When the symbol is not found, we still need to
-        // look up the main binary, as we link some shared
-        // objects (e.g., liblog.so) into arc.nexe
-        // TODO(crbug.com/400947): Remove this code once we have
-        // stopped converting .so files to .a.
-        if (!s)
-          s = soinfo_do_lookup(somain, sym_name, &lsi, needed);
+        // semantics unless the result is cached.
+        if (!symbol_cache->Get(sym, &s, &lsi)) {
+          s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+          // When the symbol is not found, we still need to
+          // look up the main binary, as we link some shared
+          // objects (e.g., liblog.so) into arc.nexe
+          // TODO(crbug.com/400947): Remove this code once we have
+          // stopped converting .so files to .a.
+          if (!s)
+            s = soinfo_do_lookup(somain, sym_name, &lsi, needed);
+          symbol_cache->Put(sym, s, lsi);
+        }
 #else
-        s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+        if (!symbol_cache->Get(sym, &s, &lsi)) {
+          s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+          symbol_cache->Put(sym, s, lsi);
+        }
 #endif
       }
       // ARC MOD END
@@ -1667,7 +2449,11 @@ static int soinfo_relocate(soinfo* si, ElfW(Rela)* rela, unsigned count, soinfo*
 
 #else // REL, not RELA.
 
-static int soinfo_relocate(soinfo* si, ElfW(Rel)* rel, unsigned count, soinfo* needed[]) {
+// ARC MOD BEGIN
+// Add |symbol_cache|.
+static int soinfo_relocate(soinfo* si, ElfW(Rel)* rel, unsigned count, soinfo* needed[],
+                           SymbolLookupCache* symbol_cache) {
+// ARC MOD END
     // ARC MOD BEGIN
     // Initialize |s| by NULL.
     ElfW(Sym)* s = NULL;
@@ -1721,17 +2507,23 @@ static int soinfo_relocate(soinfo* si, ElfW(Rel)* rel, unsigned count, soinfo* n
               // ARC MOD END
               // ARC MOD BEGIN
               // Then look up the symbol following Android's default
-              // semantics.
-              s = soinfo_do_lookup(si, sym_name, &lsi, needed);
-              // When the symbol is not found, we still need to
-              // look up the main binary, as we link some shared
-              // objects (e.g., liblog.so) into arc.nexe
-              // TODO(crbug.com/400947): Remove this code once we have
-              // stopped converting .so files to .a.
-              if (!s)
-                  s = soinfo_do_lookup(somain, sym_name, &lsi, needed);
+              // semantics unless the result is cached.
+              if (!symbol_cache->Get(sym, &s, &lsi)) {
+                  s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+                  // When the symbol is not found, we still need to
+                  // look up the main binary, as we link some shared
+                  // objects (e.g., liblog.so) into arc.nexe
+                  // TODO(crbug.com/400947): Remove this code once we have
+                  // stopped converting .so files to .a.
+                  if (!s)
+                      s = soinfo_do_lookup(somain, sym_name, &lsi, needed);
+                  symbol_cache->Put(sym, s, lsi);
+              }
 #else
-              s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+              if (!symbol_cache->Get(sym, &s, &lsi)) {
+                  s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+                  symbol_cache->Put(sym, s, lsi);
+              }
 #endif
             }
             // ARC MOD END
@@ -1947,6 +2739,7 @@ void __inject_arc_linker_hooks(__arc_linker_hooks* hooks) {
 
   g_resolve_symbol = hooks->resolve_symbol;
   g_is_statically_linked = hooks->is_statically_linked;
+  g_run_in_parallel = hooks->run_in_parallel;
   __nacl_irt_close = hooks->nacl_irt_close;
   __nacl_irt_mmap = hooks->nacl_irt_mmap;
   __nacl_irt_munmap = hooks->nacl_irt_munmap;
@@ -2337,6 +3130,35 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
             si->bucket = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr + 8);
             si->chain = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr + 8 + si->nbucket * 4);
             break;
+        // ARC MOD BEGIN
+        // Support DT_GNU_HASH. The table starts with a header of four
+        // words (nbucket, symndx, maskwords, shift2), followed by the
+        // bloom filter, the buckets, and the chain for the symbols from
+        // symndx.
+        case DT_GNU_HASH:
+            {
+                uint32_t* header = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr);
+                si->gnu_nbucket = header[0];
+                uint32_t symndx = header[1];
+                si->gnu_maskwords = header[2];
+                si->gnu_shift2 = header[3];
+                si->gnu_bloom_filter = reinterpret_cast<ElfW(Addr)*>(base + d->d_un.d_ptr + 16);
+                si->gnu_bucket = reinterpret_cast<uint32_t*>(si->gnu_bloom_filter + si->gnu_maskwords);
+                // The chain is indexed by the symbol index, but its first
+                // entry is for |symndx|.
+                si->gnu_chain = si->gnu_bucket + si->gnu_nbucket - symndx;
+
+                if (si->gnu_maskwords == 0 ||
+                    (si->gnu_maskwords & (si->gnu_maskwords - 1)) != 0) {
+                    DL_ERR("invalid maskwords for gnu_hash = 0x%x, in \"%s\" expecting power of two",
+                           si->gnu_maskwords, si->name);
+                    return false;
+                }
+                --si->gnu_maskwords;
+                si->flags |= FLAG_GNU_HASH;
+            }
+            break;
+        // ARC MOD END
         case DT_STRTAB:
             si->strtab = reinterpret_cast<const char*>(base + d->d_un.d_ptr);
             break;
@@ -2546,10 +3368,20 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         DL_ERR("linker cannot have DT_NEEDED dependencies on other libraries");
         return false;
     }
-    if (si->nbucket == 0) {
-        DL_ERR("empty/missing DT_HASH in \"%s\" (built with --hash-style=gnu?)", si->name);
+    // ARC MOD BEGIN
+    // Accept libraries which have only DT_GNU_HASH.
+    if (si->nbucket == 0 && si->gnu_nbucket == 0) {
+        DL_ERR("empty/missing DT_HASH/DT_GNU_HASH in \"%s\" "
+               "(new hash type from the future?)", si->name);
         return false;
     }
+    if ((si->flags & FLAG_GNU_HASH) != 0 && si->nbucket == 0) {
+        // Some code, such as dladdr and the symbol lookup cache,
+        // iterates over the symbol table using the number of the symbols
+        // in DT_HASH. Compute it from DT_GNU_HASH instead.
+        si->nchain = soinfo_gnu_symbol_count(si);
+    }
+    // ARC MOD END
     if (si->strtab == 0) {
         DL_ERR("empty/missing DT_STRTAB in \"%s\"", si->name);
         return false;
@@ -2577,6 +3409,10 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
 
     soinfo** needed = reinterpret_cast<soinfo**>(alloca((1 + needed_count) * sizeof(soinfo*)));
     soinfo** pneeded = needed;
+    // ARC MOD BEGIN
+    // Map the DT_NEEDED libraries in parallel if enabled.
+    ScopedLibraryPrefetcher prefetcher(si, needed_count);
+    // ARC MOD END
 
     for (ElfW(Dyn)* d = si->dynamic; d->d_tag != DT_NULL; ++d) {
         if (d->d_tag == DT_NEEDED) {
@@ -2634,6 +3470,24 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
     }
 #endif
 
+    // ARC MOD BEGIN
+    // Share the symbol lookup results between the PLT relocations and
+    // the other relocations. Also replay the results of the previous
+    // loads if the relocation cache is enabled.
+    SymbolLookupCache symbol_cache(si);
+    soinfo* relocation_cache_scope[kRelocationCacheMaxScope];
+    size_t relocation_cache_scope_count = 0;
+    char relocation_cache_path[512];
+    if (g_relocation_cache_dir != NULL && !relocating_linker &&
+        get_relocation_cache_path(si, relocation_cache_path, sizeof(relocation_cache_path))) {
+        relocation_cache_scope_count =
+            get_relocation_cache_scope(si, needed, relocation_cache_scope);
+        if (relocation_cache_scope_count) {
+            symbol_cache.LoadFromFile(relocation_cache_path, relocation_cache_scope,
+                                      relocation_cache_scope_count);
+        }
+    }
+    // ARC MOD END
 #if defined(USE_RELA)
     if (si->plt_rela != NULL) {
         // ARC MOD BEGIN
@@ -2641,7 +3495,10 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         ScopedElapsedTimePrinter<__LINE__> printer("Relocated plt symbols for", si->name);
         // ARC MOD END
         DEBUG("[ relocating %s plt ]\n", si->name);
-        if (soinfo_relocate(si, si->plt_rela, si->plt_rela_count, needed)) {
+        // ARC MOD BEGIN
+        // Pass |symbol_cache|.
+        if (soinfo_relocate(si, si->plt_rela, si->plt_rela_count, needed, &symbol_cache)) {
+        // ARC MOD END
             return false;
         }
     }
@@ -2651,7 +3508,10 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         ScopedElapsedTimePrinter<__LINE__> printer("Relocated symbols for", si->name);
         // ARC MOD END
         DEBUG("[ relocating %s ]\n", si->name);
-        if (soinfo_relocate(si, si->rela, si->rela_count, needed)) {
+        // ARC MOD BEGIN
+        // Pass |symbol_cache|.
+        if (soinfo_relocate(si, si->rela, si->rela_count, needed, &symbol_cache)) {
+        // ARC MOD END
             return false;
         }
     }
@@ -2662,7 +3522,10 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         ScopedElapsedTimePrinter<__LINE__> printer("Relocated plt symbols for", si->name);
         // ARC MOD END
         DEBUG("[ relocating %s plt ]", si->name);
-        if (soinfo_relocate(si, si->plt_rel, si->plt_rel_count, needed)) {
+        // ARC MOD BEGIN
+        // Pass |symbol_cache|.
+        if (soinfo_relocate(si, si->plt_rel, si->plt_rel_count, needed, &symbol_cache)) {
+        // ARC MOD END
             return false;
         }
     }
@@ -2672,12 +3535,23 @@ static bool soinfo_link_image(soinfo* si, const android_dlextinfo* extinfo) {
         ScopedElapsedTimePrinter<__LINE__> printer("Relocated symbols for", si->name);
         // ARC MOD END
         DEBUG("[ relocating %s ]", si->name);
-        if (soinfo_relocate(si, si->rel, si->rel_count, needed)) {
+        // ARC MOD BEGIN
+        // Pass |symbol_cache|.
+        if (soinfo_relocate(si, si->rel, si->rel_count, needed, &symbol_cache)) {
+        // ARC MOD END
             return false;
         }
     }
 #endif
 
+    // ARC MOD BEGIN
+    // Record the lookup results if any symbol was looked up.
+    if (relocation_cache_scope_count && symbol_cache.miss_count()) {
+        symbol_cache.SaveToFile(relocation_cache_path, relocation_cache_scope,
+                                relocation_cache_scope_count);
+    }
+    // ARC MOD END
+
 #if defined(__mips__)
     if (!mips_relocate_got(si, needed)) {
         return false;
@@ -2953,6 +3827,17 @@ static ElfW(Addr) __linker_init_post_relocation(KernelArgumentBlock& args, ElfW(
     if (LD_DEBUG != NULL) {
       g_ld_debug_verbosity = atoi(LD_DEBUG);
     }
+    // ARC MOD BEGIN
+    // Allow disabling the symbol lookup cache to compare the results.
+    if (linker_env_get("LD_DISABLE_SYMBOL_CACHE") != NULL) {
+      g_symbol_cache_enabled = false;
+    }
+    g_relocation_cache_dir = linker_env_get("LD_RELOCATION_CACHE");
+    const char* parallel_load = linker_env_get("LD_PARALLEL_LOAD");
+    if (parallel_load != NULL) {
+      g_parallel_load_threads = atoi(parallel_load);
+    }
+    // ARC MOD END
 
     // Normally, these are cleaned by linker_env_init, but the test
     // doesn't cost us anything.
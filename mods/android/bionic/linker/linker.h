@@ -99,6 +99,10 @@
 #define FLAG_LINKED     0x00000001
 #define FLAG_EXE        0x00000004 // The main executable
 #define FLAG_LINKER     0x00000010 // The linker itself
+// ARC MOD BEGIN
+// Add a flag for libraries which have DT_GNU_HASH.
+#define FLAG_GNU_HASH   0x00000040 // uses gnu hash
+// ARC MOD END
 #define FLAG_NEW_SOINFO 0x40000000 // new soinfo format
 
 #define SOINFO_NAME_LEN 128
@@ -235,6 +239,17 @@ struct soinfo {
   // A flag to distinguish NDK libraries.
   bool is_ndk;
   // ARC MOD END
+  // ARC MOD BEGIN
+  // Support DT_GNU_HASH. These are valid only when FLAG_GNU_HASH is set
+  // in |flags|. |gnu_maskwords| is the number of the bloom filter words
+  // minus one so it can be used as a mask.
+  size_t gnu_nbucket;
+  uint32_t* gnu_bucket;
+  uint32_t* gnu_chain;
+  uint32_t gnu_maskwords;
+  uint32_t gnu_shift2;
+  ElfW(Addr)* gnu_bloom_filter;
+  // ARC MOD END
   void CallConstructors();
   void CallDestructors();
   void CallPreInitConstructors();
@@ -133,6 +133,10 @@ static bool __is_unsafe_environment_variable(const char* name) {
       "LD_ORIGIN_PATH",
       "LD_PRELOAD",
       "LD_PROFILE",
+      // ARC MOD BEGIN
+      // The relocation cache makes the linker read and write files.
+      "LD_RELOCATION_CACHE",
+      // ARC MOD END
       "LD_SHOW_AUXV",
       "LD_USE_LOAD_BIAS",
       "LOCALDOMAIN",
@@ -227,7 +227,9 @@ TEST(dlfcn, dladdr_invalid) {
   ASSERT_TRUE(dlerror() == NULL); // dladdr(3) doesn't set dlerror(3).
 }
 
-// Our dynamic linker doesn't support GNU hash tables.
+// ARC MOD BEGIN
+// Our dynamic linker supports GNU hash tables.
+// ARC MOD END
 #if defined(__BIONIC__)
 // GNU-style ELF hash tables are incompatible with the MIPS ABI.
 // MIPS requires .dynsym to be sorted to match the GOT but GNU-style requires sorting by hash code.
@@ -235,8 +237,13 @@ TEST(dlfcn, dladdr_invalid) {
 TEST(dlfcn, dlopen_library_with_only_gnu_hash) {
   dlerror(); // Clear any pending errors.
   void* handle = dlopen("no-elf-hash-table-library.so", RTLD_NOW);
-  ASSERT_TRUE(handle == NULL);
-  ASSERT_STREQ("dlopen failed: empty/missing DT_HASH in \"no-elf-hash-table-library.so\" (built with --hash-style=gnu?)", dlerror());
+  // ARC MOD BEGIN
+  // The library is loaded and its symbol table can be searched.
+  ASSERT_TRUE(handle != NULL) << dlerror();
+  ASSERT_TRUE(dlsym(handle, "this_symbol_does_not_exist") == NULL);
+  ASSERT_TRUE(dlerror() != NULL);
+  ASSERT_EQ(0, dlclose(handle));
+  // ARC MOD END
 }
 #endif
 #endif
@@ -0,0 +1,99 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Tests for the userspace clock in libc/arch-nacl/syscalls/nacl_fast_clock.c.
+
+#if defined(__native_client__)
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+namespace {
+
+const long long kNsecPerSec = 1000000000LL;
+
+long long ToNs(const struct timespec& ts) {
+  return ts.tv_sec * kNsecPerSec + ts.tv_nsec;
+}
+
+long long GetMonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ToNs(ts);
+}
+
+// The largest time which any thread has got from CLOCK_MONOTONIC.
+long long g_latest_ns;
+
+// Reads CLOCK_MONOTONIC for |arg| milliseconds, and checks that the clock
+// never goes back from the time any thread got, including this one. Returns
+// non-NULL if it does.
+void* CheckMonotonic(void* arg) {
+  const long long end = GetMonotonicNs() + *static_cast<int*>(arg) *
+      1000000LL;
+  for (;;) {
+    long long latest = __sync_fetch_and_add(&g_latest_ns, 0);
+    const long long now = GetMonotonicNs();
+    if (now < latest)
+      return reinterpret_cast<void*>(1);
+    while (now > latest) {
+      const long long prev =
+          __sync_val_compare_and_swap(&g_latest_ns, latest, now);
+      if (prev == latest)
+        break;
+      latest = prev;
+    }
+    if (now >= end)
+      return NULL;
+  }
+}
+
+}  // namespace
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(fast_clock, QEMU_DISABLED_monotonic) {
+  static const size_t kNumThreads = 4;
+  // This spans the calibration and the first recalibration of the userspace
+  // clock, which happens after a second.
+  int milliseconds = 1200;
+  pthread_t threads[kNumThreads];
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, CheckMonotonic,
+                                &milliseconds));
+  }
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    void* result;
+    ASSERT_EQ(0, pthread_join(threads[i], &result));
+    EXPECT_TRUE(result == NULL);
+  }
+}
+
+TEST(fast_clock, realtime) {
+  // CLOCK_REALTIME, gettimeofday, and time() should agree with each other.
+  struct timespec ts;
+  struct timeval tv;
+  ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &ts));
+  ASSERT_EQ(0, gettimeofday(&tv, NULL));
+  const long long ts_us = ToNs(ts) / 1000;
+  const long long tv_us = tv.tv_sec * 1000000LL + tv.tv_usec;
+  EXPECT_GT(100 * 1000, llabs(tv_us - ts_us));
+  EXPECT_GE(1, time(NULL) - tv.tv_sec);
+  EXPECT_LE(0, time(NULL) - tv.tv_sec);
+}
+
+#endif  // __native_client__
@@ -0,0 +1,164 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Measures the time to dlopen a tree of NUM_LIBS synthetic shared
+// objects (see dlopen_benchmark_lib.c), once for the set built with
+// --hash-style=sysv and once for the set built with --hash-style=gnu.
+// Each set is loaded twice. Run this with LD_DISABLE_SYMBOL_CACHE=1 to see
+// the effect of the symbol lookup cache in the loader, and with
+// LD_RELOCATION_CACHE=<dir> to see the effect of replaying the lookup
+// results of the first load in the second one. In the latter case, this
+// also checks the first loads create the cache files and the second loads
+// read them back without rewriting them.
+//
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CACHE_FILES 256
+
+struct cache_file {
+  char path[512];
+  time_t mtime;
+  off_t size;
+};
+
+static long long get_time_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int run_benchmark(const char* hash_style, const char* label) {
+  char filename[64];
+  char symbol[64];
+  snprintf(filename, sizeof(filename), "libdlopen_benchmark_%s_%d.so",
+           hash_style, NUM_LIBS - 1);
+  snprintf(symbol, sizeof(symbol), "dlopen_benchmark_%d_sum", NUM_LIBS - 1);
+
+  long long start = get_time_us();
+  void* handle = dlopen(filename, RTLD_NOW);
+  long long elapsed = get_time_us() - start;
+  if (!handle) {
+    fprintf(stderr, "dlopen(%s) failed: %s\n", filename, dlerror());
+    exit(1);
+  }
+  int (*sum_func)(void) = (int (*)(void))dlsym(handle, symbol);
+  if (!sum_func) {
+    fprintf(stderr, "dlsym(%s) failed: %s\n", symbol, dlerror());
+    exit(1);
+  }
+  int sum = sum_func();
+  fprintf(stderr, "dlopen %d shared objects (--hash-style=%s, %s): %lld us\n",
+          NUM_LIBS, hash_style, label, elapsed);
+  dlclose(handle);
+  return sum;
+}
+
+// Calls |callback| for each relocation cache file in |dir|.
+static void for_each_cache_file(const char* dir,
+                                void (*callback)(const char* path)) {
+  DIR* d = opendir(dir);
+  if (!d) {
+    fprintf(stderr, "opendir(%s) failed\n", dir);
+    exit(1);
+  }
+  struct dirent* ent;
+  while ((ent = readdir(d)) != NULL) {
+    size_t len = strlen(ent->d_name);
+    if (len > 7 && !strcmp(ent->d_name + len - 7, ".relocs")) {
+      char path[512];
+      snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+      callback(path);
+    }
+  }
+  closedir(d);
+}
+
+static struct cache_file g_cache_files[MAX_CACHE_FILES];
+static int g_cache_file_count;
+
+static void remove_cache_file(const char* path) {
+  unlink(path);
+}
+
+static void record_cache_file(const char* path) {
+  struct stat st;
+  if (g_cache_file_count == MAX_CACHE_FILES || stat(path, &st) != 0) {
+    fprintf(stderr, "Cannot record the relocation cache %s\n", path);
+    exit(1);
+  }
+  struct cache_file* file = &g_cache_files[g_cache_file_count++];
+  snprintf(file->path, sizeof(file->path), "%s", path);
+  file->mtime = st.st_mtime;
+  file->size = st.st_size;
+}
+
+// Returns 1 if none of the recorded cache files has been rewritten. The
+// loader rewrites a cache file only when it could not replay it.
+static int check_cache_files_unchanged() {
+  for (int i = 0; i < g_cache_file_count; ++i) {
+    const struct cache_file* file = &g_cache_files[i];
+    struct stat st;
+    if (stat(file->path, &st) != 0 || st.st_mtime != file->mtime ||
+        st.st_size != file->size) {
+      fprintf(stderr, "The relocation cache %s was not read back\n",
+              file->path);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main() {
+  const char* cache_dir = getenv("LD_RELOCATION_CACHE");
+  // Start from an empty cache so the first loads have to create it.
+  if (cache_dir) {
+    for_each_cache_file(cache_dir, remove_cache_file);
+  }
+
+  int sysv_sum = run_benchmark("sysv", "first load");
+  int gnu_sum = run_benchmark("gnu", "first load");
+  if (sysv_sum != gnu_sum) {
+    fprintf(stderr, "Results differ: sysv=%d gnu=%d\n", sysv_sum, gnu_sum);
+    return 1;
+  }
+  if (cache_dir) {
+    for_each_cache_file(cache_dir, record_cache_file);
+    if (g_cache_file_count == 0) {
+      fprintf(stderr, "No relocation cache was created in %s\n", cache_dir);
+      return 1;
+    }
+    // Make sure a rewrite in the second loads changes the mtime.
+    sleep(1);
+  }
+  // dlclose has unloaded all shared objects, so they are loaded and
+  // relocated again.
+  if (run_benchmark("sysv", "second load") != sysv_sum ||
+      run_benchmark("gnu", "second load") != gnu_sum) {
+    fprintf(stderr, "Results differ between the first and second loads\n");
+    return 1;
+  }
+  if (cache_dir && !check_cache_files_unchanged()) {
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,86 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A synthetic shared object for dlopen_benchmark. This file is built
+// many times with -DLIB_INDEX=<n>. Each build defines its own set of
+// functions, and refers to all functions of the shared objects given by
+// -DDEP1, -DDEP2, and -DDEP3 (which are also its DT_NEEDED entries, in
+// this order) both
+// from a function table and from direct calls, so the loader resolves
+// every imported symbol more than once.
+//
+
+#define NAME(lib, suffix) NAME_(lib, suffix)
+#define NAME_(lib, suffix) dlopen_benchmark_##lib##_##suffix
+
+#define FOR_EACH_FUNC(X, lib) \
+  X(lib, 0) X(lib, 1) X(lib, 2) X(lib, 3) \
+  X(lib, 4) X(lib, 5) X(lib, 6) X(lib, 7) \
+  X(lib, 8) X(lib, 9) X(lib, 10) X(lib, 11) \
+  X(lib, 12) X(lib, 13) X(lib, 14) X(lib, 15)
+
+#define DECLARE_FUNC(lib, i) int NAME(lib, i)(int x);
+#define DEFINE_FUNC(lib, i) int NAME(lib, i)(int x) { return x * 3 + i; }
+#define TABLE_ENTRY(lib, i) &NAME(lib, i),
+#define CALL_FUNC(lib, i) sum += NAME(lib, i)(sum) & 0xff;
+
+typedef int (*benchmark_func_t)(int);
+
+FOR_EACH_FUNC(DEFINE_FUNC, LIB_INDEX)
+
+#if defined(DEP1)
+FOR_EACH_FUNC(DECLARE_FUNC, DEP1)
+int NAME(DEP1, sum)(void);
+#endif
+#if defined(DEP2)
+FOR_EACH_FUNC(DECLARE_FUNC, DEP2)
+#endif
+#if defined(DEP3)
+FOR_EACH_FUNC(DECLARE_FUNC, DEP3)
+#endif
+
+static const benchmark_func_t g_table[] = {
+  FOR_EACH_FUNC(TABLE_ENTRY, LIB_INDEX)
+#if defined(DEP1)
+  FOR_EACH_FUNC(TABLE_ENTRY, DEP1)
+#endif
+#if defined(DEP2)
+  FOR_EACH_FUNC(TABLE_ENTRY, DEP2)
+#endif
+#if defined(DEP3)
+  FOR_EACH_FUNC(TABLE_ENTRY, DEP3)
+#endif
+};
+
+// Returns a value which depends on all functions in this shared object
+// and its dependencies, so the caller can check they are all resolved.
+// This calls only the sum function of DEP1, which is the closest
+// dependency, to keep the number of calls linear.
+int NAME(LIB_INDEX, sum)(void) {
+  int sum = 0;
+  unsigned i;
+  for (i = 0; i < sizeof(g_table) / sizeof(g_table[0]); i++)
+    sum += g_table[i](sum) & 0xff;
+#if defined(DEP1)
+  FOR_EACH_FUNC(CALL_FUNC, DEP1)
+  sum += NAME(DEP1, sum)();
+#endif
+#if defined(DEP2)
+  FOR_EACH_FUNC(CALL_FUNC, DEP2)
+#endif
+#if defined(DEP3)
+  FOR_EACH_FUNC(CALL_FUNC, DEP3)
+#endif
+  return sum & 0xffff;
+}
@@ -0,0 +1,158 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Tests for the futex emulation in libc/arch-nacl/syscalls/futex.c.
+
+#if defined(__native_client__)
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private/bionic_futex.h"
+
+namespace {
+
+const size_t kNumWaiters = 64;
+
+// A minimal mutex and condition variable on top of futexes, so that the
+// broadcast can either wake all waiters or requeue them onto the mutex.
+class FutexCondition {
+ public:
+  FutexCondition() : num_waiting(0), num_done(0), mutex_(0), seq_(0) {}
+
+  void Lock() {
+    int c = __sync_val_compare_and_swap(&mutex_, 0, 1);
+    if (c != 0)
+      LockContended(c);
+  }
+
+  void Unlock() {
+    if (__sync_fetch_and_sub(&mutex_, 1) != 1) {
+      mutex_ = 0;
+      __futex_wake_ex(&mutex_, false, 1);
+    }
+  }
+
+  // Called with the mutex held.
+  void Wait(bool requeued) {
+    const int seq = seq_;
+    ++num_waiting;
+    Unlock();
+    __futex_wait_ex(&seq_, false, seq, NULL);
+    // A waiter requeued onto the mutex must lock it in the contended
+    // state, or the next unlock may not wake the other requeued waiters.
+    if (requeued)
+      LockContended(2);
+    else
+      Lock();
+  }
+
+  // Called with the mutex held.
+  void Broadcast(bool requeue) {
+    const int seq = __sync_add_and_fetch(&seq_, 1);
+    if (requeue)
+      __futex_cmp_requeue_ex(&seq_, false, 1, INT_MAX, &mutex_, seq);
+    else
+      __futex_wake_ex(&seq_, false, INT_MAX);
+  }
+
+  volatile int num_waiting;
+  volatile int num_done;
+
+ private:
+  void LockContended(int c) {
+    if (c != 2)
+      c = __sync_lock_test_and_set(&mutex_, 2);
+    while (c != 0) {
+      __futex_wait_ex(&mutex_, false, 2, NULL);
+      c = __sync_lock_test_and_set(&mutex_, 2);
+    }
+  }
+
+  volatile int mutex_;
+  volatile int seq_;
+};
+
+struct WaiterArg {
+  FutexCondition* cond;
+  bool requeue;
+};
+
+void* WaitForBroadcast(void* arg) {
+  WaiterArg* waiter_arg = static_cast<WaiterArg*>(arg);
+  FutexCondition* cond = waiter_arg->cond;
+  cond->Lock();
+  cond->Wait(waiter_arg->requeue);
+  ++cond->num_done;
+  cond->Unlock();
+  return NULL;
+}
+
+// Broadcasts to kNumWaiters waiters and checks all of them exit.
+void RunBroadcast(bool requeue) {
+  FutexCondition cond;
+  WaiterArg arg = { &cond, requeue };
+  pthread_t threads[kNumWaiters];
+  for (size_t i = 0; i < kNumWaiters; ++i)
+    EXPECT_EQ(0, pthread_create(&threads[i], NULL, WaitForBroadcast, &arg));
+  // Wait until all threads are waiting. A thread may still be between
+  // Unlock() and the futex wait, which is fine since the wait fails
+  // immediately in that case.
+  while (cond.num_waiting < static_cast<int>(kNumWaiters))
+    usleep(1000);
+  usleep(10000);
+
+  cond.Lock();
+  cond.Broadcast(requeue);
+  cond.Unlock();
+  for (size_t i = 0; i < kNumWaiters; ++i)
+    EXPECT_EQ(0, pthread_join(threads[i], NULL));
+  EXPECT_EQ(static_cast<int>(kNumWaiters), cond.num_done);
+}
+
+}  // namespace
+
+TEST(futex, cmp_requeue) {
+  int ftx = 0;
+  int ftx2 = 0;
+  // The value does not match.
+  EXPECT_EQ(-EAGAIN, __futex_cmp_requeue_ex(&ftx, false, 1, 1, &ftx2, 1));
+  // No waiters.
+  EXPECT_EQ(0, __futex_cmp_requeue_ex(&ftx, false, 1, 1, &ftx2, 0));
+}
+
+TEST(futex, wait_timeout) {
+  int ftx = 0;
+  const struct timespec timeout = { 0, 1000000 };
+  EXPECT_EQ(-ETIMEDOUT, __futex_wait_ex(&ftx, false, 0, &timeout));
+  EXPECT_EQ(-EWOULDBLOCK, __futex_wait_ex(&ftx, false, 1, &timeout));
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(futex, QEMU_DISABLED_broadcast) {
+  RunBroadcast(false);
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(futex, QEMU_DISABLED_broadcast_requeue) {
+  RunBroadcast(true);
+}
+
+#endif  // __native_client__
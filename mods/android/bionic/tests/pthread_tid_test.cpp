@@ -0,0 +1,132 @@
+// Copyright (C) 2014 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Tests for the thread ID allocator in libc/arch-nacl/syscalls/gettid.cpp.
+
+#if defined(__native_client__)
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+const size_t kNumLiveThreads = 64;
+
+pthread_mutex_t g_mu = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+bool g_release_threads;
+
+void* GetTidAndWait(void* arg) {
+  *static_cast<pid_t*>(arg) = gettid();
+  pthread_mutex_lock(&g_mu);
+  while (!g_release_threads)
+    pthread_cond_wait(&g_cond, &g_mu);
+  pthread_mutex_unlock(&g_mu);
+  return NULL;
+}
+
+void* GetTid(void* arg) {
+  *static_cast<pid_t*>(arg) = gettid();
+  return NULL;
+}
+
+void* DoNothing(void*) {
+  return NULL;
+}
+
+void* CreateAndJoinThreads(void* arg) {
+  const size_t num_threads = *static_cast<size_t*>(arg);
+  for (size_t i = 0; i < num_threads; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, DoNothing, NULL))
+      return reinterpret_cast<void*>(1);
+    if (pthread_join(thread, NULL))
+      return reinterpret_cast<void*>(1);
+  }
+  return NULL;
+}
+
+}  // namespace
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(pthread_tid, QEMU_DISABLED_unique_tids) {
+  pthread_t threads[kNumLiveThreads];
+  pid_t tids[kNumLiveThreads] = {};
+  g_release_threads = false;
+  for (size_t i = 0; i < kNumLiveThreads; ++i)
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, GetTidAndWait, &tids[i]));
+
+  // Wait until all threads have stored their thread IDs.
+  for (size_t i = 0; i < kNumLiveThreads; ++i) {
+    while (!__sync_fetch_and_add(&tids[i], 0))
+      sched_yield();
+  }
+  pthread_mutex_lock(&g_mu);
+  g_release_threads = true;
+  pthread_cond_broadcast(&g_cond);
+  pthread_mutex_unlock(&g_mu);
+  for (size_t i = 0; i < kNumLiveThreads; ++i)
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+
+  std::sort(tids, tids + kNumLiveThreads);
+  for (size_t i = 0; i < kNumLiveThreads; ++i) {
+    // TID 1 is reserved for the main thread.
+    EXPECT_LT(1, tids[i]);
+    // Bionic's mutex depends on 15 bit thread ID.
+    EXPECT_GE((1 << 15) - 1, tids[i]);
+    if (i)
+      EXPECT_NE(tids[i - 1], tids[i]);
+  }
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(pthread_tid, QEMU_DISABLED_no_immediate_reuse) {
+  // Like Linux, a thread ID should not be reused right after the thread
+  // which had it exits.
+  pthread_t thread;
+  pid_t tid1 = 0;
+  pid_t tid2 = 0;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, GetTid, &tid1));
+  ASSERT_EQ(0, pthread_join(thread, NULL));
+  ASSERT_EQ(0, pthread_create(&thread, NULL, GetTid, &tid2));
+  ASSERT_EQ(0, pthread_join(thread, NULL));
+  EXPECT_NE(tid1, tid2);
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(pthread_tid, QEMU_DISABLED_concurrent_create_join) {
+  // Thread IDs should keep being allocated while several threads create
+  // and join threads at the same time.
+  static const size_t kNumCreators = 4;
+  size_t num_threads = 100;
+  pthread_t creators[kNumCreators];
+  for (size_t i = 0; i < kNumCreators; ++i) {
+    ASSERT_EQ(0, pthread_create(&creators[i], NULL, CreateAndJoinThreads,
+                                &num_threads));
+  }
+  for (size_t i = 0; i < kNumCreators; ++i) {
+    void* result;
+    ASSERT_EQ(0, pthread_join(creators[i], &result));
+    EXPECT_TRUE(result == NULL);
+  }
+}
+
+#endif  // __native_client__
@@ -392,6 +392,77 @@ TEST(properties, wait) {
 #endif // __BIONIC__
 }
 
+/* ARC MOD BEGIN */
+TEST(properties, find_after_add) {
+#if defined(__BIONIC__)
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+
+    // A cached lookup failure must not hide a property added later.
+    ASSERT_EQ((const prop_info *)NULL, __system_property_find("property"));
+    ASSERT_EQ((const prop_info *)NULL, __system_property_find("property"));
+    ASSERT_EQ(0, __system_property_add("property", 8, "value1", 6));
+    const prop_info *pi = __system_property_find("property");
+    ASSERT_NE((const prop_info *)NULL, pi);
+    ASSERT_EQ(pi, __system_property_find("property"));
+
+    // A cached lookup must not return a property of another area.
+    {
+        LocalPropertyTestState pa2;
+        ASSERT_TRUE(pa2.valid);
+        ASSERT_EQ((const prop_info *)NULL, __system_property_find("property"));
+    }
+    ASSERT_EQ(pi, __system_property_find("property"));
+
+    // The snapshot for find_nth must follow additions too.
+    ASSERT_EQ(pi, __system_property_find_nth(0));
+    ASSERT_EQ((const prop_info *)NULL, __system_property_find_nth(1));
+    ASSERT_EQ(0, __system_property_add("other_property", 14, "value2", 6));
+    ASSERT_NE((const prop_info *)NULL, __system_property_find_nth(1));
+#else // __BIONIC__
+    GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif // __BIONIC__
+}
+
+TEST(properties, find_many) {
+#if defined(__BIONIC__)
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+
+    // Fill the area with properties whose names look like real ones.
+    static const int kNumProperties = 200;
+    static const char* const kPrefixes[] = {
+        "ro.build", "ro.product", "debug.sf", "persist.sys", "dalvik.vm"
+    };
+    for (int i = 0; i < kNumProperties; i++) {
+        char name[PROP_NAME_MAX];
+        char value[PROP_VALUE_MAX];
+        const int name_len = snprintf(name, PROP_NAME_MAX, "%s.property%d",
+                                      kPrefixes[i % 5], i);
+        const int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+        ASSERT_EQ(0, __system_property_add(name, name_len, value, value_len));
+    }
+
+    // Repeated lookups are served from the cache and must keep returning
+    // the same results.
+    for (int i = 0; i < 3; i++) {
+        char value[PROP_VALUE_MAX];
+        ASSERT_EQ(8, __system_property_get("ro.build.property100", value));
+        ASSERT_STREQ("value100", value);
+        ASSERT_EQ(0, __system_property_get("debug.sf.nonexistent", value));
+        ASSERT_STREQ("", value);
+    }
+
+    int count = 0;
+    while (__system_property_find_nth(count))
+        count++;
+    ASSERT_EQ(kNumProperties, count);
+#else // __BIONIC__
+    GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif // __BIONIC__
+}
+
+/* ARC MOD END */
 class KilledByFault {
     public:
         explicit KilledByFault() {};
@@ -20,6 +20,7 @@
 #include <GLES2/gl2.h>
 
 #include "common/alog.h"
+#include "common/memory_counters.h"
 #include "common/shared_object_tracker.h"
 #include "graphics_translation/egl/color_buffer.h"
 #include "graphics_translation/egl/egl_display_impl.h"
@@ -133,8 +134,12 @@ GraphicsBuffer::~GraphicsBuffer() {
   Release();
   SetObjectTrackingHandle(0);
 
-  delete[] sw_buffer_;
-  sw_buffer_ = NULL;
+  if (sw_buffer_) {
+    delete[] sw_buffer_;
+    sw_buffer_ = NULL;
+    arc::MemoryCounters::Add(arc::MemoryCounters::kGrallocBytes,
+                             -static_cast<int64_t>(sw_buffer_size_));
+  }
 
   // Clear out some of the fields to help ensure we are only ever accessing valid
   // GraphicsBuffer objects.
@@ -218,6 +223,8 @@ int GraphicsBuffer::Lock(int usage, int left, int top, int width, int height,
   } else if (CanBePosted() || request_read || request_write) {
     if (sw_buffer_ == NULL && sw_buffer_size_ > 0) {
       sw_buffer_ = new uint8_t[sw_buffer_size_];
+      arc::MemoryCounters::Add(arc::MemoryCounters::kGrallocBytes,
+                               sw_buffer_size_);
     }
     // Read ColorBuffer content for read-only access. This is made to support
     // screen capture that accesses this graphics buffer for reading only
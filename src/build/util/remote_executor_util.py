@@ -111,6 +111,8 @@ _UNITTEST_GLOB_TEMPLATE_LIST = [
     '{out}/target/{target}/intermediates/stlport_unittest/win32_file_format.tmp',  # NOQA
     '{out}/target/{target}/lib',
     '{out}/target/{target}/posix_translation_fs_images/test_readonly_fs_image.img',  # NOQA
+    '{out}/target/{target}/posix_translation_fs_images/test_readonly_fs_image_v1.img',  # NOQA
+    '{out}/target/{target}/posix_translation_fs_images/test_readonly_fs_image_compressed.img',  # NOQA
     '{out}/target/{target}/root/system/framework/art-gtest-*.jar',
     '{out}/target/{target}/root/system/framework/core-libart.jar',
     # Used by posix_translation_test
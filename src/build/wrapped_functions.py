@@ -112,6 +112,8 @@ def get_wrapped_functions():
                        'sched_setscheduler',
                        'select',
                        'send',
+                       'sendfile',
+                       'sendfile64',
                        'sendmsg',
                        'sendto',
                        'setegid',
@@ -130,6 +132,7 @@ def get_wrapped_functions():
                        'sigsuspend',
                        'socket',
                        'socketpair',
+                       'splice',
                        'statfs',
                        'statvfs',
                        'symlink',
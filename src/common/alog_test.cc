@@ -4,12 +4,26 @@
 //
 // Tests for logging functionality.
 
+#include <string>
+
 #include "common/alog.h"
+#include "common/log_ring_buffer.h"
+#include "common/logd_write.h"
 #include "common/options.h"
 #include "gtest/gtest.h"
 
 namespace arc {
 
+namespace {
+
+std::string* g_written_log;
+
+void AppendToWrittenLog(const void* buf, size_t count) {
+  g_written_log->append(static_cast<const char*>(buf), count);
+}
+
+}  // namespace
+
 TEST(LogTest, ALOG_ASSERT_false) {
   ALOG_ASSERT(true, "Should not have fired");
 }
@@ -18,4 +32,24 @@ TEST(LogTest, DirectLogs) {
   ALOG(LOG_WARN, "MyOwnTag2", "ALOG message");
 }
 
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(LogTest, QEMU_DISABLED_BufferedLog) {
+  std::string written_log;
+  g_written_log = &written_log;
+  SetLogWriter(&AppendToWrittenLog);
+  const std::string long_log(LogRingBuffer::kMaxEntrySize + 1, 'x');
+  StartBufferedLog();
+  WriteLog("buffered 1\n");
+  WriteLog(long_log);
+  WriteLog("buffered 2\n");
+  StopBufferedLog();
+  SetLogWriter(NULL);
+  g_written_log = NULL;
+
+  // The long message is written synchronously after the buffered one.
+  EXPECT_EQ("buffered 1\n" + long_log + "buffered 2\n", written_log);
+  EXPECT_EQ(0U, GetDroppedLogCount());
+}
+
 }  // namespace arc
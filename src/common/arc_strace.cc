@@ -209,9 +209,11 @@ class ArcStrace {
     // bug is fixed.
     ThreadID tid = g_thread_id_manager->Get();
     char buf[256];
-    base::strings::SafeSPrintf(buf, LOG_PREFIX "%s%5d ! ARC crashed\n",
-                               g_plugin_type_prefix, tid);
-    arc::WriteLog(buf);
+    const ssize_t len = base::strings::SafeSPrintf(
+        buf, LOG_PREFIX "%s%5d ! ARC crashed\n", g_plugin_type_prefix, tid);
+    // Use the char* version to avoid calling into malloc.
+    if (len > 0)
+      arc::WriteLog(buf, len);
   }
 
   void Report(const char* format, va_list ap) {
@@ -617,6 +619,7 @@ void StraceReportHandler(const char* handler_name) {
 void StraceReportCrash() {
   // Calling ALOG_ASSERT after crash does not make sense.
   g_arc_strace->ReportCrash();
+  FlushBufferedLog();
 }
 
 void StraceReport(const char* format, ...) {
@@ -42,6 +42,7 @@
 #include <vector>
 
 #include "common/alog.h"
+#include "common/logd_write.h"
 
 struct nacl_abi_stat;
 
@@ -225,9 +226,11 @@ int64_t GetMedian(std::vector<int64_t>* samples);
 
 // ARC_STRACE_REPORT_CRASH()
 //
-// Record the thread number that crashed. This macro never calls
+// Record the thread number that crashed, and write the messages left in
+// the buffered log even when ARC strace is disabled. This macro never calls
 // malloc which might not always be safe to call after crash.
 # define ARC_STRACE_REPORT_CRASH() do {                               \
+    arc::FlushBufferedLog();                                          \
     if (arc::StraceEnabled())                                         \
       arc::StraceReportCrash();                                       \
   } while (0)
@@ -0,0 +1,45 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Loads and stores for the variables which are shared between threads
+// without a lock. Like the rest of the tree, these are built on the __sync
+// builtins.
+
+#ifndef COMMON_ATOMICS_H_
+#define COMMON_ATOMICS_H_
+
+namespace arc {
+
+// Returns |*ptr|. The loads and stores after this are not reordered before
+// it.
+template <typename T>
+inline T AcquireLoad(const T* ptr) {
+  static_assert(sizeof(T) <= sizeof(void*),
+                "A plain load of T may not be atomic");
+  const T value = *const_cast<const volatile T*>(ptr);
+  __sync_synchronize();
+  return value;
+}
+
+// Sets |*ptr| to |value|. The loads and stores before this are not reordered
+// after it.
+template <typename T>
+inline void ReleaseStore(T* ptr, T value) {
+  static_assert(sizeof(T) <= sizeof(void*),
+                "A plain store of T may not be atomic");
+  __sync_synchronize();
+  *const_cast<volatile T*>(ptr) = value;
+}
+
+// Returns the 64-bit counter |*ptr|, which is only updated with the __sync
+// builtins. A plain 64-bit load is not atomic on 32-bit targets.
+template <typename T>
+inline T AtomicLoad64(const T* ptr) {
+  static_assert(sizeof(T) == 8, "T must be a 64-bit type");
+  return __sync_fetch_and_add(const_cast<T*>(ptr), 0);
+}
+
+}  // namespace arc
+
+#endif  // COMMON_ATOMICS_H_
@@ -7,9 +7,11 @@
 #include <irt_syscalls.h>
 #include <private/dl_dst_lib.h>
 #include <private/inject_arc_linker_hooks.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
 #include <string>
+#include <vector>
 
 #include "base/containers/hash_tables.h"
 #include "base/strings/string_split.h"
@@ -18,6 +20,12 @@
 #include "common/ndk_support/syscall.h"
 #include "common/wrapped_functions.h"
 
+extern "C" int __real_pthread_create(
+    pthread_t* thread_out,
+    pthread_attr_t const* attr,
+    void* (*start_routine)(void*),  // NOLINT(readability/casting)
+    void* arg);
+
 namespace arc {
 
 namespace {
@@ -49,6 +57,37 @@ int __nacl_irt_munmap_posix_translation(void* addr, size_t len) {
   return 0;
 }
 
+struct ParallelTask {
+  void (*func)(void*);
+  void* arg;
+};
+
+void* RunParallelTask(void* arg) {
+  ParallelTask* task = static_cast<ParallelTask*>(arg);
+  task->func(task->arg);
+  return NULL;
+}
+
+// Runs |func| on |num_threads| threads for the Bionic loader, which cannot
+// create threads by itself. The loader calls this while it holds its
+// mutex, so the threads must not call dlopen or dlsym. We use
+// __real_pthread_create not to register the short-lived threads to
+// ProcessEmulator. As |func| takes work items from a shared queue, it is
+// fine to run it on fewer threads when pthread_create fails.
+void RunInParallel(void (*func)(void*), void* arg, int num_threads) {
+  ParallelTask task = { func, arg };
+  std::vector<pthread_t> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    pthread_t thread;
+    if (__real_pthread_create(&thread, NULL, RunParallelTask, &task) != 0)
+      break;
+    threads.push_back(thread);
+  }
+  func(arg);
+  for (size_t i = 0; i < threads.size(); ++i)
+    pthread_join(threads[i], NULL);
+}
+
 }  // namespace
 
 void InitDlfcnInjection() {
@@ -97,6 +136,7 @@ void InitDlfcnInjection() {
     __nacl_irt_read,
     __nacl_irt_write,
     __nacl_irt_fstat,
+    RunInParallel,
   };
   __inject_arc_linker_hooks(&hooks);
 }
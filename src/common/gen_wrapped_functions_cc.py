@@ -35,6 +35,7 @@ _WRAPPED_FUNCTIONS_CC_TEMPLATE = string.Template("""
 #include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
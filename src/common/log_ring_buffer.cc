@@ -0,0 +1,86 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// This is a bounded multi-producer queue where each entry has a sequence
+// number telling whether it is free or filled for the current lap, so that
+// producers only need a compare-and-swap on |push_position_| to reserve an
+// entry.
+
+#include "common/log_ring_buffer.h"
+
+#include <string.h>
+
+#include "common/alog.h"
+#include "common/atomics.h"
+
+namespace arc {
+
+const size_t LogRingBuffer::kNumEntries;
+const size_t LogRingBuffer::kMaxEntrySize;
+
+LogRingBuffer::LogRingBuffer()
+    : push_position_(0), pop_position_(0), dropped_count_(0) {
+  static_assert((kNumEntries & (kNumEntries - 1)) == 0,
+                "kNumEntries must be a power of two");
+  for (size_t i = 0; i < kNumEntries; ++i) {
+    entries_[i].sequence = i;
+    entries_[i].size = 0;
+  }
+}
+
+LogRingBuffer::~LogRingBuffer() {
+}
+
+bool LogRingBuffer::Push(int priority, const char* log, size_t size) {
+  ALOG_ASSERT(size <= kMaxEntrySize);
+  uint32_t position = AcquireLoad(&push_position_);
+  Entry* entry;
+  for (;;) {
+    entry = &entries_[position & (kNumEntries - 1)];
+    const int32_t diff =
+        static_cast<int32_t>(AcquireLoad(&entry->sequence) - position);
+    if (diff < 0 ||
+        (priority < ANDROID_LOG_WARN &&
+         position - AcquireLoad(&pop_position_) >= kNumEntries * 3 / 4)) {
+      __sync_fetch_and_add(&dropped_count_, 1);
+      return false;
+    }
+    if (diff == 0 &&
+        __sync_bool_compare_and_swap(&push_position_, position,
+                                     position + 1)) {
+      break;
+    }
+    // Another thread has taken the entry.
+    position = AcquireLoad(&push_position_);
+  }
+  memcpy(entry->log, log, size);
+  entry->size = size;
+  ReleaseStore(&entry->sequence, position + 1);
+  return true;
+}
+
+size_t LogRingBuffer::Pop(char* out, size_t out_size) {
+  size_t written = 0;
+  for (;;) {
+    const uint32_t position = pop_position_;
+    Entry* entry = &entries_[position & (kNumEntries - 1)];
+    if (AcquireLoad(&entry->sequence) != position + 1)
+      break;  // Empty, or the producer has not finished copying yet.
+    if (written + entry->size > out_size)
+      break;
+    memcpy(out + written, entry->log, entry->size);
+    written += entry->size;
+    // Let producers reuse the entry for the next lap.
+    ReleaseStore(&entry->sequence,
+                 static_cast<uint32_t>(position + kNumEntries));
+    ReleaseStore(&pop_position_, position + 1);
+  }
+  return written;
+}
+
+uint64_t LogRingBuffer::dropped_count() const {
+  return AtomicLoad64(&dropped_count_);
+}
+
+}  // namespace arc
@@ -0,0 +1,61 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_LOG_RING_BUFFER_H_
+#define COMMON_LOG_RING_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/private/minimal_base.h"
+
+namespace arc {
+
+// Bounded queue of formatted log lines. Any number of threads can call Push()
+// concurrently without locking. Pop() must be called by one thread at a time.
+// Neither function allocates memory, so Pop() can be used in a crash handler.
+class LogRingBuffer {
+ public:
+  static const size_t kNumEntries = 512;
+  static const size_t kMaxEntrySize = 500;
+
+  LogRingBuffer();
+  ~LogRingBuffer();
+
+  // Copies the |size| bytes of |log| into the buffer. Returns false if it is
+  // dropped. Lines with a priority lower than ANDROID_LOG_WARN are dropped
+  // once the buffer is 3/4 full so that more important lines still fit, and
+  // all lines are dropped when it is full. |size| must not be larger than
+  // kMaxEntrySize.
+  bool Push(int priority, const char* log, size_t size);
+
+  // Moves as many whole lines as fit in |out_size| bytes to |out|, oldest
+  // first, and returns the number of bytes written.
+  size_t Pop(char* out, size_t out_size);
+
+  // Returns the number of lines dropped by Push() so far.
+  uint64_t dropped_count() const;
+
+ private:
+  struct Entry {
+    // Equals the position of the entry when it is ready to be pushed, and
+    // the position plus one when it is ready to be popped.
+    uint32_t sequence;
+    uint32_t size;
+    char log[kMaxEntrySize];
+  };
+
+  Entry entries_[kNumEntries];
+  // Only incremented by Push().
+  uint32_t push_position_;
+  // Only incremented by Pop().
+  uint32_t pop_position_;
+  uint64_t dropped_count_;
+
+  COMMON_DISALLOW_COPY_AND_ASSIGN(LogRingBuffer);
+};
+
+}  // namespace arc
+
+#endif  // COMMON_LOG_RING_BUFFER_H_
@@ -0,0 +1,107 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <string>
+
+#include "base/memory/scoped_ptr.h"
+#include "common/alog.h"
+#include "common/log_ring_buffer.h"
+#include "gtest/gtest.h"
+
+namespace arc {
+
+namespace {
+
+const int kLinesPerThread = 1000;
+
+bool PushString(LogRingBuffer* buffer, int priority, const std::string& str) {
+  return buffer->Push(priority, str.c_str(), str.size());
+}
+
+std::string PopString(LogRingBuffer* buffer, size_t size) {
+  std::string result(size, '\0');
+  result.resize(buffer->Pop(&result[0], size));
+  return result;
+}
+
+void* PushLines(void* data) {
+  LogRingBuffer* buffer = static_cast<LogRingBuffer*>(data);
+  for (int i = 0; i < kLinesPerThread; ++i) {
+    while (!PushString(buffer, ANDROID_LOG_ERROR, "line\n"))
+      sched_yield();
+  }
+  return NULL;
+}
+
+}  // namespace
+
+TEST(LogRingBufferTest, PushAndPop) {
+  // Too large for the stack.
+  scoped_ptr<LogRingBuffer> buffer(new LogRingBuffer);
+  EXPECT_EQ("", PopString(buffer.get(), 100));
+  EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_INFO, "abc\n"));
+  EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_INFO, "de\n"));
+  EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_INFO, ""));
+  EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_INFO, "f\n"));
+  // Only whole lines are popped.
+  EXPECT_EQ("abc\n", PopString(buffer.get(), 6));
+  EXPECT_EQ("de\nf\n", PopString(buffer.get(), 100));
+  EXPECT_EQ("", PopString(buffer.get(), 100));
+  EXPECT_EQ(0U, buffer->dropped_count());
+
+  const std::string max_line(LogRingBuffer::kMaxEntrySize, 'x');
+  EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_INFO, max_line));
+  EXPECT_EQ(max_line, PopString(buffer.get(), LogRingBuffer::kMaxEntrySize));
+}
+
+TEST(LogRingBufferTest, DropByPriority) {
+  scoped_ptr<LogRingBuffer> buffer(new LogRingBuffer);
+  const size_t kHighWaterMark = LogRingBuffer::kNumEntries * 3 / 4;
+  for (size_t i = 0; i < kHighWaterMark; ++i)
+    EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_VERBOSE, "v"));
+  EXPECT_FALSE(PushString(buffer.get(), ANDROID_LOG_INFO, "i"));
+  EXPECT_EQ(1U, buffer->dropped_count());
+
+  for (size_t i = kHighWaterMark; i < LogRingBuffer::kNumEntries; ++i)
+    EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_WARN, "w"));
+  EXPECT_FALSE(PushString(buffer.get(), ANDROID_LOG_FATAL, "f"));
+  EXPECT_EQ(2U, buffer->dropped_count());
+
+  // Popping makes room again, and the entries are reused.
+  const std::string popped = PopString(buffer.get(), 10000);
+  EXPECT_EQ(LogRingBuffer::kNumEntries, popped.size());
+  EXPECT_EQ(std::string(kHighWaterMark, 'v'),
+            popped.substr(0, kHighWaterMark));
+  EXPECT_TRUE(PushString(buffer.get(), ANDROID_LOG_INFO, "i"));
+  EXPECT_EQ("i", PopString(buffer.get(), 10000));
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(LogRingBufferTest, QEMU_DISABLED_Threads) {
+  static const int kNumThreads = 4;
+  scoped_ptr<LogRingBuffer> buffer(new LogRingBuffer);
+  pthread_t threads[kNumThreads];
+  for (int i = 0; i < kNumThreads; ++i)
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, &PushLines, buffer.get()));
+
+  // Pop on this thread while the others are pushing.
+  size_t total = 0;
+  char out[1024];
+  while (total < kNumThreads * kLinesPerThread * 5U) {
+    const size_t size = buffer->Pop(out, sizeof(out));
+    for (size_t i = 0; i < size; i += 5)
+      ASSERT_EQ(0, memcmp(out + i, "line\n", 5));
+    total += size;
+  }
+  for (int i = 0; i < kNumThreads; ++i)
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  EXPECT_EQ(0U, buffer->Pop(out, sizeof(out)));
+}
+
+}  // namespace arc
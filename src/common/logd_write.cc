@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,8 +30,11 @@
 #include <cctype>
 #include <string>
 
+#include "base/strings/safe_sprintf.h"
 #include "base/strings/stringprintf.h"
 #include "common/alog.h"
+#include "common/atomics.h"
+#include "common/log_ring_buffer.h"
 #include "common/scoped_pthread_mutex_locker.h"
 #include "common/stderr_log_priority.h"
 #include "common/trace_event.h"
@@ -80,6 +84,87 @@ LogWriter g_log_writer;
 pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
 LogCallback* g_callback = NULL;
 
+// For the buffered log mode: the maximum size written at once, and how long
+// the background thread sleeps between batches.
+const size_t kLogBatchSize = 16 * 1024;
+const useconds_t kBufferedLogIntervalUs = 10 * 1000;
+// How many times FlushBufferedLog() tries before giving up on waiting for
+// the thread writing the buffer, which may have crashed.
+const int kMaxFlushAttempts = 1000;
+
+// Guards starting and stopping the background thread.
+pthread_mutex_t g_buffered_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Allocated by the first StartBufferedLog() and never freed since other
+// threads may still be pushing to it after StopBufferedLog().
+LogRingBuffer* g_log_ring_buffer;
+int g_buffered_log_enabled;
+int g_buffered_log_stopping;
+pthread_t g_buffered_log_thread;
+// Set while a thread is popping from |g_log_ring_buffer|. It also guards
+// |g_reported_dropped_count| and |g_log_batch|.
+int g_log_flush_lock;
+uint64_t g_reported_dropped_count;
+char g_log_batch[kLogBatchSize];
+
+void WriteLogUnbuffered(const char* log, size_t log_size) {
+  pthread_mutex_lock(&g_mutex);
+  LogWriter log_writer = g_log_writer;
+  pthread_mutex_unlock(&g_mutex);
+  if (log_writer)
+    log_writer(log, log_size);
+  else
+    write(STDERR_FILENO, log, log_size);
+}
+
+// Writes the buffered messages in batches. Returns false if another thread
+// is doing it.
+bool TryFlushBufferedLog() {
+  if (__sync_lock_test_and_set(&g_log_flush_lock, 1))
+    return false;
+  for (;;) {
+    size_t size = 0;
+    const uint64_t dropped_count = g_log_ring_buffer->dropped_count();
+    if (dropped_count != g_reported_dropped_count) {
+      const ssize_t len = base::strings::SafeSPrintf(
+          g_log_batch, "W/" ARC_LOG_TAG ": %d log messages dropped\n",
+          dropped_count - g_reported_dropped_count);
+      if (len > 0)
+        size = len;
+      g_reported_dropped_count = dropped_count;
+    }
+    size += g_log_ring_buffer->Pop(g_log_batch + size, kLogBatchSize - size);
+    if (!size)
+      break;
+    WriteLogUnbuffered(g_log_batch, size);
+  }
+  __sync_lock_release(&g_log_flush_lock);
+  return true;
+}
+
+void* BufferedLogThreadMain(void*) {
+  for (;;) {
+    // Check the flag before flushing so that the messages pushed before
+    // StopBufferedLog() are written.
+    const bool stopping = AcquireLoad(&g_buffered_log_stopping);
+    TryFlushBufferedLog();
+    if (stopping)
+      break;
+    usleep(kBufferedLogIntervalUs);
+  }
+  return NULL;
+}
+
+void WriteLogWithPriority(int prio, const char* log, size_t log_size) {
+  if (AcquireLoad(&g_buffered_log_enabled) && prio < ANDROID_LOG_FATAL &&
+      log_size <= LogRingBuffer::kMaxEntrySize) {
+    g_log_ring_buffer->Push(prio, log, log_size);
+    return;
+  }
+  // Keep the order with the messages already in the buffer.
+  FlushBufferedLog();
+  WriteLogUnbuffered(log, log_size);
+}
+
 int WriteLogEvent(int log_id, struct iovec* vec, size_t nr) {
   // Log is not initialized for unit tests.
   if (!g_callback)
@@ -149,7 +234,7 @@ void PrintLog(int prio, const char* tag, const char* msg) {
     tag = "";
   int tag_len = strlen(tag);
   int stored_errno = errno;
-  WriteLog(base::StringPrintf(
+  const std::string log = base::StringPrintf(
       LOG_FORMAT_PREFIX "%c/%s:%*s %s\n",
 #if defined(LOG_THREAD_IDS)
       gettid(),
@@ -159,7 +244,8 @@ void PrintLog(int prio, const char* tag, const char* msg) {
 #endif  // defined(LOG_TIMESTAMPS)
       priority_char_map[prio],
       tag, tag_len > kTagSpacing ? 0 : kTagSpacing - tag_len, "",
-      msg));
+      msg);
+  WriteLogWithPriority(prio, log.c_str(), log.size());
   errno = stored_errno;
 }
 
@@ -289,19 +375,56 @@ void SetLogWriter(LogWriter writer) {
 }
 
 void WriteLog(const char* log, size_t log_size) {
-  pthread_mutex_lock(&g_mutex);
-  LogWriter log_writer = g_log_writer;
-  pthread_mutex_unlock(&g_mutex);
-  if (log_writer)
-    log_writer(log, log_size);
-  else
-    write(STDERR_FILENO, log, log_size);
+  WriteLogWithPriority(ANDROID_LOG_INFO, log, log_size);
 }
 
 void WriteLog(const std::string& log) {
   WriteLog(log.c_str(), log.size());
 }
 
+void StartBufferedLog() {
+  ScopedPthreadMutexLocker lock(&g_buffered_log_mutex);
+  if (AcquireLoad(&g_buffered_log_enabled))
+    return;
+  if (!g_log_ring_buffer)
+    g_log_ring_buffer = new LogRingBuffer;
+  ReleaseStore(&g_buffered_log_stopping, 0);
+  if (pthread_create(&g_buffered_log_thread, NULL, &BufferedLogThreadMain,
+                     NULL)) {
+    static const char kMessage[] =
+        "E/" ARC_LOG_TAG ": Failed to start the buffered log thread\n";
+    WriteLogUnbuffered(kMessage, sizeof(kMessage) - 1);
+    return;
+  }
+  // Publish |g_log_ring_buffer| before enabling.
+  ReleaseStore(&g_buffered_log_enabled, 1);
+}
+
+void StopBufferedLog() {
+  ScopedPthreadMutexLocker lock(&g_buffered_log_mutex);
+  if (!AcquireLoad(&g_buffered_log_enabled))
+    return;
+  ReleaseStore(&g_buffered_log_enabled, 0);
+  ReleaseStore(&g_buffered_log_stopping, 1);
+  pthread_join(g_buffered_log_thread, NULL);
+  // Messages pushed by threads which saw the flag before it was cleared.
+  FlushBufferedLog();
+}
+
+void FlushBufferedLog() {
+  if (!g_log_ring_buffer)
+    return;
+  for (int i = 0; i < kMaxFlushAttempts; ++i) {
+    if (TryFlushBufferedLog())
+      return;
+    sched_yield();
+  }
+}
+
+uint64_t GetDroppedLogCount() {
+  return g_log_ring_buffer ? g_log_ring_buffer->dropped_count() : 0;
+}
+
 int PrintLogBuf(int bufID, int prio, const char* tag, const char* fmt, ...) {
   va_list arguments;
   va_start(arguments, fmt);
@@ -6,6 +6,8 @@
 #ifndef COMMON_LOGD_WRITE_H_
 #define COMMON_LOGD_WRITE_H_
 
+#include <stdint.h>
+
 #include <string>
 
 #include "log/log.h"
@@ -46,6 +48,25 @@ void WriteLog(const std::string& log);
 // std::string object.
 void WriteLog(const char* log, size_t log_size);
 
+// Starts the buffered log mode. Until StopBufferedLog() is called, WriteLog()
+// and the ALOG macros only copy the message into a lock-free buffer, and a
+// background thread writes the buffered messages in batches. Under overload,
+// messages below ANDROID_LOG_WARN are dropped first, and the number of
+// dropped messages is written to the log. Fatal messages and messages which
+// do not fit in the buffer are written synchronously after flushing the
+// buffer.
+void StartBufferedLog();
+
+// Writes all buffered messages and stops the background thread.
+void StopBufferedLog();
+
+// Writes the buffered messages on the calling thread. This never allocates
+// memory, so it can be called from a crash handler.
+void FlushBufferedLog();
+
+// Returns the number of messages dropped in the buffered log mode.
+uint64_t GetDroppedLogCount();
+
 // If a crash annotation callback handler was registered, use the
 // callback to annotate extra information when crashing.
 void MaybeAddCrashExtraInformation(
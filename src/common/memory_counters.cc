@@ -0,0 +1,92 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common/memory_counters.h"
+
+#include "base/strings/stringprintf.h"
+#include "common/alog.h"
+#include "common/atomics.h"
+#include "common/trace_event.h"
+
+namespace arc {
+
+namespace {
+
+const char* const kCounterNames[MemoryCounters::kNumTypes] = {
+  "FileMappedB",
+  "AnonMappedB",
+  "AshmemB",
+  "AshmemUnpinnedB",
+  "GrallocB",
+};
+
+// These are only accessed with __sync builtins.
+int64_t g_current[MemoryCounters::kNumTypes];
+int64_t g_peak[MemoryCounters::kNumTypes];
+
+}  // namespace
+
+// static
+void MemoryCounters::Add(Type type, int64_t delta) {
+  ALOG_ASSERT(type >= 0 && type < kNumTypes);
+  if (!delta)
+    return;
+  const int64_t current = __sync_add_and_fetch(&g_current[type], delta);
+  int64_t peak = AtomicLoad64(&g_peak[type]);
+  while (current > peak) {
+    const int64_t old_peak =
+        __sync_val_compare_and_swap(&g_peak[type], peak, current);
+    if (old_peak == peak)
+      break;
+    peak = old_peak;
+  }
+  TRACE_COUNTER1(ARC_TRACE_CATEGORY, kCounterNames[type], current);
+}
+
+// static
+int64_t MemoryCounters::Get(Type type) {
+  ALOG_ASSERT(type >= 0 && type < kNumTypes);
+  return AtomicLoad64(&g_current[type]);
+}
+
+// static
+int64_t MemoryCounters::GetPeak(Type type) {
+  ALOG_ASSERT(type >= 0 && type < kNumTypes);
+  return AtomicLoad64(&g_peak[type]);
+}
+
+// static
+void MemoryCounters::GetSnapshot(Snapshot* out) {
+  // Each counter is read atomically, but the counters are not read at the
+  // same instant.
+  for (int i = 0; i < kNumTypes; ++i) {
+    out->current[i] = AtomicLoad64(&g_current[i]);
+    out->peak[i] = AtomicLoad64(&g_peak[i]);
+  }
+}
+
+// static
+std::string MemoryCounters::GetSnapshotAsJSON() {
+  Snapshot snapshot;
+  GetSnapshot(&snapshot);
+  std::string result;
+  result += "{";
+  for (int i = 0; i < kNumTypes; ++i) {
+    if (i != 0)
+      result += ",";
+    result += base::StringPrintf(
+        "\"%s\":{\"current\":%lld,\"peak\":%lld}",
+        kCounterNames[i], snapshot.current[i], snapshot.peak[i]);
+  }
+  result += "}";
+  return result;
+}
+
+// static
+const char* MemoryCounters::GetName(Type type) {
+  ALOG_ASSERT(type >= 0 && type < kNumTypes);
+  return kCounterNames[type];
+}
+
+}  // namespace arc
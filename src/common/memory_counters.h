@@ -0,0 +1,67 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Memory usage counters which are updated when memory is mapped or freed.
+
+#ifndef COMMON_MEMORY_COUNTERS_H_
+#define COMMON_MEMORY_COUNTERS_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "common/private/minimal_base.h"
+
+namespace arc {
+
+// Keeps track of memory usage by source. Unlike Performance::GetMemoryUsage
+// which walks the whole memory map, the counters are updated incrementally
+// by the code which maps or frees the memory, so reading them is cheap.
+// Each update is also reported as a trace counter.
+// All methods are thread-safe and lock-free.
+class MemoryCounters {
+ public:
+  enum Type {
+    // Regions mmapped with a file descriptor through posix_translation,
+    // including ashmem regions.
+    kFileMappedBytes = 0,
+    // Regions mmapped with MAP_ANONYMOUS through posix_translation.
+    kAnonymousMappedBytes,
+    // The MAP_SHARED regions of ashmem, which live until the last munmap
+    // even if the file descriptor is closed.
+    kAshmemBytes,
+    // Unpinned ashmem ranges which have not been purged yet.
+    kAshmemUnpinnedBytes,
+    // Software buffers allocated by gralloc.
+    kGrallocBytes,
+    kNumTypes
+  };
+
+  struct Snapshot {
+    int64_t current[kNumTypes];
+    int64_t peak[kNumTypes];
+  };
+
+  // Adds |delta| bytes to the counter for |type|. |delta| can be negative.
+  static void Add(Type type, int64_t delta);
+
+  static int64_t Get(Type type);
+  static int64_t GetPeak(Type type);
+  static void GetSnapshot(Snapshot* out);
+
+  // Returns the snapshot as a JSON object keyed by the counter names.
+  static std::string GetSnapshotAsJSON();
+
+  // Returns the name used for the trace counter of |type|.
+  static const char* GetName(Type type);
+
+ private:
+  MemoryCounters();
+
+  COMMON_DISALLOW_COPY_AND_ASSIGN(MemoryCounters);
+};
+
+}  // namespace arc
+
+#endif  // COMMON_MEMORY_COUNTERS_H_
@@ -0,0 +1,58 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include "common/memory_counters.h"
+#include "gtest/gtest.h"
+
+namespace arc {
+
+// The counters are process-wide, so the tests only check differences.
+
+TEST(MemoryCountersTest, AddAndGet) {
+  const int64_t start = MemoryCounters::Get(MemoryCounters::kGrallocBytes);
+  MemoryCounters::Add(MemoryCounters::kGrallocBytes, 4096);
+  EXPECT_EQ(start + 4096, MemoryCounters::Get(MemoryCounters::kGrallocBytes));
+  MemoryCounters::Add(MemoryCounters::kGrallocBytes, -4096);
+  EXPECT_EQ(start, MemoryCounters::Get(MemoryCounters::kGrallocBytes));
+}
+
+TEST(MemoryCountersTest, Peak) {
+  const MemoryCounters::Type type = MemoryCounters::kAshmemUnpinnedBytes;
+  const int64_t start = MemoryCounters::Get(type);
+  const int64_t start_peak = MemoryCounters::GetPeak(type);
+  EXPECT_LE(start, start_peak);
+  const int64_t delta = start_peak - start + 8192;
+  MemoryCounters::Add(type, delta);
+  MemoryCounters::Add(type, -delta);
+  EXPECT_EQ(start, MemoryCounters::Get(type));
+  EXPECT_EQ(start + delta, MemoryCounters::GetPeak(type));
+}
+
+TEST(MemoryCountersTest, Snapshot) {
+  MemoryCounters::Add(MemoryCounters::kAnonymousMappedBytes, 4096);
+  MemoryCounters::Snapshot snapshot;
+  MemoryCounters::GetSnapshot(&snapshot);
+  for (int i = 0; i < MemoryCounters::kNumTypes; ++i) {
+    const MemoryCounters::Type type = static_cast<MemoryCounters::Type>(i);
+    EXPECT_EQ(MemoryCounters::Get(type), snapshot.current[i]);
+    EXPECT_EQ(MemoryCounters::GetPeak(type), snapshot.peak[i]);
+  }
+  MemoryCounters::Add(MemoryCounters::kAnonymousMappedBytes, -4096);
+}
+
+TEST(MemoryCountersTest, GetSnapshotAsJSON) {
+  const std::string json = MemoryCounters::GetSnapshotAsJSON();
+  EXPECT_EQ('{', json[0]);
+  EXPECT_EQ('}', json[json.size() - 1]);
+  for (int i = 0; i < MemoryCounters::kNumTypes; ++i) {
+    const std::string key = std::string("\"") +
+        MemoryCounters::GetName(static_cast<MemoryCounters::Type>(i)) +
+        "\":{\"current\":";
+    EXPECT_NE(std::string::npos, json.find(key)) << key;
+  }
+}
+
+}  // namespace arc
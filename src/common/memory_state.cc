@@ -7,7 +7,10 @@
 #include <errno.h>
 #include <execinfo.h>
 #include <malloc.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <sstream>
 #include <algorithm>
@@ -17,6 +20,7 @@
 #include "base/synchronization/lock.h"
 #include "common/alog.h"
 #include "common/backtrace.h"
+#include "common/memory_counters.h"
 
 #if defined(__native_client__)
 static const uintptr_t kTrampolinesStartAddress = 0x10000;
@@ -199,29 +203,93 @@ std::string ProcessMapHeader::ConvertListToJSON(
   return result;
 }
 
-// MemoryMappingBacktraceMap keeps a mapping of start address to end address
-// plus backtrace.
+// MemoryMappingBacktrace is an interned backtrace shared by all regions
+// mapped from the same call site, plus the counters for that call site.
 struct MemoryMappingBacktrace {
   static const int kBacktraceCapacity = 100;
 
-  uintptr_t end;  // Keeping this as uintptr_t to allow comparisons without
-                  // casting.
-
   // A raw backtrace as a series of code addresses. Decoded to symbols on
   // demand.
   void* backtrace[kBacktraceCapacity];
   int backtrace_size;
+  uint32_t hash;
+  int id;
+
+  // The number of regions which refer to this backtrace. The backtrace is
+  // kept after this drops to zero so that the call site still shows up in
+  // the profile with its total counters.
+  int refcount;
+  // The number of bytes currently mapped from this call site, and the
+  // maximum of it.
+  size_t live_bytes;
+  size_t peak_bytes;
+  // The number of mappings ever made from this call site, and their total
+  // size.
+  size_t count;
+  size_t total_bytes;
 };
 
+namespace {
+
+bool CompareById(const MemoryMappingBacktrace* i,
+                 const MemoryMappingBacktrace* j) {
+  return i->id < j->id;
+}
+
+uint32_t HashBacktrace(void* const* backtrace, int backtrace_size) {
+  // FNV-1a over the code addresses.
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < backtrace_size; ++i) {
+    uintptr_t frame = reinterpret_cast<uintptr_t>(backtrace[i]);
+    for (size_t j = 0; j < sizeof(frame); ++j) {
+      hash ^= (frame >> (j * 8)) & 0xff;
+      hash *= 16777619u;
+    }
+  }
+  return hash;
+}
+
+// Setting this environment variable turns on recording for builds without
+// the verbose memory viewer. Its value is the sampling rate in bytes, and 0
+// records every mapping.
+const char kSamplingRateEnvName[] = "ARC_MMAP_SAMPLING_RATE";
+
+pthread_once_t g_sampling_rate_env_once = PTHREAD_ONCE_INIT;
+// The sampling rate given by the environment, if any.
+bool g_has_sampling_rate_env = false;
+size_t g_sampling_rate_env = 0;
+
+void ReadSamplingRateFromEnvironment() {
+  // This runs in mmap, so it must not allocate memory.
+  const char* value = getenv(kSamplingRateEnvName);
+  if (!value || !*value)
+    return;
+  g_sampling_rate_env = strtoul(value, NULL, 10);
+  g_has_sampling_rate_env = true;
+}
+
+}  // namespace
+
+bool MemoryMappingBacktraceMap::enabled_ = false;
+
 MemoryMappingBacktraceMap::MemoryMappingBacktraceMap()
-      : mu_(new base::Lock) {
+      : next_trace_id_(1),
+        sampling_rate_(0),
+        bytes_until_sample_(0),
+        rand_state_(0x12345678),
+        mu_(new base::Lock) {
   backtracer_ = BacktraceInterface::Get();
+  pthread_once(&g_sampling_rate_env_once, &ReadSamplingRateFromEnvironment);
+  if (g_has_sampling_rate_env && g_sampling_rate_env) {
+    sampling_rate_ = g_sampling_rate_env;
+    bytes_until_sample_ = PickNextSamplingPoint();
+  }
 }
 
 MemoryMappingBacktraceMap::~MemoryMappingBacktraceMap() {
   delete mu_;
   delete backtracer_;
-  for (Map::iterator i = memory_.begin(); i != memory_.end(); ++i) {
+  for (TraceTable::iterator i = traces_.begin(); i != traces_.end(); ++i) {
     delete i->second;
   }
 }
@@ -239,30 +307,129 @@ MemoryMappingBacktraceMap* MemoryMappingBacktraceMap::GetInstance() {
                    LeakySingletonTraits<MemoryMappingBacktraceMap> >::get();
 }
 
+bool MemoryMappingBacktraceMap::IsEnabled() {
+  pthread_once(&g_sampling_rate_env_once, &ReadSamplingRateFromEnvironment);
+  return enabled_ || g_has_sampling_rate_env;
+}
+
+void MemoryMappingBacktraceMap::SetSamplingRate(size_t sampling_rate) {
+  base::AutoLock lock(*mu_);
+  sampling_rate_ = sampling_rate;
+  bytes_until_sample_ = sampling_rate ? PickNextSamplingPoint() : 0;
+  enabled_ = true;
+}
+
+size_t MemoryMappingBacktraceMap::PickNextSamplingPoint() {
+  // Like tcmalloc's heap sampler, the distance between samples is
+  // exponentially distributed, so that the probability that a mapping of
+  // |length| bytes is sampled is 1 - exp(-length / sampling_rate_). pprof
+  // relies on this to estimate the unsampled sizes.
+  rand_state_ ^= rand_state_ << 13;
+  rand_state_ ^= rand_state_ >> 17;
+  rand_state_ ^= rand_state_ << 5;
+  // A uniform number in (0, 1].
+  const double u = (rand_state_ >> 8) / 16777216.0 + 1.0 / 16777216.0;
+  return static_cast<size_t>(-log(u) * sampling_rate_) + 1;
+}
+
+bool MemoryMappingBacktraceMap::ShouldSample(size_t length) {
+  if (!sampling_rate_)
+    return true;
+  if (length < bytes_until_sample_) {
+    bytes_until_sample_ -= length;
+    return false;
+  }
+  bytes_until_sample_ = PickNextSamplingPoint();
+  return true;
+}
+
+MemoryMappingBacktrace* MemoryMappingBacktraceMap::InternBacktrace(
+    void* const* backtrace, int backtrace_size) {
+  const uint32_t hash = HashBacktrace(backtrace, backtrace_size);
+  std::pair<TraceTable::iterator, TraceTable::iterator> range =
+      traces_.equal_range(hash);
+  for (TraceTable::iterator i = range.first; i != range.second; ++i) {
+    MemoryMappingBacktrace* trace = i->second;
+    if (trace->backtrace_size == backtrace_size &&
+        std::equal(backtrace, backtrace + backtrace_size, trace->backtrace))
+      return trace;
+  }
+  MemoryMappingBacktrace* trace = new MemoryMappingBacktrace;
+  std::copy(backtrace, backtrace + backtrace_size, trace->backtrace);
+  trace->backtrace_size = backtrace_size;
+  trace->hash = hash;
+  trace->id = next_trace_id_++;
+  trace->refcount = 0;
+  trace->live_bytes = 0;
+  trace->peak_bytes = 0;
+  trace->count = 0;
+  trace->total_bytes = 0;
+  traces_.insert(std::make_pair(hash, trace));
+  return trace;
+}
+
+void MemoryMappingBacktraceMap::AddRegion(
+    uintptr_t start, uintptr_t end, MemoryMappingBacktrace* trace) {
+  Region region = { end, trace };
+  memory_[start] = region;
+  ++trace->refcount;
+}
+
+void MemoryMappingBacktraceMap::ReleaseBacktrace(
+    MemoryMappingBacktrace* trace) {
+  // The call site stays interned even when this drops to zero, so that
+  // mappings which have been freed are still counted in the profile. The
+  // table is bounded by the number of distinct call sites.
+  --trace->refcount;
+}
+
 void MemoryMappingBacktraceMap::MapCurrentStackFrame(
     void* addr, size_t length) {
-  Unmap(addr, length);
-  base::AutoLock lock(*mu_);
   size_t addri = reinterpret_cast<size_t>(addr);
-  MemoryMappingBacktrace* trace = new MemoryMappingBacktrace;
-  trace->backtrace_size = backtracer_->Backtrace(
-      trace->backtrace, MemoryMappingBacktrace::kBacktraceCapacity);
-  trace->end = addri + length;
-  memory_[addri] = trace;
+  bool sampled;
+  {
+    base::AutoLock lock(*mu_);
+    // The new mapping replaces whatever was mapped there, whether or not
+    // it is sampled.
+    UnmapLocked(addri, length);
+    sampled = ShouldSample(length);
+  }
+  if (!sampled)
+    return;
+
+  // Unwind without holding the lock, since this is the expensive part.
+  void* backtrace[MemoryMappingBacktrace::kBacktraceCapacity];
+  int backtrace_size = backtracer_->Backtrace(
+      backtrace, MemoryMappingBacktrace::kBacktraceCapacity);
+
+  base::AutoLock lock(*mu_);
+  // Another thread may have mapped the same range while unwinding.
+  UnmapLocked(addri, length);
+  MemoryMappingBacktrace* trace = InternBacktrace(backtrace, backtrace_size);
+  AddRegion(addri, addri + length, trace);
+  trace->live_bytes += length;
+  trace->peak_bytes = std::max(trace->peak_bytes, trace->live_bytes);
+  ++trace->count;
+  trace->total_bytes += length;
 }
 
 void MemoryMappingBacktraceMap::Unmap(void* addr, size_t length) {
+  base::AutoLock lock(*mu_);
+  UnmapLocked(reinterpret_cast<size_t>(addr), length);
+}
+
+void MemoryMappingBacktraceMap::UnmapLocked(uintptr_t addri, size_t length) {
   // This operation is a NOP in the case where there are no mappings
   // in [addr:addr+length). (Matches some munmap definitions and
-  // relied on inside Add above).
-  base::AutoLock lock(*mu_);
-  size_t addri = reinterpret_cast<size_t>(addr);
+  // relied on inside MapCurrentStackFrame above).
+  //
   // Loop over all regions intersecting the area to remove.
   Map::iterator start = memory_.lower_bound(addri);
   // If the first region starting at least at addri is does not begin at
   // exactly addri, the region in front of it may need to be clipped.
   // Go back one assuming we are not on the first region already.
-  if (start != memory_.begin() && start->first != addri)
+  if (start != memory_.begin() &&
+      (start == memory_.end() || start->first != addri))
     --start;
   Map::iterator end = memory_.upper_bound(addri + length);
   Map::iterator i = start;
@@ -306,7 +473,7 @@ void MemoryMappingBacktraceMap::Unmap(void* addr, size_t length) {
     //
     // If the regions not overlap (cases v and vi), skip to the next region.
     if (addri + length <= i->first ||
-        i->second->end <= addri) {
+        i->second.end <= addri) {
       ++i;
       continue;
     }
@@ -318,33 +485,56 @@ void MemoryMappingBacktraceMap::Unmap(void* addr, size_t length) {
     size_t left_start = i->first;
     size_t left_end = addri;
     size_t right_start = addri + length;
-    size_t right_end = i->second->end;
+    size_t right_end = i->second.end;
 
     // Extract the current area.
-    MemoryMappingBacktrace* trace = i->second;
+    MemoryMappingBacktrace* trace = i->second.trace;
     Map::iterator next = i;
     ++next;
     memory_.erase(i);
 
-    // Add left and right divisions if they are needed.
-    if (left_end > left_start) {
-      MemoryMappingBacktrace* left_trace = new MemoryMappingBacktrace;
-      *left_trace = *trace;
-      left_trace->end = left_end;
-      memory_[left_start] = left_trace;
-    }
-    if (right_end > right_start) {
-      MemoryMappingBacktrace* right_trace = new MemoryMappingBacktrace;
-      *right_trace = *trace;
-      right_trace->end = right_end;
-      memory_[right_start] = right_trace;
-    }
+    // Add left and right divisions if they are needed. They share the
+    // backtrace with the original region.
+    if (left_end > left_start)
+      AddRegion(left_start, left_end, trace);
+    if (right_end > right_start)
+      AddRegion(right_start, right_end, trace);
 
-    delete trace;
+    trace->live_bytes -= std::min(right_start, right_end) -
+        std::max(left_start, left_end);
+    ReleaseBacktrace(trace);
     i = next;
   }
 }
 
+std::vector<const MemoryMappingBacktrace*>
+MemoryMappingBacktraceMap::GetSortedBacktraces() {
+  std::vector<const MemoryMappingBacktrace*> traces;
+  for (TraceTable::iterator i = traces_.begin(); i != traces_.end(); ++i)
+    traces.push_back(i->second);
+  std::sort(traces.begin(), traces.end(), CompareById);
+  return traces;
+}
+
+std::string MemoryMappingBacktraceMap::ConvertFramesToJSON(
+    const MemoryMappingBacktrace* trace) {
+  char** names = backtracer_->BacktraceSymbols(trace->backtrace,
+                                               trace->backtrace_size);
+  std::string result;
+  result += "[";
+  // Skip the initial uninteresting ones.
+  for (int j = GetUninterestingLayers(); j < trace->backtrace_size; ++j) {
+    if (j != GetUninterestingLayers())
+      result += ",";
+    result += "\"";
+    result += BacktraceInterface::DemangleAll(names[j]);
+    result += "\"";
+  }
+  result += "]";
+  free(names);
+  return result;
+}
+
 std::string MemoryMappingBacktraceMap::ConvertBacktraceToJSON(void* addr) {
   base::AutoLock lock(*mu_);
   size_t addri = reinterpret_cast<size_t>(addr);
@@ -356,22 +546,101 @@ std::string MemoryMappingBacktraceMap::ConvertBacktraceToJSON(void* addr) {
   // Look at the range in front of it.
   --i;
   // If it does not include this address, give up.
-  if (addri < i->first || addri >= i->second->end)
+  if (addri < i->first || addri >= i->second.end)
     return "[]";
-  char** names = backtracer_->BacktraceSymbols(i->second->backtrace,
-                                               i->second->backtrace_size);
+  return ConvertFramesToJSON(i->second.trace);
+}
+
+std::string MemoryMappingBacktraceMap::ConvertCallSitesToJSON() {
+  base::AutoLock lock(*mu_);
   std::string result;
-  result += "[";
-  // Skip the initial uninteresting ones.
-  for (int j = GetUninterestingLayers(); j < i->second->backtrace_size; ++j) {
-    if (j != GetUninterestingLayers())
+  // We do not use PRIxxx macros here. See ConvertToString().
+  result += base::StringPrintf(
+      "{\"samplingRate\":%zu,\"callSites\":[", sampling_rate_);
+  std::vector<const MemoryMappingBacktrace*> traces = GetSortedBacktraces();
+  for (uint i = 0; i < traces.size(); ++i) {
+    const MemoryMappingBacktrace* trace = traces[i];
+    if (i != 0)
       result += ",";
-    result += "\"";
-    result += BacktraceInterface::DemangleAll(names[j]);
-    result += "\"";
+    result += base::StringPrintf(
+        "{"
+            "\"id\":%d,"
+            "\"liveRegions\":%d,"
+            "\"liveBytes\":%zu,"
+            "\"peakBytes\":%zu,"
+            "\"count\":%zu,"
+            "\"totalBytes\":%zu,"
+            "\"backtrace\":%s"
+        "}",
+        trace->id,
+        trace->refcount,
+        trace->live_bytes,
+        trace->peak_bytes,
+        trace->count,
+        trace->total_bytes,
+        ConvertFramesToJSON(trace).c_str());
+  }
+  result += "]}";
+  return result;
+}
+
+std::string MemoryMappingBacktraceMap::ConvertCallSitesToPprof() {
+  std::string body;
+  size_t live_regions = 0;
+  size_t live_bytes = 0;
+  size_t count = 0;
+  size_t total_bytes = 0;
+  size_t sampling_rate;
+  {
+    base::AutoLock lock(*mu_);
+    sampling_rate = sampling_rate_;
+    std::vector<const MemoryMappingBacktrace*> traces = GetSortedBacktraces();
+    for (uint i = 0; i < traces.size(); ++i) {
+      const MemoryMappingBacktrace* trace = traces[i];
+      body += base::StringPrintf(
+          "%6d: %8zu [%6zu: %8zu] @", trace->refcount, trace->live_bytes,
+          trace->count, trace->total_bytes);
+      for (int j = GetUninterestingLayers(); j < trace->backtrace_size; ++j)
+        body += base::StringPrintf(" %p", trace->backtrace[j]);
+      body += "\n";
+      live_regions += trace->refcount;
+      live_bytes += trace->live_bytes;
+      count += trace->count;
+      total_bytes += trace->total_bytes;
+    }
+  }
+
+  // heap_v2 tells pprof to scale the sampled sizes. Without sampling, the
+  // sizes are exact.
+  std::string result = base::StringPrintf(
+      "heap profile: %6zu: %8zu [%6zu: %8zu] @ ", live_regions, live_bytes,
+      count, total_bytes);
+  if (sampling_rate)
+    result += base::StringPrintf("heap_v2/%zu\n", sampling_rate);
+  else
+    result += "heap\n";
+  result += body;
+
+  // pprof reads the library layout in the /proc/self/maps format to
+  // symbolize the addresses.
+  result += "\nMAPPED_LIBRARIES:\n";
+  ProcessMapHeader::List list;
+  ProcessMapHeader::DumpLayout(&list);
+  ProcessMapHeader::SortByVirtualAddress(&list);
+  for (uint i = 0; i < list.size(); ++i) {
+    if (list[i].GetType() != PT_LOAD)
+      continue;
+    const uint32_t flags = list[i].GetFlags();
+    result += base::StringPrintf(
+        "%08zx-%08zx %c%c%cp %08zx 00:00 0 %s\n",
+        static_cast<size_t>(list[i].GetVirtualAddress()),
+        static_cast<size_t>(list[i].GetVirtualAddress() +
+                            list[i].GetMemorySize()),
+        (flags & PF_R) ? 'r' : '-', (flags & PF_W) ? 'w' : '-',
+        (flags & PF_X) ? 'x' : '-',
+        static_cast<size_t>(list[i].GetFileOffset()),
+        list[i].GetLibrary().c_str());
   }
-  result += "]";
-  free(names);
   return result;
 }
 
@@ -488,6 +757,11 @@ std::string MemoryState::DumpAsJSON() {
 
   std::string minfo = DumpMallocInfoAsJSON();
 
+  std::string call_sites = MemoryMappingBacktraceMap::GetInstance()->
+      ConvertCallSitesToJSON();
+
+  std::string counters = MemoryCounters::GetSnapshotAsJSON();
+
   return base::StringPrintf(
       "{"
           "\"namespace\":\"memory-state\","
@@ -496,9 +770,12 @@ std::string MemoryState::DumpAsJSON() {
               "\"processMapHeaders\": %s,"
               "\"memoryMappingInfo\": %s,"
               "\"mallinfo\": %s,"
+              "\"mappingCallSites\": %s,"
+              "\"memoryCounters\": %s,"
               "\"arcTarget\": \"%s\""
           "}"
-      "}", pmhs.c_str(), mmis.c_str(), minfo.c_str(), ARC_TARGET);
+      "}", pmhs.c_str(), mmis.c_str(), minfo.c_str(), call_sites.c_str(),
+      counters.c_str(), ARC_TARGET);
 }
 
 }  // namespace arc
@@ -96,15 +96,40 @@ struct NaClMemMappingInfo {
 };
 
 // Records backtraces when mmap is done.
+//
+// Identical backtraces are interned, so each distinct call site is stored
+// once and shared by all regions mapped from it. Each call site keeps
+// aggregate counters which can be dumped as JSON or as a pprof heap
+// profile to find mapping leaks. To keep the cost low enough for JIT-heavy
+// apps, mappings can be sampled by the number of bytes mapped.
+//
+// Builds without the verbose memory viewer record nothing unless the
+// ARC_MMAP_SAMPLING_RATE environment variable is set or SetSamplingRate() is
+// called. The profile is served as /proc/arc/mmap_profile.
 struct MemoryMappingBacktrace;
 class MemoryMappingBacktraceMap {
  public:
   static MemoryMappingBacktraceMap* GetInstance();
 
+  // Returns true if ARC_MMAP_SAMPLING_RATE is set or SetSamplingRate() has
+  // been called. Builds with the verbose memory viewer record all mappings
+  // regardless of this.
+  static bool IsEnabled();
+
+  // Records on average one mapping per |sampling_rate| bytes mapped, and
+  // enables recording. 0 records every mapping, which is the default.
+  void SetSamplingRate(size_t sampling_rate);
+
   void MapCurrentStackFrame(void *addr, size_t length);
   void Unmap(void *addr, size_t length);
   std::string ConvertBacktraceToJSON(void *addr);
 
+  // Dumps the counters of all call sites seen so far, including the ones
+  // whose mappings have all been unmapped.
+  std::string ConvertCallSitesToJSON();
+  // Dumps the same data in the legacy pprof heap profile format.
+  std::string ConvertCallSitesToPprof();
+
   static int GetUninterestingLayers();
 
  private:
@@ -114,12 +139,44 @@ class MemoryMappingBacktraceMap {
   MemoryMappingBacktraceMap();
   ~MemoryMappingBacktraceMap();
 
+  // A mapped region and the call site which mapped it.
+  struct Region {
+    uintptr_t end;  // Keeping this as uintptr_t to allow comparisons without
+                    // casting.
+    MemoryMappingBacktrace* trace;
+  };
+
+  typedef std::map<uintptr_t, Region> Map;
+  // Interned backtraces keyed by the hash of their frames.
+  typedef std::multimap<uint32_t, MemoryMappingBacktrace*> TraceTable;
+
+  // These require |mu_| to be held.
+  bool ShouldSample(size_t length);
+  size_t PickNextSamplingPoint();
+  MemoryMappingBacktrace* InternBacktrace(void* const* backtrace,
+                                          int backtrace_size);
+  void AddRegion(uintptr_t start, uintptr_t end,
+                 MemoryMappingBacktrace* trace);
+  void ReleaseBacktrace(MemoryMappingBacktrace* trace);
+  void UnmapLocked(uintptr_t addr, size_t length);
+  // Returns the live backtraces in the order they were first seen.
+  std::vector<const MemoryMappingBacktrace*> GetSortedBacktraces();
+
+  std::string ConvertFramesToJSON(const MemoryMappingBacktrace* trace);
+
+  static bool enabled_;
+
   // Hook to allow mocking of backtracing.
   BacktraceInterface* backtracer_;
 
-  typedef std::map<uintptr_t, MemoryMappingBacktrace*> Map;
-
   Map memory_;
+  TraceTable traces_;
+  int next_trace_id_;
+
+  size_t sampling_rate_;
+  size_t bytes_until_sample_;
+  uint32_t rand_state_;
+
   // TODO(crbug.com/391661): Use std::unique_ptr once we completely migrate to
   // clang.
   base::Lock* mu_;
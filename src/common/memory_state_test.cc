@@ -12,9 +12,12 @@
 
 namespace arc {
 
+using ::testing::Between;
+using ::testing::DoAll;
 using ::testing::Ge;
 using ::testing::NotNull;
 using ::testing::Return;
+using ::testing::SetArrayArgument;
 using ::testing::_;
 
 class ProcessMapHeaderTest : public testing::Test {
@@ -185,6 +188,9 @@ class MemoryMappingBacktraceMapTest : public testing::Test {
   char** NewSimpleTrace();
   int GetSimpleTraceSize();
 
+  // Maps a region whose backtrace is |frame| repeated.
+  void MapWithFrame(int start, int size, int frame);
+
   void ClippingTest(
       int test_range,
       int map_start, int map_size, int unmap_start, int unmap_size,
@@ -255,6 +261,130 @@ TEST_F(MemoryMappingBacktraceMapTest, Demangling) {
       map_->ConvertBacktraceToJSON(reinterpret_cast<void*>(0x12345678)));
 }
 
+void MemoryMappingBacktraceMapTest::MapWithFrame(
+    int start, int size, int frame) {
+  void* frames[16];
+  const int frame_count = GetSimpleTraceSize();
+  ASSERT_GE(16, frame_count);
+  for (int i = 0; i < frame_count; ++i)
+    frames[i] = reinterpret_cast<void*>(frame);
+  EXPECT_CALL(*backtracer_, Backtrace(NotNull(), Ge(frame_count))).WillOnce(
+      DoAll(SetArrayArgument<0>(frames, frames + frame_count),
+            Return(frame_count)));
+  map_->MapCurrentStackFrame(reinterpret_cast<void*>(start), size);
+}
+
+TEST_F(MemoryMappingBacktraceMapTest, CallSites) {
+  MapWithFrame(100, 100, 1);
+  MapWithFrame(300, 200, 1);
+  MapWithFrame(600, 50, 2);
+  // Clip the second region of the first call site.
+  map_->Unmap(reinterpret_cast<void*>(350), 100);
+
+  EXPECT_CALL(*backtracer_,
+      BacktraceSymbols(NotNull(), GetSimpleTraceSize())).
+      WillOnce(Return(NewSimpleTrace())).
+      WillOnce(Return(NewSimpleTrace()));
+  EXPECT_EQ(
+      "{"
+          "\"samplingRate\":0,"
+          "\"callSites\":["
+              "{"
+                  "\"id\":1,"
+                  "\"liveRegions\":3,"
+                  "\"liveBytes\":200,"
+                  "\"peakBytes\":300,"
+                  "\"count\":2,"
+                  "\"totalBytes\":300,"
+                  "\"backtrace\":[\"OK\"]"
+              "},"
+              "{"
+                  "\"id\":2,"
+                  "\"liveRegions\":1,"
+                  "\"liveBytes\":50,"
+                  "\"peakBytes\":50,"
+                  "\"count\":1,"
+                  "\"totalBytes\":50,"
+                  "\"backtrace\":[\"OK\"]"
+              "}"
+          "]"
+      "}", map_->ConvertCallSitesToJSON());
+}
+
+TEST_F(MemoryMappingBacktraceMapTest, CallSiteKeptAfterUnmap) {
+  MapWithFrame(100, 100, 1);
+  // Remapping the same range releases the region of the old call site.
+  MapWithFrame(100, 100, 2);
+  map_->Unmap(reinterpret_cast<void*>(0), 1000);
+
+  // The call sites still report what they have mapped.
+  EXPECT_CALL(*backtracer_,
+      BacktraceSymbols(NotNull(), GetSimpleTraceSize())).
+      WillOnce(Return(NewSimpleTrace())).
+      WillOnce(Return(NewSimpleTrace()));
+  EXPECT_EQ(
+      "{"
+          "\"samplingRate\":0,"
+          "\"callSites\":["
+              "{"
+                  "\"id\":1,"
+                  "\"liveRegions\":0,"
+                  "\"liveBytes\":0,"
+                  "\"peakBytes\":100,"
+                  "\"count\":1,"
+                  "\"totalBytes\":100,"
+                  "\"backtrace\":[\"OK\"]"
+              "},"
+              "{"
+                  "\"id\":2,"
+                  "\"liveRegions\":0,"
+                  "\"liveBytes\":0,"
+                  "\"peakBytes\":100,"
+                  "\"count\":1,"
+                  "\"totalBytes\":100,"
+                  "\"backtrace\":[\"OK\"]"
+              "}"
+          "]"
+      "}", map_->ConvertCallSitesToJSON());
+
+  // The same call site keeps its ID when it is seen again.
+  MapWithFrame(100, 100, 1);
+  EXPECT_CALL(*backtracer_,
+      BacktraceSymbols(NotNull(), GetSimpleTraceSize())).
+      WillOnce(Return(NewSimpleTrace())).
+      WillOnce(Return(NewSimpleTrace()));
+  const std::string json = map_->ConvertCallSitesToJSON();
+  EXPECT_NE(std::string::npos, json.find(
+      "\"id\":1,\"liveRegions\":1,\"liveBytes\":100,\"peakBytes\":100,"
+      "\"count\":2,\"totalBytes\":200,"));
+  EXPECT_EQ(std::string::npos, json.find("\"id\":3,"));
+}
+
+TEST_F(MemoryMappingBacktraceMapTest, Sampling) {
+  static const int kPageSize = 4096;
+  static const int kNumPages = 256;
+  // Sample about one in 16 pages. Unsampled mappings do not unwind.
+  map_->SetSamplingRate(kPageSize * 16);
+  EXPECT_CALL(*backtracer_, Backtrace(NotNull(), _)).
+      Times(Between(1, kNumPages / 4)).WillRepeatedly(Return(0));
+  for (int i = 0; i < kNumPages; ++i)
+    map_->MapCurrentStackFrame(reinterpret_cast<void*>(i * kPageSize),
+                               kPageSize);
+  EXPECT_TRUE(MemoryMappingBacktraceMap::IsEnabled());
+}
+
+TEST_F(MemoryMappingBacktraceMapTest, ConvertCallSitesToPprof) {
+  MapWithFrame(100, 100, 0x1234);
+  MapWithFrame(300, 200, 0x1234);
+  const std::string pprof = map_->ConvertCallSitesToPprof();
+  const std::string expected_prefix =
+      "heap profile:      2:      300 [     2:      300] @ heap\n"
+      "     2:      300 [     2:      300] @ 0x1234\n"
+      "\n"
+      "MAPPED_LIBRARIES:\n";
+  EXPECT_EQ(expected_prefix, pprof.substr(0, expected_prefix.size()));
+}
+
 // These tests match the cases described in memory_state.cc (i - vi).
 
 void MemoryMappingBacktraceMapTest::ClippingTest(
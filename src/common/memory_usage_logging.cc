@@ -8,6 +8,7 @@
 #include <unistd.h>
 
 #include "common/alog.h"
+#include "common/memory_counters.h"
 #include "common/memory_usage_logging.h"
 #include "common/performance.h"
 #include "common/trace_event.h"
@@ -21,21 +22,28 @@ namespace arc {
 
 namespace {
 
-const char kResidentMemoryCounter[] = "ResidentB";
 const char kVirtualMemoryCounter[] = "VirtualB";
 
-const int kMicrosecondsBetweenLogging = 100000;  // 100ms
+// Memory mapped through posix_translation and allocated by gralloc is
+// reported by MemoryCounters when it changes. This loop is a fallback for
+// the total virtual memory, which also includes the mappings made outside
+// posix_translation, so it walks the whole memory map much less often and
+// logs only when the total changes.
+const int kMicrosecondsBetweenPolling = 2000000;  // 2s
 
 void* MemoryUsageLoop(void* unused) {
+  int last_virtual_bytes = -1;
   while (true) {
     int virtual_bytes = 0;
     int resident_bytes = 0;
     Performance::GetInstance()->GetMemoryUsage(&virtual_bytes, &resident_bytes);
     TRACE_COUNTER1(ARC_TRACE_CATEGORY, kVirtualMemoryCounter, virtual_bytes);
-    TRACE_COUNTER1(ARC_TRACE_CATEGORY, kResidentMemoryCounter,
-                   resident_bytes);
-    ALOGI("Memory usage: Res: %dB, Virt: %dB", resident_bytes, virtual_bytes);
-    usleep(kMicrosecondsBetweenLogging);
+    if (virtual_bytes != last_virtual_bytes) {
+      ALOGI("Memory usage: Virt: %dB, Counters: %s", virtual_bytes,
+            MemoryCounters::GetSnapshotAsJSON().c_str());
+      last_virtual_bytes = virtual_bytes;
+    }
+    usleep(kMicrosecondsBetweenPolling);
   }
   return NULL;
 }
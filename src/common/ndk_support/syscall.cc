@@ -5,7 +5,6 @@
 #include "common/ndk_support/syscall.h"
 
 #include <errno.h>
-#include <linux/futex.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <sys/syscall.h>
@@ -78,13 +77,11 @@ int RunKernelSyscallImpl(int arm_sysno, va_list ap) {
       int val3 = va_arg(ap, int);
 
       int result = syscall(__NR_futex, addr, op, val, timeout, addr2, val3);
-      if (result >= 0 && (op == FUTEX_WAKE || op == FUTEX_WAKE_PRIVATE))
-        return result;  // woken threads
+      if (result >= 0)
+        return result;  // 0 or woken (or requeued) threads
 
-      if (result) {
-        result = -errno;
-        errno = saved_errno;
-      }
+      result = -errno;
+      errno = saved_errno;
       return result;
     }
     case 241:  // sched_setaffinity
@@ -15,6 +15,8 @@
 #include <sys/resource.h>
 
 #include <cstddef>
+#include <map>
+#include <string>
 #include <vector>
 
 #include "base/memory/singleton.h"
@@ -27,6 +29,11 @@
 static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_key_t s_tls = 0;
 static pthread_once_t s_tls_init = PTHREAD_ONCE_INIT;
+// |s_tls| plus one, or zero until the key is created. GetThreadState() reads
+// this instead of calling pthread_once() on every getpid() and getuid(). Since
+// the key and the flag are in one word, no memory barrier is needed: a thread
+// can have a state only after it has created or seen the key itself.
+static volatile int s_tls_plus_one = 0;
 static const pid_t kFirstPidMinusOne = 200;
 static pid_t s_prev_pid = kFirstPidMinusOne;
 static bool s_is_multi_threaded = false;
@@ -127,6 +134,123 @@ bool ProcessEmulatorThreadState::PopBinderFrame(int64_t* cookie) {
   return has_cookie;
 }
 
+struct EmulatedProcessEntry {
+  EmulatedProcessEntry() : uid(0), has_uid(false) {}
+
+  std::string argv0;
+  uid_t uid;
+  // False for a pid which only has argv0, set by SetArgV0() on a thread
+  // without an emulated process.
+  bool has_uid;
+};
+
+// An immutable copy of the emulated process table. Writers copy the current
+// snapshot with |s_mutex| held and publish the modified copy, so that /proc
+// enumeration and permission checks read the table without locking.
+struct ProcessTableSnapshot {
+  ProcessTableSnapshot() : num_readers(0), next_retired(NULL) {}
+
+  std::map<pid_t, EmulatedProcessEntry> processes;
+  // The number of ScopedProcessTableReaders which hold this snapshot.
+  int num_readers;
+  // Links the snapshots which were replaced but may still be read.
+  ProcessTableSnapshot* next_retired;
+};
+
+// The current snapshot. NULL means no process.
+ProcessTableSnapshot* s_process_table = NULL;
+// The number of threads between loading |s_process_table| and incrementing
+// the |num_readers| of the loaded snapshot.
+int s_num_acquiring_process_table_readers = 0;
+// Guarded by |s_mutex|.
+ProcessTableSnapshot* s_retired_process_tables = NULL;
+int s_num_retired_process_tables = 0;
+// Beyond this, PublishProcessTableLocked() waits for the acquiring readers
+// so that only the snapshots which are still read are kept.
+const int kMaxRetiredProcessTables = 16;
+
+// Keeps the current snapshot alive while this object exists.
+class ScopedProcessTableReader {
+ public:
+  ScopedProcessTableReader() {
+    // The full barrier of the increment orders it before the load below.
+    // See PublishProcessTableLocked().
+    __sync_add_and_fetch(&s_num_acquiring_process_table_readers, 1);
+    snapshot_ = *const_cast<ProcessTableSnapshot* volatile*>(
+        &s_process_table);
+    if (snapshot_)
+      __sync_add_and_fetch(&snapshot_->num_readers, 1);
+    __sync_sub_and_fetch(&s_num_acquiring_process_table_readers, 1);
+  }
+
+  ~ScopedProcessTableReader() {
+    // |snapshot_| may be deleted as soon as this is decremented.
+    if (snapshot_)
+      __sync_sub_and_fetch(&snapshot_->num_readers, 1);
+  }
+
+  // Returns the entry for |pid|, or NULL if it does not exist.
+  const EmulatedProcessEntry* Find(pid_t pid) const {
+    if (!snapshot_)
+      return NULL;
+    std::map<pid_t, EmulatedProcessEntry>::const_iterator it =
+        snapshot_->processes.find(pid);
+    return it == snapshot_->processes.end() ? NULL : &it->second;
+  }
+
+  // Returns the smallest pid which is larger than |pid|, or 0 if none.
+  pid_t GetNextPid(pid_t pid) const {
+    if (!snapshot_)
+      return 0;
+    std::map<pid_t, EmulatedProcessEntry>::const_iterator it =
+        snapshot_->processes.upper_bound(pid);
+    return it == snapshot_->processes.end() ? 0 : it->first;
+  }
+
+ private:
+  ProcessTableSnapshot* snapshot_;
+
+  COMMON_DISALLOW_COPY_AND_ASSIGN(ScopedProcessTableReader);
+};
+
+ProcessTableSnapshot* CopyProcessTableLocked() {
+  ProcessTableSnapshot* snapshot = new ProcessTableSnapshot;
+  if (s_process_table)
+    snapshot->processes = s_process_table->processes;
+  return snapshot;
+}
+
+void PublishProcessTableLocked(ProcessTableSnapshot* snapshot) {
+  ProcessTableSnapshot* old_snapshot = s_process_table;
+  __sync_synchronize();
+  *const_cast<ProcessTableSnapshot* volatile*>(&s_process_table) = snapshot;
+  if (old_snapshot) {
+    old_snapshot->next_retired = s_retired_process_tables;
+    s_retired_process_tables = old_snapshot;
+    ++s_num_retired_process_tables;
+  }
+  // Readers which start acquiring after this point see |snapshot|. Once no
+  // reader is acquiring, the readers of the retired snapshots are counted in
+  // their |num_readers|. Usually just try later instead of waiting, but do
+  // not let overlapping readers grow the list without bound.
+  while (__sync_fetch_and_add(&s_num_acquiring_process_table_readers, 0)) {
+    if (s_num_retired_process_tables <= kMaxRetiredProcessTables)
+      return;
+    sched_yield();
+  }
+  ProcessTableSnapshot** link = &s_retired_process_tables;
+  while (*link) {
+    ProcessTableSnapshot* retired = *link;
+    if (__sync_fetch_and_add(&retired->num_readers, 0)) {
+      link = &retired->next_retired;
+    } else {
+      *link = retired->next_retired;
+      --s_num_retired_process_tables;
+      delete retired;
+    }
+  }
+}
+
 }  // namespace
 
 volatile ProcessEmulator::EnterBinderFunc
@@ -150,17 +274,13 @@ bool ProcessEmulator::IsMultiThreaded() {
 }
 
 pid_t ProcessEmulator::GetFirstPid() {
-  ScopedPthreadMutexLocker lock(&s_mutex);
-  PidStringMap::iterator i = argv0_per_emulated_process_.begin();
-  if (i == argv0_per_emulated_process_.end()) return 0;
-  return i->first;
+  // Emulated pids are always positive.
+  return GetNextPid(0);
 }
 
 pid_t ProcessEmulator::GetNextPid(pid_t last_pid) {
-  ScopedPthreadMutexLocker lock(&s_mutex);
-  PidStringMap::iterator i = argv0_per_emulated_process_.upper_bound(last_pid);
-  if (i == argv0_per_emulated_process_.end()) return 0;
-  return i->first;
+  ScopedProcessTableReader reader;
+  return reader.GetNextPid(last_pid);
 }
 
 pid_t ProcessEmulator::AllocateNewPid(uid_t uid) {
@@ -174,8 +294,12 @@ pid_t ProcessEmulator::AllocateNewPid(uid_t uid) {
   // However we should usually create the process thread shortly after setting
   // up for it.
   result = ++s_prev_pid;
-  self->argv0_per_emulated_process_[result] = kDefaultProcessName;
-  self->uid_per_emulated_process_[result] = uid;
+  ProcessTableSnapshot* snapshot = CopyProcessTableLocked();
+  EmulatedProcessEntry* entry = &snapshot->processes[result];
+  entry->argv0 = kDefaultProcessName;
+  entry->uid = uid;
+  entry->has_uid = true;
+  PublishProcessTableLocked(snapshot);
   self->update_producer_.ProduceUpdate();
   return result;
 }
@@ -192,13 +316,15 @@ static void InitializeTls() {
   if (pthread_key_create(&s_tls, DestroyEmulatedProcessThreadState) != 0) {
     LOG_FATAL("Unable to create TLS key");
   }
+  s_tls_plus_one = static_cast<int>(s_tls) + 1;
 }
 
 static ProcessEmulatorThreadState* GetThreadState() {
-  pthread_once(&s_tls_init, InitializeTls);
-  ProcessEmulatorThreadState* result =
-      reinterpret_cast<ProcessEmulatorThreadState*>(pthread_getspecific(s_tls));
-  return result;
+  const int tls_plus_one = s_tls_plus_one;
+  if (!tls_plus_one)
+    return NULL;
+  return reinterpret_cast<ProcessEmulatorThreadState*>(
+      pthread_getspecific(static_cast<pthread_key_t>(tls_plus_one - 1)));
 }
 
 static void InitProcessEmulatorTLS(const EmulatedProcessInfo& process) {
@@ -472,23 +598,22 @@ void ProcessEmulator::SetArgV0(const char* argv0) {
   pid_t pid = getpid();
   ProcessEmulator* self = GetInstance();
   ScopedPthreadMutexLocker lock(&s_mutex);
-  self->argv0_per_emulated_process_[pid] = argv0;
+  ProcessTableSnapshot* snapshot = CopyProcessTableLocked();
+  snapshot->processes[pid].argv0 = argv0;
+  PublishProcessTableLocked(snapshot);
+  self->update_producer_.ProduceUpdate();
 }
 
 bool ProcessEmulator::GetInfoByPid(pid_t pid, std::string* out_argv0,
                                    uid_t* out_uid) {
-  ProcessEmulator* self = GetInstance();
-  ScopedPthreadMutexLocker lock(&s_mutex);
-  PidStringMap::iterator i = self->argv0_per_emulated_process_.find(pid);
-  if (i == self->argv0_per_emulated_process_.end())
-    return false;
-  PidUidMap::iterator j = self->uid_per_emulated_process_.find(pid);
-  if (j == self->uid_per_emulated_process_.end())
+  ScopedProcessTableReader reader;
+  const EmulatedProcessEntry* entry = reader.Find(pid);
+  if (!entry || !entry->has_uid)
     return false;
   if (out_argv0 != NULL)
-    *out_argv0 = i->second;
+    *out_argv0 = entry->argv0;
   if (out_uid != NULL)
-    *out_uid = j->second;
+    *out_uid = entry->uid;
   return true;
 }
 
@@ -567,8 +692,8 @@ void ProcessEmulator::ResetForTest() {
     pthread_setspecific(s_tls, NULL);
   }
   ScopedPthreadMutexLocker lock(&s_mutex);
-  self->argv0_per_emulated_process_.clear();
-  self->uid_per_emulated_process_.clear();
+  PublishProcessTableLocked(NULL);
+  self->update_producer_.ProduceUpdate();
   s_is_multi_threaded = false;
   s_prev_pid = kFirstPidMinusOne;
 }
@@ -578,8 +703,19 @@ void ProcessEmulator::AddProcessForTest(pid_t pid, uid_t uid,
                                         const char* argv0) {
   ProcessEmulator* self = ProcessEmulator::GetInstance();
   ScopedPthreadMutexLocker lock(&s_mutex);
-  self->argv0_per_emulated_process_[pid] = argv0;
-  self->uid_per_emulated_process_[pid] = uid;
+  ProcessTableSnapshot* snapshot = CopyProcessTableLocked();
+  EmulatedProcessEntry* entry = &snapshot->processes[pid];
+  entry->argv0 = argv0;
+  entry->uid = uid;
+  entry->has_uid = true;
+  PublishProcessTableLocked(snapshot);
+  self->update_producer_.ProduceUpdate();
+}
+
+// static
+int ProcessEmulator::GetNumRetiredProcessTablesForTest() {
+  ScopedPthreadMutexLocker lock(&s_mutex);
+  return s_num_retired_process_tables;
 }
 
 // static
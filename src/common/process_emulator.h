@@ -10,7 +10,6 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-#include <map>
 #include <string>
 
 #include "common/private/minimal_base.h"
@@ -128,6 +127,9 @@ class ProcessEmulator {
   static void ExitBinderCall();
 
   static void SetArgV0(const char* argv);
+
+  // These read a snapshot of the process table without locking, so they
+  // never block on thread creation.
   static bool GetInfoByPid(pid_t pid, std::string* out_argv0, uid_t* out_uid);
 
   // Gets the first emulated pid.  Note that by the time the function returns
@@ -150,8 +152,6 @@ class ProcessEmulator {
   friend class ProcessEmulatorTest;
   friend class posix_translation::ProcfsHandlerTest;
   friend class posix_translation::ScopedUidSetter;
-  typedef std::map<pid_t, std::string> PidStringMap;
-  typedef std::map<pid_t, uid_t> PidUidMap;
 
   ProcessEmulator();
   ~ProcessEmulator() {}
@@ -169,6 +169,10 @@ class ProcessEmulator {
   // For testing only: Add the given emulated process.
   static void AddProcessForTest(pid_t pid, uid_t uid, const char* argv0);
 
+  // For testing only: Returns the number of replaced process table snapshots
+  // which are not deleted yet.
+  static int GetNumRetiredProcessTablesForTest();
+
   // For testing. Do not call.
   // In unit tests where |start_routine| is not actually started after
   // UpdatePthreadCreateArgsIfNewEmulatedProcess(), we need to call this
@@ -185,8 +189,6 @@ class ProcessEmulator {
   static volatile EnterBinderFunc binder_enter_function_;
   static volatile ExitBinderFunc binder_exit_function_;
 
-  PidStringMap argv0_per_emulated_process_;
-  PidUidMap uid_per_emulated_process_;
   UpdateProducer update_producer_;
 
   COMMON_DISALLOW_COPY_AND_ASSIGN(ProcessEmulator);
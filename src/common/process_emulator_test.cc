@@ -6,6 +6,8 @@
 
 #include <pthread.h>
 
+#include <string>
+
 #include "base/compiler_specific.h"
 #include "common/process_emulator.h"
 #include "gtest/gtest.h"
@@ -16,6 +18,11 @@ static void* EmptyRoutine(void* arg) {
   return NULL;
 }
 
+static const int kNumProcessesForThreadTest = 200;
+static const int kNumReaderThreads = 4;
+// See kMaxRetiredProcessTables in process_emulator.cc.
+static const int kMaxRetiredProcessTables = 16;
+
 class ProcessEmulatorTest : public testing::Test {
  public:
   virtual void SetUp() OVERRIDE {
@@ -36,6 +43,31 @@ class ProcessEmulatorTest : public testing::Test {
         start_routine, arg);
   }
 
+  static void AddProcessForTest(pid_t pid, uid_t uid, const char* argv0) {
+    ProcessEmulator::AddProcessForTest(pid, uid, argv0);
+  }
+
+  static void* AddProcesses(void* arg) {
+    for (int i = 1; i <= kNumProcessesForThreadTest; ++i)
+      AddProcessForTest(1000 + i, kFirstAppUid, "app");
+    return NULL;
+  }
+
+  static void* EnumerateProcesses(void* arg) {
+    const volatile bool* done = static_cast<volatile bool*>(arg);
+    ProcessEmulator* emulator = ProcessEmulator::GetInstance();
+    while (!*done) {
+      for (pid_t pid = emulator->GetFirstPid(); pid;
+           pid = emulator->GetNextPid(pid)) {
+      }
+    }
+    return NULL;
+  }
+
+  static int GetNumRetiredProcessTablesForTest() {
+    return ProcessEmulator::GetNumRetiredProcessTablesForTest();
+  }
+
  protected:
   ProcessEmulator* emulator_;
 };
@@ -71,4 +103,75 @@ TEST_F(ProcessEmulatorTest, NewEmulatedProcess) {
   DestroyPthreadCreateArgsIfAllocatedForTest(start_routine, arg);
 }
 
+TEST_F(ProcessEmulatorTest, ProcessTable) {
+  EXPECT_EQ(0, emulator_->GetFirstPid());
+  EXPECT_FALSE(ProcessEmulator::GetInfoByPid(300, NULL, NULL));
+
+  AddProcessForTest(300, kFirstAppUid, "app");
+  AddProcessForTest(250, kSystemUid, "system");
+  EXPECT_EQ(250, emulator_->GetFirstPid());
+  EXPECT_EQ(300, emulator_->GetNextPid(250));
+  EXPECT_EQ(300, emulator_->GetNextPid(260));
+  EXPECT_EQ(0, emulator_->GetNextPid(300));
+
+  std::string argv0;
+  uid_t uid = 0;
+  EXPECT_TRUE(ProcessEmulator::GetInfoByPid(300, &argv0, &uid));
+  EXPECT_EQ("app", argv0);
+  EXPECT_EQ(kFirstAppUid, uid);
+
+  emulator_->SetFirstEmulatedProcessThread(kSystemUid);
+  EXPECT_TRUE(ProcessEmulator::GetInfoByPid(ProcessEmulator::GetPid(), &argv0,
+                                            &uid));
+  EXPECT_EQ(kSystemUid, uid);
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST_F(ProcessEmulatorTest, QEMU_DISABLED_EnumerateWhileAdding) {
+  emulator_->SetFirstEmulatedProcessThread(kSystemUid);
+  const pid_t first_pid = emulator_->GetFirstPid();
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, &AddProcesses, NULL));
+  // The enumeration only sees increasing pids of existing processes.
+  int num_processes = 0;
+  while (num_processes <= kNumProcessesForThreadTest) {
+    num_processes = 0;
+    pid_t last_pid = 0;
+    for (pid_t pid = emulator_->GetFirstPid(); pid;
+         pid = emulator_->GetNextPid(pid)) {
+      ASSERT_LT(last_pid, pid);
+      ASSERT_TRUE(ProcessEmulator::GetInfoByPid(pid, NULL, NULL));
+      last_pid = pid;
+      ++num_processes;
+    }
+  }
+  ASSERT_EQ(0, pthread_join(thread, NULL));
+  EXPECT_EQ(first_pid, emulator_->GetFirstPid());
+  EXPECT_EQ(kNumProcessesForThreadTest + 1, num_processes);
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST_F(ProcessEmulatorTest, QEMU_DISABLED_OverlappingReaders) {
+  volatile bool done = false;
+  pthread_t threads[kNumReaderThreads];
+  for (int i = 0; i < kNumReaderThreads; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, &EnumerateProcesses,
+                                const_cast<bool*>(&done)));
+  }
+  // The readers overlap each other all the time, but the replaced
+  // snapshots are still deleted.
+  for (int i = 1; i <= kNumProcessesForThreadTest; ++i) {
+    AddProcessForTest(1000 + i, kFirstAppUid, "app");
+    EXPECT_GE(kMaxRetiredProcessTables + kNumReaderThreads,
+              GetNumRetiredProcessTablesForTest());
+  }
+  done = true;
+  for (int i = 0; i < kNumReaderThreads; ++i)
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  AddProcessForTest(999, kFirstAppUid, "app");
+  EXPECT_EQ(0, GetNumRetiredProcessTablesForTest());
+}
+
 }  // namespace arc
@@ -0,0 +1,471 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Each thread records events into its own fixed-size buffer without taking
+// any lock. A buffer is only written by its owner thread, which publishes an
+// event by incrementing |size| after a memory barrier, so the exporter can
+// read the events [0, size) from any thread. The buffer of an exited thread
+// is kept so that its events can be exported, and is reused by a new thread
+// once its events belong to an old session. The event storage is allocated
+// for a limited number of buffers, so threads churning during a session do
+// not grow the memory without bound.
+
+#include "common/trace_buffer.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base/strings/stringprintf.h"
+#include "common/alog.h"
+#include "common/atomics.h"
+#include "common/scoped_pthread_mutex_locker.h"
+#include "common/thread_local.h"
+#include "common/trace_event.h"
+
+namespace arc {
+namespace trace {
+
+namespace {
+
+const int kMaxCategories = 64;
+const int kMaxEventsPerThread = 16 * 1024;
+// The maximum number of buffers which have event storage, about 40MB in
+// total. The events of the other threads are dropped.
+const int kMaxEventStorages = 16;
+const int kMaxArgs = 2;
+const size_t kMaxThreadNameLength = 32;
+// The size of the per-event storage for the strings which are copied because
+// of TRACE_EVENT_FLAG_COPY or TRACE_VALUE_TYPE_COPY_STRING. Longer strings
+// are truncated.
+const size_t kCopyStorageSize = 96;
+
+struct Event {
+  int64_t timestamp_ns;
+  uint64_t id;
+  const char* name;
+  const char* arg_names[kMaxArgs];
+  uint64_t arg_values[kMaxArgs];
+  unsigned char arg_types[kMaxArgs];
+  unsigned char num_args;
+  unsigned char category;
+  unsigned char flags;
+  char phase;
+  // The last byte is always 0 so that a string in this storage is always
+  // terminated even if the event is being overwritten.
+  char copy_storage[kCopyStorageSize];
+};
+
+struct ThreadBuffer {
+  ThreadBuffer* next;
+  int tid;
+  // The session this buffer was last written in. Only written by the owner
+  // thread.
+  int generation;
+  // The number of published events. Only written by the owner thread.
+  int size;
+  int dropped;
+  // Set when the owner thread exits.
+  int exited;
+  // Allocated when the owner records its first event. Kept when the buffer
+  // is reused.
+  Event* events;
+  char name[kMaxThreadNameLength];
+};
+
+// The per-thread state, which is deleted when the thread exits.
+struct ThreadState {
+  ThreadState();
+  ~ThreadState();
+
+  // Created when the thread records its first event.
+  ThreadBuffer* buffer;
+  // The name set by SetInProcessThreadName(), which is copied to |buffer|.
+  char name[kMaxThreadNameLength];
+};
+
+// Guards the category names and the thread buffer list.
+pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char* g_category_names[kMaxCategories];
+unsigned char g_category_enabled[kMaxCategories];
+int g_num_categories;
+// Returned when |g_category_enabled| is full. Never enabled.
+unsigned char g_overflow_category_enabled;
+
+// The comma separated category filter of the current session. NULL means all
+// categories.
+char* g_category_filter;
+bool g_is_tracing;
+// Incremented by every StartInProcessTracing() call so that each thread
+// discards its old events when it records the first event of a new session.
+int g_generation;
+
+ThreadBuffer* g_thread_buffers;
+int g_num_threads;
+// The number of buffers which have event storage.
+int g_num_event_storages;
+// The events dropped in the current session by the threads whose buffers
+// have been reused.
+int g_reused_buffer_dropped;
+
+DEFINE_THREAD_LOCAL(ThreadState, g_thread_state);
+
+int64_t GetTimestampNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Must be called with |g_mutex| locked.
+bool MatchesCategoryFilterLocked(const char* category_name) {
+  if (!g_category_filter)
+    return true;
+  const size_t name_length = strlen(category_name);
+  const char* token = g_category_filter;
+  while (true) {
+    const char* end = strchr(token, ',');
+    const size_t length = end ? end - token : strlen(token);
+    if ((length == 1 && token[0] == '*') ||
+        (length == name_length && !strncmp(token, category_name, length)))
+      return true;
+    if (!end)
+      return false;
+    token = end + 1;
+  }
+}
+
+// Must be called with |g_mutex| locked.
+void UpdateCategoriesLocked() {
+  for (int i = 0; i < g_num_categories; ++i) {
+    g_category_enabled[i] =
+        g_is_tracing && MatchesCategoryFilterLocked(g_category_names[i]);
+  }
+}
+
+ThreadState::ThreadState() : buffer(NULL) {
+  memset(name, 0, sizeof(name));
+}
+
+ThreadState::~ThreadState() {
+  if (buffer)
+    ReleaseStore(&buffer->exited, 1);
+}
+
+// Returns a buffer of an exited thread whose events are no longer exported,
+// or a new buffer. Must be called with |g_mutex| locked.
+ThreadBuffer* AcquireThreadBufferLocked() {
+  ThreadBuffer* buffer = g_thread_buffers;
+  for (; buffer; buffer = buffer->next) {
+    if (!AcquireLoad(&buffer->exited))
+      continue;
+    if (buffer->generation != g_generation)
+      break;
+    if (!buffer->size) {
+      // Keep the number of the events this thread has dropped.
+      g_reused_buffer_dropped += buffer->dropped;
+      break;
+    }
+  }
+  if (!buffer) {
+    buffer = static_cast<ThreadBuffer*>(calloc(1, sizeof(ThreadBuffer)));
+    if (!buffer)
+      LOG_ALWAYS_FATAL("Failed to allocate a trace buffer");
+    buffer->next = g_thread_buffers;
+    g_thread_buffers = buffer;
+  }
+  buffer->tid = ++g_num_threads;
+  buffer->generation = g_generation;
+  buffer->size = 0;
+  buffer->dropped = 0;
+  buffer->exited = 0;
+  memset(buffer->name, 0, sizeof(buffer->name));
+  return buffer;
+}
+
+ThreadBuffer* GetThreadBuffer() {
+  ThreadState& state = g_thread_state.Ref();
+  if (!state.buffer) {
+    ScopedPthreadMutexLocker lock(&g_mutex);
+    state.buffer = AcquireThreadBufferLocked();
+    memcpy(state.buffer->name, state.name, kMaxThreadNameLength);
+  }
+  return state.buffer;
+}
+
+// Allocates the event storage of |buffer|. Returns false if too many buffers
+// already have one.
+bool AllocateEvents(ThreadBuffer* buffer) {
+  if (AcquireLoad(&g_num_event_storages) >= kMaxEventStorages)
+    return false;
+  ScopedPthreadMutexLocker lock(&g_mutex);
+  if (g_num_event_storages >= kMaxEventStorages)
+    return false;
+  Event* events =
+      static_cast<Event*>(calloc(kMaxEventsPerThread, sizeof(Event)));
+  if (!events)
+    LOG_ALWAYS_FATAL("Failed to allocate trace events");
+  ReleaseStore(&g_num_event_storages, g_num_event_storages + 1);
+  __sync_synchronize();
+  buffer->events = events;
+  return true;
+}
+
+// Copies |str| to the unused part of |event->copy_storage|. Returns a
+// pointer to the copy.
+const char* CopyString(const char* str, Event* event, size_t* used) {
+  char* dest = event->copy_storage + *used;
+  const size_t available = kCopyStorageSize - 1 - *used;
+  const size_t length = str ? strnlen(str, available) : 0;
+  if (length)
+    memcpy(dest, str, length);
+  if (*used + length < kCopyStorageSize - 1) {
+    dest[length] = '\0';
+    *used += length + 1;
+  } else {
+    *used = kCopyStorageSize - 1;
+  }
+  return dest;
+}
+
+void AppendJSONString(const char* str, std::string* out) {
+  out->push_back('"');
+  for (const char* p = str ? str : ""; *p; ++p) {
+    const unsigned char c = *p;
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      base::StringAppendF(out, "\\u%04x", c);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+void AppendJSONValue(unsigned char type, uint64_t value, std::string* out) {
+  arc_trace_event_internal::TraceValueUnion u;
+  u.as_uint = value;
+  switch (type) {
+    case TRACE_VALUE_TYPE_BOOL:
+      *out += u.as_bool ? "true" : "false";
+      break;
+    case TRACE_VALUE_TYPE_UINT:
+      base::StringAppendF(out, "%llu", u.as_uint);
+      break;
+    case TRACE_VALUE_TYPE_INT:
+      base::StringAppendF(out, "%lld", u.as_int);
+      break;
+    case TRACE_VALUE_TYPE_DOUBLE:
+      // JSON has no representation for NaN and infinities.
+      if (isfinite(u.as_double))
+        base::StringAppendF(out, "%.17g", u.as_double);
+      else
+        base::StringAppendF(out, "\"%f\"", u.as_double);
+      break;
+    case TRACE_VALUE_TYPE_POINTER:
+      base::StringAppendF(out, "\"0x%llx\"", u.as_uint);
+      break;
+    case TRACE_VALUE_TYPE_STRING:
+    case TRACE_VALUE_TYPE_COPY_STRING:
+      AppendJSONString(u.as_string, out);
+      break;
+    default:
+      *out += "null";
+      break;
+  }
+}
+
+void AppendEventAsJSON(const Event& event, int pid, int tid,
+                       std::string* out) {
+  *out += "{\"name\":";
+  AppendJSONString(event.name, out);
+  *out += ",\"cat\":";
+  AppendJSONString(event.category < g_num_categories ?
+                   g_category_names[event.category] : "", out);
+  base::StringAppendF(out, ",\"ph\":\"%c\",\"ts\":%lld.%03lld,"
+                      "\"pid\":%d,\"tid\":%d",
+                      event.phase,
+                      static_cast<long long>(event.timestamp_ns / 1000),
+                      static_cast<long long>(event.timestamp_ns % 1000),
+                      pid, tid);
+  if (event.flags & TRACE_EVENT_FLAG_HAS_ID)
+    base::StringAppendF(out, ",\"id\":\"0x%llx\"",
+                        static_cast<unsigned long long>(event.id));
+  if (event.phase == TRACE_EVENT_PHASE_INSTANT)
+    *out += ",\"s\":\"t\"";
+  *out += ",\"args\":{";
+  for (int i = 0; i < event.num_args; ++i) {
+    if (i)
+      out->push_back(',');
+    AppendJSONString(event.arg_names[i], out);
+    out->push_back(':');
+    AppendJSONValue(event.arg_types[i], event.arg_values[i], out);
+  }
+  *out += "}}";
+}
+
+}  // namespace
+
+void StartInProcessTracing(const char* categories) {
+  ScopedPthreadMutexLocker lock(&g_mutex);
+  free(g_category_filter);
+  g_category_filter =
+      (categories && categories[0]) ? strdup(categories) : NULL;
+  __sync_add_and_fetch(&g_generation, 1);
+  g_reused_buffer_dropped = 0;
+  g_is_tracing = true;
+  UpdateCategoriesLocked();
+}
+
+void StopInProcessTracing() {
+  ScopedPthreadMutexLocker lock(&g_mutex);
+  g_is_tracing = false;
+  UpdateCategoriesLocked();
+}
+
+bool IsInProcessTracing() {
+  ScopedPthreadMutexLocker lock(&g_mutex);
+  return g_is_tracing;
+}
+
+std::string GetInProcessTraceAsJSON() {
+  ScopedPthreadMutexLocker lock(&g_mutex);
+  const int pid = getpid();
+  const int generation = AcquireLoad(&g_generation);
+  std::string result = "{\"traceEvents\":[";
+  bool first = true;
+  int dropped = g_reused_buffer_dropped;
+  for (ThreadBuffer* buffer = g_thread_buffers; buffer;
+       buffer = buffer->next) {
+    if (AcquireLoad(&buffer->generation) != generation)
+      continue;
+    const int size = AcquireLoad(&buffer->size);
+    dropped += AcquireLoad(&buffer->dropped);
+    if (!size)
+      continue;
+    for (int i = 0; i < size; ++i) {
+      if (!first)
+        result.push_back(',');
+      first = false;
+      AppendEventAsJSON(buffer->events[i], pid, buffer->tid, &result);
+    }
+    if (buffer->name[0]) {
+      base::StringAppendF(&result, ",{\"name\":\"thread_name\",\"ph\":\"M\","
+                          "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                          pid, buffer->tid);
+      AppendJSONString(buffer->name, &result);
+      result += "}}";
+    }
+  }
+  base::StringAppendF(&result, "],\"droppedEventCount\":%d}", dropped);
+  return result;
+}
+
+const unsigned char* GetInProcessCategoryEnabled(const char* category_name) {
+  {
+    ScopedPthreadMutexLocker lock(&g_mutex);
+    for (int i = 0; i < g_num_categories; ++i) {
+      if (!strcmp(g_category_names[i], category_name))
+        return &g_category_enabled[i];
+    }
+    if (g_num_categories < kMaxCategories) {
+      const int index = g_num_categories++;
+      g_category_names[index] = strdup(category_name);
+      g_category_enabled[index] =
+          g_is_tracing && MatchesCategoryFilterLocked(category_name);
+      return &g_category_enabled[index];
+    }
+  }
+  // Log without |g_mutex| since writing the log may add trace events.
+  ALOGW("Too many trace categories, %s is never traced", category_name);
+  return &g_overflow_category_enabled;
+}
+
+bool IsInProcessCategory(const unsigned char* category_enabled) {
+  return (category_enabled >= g_category_enabled &&
+          category_enabled < g_category_enabled + kMaxCategories) ||
+      category_enabled == &g_overflow_category_enabled;
+}
+
+void AddInProcessTraceEvent(char phase,
+                            const unsigned char* category_enabled,
+                            const char* name,
+                            uint64_t id,
+                            int num_args,
+                            const char** arg_names,
+                            const unsigned char* arg_types,
+                            const uint64_t* arg_values,
+                            unsigned char flags) {
+  if (!*category_enabled)
+    return;
+  ThreadBuffer* buffer = GetThreadBuffer();
+  const int generation = AcquireLoad(&g_generation);
+  if (buffer->generation != generation) {
+    ReleaseStore(&buffer->size, 0);
+    ReleaseStore(&buffer->dropped, 0);
+    ReleaseStore(&buffer->generation, generation);
+  }
+  const int size = buffer->size;
+  if (size == kMaxEventsPerThread ||
+      (!buffer->events && !AllocateEvents(buffer))) {
+    ReleaseStore(&buffer->dropped, buffer->dropped + 1);
+    return;
+  }
+
+  Event* event = &buffer->events[size];
+  size_t copy_used = 0;
+  const bool copy = flags & TRACE_EVENT_FLAG_COPY;
+  event->timestamp_ns = GetTimestampNs();
+  event->id = id;
+  event->name = copy ? CopyString(name, event, &copy_used) : name;
+  event->phase = phase;
+  event->flags = flags;
+  event->category = category_enabled - g_category_enabled;
+  if (num_args > kMaxArgs)
+    num_args = kMaxArgs;
+  event->num_args = num_args;
+  for (int i = 0; i < num_args; ++i) {
+    event->arg_names[i] =
+        copy ? CopyString(arg_names[i], event, &copy_used) : arg_names[i];
+    event->arg_types[i] = arg_types[i];
+    if (arg_types[i] == TRACE_VALUE_TYPE_COPY_STRING) {
+      arc_trace_event_internal::TraceValueUnion u;
+      u.as_uint = arg_values[i];
+      u.as_string = CopyString(u.as_string, event, &copy_used);
+      event->arg_values[i] = u.as_uint;
+    } else {
+      event->arg_values[i] = arg_values[i];
+    }
+  }
+  ReleaseStore(&buffer->size, size + 1);
+}
+
+void SetInProcessThreadName(const char* thread_name) {
+  // Do not create a buffer here. Most threads are named when they start,
+  // whether or not tracing is active.
+  ThreadState& state = g_thread_state.Ref();
+  strncpy(state.name, thread_name, kMaxThreadNameLength - 1);
+  // The last byte is kept 0 since the exporter may read the name
+  // concurrently.
+  if (state.buffer)
+    strncpy(state.buffer->name, thread_name, kMaxThreadNameLength - 1);
+}
+
+size_t GetInProcessThreadBufferCountForTesting() {
+  ScopedPthreadMutexLocker lock(&g_mutex);
+  size_t count = 0;
+  for (ThreadBuffer* buffer = g_thread_buffers; buffer;
+       buffer = buffer->next) {
+    ++count;
+  }
+  return count;
+}
+
+}  // namespace trace
+}  // namespace arc
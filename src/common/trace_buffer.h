@@ -0,0 +1,68 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// In-process backend for arc::trace which is used when the
+// PPB_Trace_Event_Dev interface is not available, e.g. in unit tests and
+// headless runs.
+
+#ifndef COMMON_TRACE_BUFFER_H_
+#define COMMON_TRACE_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace arc {
+namespace trace {
+
+// Starts recording TRACE_EVENT macros into per-thread in-process buffers.
+// |categories| is a comma separated list of categories to record. NULL, an
+// empty string, or "*" records all categories. Events recorded by the
+// previous session are discarded. This only affects the categories which are
+// not handled by the PPAPI interface.
+void StartInProcessTracing(const char* categories);
+
+// Stops recording. The recorded events are kept until the next
+// StartInProcessTracing() call.
+void StopInProcessTracing();
+
+bool IsInProcessTracing();
+
+// Returns the events recorded by the current or last session in the Chrome
+// JSON trace format, which can be loaded in about:tracing. This should be
+// called after StopInProcessTracing(); events which are being recorded while
+// the export is running may be missing.
+std::string GetInProcessTraceAsJSON();
+
+// The following functions are called from trace_event.cc.
+
+// Returns the enabled flag for |category_name|. The returned pointer stays
+// valid forever, and the flag is updated by Start/StopInProcessTracing.
+const unsigned char* GetInProcessCategoryEnabled(const char* category_name);
+
+// Returns true if |category_enabled| is returned by
+// GetInProcessCategoryEnabled().
+bool IsInProcessCategory(const unsigned char* category_enabled);
+
+void AddInProcessTraceEvent(char phase,
+                            const unsigned char* category_enabled,
+                            const char* name,
+                            uint64_t id,
+                            int num_args,
+                            const char** arg_names,
+                            const unsigned char* arg_types,
+                            const uint64_t* arg_values,
+                            unsigned char flags);
+
+void SetInProcessThreadName(const char* thread_name);
+
+// Returns the number of per-thread buffers, including the ones kept for
+// exited threads.
+size_t GetInProcessThreadBufferCountForTesting();
+
+}  // namespace trace
+}  // namespace arc
+
+#endif  // COMMON_TRACE_BUFFER_H_
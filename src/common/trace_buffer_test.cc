@@ -0,0 +1,190 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <pthread.h>
+
+#include <string>
+
+#include "base/strings/stringprintf.h"
+#include "common/trace_buffer.h"
+#include "common/trace_event.h"
+#include "gtest/gtest.h"
+
+namespace arc {
+namespace trace {
+
+namespace {
+
+size_t CountOccurrences(const std::string& str, const std::string& pattern) {
+  size_t count = 0;
+  for (size_t pos = str.find(pattern); pos != std::string::npos;
+       pos = str.find(pattern, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void TraceScope() {
+  TRACE_EVENT1("TraceBufferTest", "TraceScope", "value", 42);
+}
+
+void* TraceOnThread(void*) {
+  SetThreadName("TraceBufferTestThread");
+  TraceScope();
+  return NULL;
+}
+
+void* SetNameOnThread(void*) {
+  SetInProcessThreadName("TraceBufferTestThread");
+  return NULL;
+}
+
+}  // namespace
+
+TEST(TraceBufferTest, NotTracing) {
+  StopInProcessTracing();
+  const unsigned char* enabled = GetCategoryEnabled("TraceBufferTest");
+  EXPECT_FALSE(*enabled);
+  EXPECT_TRUE(IsInProcessCategory(enabled));
+  EXPECT_EQ(enabled, GetCategoryEnabled("TraceBufferTest"));
+}
+
+TEST(TraceBufferTest, ScopedEvent) {
+  StartInProcessTracing(NULL);
+  EXPECT_TRUE(IsInProcessTracing());
+  TraceScope();
+  StopInProcessTracing();
+  EXPECT_FALSE(IsInProcessTracing());
+  // Not recorded after tracing is stopped.
+  TraceScope();
+
+  const std::string json = GetInProcessTraceAsJSON();
+  EXPECT_EQ(0U, json.find("{\"traceEvents\":["));
+  EXPECT_EQ(2U, CountOccurrences(json, "\"name\":\"TraceScope\""));
+  EXPECT_EQ(1U, CountOccurrences(json, "\"ph\":\"B\""));
+  EXPECT_EQ(1U, CountOccurrences(json, "\"ph\":\"E\""));
+  EXPECT_NE(std::string::npos, json.find("\"cat\":\"TraceBufferTest\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"value\":42}"));
+  EXPECT_NE(std::string::npos, json.find("\"droppedEventCount\":0}"));
+}
+
+TEST(TraceBufferTest, RestartDiscardsEvents) {
+  StartInProcessTracing(NULL);
+  TraceScope();
+  StartInProcessTracing(NULL);
+  TRACE_EVENT_INSTANT0("TraceBufferTest", "Instant");
+  StopInProcessTracing();
+
+  const std::string json = GetInProcessTraceAsJSON();
+  EXPECT_EQ(0U, CountOccurrences(json, "\"name\":\"TraceScope\""));
+  EXPECT_EQ(1U, CountOccurrences(json, "\"name\":\"Instant\""));
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"I\""));
+}
+
+TEST(TraceBufferTest, CategoryFilter) {
+  StartInProcessTracing("TraceBufferTestOther,TraceBufferTest");
+  EXPECT_TRUE(*GetCategoryEnabled("TraceBufferTest"));
+  EXPECT_FALSE(*GetCategoryEnabled("TraceBufferTestDisabled"));
+  TRACE_EVENT_INSTANT0("TraceBufferTest", "Enabled");
+  TRACE_EVENT_INSTANT0("TraceBufferTestDisabled", "Disabled");
+  StopInProcessTracing();
+  EXPECT_FALSE(*GetCategoryEnabled("TraceBufferTest"));
+
+  const std::string json = GetInProcessTraceAsJSON();
+  EXPECT_EQ(1U, CountOccurrences(json, "\"name\":\"Enabled\""));
+  EXPECT_EQ(0U, CountOccurrences(json, "\"name\":\"Disabled\""));
+
+  StartInProcessTracing("*");
+  EXPECT_TRUE(*GetCategoryEnabled("TraceBufferTestDisabled"));
+  StopInProcessTracing();
+}
+
+TEST(TraceBufferTest, CounterAndCopiedStrings) {
+  StartInProcessTracing(NULL);
+  std::string name = "Copied";
+  TRACE_EVENT_COPY_INSTANT1("TraceBufferTest", name.c_str(),
+                            "str", std::string("a\"b"));
+  name = "Overwritten";
+  TRACE_COUNTER1("TraceBufferTest", "Counter", 1234);
+  TRACE_EVENT_ASYNC_BEGIN0("TraceBufferTest", "Async", 0x10);
+  StopInProcessTracing();
+
+  const std::string json = GetInProcessTraceAsJSON();
+  EXPECT_NE(std::string::npos, json.find(
+      "\"name\":\"Copied\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"str\":\"a\\\"b\"}"));
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"C\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"value\":1234}"));
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"S\""));
+  EXPECT_NE(std::string::npos, json.find("\"id\":\"0x10\""));
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(TraceBufferTest, QEMU_DISABLED_Threads) {
+  static const int kNumThreads = 4;
+  StartInProcessTracing(NULL);
+  pthread_t threads[kNumThreads];
+  for (int i = 0; i < kNumThreads; ++i)
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, &TraceOnThread, NULL));
+  for (int i = 0; i < kNumThreads; ++i)
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  StopInProcessTracing();
+
+  // The events of exited threads are still exported.
+  const std::string json = GetInProcessTraceAsJSON();
+  EXPECT_EQ(kNumThreads * 2U,
+            CountOccurrences(json, "\"name\":\"TraceScope\""));
+  EXPECT_EQ(static_cast<size_t>(kNumThreads), CountOccurrences(
+      json, "\"args\":{\"name\":\"TraceBufferTestThread\"}"));
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(TraceBufferTest, QEMU_DISABLED_ThreadChurn) {
+  static const size_t kNumThreads = 64;
+  StartInProcessTracing(NULL);
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, &TraceOnThread, NULL));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+  }
+  StopInProcessTracing();
+
+  // Only a limited number of threads get the event storage. The events of
+  // the others are counted as dropped.
+  const std::string json = GetInProcessTraceAsJSON();
+  const size_t recorded_threads =
+      CountOccurrences(json, "\"name\":\"TraceScope\"") / 2;
+  EXPECT_LT(0U, recorded_threads);
+  EXPECT_GT(kNumThreads, recorded_threads);
+  EXPECT_NE(std::string::npos, json.find(base::StringPrintf(
+      "\"droppedEventCount\":%zu}", (kNumThreads - recorded_threads) * 2)));
+
+  // In a new session, new threads reuse the buffers of the exited threads.
+  const size_t num_buffers = GetInProcessThreadBufferCountForTesting();
+  StartInProcessTracing(NULL);
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, NULL, &TraceOnThread, NULL));
+    ASSERT_EQ(0, pthread_join(thread, NULL));
+  }
+  StopInProcessTracing();
+  EXPECT_EQ(num_buffers, GetInProcessThreadBufferCountForTesting());
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST(TraceBufferTest, QEMU_DISABLED_ThreadNameWithoutTracing) {
+  StopInProcessTracing();
+  // Naming a thread does not create a buffer unless it records an event.
+  const size_t num_buffers = GetInProcessThreadBufferCountForTesting();
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, &SetNameOnThread, NULL));
+  ASSERT_EQ(0, pthread_join(thread, NULL));
+  EXPECT_EQ(num_buffers, GetInProcessThreadBufferCountForTesting());
+}
+
+}  // namespace trace
+}  // namespace arc
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include "common/trace_event.h"
+#include "common/trace_buffer.h"
 #include "common/trace_event_ppapi.h"
 #include "ppapi/c/dev/ppb_trace_event_dev.h"
 
@@ -30,10 +31,9 @@ const unsigned char* GetCategoryEnabled(const char* category_name) {
     return reinterpret_cast<const unsigned char*>(
             g_trace_iface->GetCategoryEnabled(category_name));
   }
-  // In case the interface is not enabled, return a valid non-enabled category
-  // pointer.
-  static const unsigned char dummy = 0;
-  return &dummy;
+  // Without the interface, events are recorded in the process while
+  // in-process tracing is started.
+  return GetInProcessCategoryEnabled(category_name);
 }
 
 void AddTraceEvent(char phase,
@@ -45,7 +45,11 @@ void AddTraceEvent(char phase,
                   const unsigned char* arg_types,
                   const uint64_t* arg_values,
                   unsigned char flags) {
-  if (g_trace_iface) {
+  // The category may have been looked up before Init() was called.
+  if (IsInProcessCategory(category_enabled)) {
+    AddInProcessTraceEvent(phase, category_enabled, name, id, num_args,
+                           arg_names, arg_types, arg_values, flags);
+  } else if (g_trace_iface) {
     // |category_enabled| has to be passed as (const void*) because PPAPI has no
     // concept of pointers of different types being used as parameters.
     g_trace_iface->AddTraceEvent(phase,
@@ -55,6 +59,7 @@ void AddTraceEvent(char phase,
 }
 
 void SetThreadName(const char* thread_name) {
+  SetInProcessThreadName(thread_name);
   if (g_trace_iface)
     g_trace_iface->SetThreadName(thread_name);
 }
@@ -0,0 +1,241 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "posix_translation/ashmem_purger.h"
+
+#include <algorithm>
+
+#include "base/strings/stringprintf.h"
+#include "common/alog.h"
+#include "common/arc_strace.h"
+#include "common/memory_counters.h"
+#include "posix_translation/dev_ashmem.h"
+
+namespace posix_translation {
+
+AshmemPurger::Stats::Stats()
+    : unpinned_bytes(0),
+      purged_bytes(0),
+      purge_count(0),
+      was_purged_count(0) {
+}
+
+AshmemPurger::AshmemPurger(size_t budget)
+    : budget_(budget), reported_unpinned_bytes_(0) {
+}
+
+AshmemPurger::~AshmemPurger() {
+  ALOG_ASSERT(streams_.empty());
+  ALOG_ASSERT(lru_.empty());
+}
+
+void AshmemPurger::Unpin(DevAshmem* stream, size_t offset, size_t length) {
+  ALOG_ASSERT(stream);
+  if (!length)
+    return;
+  const size_t end = offset + length;
+  RangeMap& ranges = streams_[stream];
+
+  // Merge the existing ranges which overlap [offset, end) into the new one.
+  size_t new_start = offset;
+  size_t new_end = end;
+  bool purged = false;
+  RangeMap::iterator it = FindFirstRange(&ranges, offset);
+  while (it != ranges.end() && it->first < end) {
+    if (it->first <= offset && end <= it->second.end)
+      return;  // Already unpinned.
+    new_start = std::min(new_start, it->first);
+    new_end = std::max(new_end, it->second.end);
+    purged |= it->second.purged;
+    EraseRange(&ranges, it++);
+  }
+
+  Range range;
+  range.end = new_end;
+  range.purged = false;
+  range.lru_position =
+      lru_.insert(lru_.end(), std::make_pair(stream, new_start));
+  it = ranges.insert(std::make_pair(new_start, range)).first;
+  stats_.unpinned_bytes += new_end - new_start;
+
+  // A merged range is purged as a whole when a part of it has been purged.
+  if (purged)
+    PurgeRange(stream, it);
+  PurgeIfNeeded();
+  ReportUnpinnedBytes();
+}
+
+bool AshmemPurger::Pin(DevAshmem* stream, size_t offset, size_t length) {
+  StreamMap::iterator stream_it = streams_.find(stream);
+  if (stream_it == streams_.end())
+    return false;
+  RangeMap& ranges = stream_it->second;
+  const size_t end = offset + length;
+
+  bool was_purged = false;
+  RangeMap::iterator it = FindFirstRange(&ranges, offset);
+  while (it != ranges.end() && it->first < end) {
+    const size_t range_start = it->first;
+    Range& range = it->second;
+    was_purged |= range.purged;
+
+    if (range_start < offset && end < range.end) {
+      // [offset, end) is in the middle of the range. Split the range into two.
+      Range latter = range;
+      if (!range.purged) {
+        // The latter half inherits the age of the range.
+        LruList::iterator next_position = range.lru_position;
+        latter.lru_position =
+            lru_.insert(++next_position, std::make_pair(stream, end));
+        stats_.unpinned_bytes -= end - offset;
+      }
+      range.end = offset;
+      ranges.insert(std::make_pair(end, latter));
+      break;
+    }
+    if (range_start < offset) {
+      // Shrink the range from the end.
+      if (!range.purged)
+        stats_.unpinned_bytes -= range.end - offset;
+      range.end = offset;
+      ++it;
+      continue;
+    }
+    if (end < range.end) {
+      // Shrink the range from the start.
+      Range latter = range;
+      if (!range.purged) {
+        latter.lru_position->second = end;
+        stats_.unpinned_bytes -= end - range_start;
+      }
+      ranges.erase(it);
+      ranges.insert(std::make_pair(end, latter));
+      break;
+    }
+    // The range is fully pinned.
+    EraseRange(&ranges, it++);
+  }
+
+  if (ranges.empty())
+    streams_.erase(stream_it);
+  if (was_purged)
+    ++stats_.was_purged_count;
+  ReportUnpinnedBytes();
+  return was_purged;
+}
+
+bool AshmemPurger::IsUnpinned(
+    DevAshmem* stream, size_t offset, size_t length) const {
+  StreamMap::const_iterator stream_it = streams_.find(stream);
+  if (stream_it == streams_.end())
+    return false;
+  RangeMap::const_iterator it = FindFirstRange(stream_it->second, offset);
+  return it != stream_it->second.end() && it->first < offset + length;
+}
+
+void AshmemPurger::RemoveStream(DevAshmem* stream) {
+  StreamMap::iterator stream_it = streams_.find(stream);
+  if (stream_it == streams_.end())
+    return;
+  RangeMap& ranges = stream_it->second;
+  while (!ranges.empty())
+    EraseRange(&ranges, ranges.begin());
+  streams_.erase(stream_it);
+  ReportUnpinnedBytes();
+}
+
+size_t AshmemPurger::PurgeAll() {
+  const size_t purged_bytes = stats_.purged_bytes;
+  while (!lru_.empty()) {
+    DevAshmem* stream = lru_.front().first;
+    RangeMap& ranges = streams_[stream];
+    PurgeRange(stream, ranges.find(lru_.front().second));
+  }
+  ReportUnpinnedBytes();
+  return stats_.purged_bytes - purged_bytes;
+}
+
+void AshmemPurger::SetBudget(size_t budget) {
+  budget_ = budget;
+  PurgeIfNeeded();
+  ReportUnpinnedBytes();
+}
+
+std::string AshmemPurger::GetStatsAsString() const {
+  return base::StringPrintf(
+      "ashmem: budget=%zu unpinned=%zu purged=%zu (%zu ranges) "
+      "was_purged=%zu\n",
+      budget_, stats_.unpinned_bytes, stats_.purged_bytes, stats_.purge_count,
+      stats_.was_purged_count);
+}
+
+// static
+AshmemPurger::RangeMap::iterator AshmemPurger::FindFirstRange(
+    RangeMap* ranges, size_t offset) {
+  RangeMap::iterator it = ranges->upper_bound(offset);
+  if (it != ranges->begin()) {
+    RangeMap::iterator prev_it = it;
+    --prev_it;
+    if (offset < prev_it->second.end)
+      return prev_it;
+  }
+  return it;
+}
+
+// static
+AshmemPurger::RangeMap::const_iterator AshmemPurger::FindFirstRange(
+    const RangeMap& ranges, size_t offset) {
+  RangeMap::const_iterator it = ranges.upper_bound(offset);
+  if (it != ranges.begin()) {
+    RangeMap::const_iterator prev_it = it;
+    --prev_it;
+    if (offset < prev_it->second.end)
+      return prev_it;
+  }
+  return it;
+}
+
+void AshmemPurger::PurgeRange(DevAshmem* stream, RangeMap::iterator it) {
+  Range& range = it->second;
+  ALOG_ASSERT(!range.purged);
+  const size_t length = range.end - it->first;
+  ARC_STRACE_REPORT("Purging unpinned ashmem range: offset=%zu length=%zu "
+                    "(%s)", it->first, length, stream->GetAuxInfo().c_str());
+  stream->Purge(it->first, length);
+  range.purged = true;
+  lru_.erase(range.lru_position);
+  stats_.unpinned_bytes -= length;
+  stats_.purged_bytes += length;
+  ++stats_.purge_count;
+}
+
+void AshmemPurger::PurgeIfNeeded() {
+  while (stats_.unpinned_bytes > budget_) {
+    ALOG_ASSERT(!lru_.empty());
+    DevAshmem* stream = lru_.front().first;
+    RangeMap& ranges = streams_[stream];
+    RangeMap::iterator it = ranges.find(lru_.front().second);
+    ALOG_ASSERT(it != ranges.end());
+    PurgeRange(stream, it);
+  }
+}
+
+void AshmemPurger::ReportUnpinnedBytes() {
+  arc::MemoryCounters::Add(
+      arc::MemoryCounters::kAshmemUnpinnedBytes,
+      static_cast<int64_t>(stats_.unpinned_bytes) -
+          static_cast<int64_t>(reported_unpinned_bytes_));
+  reported_unpinned_bytes_ = stats_.unpinned_bytes;
+}
+
+void AshmemPurger::EraseRange(RangeMap* ranges, RangeMap::iterator it) {
+  Range& range = it->second;
+  if (!range.purged) {
+    lru_.erase(range.lru_position);
+    stats_.unpinned_bytes -= range.end - it->first;
+  }
+  ranges->erase(it);
+}
+
+}  // namespace posix_translation
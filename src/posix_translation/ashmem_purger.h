@@ -0,0 +1,125 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef POSIX_TRANSLATION_ASHMEM_PURGER_H_
+#define POSIX_TRANSLATION_ASHMEM_PURGER_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+
+namespace posix_translation {
+
+class DevAshmem;
+
+// A class that keeps track of unpinned ranges of all ashmem regions, and
+// purges the least recently unpinned ones when the total size of unpinned
+// ranges which are not purged yet exceeds a budget. This emulates the ashmem
+// shrinker in the Linux kernel which purges unpinned ranges under memory
+// pressure. Like the kernel, an unpinned range which overlaps existing ones
+// is merged with them, and a range is purged as a whole.
+// Note: This class is not thread-safe. VirtualFileSystem::mutex() must be
+// held when calling its methods.
+class AshmemPurger : public base::RefCounted<AshmemPurger> {
+ public:
+  struct Stats {
+    Stats();
+
+    // The total size of unpinned ranges which are not purged yet.
+    size_t unpinned_bytes;
+    // The total size of purged ranges so far.
+    size_t purged_bytes;
+    // The number of purged ranges so far.
+    size_t purge_count;
+    // The number of pin requests which found a purged range.
+    size_t was_purged_count;
+  };
+
+  // |budget| is the maximum total size of unpinned ranges which are kept
+  // without being purged.
+  explicit AshmemPurger(size_t budget);
+
+  // Marks [offset, offset+length) of |stream| as unpinned. This may purge the
+  // least recently unpinned ranges, including the new one, to keep the total
+  // size of unpinned ranges within the budget.
+  void Unpin(DevAshmem* stream, size_t offset, size_t length);
+
+  // Marks [offset, offset+length) of |stream| as pinned. Returns true if any
+  // of the unpinned ranges which overlap [offset, offset+length) has been
+  // purged.
+  bool Pin(DevAshmem* stream, size_t offset, size_t length);
+
+  // Returns true if any page in [offset, offset+length) of |stream| is
+  // unpinned.
+  bool IsUnpinned(DevAshmem* stream, size_t offset, size_t length) const;
+
+  // Forgets all unpinned ranges of |stream|. This must be called before
+  // |stream| is deleted.
+  void RemoveStream(DevAshmem* stream);
+
+  // Purges all unpinned ranges regardless of the budget. Returns the number
+  // of purged bytes.
+  size_t PurgeAll();
+
+  void SetBudget(size_t budget);
+  size_t budget() const { return budget_; }
+
+  const Stats& stats() const { return stats_; }
+  std::string GetStatsAsString() const;
+
+ private:
+  friend class base::RefCounted<AshmemPurger>;
+
+  // A list of unpinned ranges which are not purged yet. Each element is a
+  // pair of a stream and the start offset of the range. The least recently
+  // unpinned range comes first.
+  typedef std::list<std::pair<DevAshmem*, size_t> > LruList;
+
+  struct Range {
+    size_t end;  // exclusive
+    bool purged;
+    // The position of the range in |lru_|. Valid only when |purged| is false.
+    LruList::iterator lru_position;
+  };
+  // A map from the start offset of an unpinned range to the range. Ranges in
+  // the map never overlap.
+  typedef std::map<size_t, Range> RangeMap;
+  typedef std::map<DevAshmem*, RangeMap> StreamMap;
+
+  ~AshmemPurger();
+
+  // Returns the first range in |ranges| which ends after |offset|.
+  static RangeMap::iterator FindFirstRange(RangeMap* ranges, size_t offset);
+  static RangeMap::const_iterator FindFirstRange(const RangeMap& ranges,
+                                                 size_t offset);
+
+  // Purges the range |it| of |stream|.
+  void PurgeRange(DevAshmem* stream, RangeMap::iterator it);
+
+  // Purges the least recently unpinned ranges while the total size of the
+  // unpinned ranges exceeds the budget.
+  void PurgeIfNeeded();
+
+  // Removes the range |it| from |ranges| and |lru_|.
+  void EraseRange(RangeMap* ranges, RangeMap::iterator it);
+
+  // Updates the process-wide memory counter for unpinned ranges with the
+  // change in |stats_.unpinned_bytes| since the last call.
+  void ReportUnpinnedBytes();
+
+  size_t budget_;
+  LruList lru_;
+  StreamMap streams_;
+  Stats stats_;
+  size_t reported_unpinned_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(AshmemPurger);
+};
+
+}  // namespace posix_translation
+#endif  // POSIX_TRANSLATION_ASHMEM_PURGER_H_
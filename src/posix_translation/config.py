@@ -88,6 +88,8 @@ def _generate_libposix_translation():
   # nacl_pepper_path instead.
   n.add_ppapi_compile_flags()
   n.add_libchromium_base_compile_flags()
+  # For decompressing the read-only file system image.
+  n.add_include_paths('android/external/zlib')
   all_files = build_common.find_all_files(['src/posix_translation'],
                                           ['.cc'])
   n.build_default(all_files).archive()
@@ -103,7 +105,7 @@ def _generate_libposix_translation():
   # the library.
   # TODO(crbug.com/423063, crbug.com/336316): Statically link libcommon.a into
   # the DSO too for more safety.
-  n.add_library_deps('libchromium_base.a')
+  n.add_library_deps('libchromium_base.a', 'libz_static.a')
   n.add_compiler_flags(*compiler_flags)
   n.add_ppapi_link_flags()
   n.build_default([]).link()
@@ -196,17 +198,22 @@ def generate_test_ninjas():
   # to also store a test image in the same location for simplicity.
   out_path = os.path.dirname(gen_prod_image)
   gen_test_image = os.path.join(out_path, 'test_readonly_fs_image.img')
+  gen_test_image_v1 = os.path.join(out_path, 'test_readonly_fs_image_v1.img')
+  gen_test_image_compressed = os.path.join(
+      out_path, 'test_readonly_fs_image_compressed.img')
 
   n.rule(rule_name,
          command=script_path + ' $out_path',
          description=rule_name + ' $in_real_path')
   n.add_ppapi_compile_flags()
-  n.build([gen_test_image], rule_name,
+  n.build([gen_test_image, gen_test_image_v1, gen_test_image_compressed],
+          rule_name,
           variables={'out_path': out_path},
           # The script calls create_readonly_fs_image.py.
           implicit=[script_path,
                     _CREATE_READONLY_FS_IMAGE_SCRIPT,
                     ])
+  n.add_include_paths('android/external/zlib')
   all_files = n.find_all_contained_test_sources()
 
   n.build_default(all_files, base_path=None)
@@ -214,10 +221,11 @@ def generate_test_ninjas():
   n.add_library_deps('libposix_translation_static.a',
                      'libchromium_base.a',
                      'libcommon.a',
-                     'libgccdemangle_static.a')
+                     'libgccdemangle_static.a',
+                     'libz_static.a')
   if build_common.use_ndk_direct_execution():
     n.add_defines('USE_NDK_DIRECT_EXECUTION')
-  implicit = [gen_test_image]
+  implicit = [gen_test_image, gen_test_image_v1, gen_test_image_compressed]
   if open_source.is_open_source_repo():
     implicit.append(gen_prod_image)
     n.add_defines('PROD_READONLY_FS_IMAGE="%s"' % gen_prod_image)
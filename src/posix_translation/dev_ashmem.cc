@@ -14,6 +14,8 @@
 #include <algorithm>
 
 #include "base/strings/string_util.h"  // strlcpy
+#include "common/memory_counters.h"
+#include "posix_translation/address_util.h"
 #include "posix_translation/dir.h"
 #include "posix_translation/statfs.h"
 #include "posix_translation/virtual_file_system.h"
@@ -38,7 +40,9 @@ int DoStatLocked(const std::string& pathname, struct stat* out) {
 
 }  // namespace
 
-DevAshmemHandler::DevAshmemHandler() : DeviceHandler("DevAshmemHandler") {
+DevAshmemHandler::DevAshmemHandler()
+    : DeviceHandler("DevAshmemHandler"),
+      purger_(new AshmemPurger(kDefaultUnpinnedMemoryBudget)) {
 }
 
 DevAshmemHandler::~DevAshmemHandler() {
@@ -50,14 +54,25 @@ scoped_refptr<FileStream> DevAshmemHandler::open(
     errno = ENOTDIR;
     return NULL;
   }
-  return new DevAshmem(fd, pathname, oflag);
+  return new DevAshmem(fd, pathname, oflag, purger_);
 }
 
 int DevAshmemHandler::stat(const std::string& pathname, struct stat* out) {
   return DoStatLocked(pathname, out);
 }
 
-DevAshmem::DevAshmem(int fd, const std::string& pathname, int oflag)
+void DevAshmemHandler::SetUnpinnedMemoryBudget(size_t budget) {
+  VirtualFileSystem::GetVirtualFileSystem()->mutex().AssertAcquired();
+  purger_->SetBudget(budget);
+}
+
+std::string DevAshmemHandler::GetPurgeStatsAsString() const {
+  VirtualFileSystem::GetVirtualFileSystem()->mutex().AssertAcquired();
+  return purger_->GetStatsAsString();
+}
+
+DevAshmem::DevAshmem(int fd, const std::string& pathname, int oflag,
+                     scoped_refptr<AshmemPurger> purger)
     : DeviceStream(oflag, pathname),
       fd_(fd),
       size_(0),
@@ -65,12 +80,18 @@ DevAshmem::DevAshmem(int fd, const std::string& pathname, int oflag)
       mmap_length_(0),
       offset_(0),
       has_private_mapping_(false),
+      purger_(purger),
       state_(STATE_INITIAL) {
+  ALOG_ASSERT(purger_);
 }
 
 DevAshmem::~DevAshmem() {
-  if (state_ == STATE_UNMAP_DELAYED)
+  purger_->RemoveStream(this);
+  if (state_ == STATE_UNMAP_DELAYED) {
     ::munmap(content_, mmap_length_);
+    arc::MemoryCounters::Add(arc::MemoryCounters::kAshmemBytes,
+                             -static_cast<int64_t>(mmap_length_));
+  }
 }
 
 int DevAshmem::fstat(struct stat* out) {
@@ -94,6 +115,10 @@ int DevAshmem::ioctl(int request, va_list ap) {
     return IoctlPin(request, ap);
   } else if (urequest == ASHMEM_UNPIN) {
     return IoctlUnpin(request, ap);
+  } else if (urequest == ASHMEM_GET_PIN_STATUS) {
+    return IoctlGetPinStatus(request, ap);
+  } else if (urequest == ASHMEM_PURGE_ALL_CACHES) {
+    return IoctlPurgeAllCaches(request, ap);
   }
   ALOGE("ioctl command %u is not supported", urequest);
   errno = EINVAL;
@@ -194,6 +219,8 @@ void* DevAshmem::mmap(
     mmap_length_ = length;
     ARC_STRACE_REPORT("MAP_ANONYMOUS returned %p (name_=%s)",
                       content_, name_.c_str());
+    if (content_ != MAP_FAILED)
+      arc::MemoryCounters::Add(arc::MemoryCounters::kAshmemBytes, length);
     state_ = STATE_MAPPED;
     return content_;
   }
@@ -261,6 +288,8 @@ int DevAshmem::munmap(void* addr_vp, size_t length) {
   state_ = STATE_PARTIALLY_UNMAPPED;
   const int result = ::munmap(addr, length);
   ALOG_ASSERT(!result);
+  arc::MemoryCounters::Add(arc::MemoryCounters::kAshmemBytes,
+                           -static_cast<int64_t>(length));
   return 0;
 }
 
@@ -331,6 +360,8 @@ void DevAshmem::OnUnmapByOverwritingMmap(void* addr_vp, size_t length) {
   // the object no longer ownes the memory region.
   if (state_ == STATE_MAPPED)
     state_ = STATE_PARTIALLY_UNMAPPED;
+  arc::MemoryCounters::Add(arc::MemoryCounters::kAshmemBytes,
+                           -static_cast<int64_t>(length));
 }
 
 const char* DevAshmem::GetStreamType() const {
@@ -347,11 +378,66 @@ std::string DevAshmem::GetAuxInfo() const {
   return name_;
 }
 
+void DevAshmem::Purge(size_t offset, size_t length) {
+  // MAP_PRIVATE regions are not tracked by this object and are never purged.
+  // The same applies to a partially unmapped MAP_SHARED region since some of
+  // its pages may now belong to another stream.
+  if (content_ == MAP_FAILED || state_ == STATE_PARTIALLY_UNMAPPED)
+    return;
+  if (offset >= mmap_length_)
+    return;
+  length = std::min(length, mmap_length_ - offset);
+
+  // Replace the pages with fresh anonymous ones in the same way as madvise
+  // with MADV_DONTNEED. See the TODO in madvise about the protection mode.
+  void* addr = content_ + offset;
+  void* result = ::mmap(addr, length, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0);
+  LOG_ALWAYS_FATAL_IF(result != addr,
+                      "An internal mmap call for DevAshmem::Purge returns an "
+                      "unexpected address %p for expected address %p",
+                      result, addr);
+}
+
 bool DevAshmem::IsMapShared(uint8_t* addr) const {
   return (content_ != MAP_FAILED) &&
       (content_ <= addr) && (addr < content_ + mmap_length_);
 }
 
+bool DevAshmem::GetPinRange(va_list ap, size_t* out_offset,
+                            size_t* out_length) {
+  // These behaviors are compatible with the Linux kernel.
+  if (state_ == STATE_INITIAL && !has_private_mapping_) {
+    errno = EINVAL;
+    return false;
+  }
+  const struct ashmem_pin* pin = va_arg(ap, const struct ashmem_pin*);
+  if (!pin) {
+    errno = EFAULT;
+    return false;
+  }
+  const size_t page_size = util::GetPageSize();
+  const size_t aligned_size = util::RoundToPageSize(size_);
+  const size_t offset = pin->offset;
+  if (offset > aligned_size) {
+    errno = EINVAL;
+    return false;
+  }
+  // A zero length means "from |offset| to the end of the region".
+  const size_t length = pin->len ? pin->len : aligned_size - offset;
+  if ((offset | length) & (page_size - 1)) {
+    errno = EINVAL;
+    return false;
+  }
+  if (offset + length < offset || offset + length > aligned_size) {
+    errno = EINVAL;
+    return false;
+  }
+  *out_offset = offset;
+  *out_length = length;
+  return true;
+}
+
 int DevAshmem::IoctlSetName(int request, va_list ap) {
   if (state_ != STATE_INITIAL || has_private_mapping_) {
     // This behavior is compatible with the Linux kernel.
@@ -391,19 +477,39 @@ int DevAshmem::IoctlGetSize(int request, va_list ap) {
 }
 
 int DevAshmem::IoctlPin(int request, va_list ap) {
-  // TODO(crbug.com/379838): Implement this once a new IRT for handling real
-  // shared memory is added. For now, return the same value as ashmem-host.c
-  // as a safe fallback.
-  ALOGW("ASHMEM_PIN: not implemented: fd=%d", fd_);
-  return ASHMEM_NOT_PURGED;
+  size_t offset, length;
+  if (!GetPinRange(ap, &offset, &length))
+    return -1;
+  const bool was_purged = purger_->Pin(this, offset, length);
+  ARC_STRACE_REPORT("ASHMEM_PIN: offset=%zu length=%zu %s", offset, length,
+                    was_purged ? "ASHMEM_WAS_PURGED" : "ASHMEM_NOT_PURGED");
+  return was_purged ? ASHMEM_WAS_PURGED : ASHMEM_NOT_PURGED;
 }
 
 int DevAshmem::IoctlUnpin(int request, va_list ap) {
-  // TODO(crbug.com/379838): Implement this too.
-  ALOGW("ASHMEM_UNPIN: not implemented: fd=%d", fd_);
+  size_t offset, length;
+  if (!GetPinRange(ap, &offset, &length))
+    return -1;
+  ARC_STRACE_REPORT("ASHMEM_UNPIN: offset=%zu length=%zu", offset, length);
+  purger_->Unpin(this, offset, length);
   return ASHMEM_IS_UNPINNED;
 }
 
+int DevAshmem::IoctlGetPinStatus(int request, va_list ap) {
+  size_t offset, length;
+  if (!GetPinRange(ap, &offset, &length))
+    return -1;
+  return purger_->IsUnpinned(this, offset, length) ?
+      ASHMEM_IS_UNPINNED : ASHMEM_IS_PINNED;
+}
+
+int DevAshmem::IoctlPurgeAllCaches(int request, va_list ap) {
+  // Like the kernel, return the number of purged pages.
+  const size_t purged = purger_->PurgeAll();
+  ARC_STRACE_REPORT("ASHMEM_PURGE_ALL_CACHES: %zu bytes purged", purged);
+  return purged / util::GetPageSize();
+}
+
 int DevAshmem::IoctlSetProtMask(int request, va_list ap) {
   // TODO(crbug.com/379838): Implement this too.
   int prot = va_arg(ap, int);
@@ -9,8 +9,10 @@
 
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
+#include "base/memory/ref_counted.h"
 #include "base/synchronization/lock.h"
 #include "common/export.h"
+#include "posix_translation/ashmem_purger.h"
 #include "posix_translation/device_file.h"
 
 namespace posix_translation {
@@ -26,8 +28,16 @@ namespace posix_translation {
 // /* read/write the memory region |p|. */
 // …
 // /* Pass the |fd| to another process via Binder. */
+//
+// Ranges unpinned with ASHMEM_UNPIN are purged (i.e. zero-filled) in least
+// recently unpinned order once their total size exceeds a budget. See
+// AshmemPurger for details.
 class ARC_EXPORT DevAshmemHandler : public DeviceHandler {
  public:
+  // The default maximum total size of unpinned ranges kept without being
+  // purged.
+  static const size_t kDefaultUnpinnedMemoryBudget = 32 * 1024 * 1024;
+
   DevAshmemHandler();
   virtual ~DevAshmemHandler();
 
@@ -35,13 +45,27 @@ class ARC_EXPORT DevAshmemHandler : public DeviceHandler {
       int fd, const std::string& pathname, int oflag, mode_t cmode) OVERRIDE;
   virtual int stat(const std::string& pathname, struct stat* out) OVERRIDE;
 
+  // Changes the budget for unpinned ranges. Unpinned ranges are purged
+  // immediately if their total size exceeds the new budget. The VFS mutex
+  // must be held.
+  void SetUnpinnedMemoryBudget(size_t budget);
+
+  // Returns a human readable string of purge statistics. The VFS mutex must be
+  // held.
+  std::string GetPurgeStatsAsString() const;
+
  private:
+  friend class DevAshmemTest;
+
+  scoped_refptr<AshmemPurger> purger_;
+
   DISALLOW_COPY_AND_ASSIGN(DevAshmemHandler);
 };
 
 class DevAshmem : public DeviceStream {
  public:
-  DevAshmem(int fd, const std::string& pathname, int oflag);
+  DevAshmem(int fd, const std::string& pathname, int oflag,
+            scoped_refptr<AshmemPurger> purger);
 
   virtual int fstat(struct stat* out) OVERRIDE;
   virtual int ioctl(int request, va_list ap) OVERRIDE;
@@ -61,6 +85,11 @@ class DevAshmem : public DeviceStream {
   virtual size_t GetSize() const OVERRIDE;
   virtual std::string GetAuxInfo() const OVERRIDE;
 
+  // Discards the content of [offset, offset+length) of the MAP_SHARED region
+  // so that the pages are filled with zeros on next access. Called by
+  // AshmemPurger.
+  void Purge(size_t offset, size_t length);
+
  protected:
   virtual ~DevAshmem();
 
@@ -68,12 +97,18 @@ class DevAshmem : public DeviceStream {
   // Returns true if |addr| is in [content_, content_ + mmap_length_).
   bool IsMapShared(uint8_t* addr) const;
 
+  // Reads a struct ashmem_pin from |ap| and converts it into a page aligned
+  // range. Returns false with errno on error.
+  bool GetPinRange(va_list ap, size_t* out_offset, size_t* out_length);
+
   int IoctlSetName(int request, va_list ap);
   int IoctlGetName(int request, va_list ap);
   int IoctlSetSize(int request, va_list ap);
   int IoctlGetSize(int request, va_list ap);
   int IoctlPin(int request, va_list ap);
   int IoctlUnpin(int request, va_list ap);
+  int IoctlGetPinStatus(int request, va_list ap);
+  int IoctlPurgeAllCaches(int request, va_list ap);
   int IoctlSetProtMask(int request, va_list ap);
 
   int fd_;  // our VFS's FD, not NaCl's. This is for debug prints.
@@ -87,6 +122,10 @@ class DevAshmem : public DeviceStream {
   // True if mmap with MAP_PRIVATE has succeeded at least once.
   bool has_private_mapping_;
 
+  // Keeps track of unpinned ranges of this stream. Shared by all DevAshmem
+  // streams.
+  scoped_refptr<AshmemPurger> purger_;
+
   // The current status of the |content_|. The possible transition of the
   // state is as follows:
   //
@@ -7,10 +7,13 @@
 #include <stdarg.h>
 #include <inttypes.h>
 #include <linux/ashmem.h>
+#include <string.h>
 #include <sys/sysmacros.h>
+#include <unistd.h>
 
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
+#include "common/memory_counters.h"
 #include "gtest/gtest.h"
 #include "posix_translation/dev_ashmem.h"
 #include "posix_translation/test_util/file_system_test_common.h"
@@ -34,6 +37,36 @@ class DevAshmemTest : public FileSystemTestCommon {
     return ret;
   }
 
+  int CallPinIoctl(scoped_refptr<FileStream> stream, int request,
+                   size_t offset, size_t len) {
+    struct ashmem_pin pin = {};
+    pin.offset = offset;
+    pin.len = len;
+    return CallIoctl(stream, request, &pin);
+  }
+
+  // Opens a stream and maps |size| bytes of it with MAP_SHARED.
+  scoped_refptr<FileStream> OpenAndMap(size_t size, uint8_t** out_mapped) {
+    scoped_refptr<FileStream> stream =
+        handler_->open(512, "/dev/ashmem", O_RDWR, 0);
+    EXPECT_TRUE(stream != NULL);
+    EXPECT_EQ(0, CallIoctl(stream, ASHMEM_SET_SIZE, size));
+    void* mapped =
+        stream->mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+    EXPECT_NE(MAP_FAILED, mapped);
+    *out_mapped = static_cast<uint8_t*>(mapped);
+    return stream;
+  }
+
+  const AshmemPurger::Stats& GetPurgeStats() {
+    return static_cast<DevAshmemHandler*>(handler_.get())->purger_->stats();
+  }
+
+  void SetUnpinnedMemoryBudget(size_t budget) {
+    static_cast<DevAshmemHandler*>(handler_.get())->SetUnpinnedMemoryBudget(
+        budget);
+  }
+
   scoped_ptr<FileSystemHandler> handler_;
 
  private:
@@ -106,8 +139,222 @@ TEST_F(DevAshmemTest, TestIoctl) {
 
   int dummy_prot = 0;
   EXPECT_EQ(0, CallIoctl(stream, ASHMEM_SET_PROT_MASK, dummy_prot));
-  EXPECT_EQ(ASHMEM_NOT_PURGED, CallIoctl(stream, ASHMEM_PIN));
-  EXPECT_EQ(ASHMEM_IS_UNPINNED, CallIoctl(stream, ASHMEM_UNPIN));
+  EXPECT_EQ(ASHMEM_NOT_PURGED, CallPinIoctl(stream, ASHMEM_PIN, 0, 0));
+  EXPECT_EQ(ASHMEM_IS_UNPINNED, CallPinIoctl(stream, ASHMEM_UNPIN, 0, 0));
+}
+
+TEST_F(DevAshmemTest, TestPinUnpin) {
+  const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  const size_t size = kPageSize * 4;
+  uint8_t* mapped = NULL;
+  scoped_refptr<FileStream> stream = OpenAndMap(size, &mapped);
+  ASSERT_TRUE(mapped != NULL);
+  memset(mapped, 0x5a, size);
+
+  EXPECT_EQ(ASHMEM_IS_PINNED,
+            CallPinIoctl(stream, ASHMEM_GET_PIN_STATUS, 0, 0));
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_UNPIN, kPageSize, kPageSize * 2));
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_GET_PIN_STATUS, 0, 0));
+  EXPECT_EQ(ASHMEM_IS_PINNED,
+            CallPinIoctl(stream, ASHMEM_GET_PIN_STATUS, 0, kPageSize));
+  EXPECT_EQ(kPageSize * 2, GetPurgeStats().unpinned_bytes);
+
+  // Pin the middle of the unpinned range. The range is split into two.
+  EXPECT_EQ(ASHMEM_NOT_PURGED,
+            CallPinIoctl(stream, ASHMEM_PIN, kPageSize, kPageSize));
+  EXPECT_EQ(kPageSize, GetPurgeStats().unpinned_bytes);
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_GET_PIN_STATUS, kPageSize * 2, 0));
+  EXPECT_EQ(ASHMEM_NOT_PURGED, CallPinIoctl(stream, ASHMEM_PIN, 0, 0));
+  EXPECT_EQ(0U, GetPurgeStats().unpinned_bytes);
+
+  // The content is not purged within the budget.
+  for (size_t i = 0; i < size; ++i)
+    ASSERT_EQ(0x5a, mapped[i]) << i;
+  EXPECT_EQ(0U, GetPurgeStats().purge_count);
+  EXPECT_EQ(0, stream->munmap(mapped, size));
+}
+
+TEST_F(DevAshmemTest, TestPinUnpinErrors) {
+  const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  scoped_refptr<FileStream> stream =
+      handler_->open(512, "/dev/ashmem", O_RDWR, 0);
+  ASSERT_TRUE(stream != NULL);
+  EXPECT_EQ(0, CallIoctl(stream, ASHMEM_SET_SIZE, kPageSize * 2));
+
+  // The region has not been mapped yet.
+  errno = 0;
+  EXPECT_EQ(-1, CallPinIoctl(stream, ASHMEM_UNPIN, 0, 0));
+  EXPECT_EQ(EINVAL, errno);
+
+  void* mapped = stream->mmap(
+      NULL, kPageSize * 2, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+  ASSERT_NE(MAP_FAILED, mapped);
+  errno = 0;
+  EXPECT_EQ(-1, CallIoctl(stream, ASHMEM_UNPIN, NULL));
+  EXPECT_EQ(EFAULT, errno);
+  // Not page aligned.
+  errno = 0;
+  EXPECT_EQ(-1, CallPinIoctl(stream, ASHMEM_UNPIN, 1, kPageSize));
+  EXPECT_EQ(EINVAL, errno);
+  errno = 0;
+  EXPECT_EQ(-1, CallPinIoctl(stream, ASHMEM_UNPIN, 0, 1));
+  EXPECT_EQ(EINVAL, errno);
+  // Beyond the end of the region.
+  errno = 0;
+  EXPECT_EQ(-1, CallPinIoctl(stream, ASHMEM_UNPIN, kPageSize, kPageSize * 2));
+  EXPECT_EQ(EINVAL, errno);
+  errno = 0;
+  EXPECT_EQ(-1, CallPinIoctl(stream, ASHMEM_UNPIN, kPageSize * 3, 0));
+  EXPECT_EQ(EINVAL, errno);
+  EXPECT_EQ(0U, GetPurgeStats().unpinned_bytes);
+  EXPECT_EQ(0, stream->munmap(mapped, kPageSize * 2));
+}
+
+TEST_F(DevAshmemTest, TestPurgeOverBudget) {
+  const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  const size_t size = kPageSize * 2;
+  SetUnpinnedMemoryBudget(size);
+
+  uint8_t* mapped1 = NULL;
+  uint8_t* mapped2 = NULL;
+  scoped_refptr<FileStream> stream1 = OpenAndMap(size, &mapped1);
+  scoped_refptr<FileStream> stream2 = OpenAndMap(size, &mapped2);
+  ASSERT_TRUE(mapped1 != NULL);
+  ASSERT_TRUE(mapped2 != NULL);
+  memset(mapped1, 0x11, size);
+  memset(mapped2, 0x22, size);
+
+  // Unpinning both regions exceeds the budget. The least recently unpinned
+  // one, |stream1|, should be purged.
+  EXPECT_EQ(ASHMEM_IS_UNPINNED, CallPinIoctl(stream1, ASHMEM_UNPIN, 0, 0));
+  EXPECT_EQ(0U, GetPurgeStats().purge_count);
+  EXPECT_EQ(ASHMEM_IS_UNPINNED, CallPinIoctl(stream2, ASHMEM_UNPIN, 0, 0));
+  EXPECT_EQ(1U, GetPurgeStats().purge_count);
+  EXPECT_EQ(size, GetPurgeStats().purged_bytes);
+  EXPECT_EQ(size, GetPurgeStats().unpinned_bytes);
+
+  // A purged range is still unpinned until it is pinned again.
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream1, ASHMEM_GET_PIN_STATUS, 0, 0));
+  EXPECT_EQ(ASHMEM_WAS_PURGED, CallPinIoctl(stream1, ASHMEM_PIN, 0, 0));
+  EXPECT_EQ(0, mapped1[0]);
+  EXPECT_EQ(0, mapped1[size - 1]);
+  EXPECT_EQ(ASHMEM_NOT_PURGED, CallPinIoctl(stream2, ASHMEM_PIN, 0, 0));
+  EXPECT_EQ(0x22, mapped2[0]);
+  EXPECT_EQ(0x22, mapped2[size - 1]);
+  EXPECT_EQ(1U, GetPurgeStats().was_purged_count);
+  EXPECT_EQ(0U, GetPurgeStats().unpinned_bytes);
+
+  // The purge is reported only once.
+  EXPECT_EQ(ASHMEM_NOT_PURGED, CallPinIoctl(stream1, ASHMEM_PIN, 0, 0));
+
+  // Shrinking the budget purges the unpinned ranges immediately.
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream2, ASHMEM_UNPIN, 0, kPageSize));
+  SetUnpinnedMemoryBudget(0);
+  EXPECT_EQ(2U, GetPurgeStats().purge_count);
+  EXPECT_EQ(0, mapped2[0]);
+  EXPECT_EQ(0x22, mapped2[kPageSize]);
+
+  EXPECT_EQ(0, stream1->munmap(mapped1, size));
+  EXPECT_EQ(0, stream2->munmap(mapped2, size));
+}
+
+TEST_F(DevAshmemTest, TestPurgeAllCaches) {
+  const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  const size_t size = kPageSize * 4;
+  uint8_t* mapped = NULL;
+  scoped_refptr<FileStream> stream = OpenAndMap(size, &mapped);
+  ASSERT_TRUE(mapped != NULL);
+  memset(mapped, 0x33, size);
+
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_UNPIN, 0, kPageSize));
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_UNPIN, kPageSize * 2, kPageSize));
+  EXPECT_EQ(2, CallIoctl(stream, ASHMEM_PURGE_ALL_CACHES));
+  EXPECT_EQ(0, mapped[0]);
+  EXPECT_EQ(0x33, mapped[kPageSize]);
+  EXPECT_EQ(0, mapped[kPageSize * 2]);
+  EXPECT_EQ(0x33, mapped[kPageSize * 3]);
+
+  // Unpinning a range which overlaps a purged one purges the merged range.
+  mapped[kPageSize] = 0x44;
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_UNPIN, 0, kPageSize * 2));
+  EXPECT_EQ(0, mapped[kPageSize]);
+  EXPECT_EQ(ASHMEM_WAS_PURGED, CallPinIoctl(stream, ASHMEM_PIN, 0, 0));
+  EXPECT_EQ(0, stream->munmap(mapped, size));
+}
+
+TEST_F(DevAshmemTest, TestCloseUnpinnedStream) {
+  const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  uint8_t* mapped = NULL;
+  scoped_refptr<FileStream> stream = OpenAndMap(kPageSize, &mapped);
+  ASSERT_TRUE(mapped != NULL);
+  EXPECT_EQ(ASHMEM_IS_UNPINNED, CallPinIoctl(stream, ASHMEM_UNPIN, 0, 0));
+  EXPECT_EQ(kPageSize, GetPurgeStats().unpinned_bytes);
+  EXPECT_EQ(0, stream->munmap(mapped, kPageSize));
+  stream = NULL;
+  // The unpinned range of the deleted stream is forgotten.
+  EXPECT_EQ(0U, GetPurgeStats().unpinned_bytes);
+}
+
+TEST_F(DevAshmemTest, TestMemoryCounters) {
+  const int64_t kPageSize = sysconf(_SC_PAGESIZE);
+  const int64_t ashmem_bytes =
+      arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes);
+  const int64_t unpinned_bytes =
+      arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemUnpinnedBytes);
+
+  uint8_t* mapped = NULL;
+  scoped_refptr<FileStream> stream = OpenAndMap(kPageSize * 4, &mapped);
+  ASSERT_TRUE(mapped != NULL);
+  EXPECT_EQ(ashmem_bytes + kPageSize * 4,
+            arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes));
+
+  EXPECT_EQ(ASHMEM_IS_UNPINNED,
+            CallPinIoctl(stream, ASHMEM_UNPIN, 0, kPageSize * 2));
+  EXPECT_EQ(unpinned_bytes + kPageSize * 2,
+            arc::MemoryCounters::Get(
+                arc::MemoryCounters::kAshmemUnpinnedBytes));
+  EXPECT_EQ(ASHMEM_NOT_PURGED, CallPinIoctl(stream, ASHMEM_PIN, 0, kPageSize));
+  EXPECT_EQ(unpinned_bytes + kPageSize,
+            arc::MemoryCounters::Get(
+                arc::MemoryCounters::kAshmemUnpinnedBytes));
+
+  // A partial munmap releases the memory immediately.
+  EXPECT_EQ(0, stream->munmap(mapped + kPageSize * 3, kPageSize));
+  EXPECT_EQ(ashmem_bytes + kPageSize * 3,
+            arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes));
+  EXPECT_EQ(0, stream->munmap(mapped, kPageSize * 3));
+  EXPECT_EQ(ashmem_bytes,
+            arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes));
+
+  stream = NULL;
+  EXPECT_EQ(unpinned_bytes,
+            arc::MemoryCounters::Get(
+                arc::MemoryCounters::kAshmemUnpinnedBytes));
+}
+
+TEST_F(DevAshmemTest, TestMemoryCountersDelayedUnmap) {
+  const int64_t kPageSize = sysconf(_SC_PAGESIZE);
+  const int64_t ashmem_bytes =
+      arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes);
+
+  uint8_t* mapped = NULL;
+  scoped_refptr<FileStream> stream = OpenAndMap(kPageSize, &mapped);
+  ASSERT_TRUE(mapped != NULL);
+  // A full munmap is delayed until the stream is deleted.
+  EXPECT_EQ(0, stream->munmap(mapped, kPageSize));
+  EXPECT_EQ(ashmem_bytes + kPageSize,
+            arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes));
+  stream = NULL;
+  EXPECT_EQ(ashmem_bytes,
+            arc::MemoryCounters::Get(arc::MemoryCounters::kAshmemBytes));
 }
 
 TEST_F(DevAshmemTest, TestLseek) {
@@ -29,6 +29,19 @@ int DoStatLocked(const std::string& pathname, mode_t mode, struct stat* out) {
   return 0;
 }
 
+ssize_t LockFreeRead(void* buf, size_t count) {
+  return 0;
+}
+
+ssize_t LockFreeWrite(const void* buf, size_t count) {
+  return count;
+}
+
+const FileStream::LockFreeOps kLockFreeOps = {
+  &LockFreeRead,
+  &LockFreeWrite,
+};
+
 }  // namespace
 
 DevNullHandler::DevNullHandler()
@@ -83,11 +96,15 @@ int DevNull::munmap(void* addr, size_t length) {
 }
 
 ssize_t DevNull::read(void* buf, size_t count) {
-  return 0;
+  return LockFreeRead(buf, count);
 }
 
 ssize_t DevNull::write(const void* buf, size_t count) {
-  return count;
+  return LockFreeWrite(buf, count);
+}
+
+const FileStream::LockFreeOps* DevNull::GetLockFreeOps() const {
+  return &kLockFreeOps;
 }
 
 const char* DevNull::GetStreamType() const { return "dev_null"; }
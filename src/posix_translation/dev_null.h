@@ -43,6 +43,7 @@ class DevNull : public DeviceStream {
   virtual ssize_t read(void* buf, size_t count) OVERRIDE;
   virtual ssize_t write(const void* buf, size_t count) OVERRIDE;
 
+  virtual const LockFreeOps* GetLockFreeOps() const OVERRIDE;
   virtual const char* GetStreamType() const OVERRIDE;
 
  private:
@@ -4,8 +4,10 @@
 
 #include "posix_translation/dev_urandom.h"
 
+#include <pthread.h>
 #include <string.h>
 
+#include "native_client/src/untrusted/irt/irt.h"
 #include "posix_translation/dir.h"
 #include "posix_translation/virtual_file_system.h"
 
@@ -27,6 +29,28 @@ int DoStatLocked(const std::string& pathname, struct stat* out) {
   return 0;
 }
 
+// Shared by all streams so that it can be used without a stream.
+pthread_once_t g_random_once = PTHREAD_ONCE_INIT;
+nacl_irt_random g_random;
+
+void InitializeRandom() {
+  nacl_interface_query(NACL_IRT_RANDOM_v0_1, &g_random, sizeof(g_random));
+}
+
+ssize_t LockFreeRead(void* buf, size_t count) {
+  size_t nread = 0;
+  if (g_random.get_random_bytes(
+          reinterpret_cast<unsigned char*>(buf), count, &nread) != 0) {
+    return -1;
+  }
+  return nread;
+}
+
+const FileStream::LockFreeOps kLockFreeOps = {
+  &LockFreeRead,
+  NULL,  // write() always fails.
+};
+
 }  // namespace
 
 DevUrandomHandler::DevUrandomHandler()
@@ -53,7 +77,7 @@ int DevUrandomHandler::stat(const std::string& pathname, struct stat* out) {
 
 DevUrandom::DevUrandom(const std::string& pathname, int oflag)
     : DeviceStream(oflag, pathname) {
-  nacl_interface_query(NACL_IRT_RANDOM_v0_1, &random_, sizeof(random_));
+  pthread_once(&g_random_once, &InitializeRandom);
 }
 
 DevUrandom::~DevUrandom() {
@@ -64,12 +88,10 @@ int DevUrandom::fstat(struct stat* out) {
 }
 
 ssize_t DevUrandom::read(void* buf, size_t count) {
-  size_t nread = 0;
-  if (!GetRandomBytes(buf, count, &nread)) {
+  const ssize_t result = LockFreeRead(buf, count);
+  if (result < 0)
     errno = EIO;
-    return -1;
-  }
-  return nread;
+  return result;
 }
 
 ssize_t DevUrandom::write(const void* buf, size_t count) {
@@ -77,9 +99,8 @@ ssize_t DevUrandom::write(const void* buf, size_t count) {
   return -1;
 }
 
-bool DevUrandom::GetRandomBytes(void* buf, size_t count, size_t* nread) {
-  return random_.get_random_bytes(
-      reinterpret_cast<unsigned char*>(buf), count, nread) == 0;
+const FileStream::LockFreeOps* DevUrandom::GetLockFreeOps() const {
+  return &kLockFreeOps;
 }
 
 const char* DevUrandom::GetStreamType() const {
@@ -11,7 +11,6 @@
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
 #include "common/export.h"
-#include "native_client/src/untrusted/irt/irt.h"
 #include "posix_translation/device_file.h"
 #include "posix_translation/file_system_handler.h"
 
@@ -38,16 +37,13 @@ class DevUrandom : public DeviceStream {
   virtual ssize_t read(void* buf, size_t count) OVERRIDE;
   virtual ssize_t write(const void* buf, size_t count) OVERRIDE;
 
+  virtual const LockFreeOps* GetLockFreeOps() const OVERRIDE;
   virtual const char* GetStreamType() const OVERRIDE;
 
  protected:
   virtual ~DevUrandom();
 
  private:
-  bool GetRandomBytes(void* buf, size_t count, size_t* nread);
-
-  nacl_irt_random random_;
-
   DISALLOW_COPY_AND_ASSIGN(DevUrandom);
 };
 
@@ -29,6 +29,22 @@ int DoStatLocked(const std::string& pathname, struct stat* out) {
   return 0;
 }
 
+ssize_t LockFreeRead(void* buf, size_t count) {
+  // On the other hand, read() always fills zero even after the device is
+  // updated with write() or mmap(PROT_WRITE).
+  memset(buf, 0, count);
+  return count;
+}
+
+ssize_t LockFreeWrite(const void* buf, size_t count) {
+  return count;
+}
+
+const FileStream::LockFreeOps kLockFreeOps = {
+  &LockFreeRead,
+  &LockFreeWrite,
+};
+
 }  // namespace
 
 DevZeroHandler::DevZeroHandler() : DeviceHandler("DevZeroHandler") {
@@ -82,14 +98,15 @@ int DevZero::munmap(void* addr, size_t length) {
 }
 
 ssize_t DevZero::read(void* buf, size_t count) {
-  // On the other hand, read() always fills zero even after the device is
-  // updated with write() or mmap(PROT_WRITE).
-  memset(buf, 0, count);
-  return count;
+  return LockFreeRead(buf, count);
 }
 
 ssize_t DevZero::write(const void* buf, size_t count) {
-  return count;
+  return LockFreeWrite(buf, count);
+}
+
+const FileStream::LockFreeOps* DevZero::GetLockFreeOps() const {
+  return &kLockFreeOps;
 }
 
 const char* DevZero::GetStreamType() const { return "dev_zero"; }
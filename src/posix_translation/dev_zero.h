@@ -38,6 +38,7 @@ class DevZero : public DeviceStream {
   virtual ssize_t read(void* buf, size_t count) OVERRIDE;
   virtual ssize_t write(const void* buf, size_t count) OVERRIDE;
 
+  virtual const LockFreeOps* GetLockFreeOps() const OVERRIDE;
   virtual const char* GetStreamType() const OVERRIDE;
 
  protected:
@@ -2,12 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <string.h>
 #include <sys/sysmacros.h>
 
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
 #include "gtest/gtest.h"
 #include "posix_translation/dev_zero.h"
+#include "posix_translation/test_util/file_system_background_test_common.h"
 #include "posix_translation/test_util/file_system_test_common.h"
 
 // We use random numbers for this test.
@@ -32,6 +35,28 @@ class DevZeroTest : public FileSystemTestCommon {
   DISALLOW_COPY_AND_ASSIGN(DevZeroTest);
 };
 
+// For tests which call VirtualFileSystem functions that take the mutex.
+class DevZeroBackgroundTest
+    : public FileSystemBackgroundTestCommon<DevZeroBackgroundTest> {
+ public:
+  DECLARE_BACKGROUND_TEST(TestLockFreeRead);
+
+ protected:
+  // Opens /dev/zero as a new fd without a mount point.
+  int OpenDevZero() {
+    base::AutoLock lock(mutex());
+    const int fd = GetFirstUnusedDescriptor();
+    DevZeroHandler handler;
+    AddFileStream(fd, handler.open(fd, "/dev/zero", O_RDWR, 0));
+    return fd;
+  }
+
+  void CloseDevZero(int fd) {
+    base::AutoLock lock(mutex());
+    RemoveFileStream(fd);
+  }
+};
+
 TEST_F(DevZeroTest, TestInit) {
 }
 
@@ -122,4 +147,37 @@ TEST_F(DevZeroTest, TestWrite) {
   EXPECT_EQ(3, stream->write("abc", 3));
 }
 
+TEST_F(DevZeroTest, TestGetLockFreeOps) {
+  scoped_refptr<FileStream> stream =
+      handler_->open(512, "/dev/zero", O_RDONLY, 0);
+  ASSERT_TRUE(stream != NULL);
+  const FileStream::LockFreeOps* ops = stream->GetLockFreeOps();
+  ASSERT_TRUE(ops != NULL);
+  char buf[16];
+  memset(buf, 1, sizeof(buf));
+  EXPECT_EQ(static_cast<ssize_t>(sizeof(buf)), ops->read(buf, sizeof(buf)));
+  EXPECT_EQ(0, buf[0]);
+  EXPECT_EQ(3, ops->write("abc", 3));
+}
+
+TEST_BACKGROUND_F(DevZeroBackgroundTest, TestLockFreeRead) {
+  const int fd = OpenDevZero();
+  char buf[16];
+  memset(buf, 1, sizeof(buf));
+  ssize_t result = -1;
+  {
+    // The lock-free path must not need the mutex.
+    base::AutoLock lock(mutex());
+    EXPECT_TRUE(file_system_->TryLockFreeRead(fd, buf, sizeof(buf), &result));
+    EXPECT_TRUE(file_system_->TryLockFreeWrite(fd, buf, 5, &result));
+  }
+  EXPECT_EQ(5, result);
+  EXPECT_EQ(0, buf[sizeof(buf) - 1]);
+
+  CloseDevZero(fd);
+  EXPECT_FALSE(file_system_->TryLockFreeRead(fd, buf, sizeof(buf), &result));
+  EXPECT_FALSE(file_system_->TryLockFreeWrite(fd, buf, 5, &result));
+  EXPECT_FALSE(file_system_->TryLockFreeRead(-1, buf, sizeof(buf), &result));
+}
+
 }  // namespace posix_translation
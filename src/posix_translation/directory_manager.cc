@@ -212,6 +212,12 @@ Dir* DirectoryManager::OpenDirectory(const std::string& dirname) const {
   return new DirImpl(dirname_slash, *files);
 }
 
+// static
+Dir* DirectoryManager::CreateDir(const std::string& dirname,
+                                 const FilesInDir& files) {
+  return new DirImpl(dirname, files);
+}
+
 void DirectoryManager::MakeDirectories(const std::string& dirname) {
   std::vector<std::string> paths;
 
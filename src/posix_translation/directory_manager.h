@@ -23,6 +23,9 @@ class Dir;
 // list of files in each directory. This class is not thread-safe.
 class DirectoryManager {
  public:
+  // A mapping from a file name to its type. Names of directories end with '/'.
+  typedef base::hash_map<std::string, Dir::Type> FilesInDir;  // NOLINT
+
   DirectoryManager();
   ~DirectoryManager();
 
@@ -63,6 +66,10 @@ class DirectoryManager {
   // "/usr/bin" forms are accepted as |dirname|.
   void MakeDirectories(const std::string& dirname);
 
+  // Returns a Dir object which contains |files| in |dirname|. This is for
+  // callers which keep their own list of files, e.g. ReadonlyFsReader.
+  static Dir* CreateDir(const std::string& dirname, const FilesInDir& files);
+
   // TODO(crbug.com/190550): If needed, support rmdir.
  private:
   FRIEND_TEST(DirectoryManagerTest, TestAddRemoveFileBasic);
@@ -74,7 +81,6 @@ class DirectoryManager {
 
   class DirImpl;
   typedef std::pair<std::string /* dir */, std::string /* file */> DirAndFile;
-  typedef base::hash_map<std::string, Dir::Type> FilesInDir;  // NOLINT
 
   bool MakeDirectory(const std::string& dirname);
   bool AddFileInternal(const std::string& directory,
@@ -9,6 +9,7 @@
 
 #include "common/arc_strace.h"
 #include "common/alog.h"
+#include "common/atomics.h"
 #include "posix_translation/file_stream.h"
 #include "ppapi/cpp/module.h"
 
@@ -17,6 +18,8 @@ namespace posix_translation {
 FdToFileStreamMap::FdToFileStreamMap(int min_file_id, int max_file_id)
     : min_file_id_(min_file_id), max_file_id_(max_file_id) {
   ALOG_ASSERT(max_file_id_ >= min_file_id_);
+  const LockFreeEntry empty_entry = {};
+  lock_free_entries_.resize(max_file_id - min_file_id_ + 1, empty_entry);
   unused_fds_.reserve(max_file_id - min_file_id_ + 1);
   for (int fd = min_file_id_; fd <= max_file_id_; ++fd) {
     unused_fds_.push_back(fd);
@@ -50,6 +53,7 @@ void FdToFileStreamMap::AddFileStream(
     ALOG_ASSERT(!it->second, "fd=%d", fd);
     it->second = stream;
   }
+  UpdateLockFreeEntry(fd, stream.get());
 }
 
 void FdToFileStreamMap::ReplaceFileStream(
@@ -58,6 +62,7 @@ void FdToFileStreamMap::ReplaceFileStream(
   scoped_refptr<FileStream> old_stream = streams_[fd];
   if (stream != old_stream) {
     streams_[fd] = stream;
+    UpdateLockFreeEntry(fd, stream.get());
     stream->AddFileRef();
     old_stream->ReleaseFileRef();
   }
@@ -74,6 +79,7 @@ void FdToFileStreamMap::RemoveFileStream(int fd) {
   // first.
   scoped_refptr<FileStream> old_stream(iter->second);
   streams_.erase(iter);
+  UpdateLockFreeEntry(fd, NULL);
   unused_fds_.push_back(fd);
   std::push_heap(unused_fds_.begin(), unused_fds_.end(), cmp_);
   if (old_stream)
@@ -114,4 +120,29 @@ scoped_refptr<FileStream> FdToFileStreamMap::GetStream(int fd) {
   return stream;
 }
 
+const FileStream::LockFreeOps* FdToFileStreamMap::GetLockFreeOps(
+    int fd, IOStats::Slot** out_io_stats_slot) const {
+  if (fd < min_file_id_ || fd > max_file_id_)
+    return NULL;
+  const LockFreeEntry& entry = lock_free_entries_[fd - min_file_id_];
+  const FileStream::LockFreeOps* ops = arc::AcquireLoad(&entry.ops);
+  // The slot is only a hint for recording, so a plain load is enough.
+  if (ops)
+    *out_io_stats_slot = entry.io_stats_slot;
+  return ops;
+}
+
+void FdToFileStreamMap::UpdateLockFreeEntry(int fd, FileStream* stream) {
+  if (fd < min_file_id_ || fd > max_file_id_)
+    return;
+  LockFreeEntry* entry = &lock_free_entries_[fd - min_file_id_];
+  const FileStream::LockFreeOps* ops =
+      stream ? stream->GetLockFreeOps() : NULL;
+  // A reader may see the new |ops| with the old slot if it races with this
+  // update. Then the call is only recorded in the wrong slot.
+  if (ops)
+    entry->io_stats_slot = stream->GetIOStatsSlot();
+  arc::ReleaseStore(&entry->ops, ops);
+}
+
 }  // namespace posix_translation
@@ -16,11 +16,11 @@
 #include "base/basictypes.h"
 #include "base/memory/ref_counted.h"
 #include "base/synchronization/lock.h"
+#include "posix_translation/file_stream.h"
+#include "posix_translation/io_stats.h"
 
 namespace posix_translation {
 
-class FileStream;
-
 class FdToFileStreamMap {
  public:
   FdToFileStreamMap(int min_file_id, int max_file_id);
@@ -33,6 +33,13 @@ class FdToFileStreamMap {
   bool IsKnownDescriptor(int fd);
   scoped_refptr<FileStream> GetStream(int fd);
 
+  // Returns the lock-free operations of the stream for |fd|, or NULL if the
+  // stream has none or |fd| is not used. Unlike the other functions, this
+  // can be called without the VirtualFileSystem mutex. |out_io_stats_slot|
+  // is set to the I/O statistics slot of the stream.
+  const FileStream::LockFreeOps* GetLockFreeOps(
+      int fd, IOStats::Slot** out_io_stats_slot) const;
+
   int min_file_id() const { return min_file_id_; }
   int max_file_id() const { return max_file_id_; }
 
@@ -40,6 +47,15 @@ class FdToFileStreamMap {
   friend class VirtualFileSystem;
 
  private:
+  struct LockFreeEntry {
+    const FileStream::LockFreeOps* ops;
+    IOStats::Slot* io_stats_slot;
+  };
+
+  // Updates the entry of |fd| in |lock_free_entries_| for |stream|, which
+  // can be NULL.
+  void UpdateLockFreeEntry(int fd, FileStream* stream);
+
   // File streams that have assigned file descriptors. For allocated file
   // descriptors without a stream (when stream is in a process of being created
   // or assigned) the value will be NULL.
@@ -47,6 +63,10 @@ class FdToFileStreamMap {
   FileStreamMap streams_;
   std::vector<int> unused_fds_;  // min-heap.
   std::greater<int> cmp_;  // to use |unused_fds_| as a min-heap.
+  // Indexed by fd - |min_file_id_|. Written with the VirtualFileSystem mutex
+  // held, and read without it by GetLockFreeOps(). The vector is never
+  // resized after construction.
+  std::vector<LockFreeEntry> lock_free_entries_;
 
   // The minimum/maximum fd number allowed.
   const int min_file_id_;
@@ -9,6 +9,7 @@
 #include <algorithm>
 
 #include "base/memory/scoped_ptr.h"
+#include "base/synchronization/condition_variable.h"
 #include "common/alog.h"
 #include "posix_translation/directory_file_stream.h"
 #include "posix_translation/statfs.h"
@@ -41,21 +42,32 @@ int VerifyIoVec(const struct iovec* iov, int iovcnt, ssize_t* out_total_size) {
 }  // namespace
 
 FileStream::FileStream(int oflag, const std::string& pathname)
-    : oflag_(oflag), inode_(kBadInode), pathname_(pathname),
+    : oflag_(oflag), inode_(kBadInode),
+      pathname_(FileStreamPool::InternPathname(pathname)),
       is_listening_enabled_(false), file_ref_count_(0),
-      had_file_refs_(false) {
+      had_file_refs_(false), io_stats_slot_(NULL) {
   // When the stream is not associated with a file (e.g. socket), |pathname|
   // is empty.
-  if (!pathname_.empty()) {
+  if (!pathname.empty()) {
     // Claim a unique inode for the pathname before the file is unlinked.
     VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-    inode_ = sys->GetInodeLocked(pathname_);
+    inode_ = sys->GetInodeLocked(pathname);
   }
 }
 
 FileStream::~FileStream() {
   // Make sure it was never properly opened, or has no remaining file refs.
   ALOG_ASSERT(!had_file_refs_ || file_ref_count_ == 0);
+  ALOG_ASSERT(poll_waiters_.empty());
+  FileStreamPool::ReleasePathname(pathname_);
+}
+
+void* FileStream::operator new(size_t size) {
+  return FileStreamPool::Allocate(size);
+}
+
+void FileStream::operator delete(void* ptr, size_t size) {
+  FileStreamPool::Free(ptr, size);
 }
 
 bool FileStream::IsAllowedOnMainThread() const {
@@ -95,6 +107,8 @@ void FileStream::ReleaseFileRef() {
     it->second->HandleNotificationFrom(this, true);
   }
   listeners_.clear();
+  // Wake up poll() and select() calls so that they can see the closed state.
+  SignalPollWaiters();
 
   OnLastFileRef();
 }
@@ -421,6 +435,29 @@ std::string FileStream::GetAuxInfo() const {
   return std::string();
 }
 
+const FileStream::LockFreeOps* FileStream::GetLockFreeOps() const {
+  return NULL;
+}
+
+bool FileStream::GetContentBuffer(off64_t offset, size_t count,
+                                  const void** out_buf, size_t* out_size) {
+  return false;
+}
+
+bool FileStream::GetWritableSize(size_t* out_size) const {
+  return false;
+}
+
+IOStats::Slot* FileStream::GetIOStatsSlot() {
+  if (!io_stats_slot_)
+    io_stats_slot_ = IOStats::GetSlot(std::string(), GetStreamType());
+  return io_stats_slot_;
+}
+
+void FileStream::SetIOStatsHandlerName(const std::string& handler_name) {
+  io_stats_slot_ = IOStats::GetSlot(handler_name, GetStreamType());
+}
+
 void FileStream::OnLastFileRef() {
 }
 
@@ -431,11 +468,33 @@ int16_t FileStream::GetPollEvents() const {
   return POLLIN | POLLOUT;
 }
 
+bool FileStream::AddPollWaiter(base::ConditionVariable* waiter) {
+  if (!is_listening_enabled_)
+    return false;
+  poll_waiters_.push_back(waiter);
+  return true;
+}
+
+void FileStream::RemovePollWaiter(base::ConditionVariable* waiter) {
+  std::vector<base::ConditionVariable*>::iterator it =
+      std::find(poll_waiters_.begin(), poll_waiters_.end(), waiter);
+  ALOG_ASSERT(it != poll_waiters_.end());
+  poll_waiters_.erase(it);
+}
+
+void FileStream::SignalPollWaiters() {
+  // Each condition variable has only one waiter, the thread in poll() or
+  // select() which registered it.
+  for (size_t i = 0; i < poll_waiters_.size(); ++i)
+    poll_waiters_[i]->Signal();
+}
+
 void FileStream::NotifyListeners() {
   ALOG_ASSERT(is_listening_enabled_,
               "Cannot notify listeners when file cannot be listened to");
   if (IsClosed())
     return;  // Likely processing the last read event.
+  SignalPollWaiters();
   for (FileMap::iterator it = listeners_.begin();
       it != listeners_.end(); it++) {
     it->second->CheckNotClosed();
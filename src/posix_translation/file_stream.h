@@ -21,18 +21,30 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/memory/ref_counted.h"
 #include "common/arc_strace.h"
+#include "posix_translation/file_stream_pool.h"
+#include "posix_translation/io_stats.h"
 #include "posix_translation/permission_info.h"
 
+namespace base {
+class ConditionVariable;
+}  // namespace base
+
 namespace posix_translation {
 
 class FileStream : public base::RefCounted<FileStream> {
  public:
   FileStream(int oflag, const std::string& pathname);
 
+  // Streams are allocated from FileStreamPool since apps often create and
+  // destroy them at a high rate, e.g. for sockets and /proc files.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   const PermissionInfo& permission() const {
     return permission_;
   }
@@ -121,6 +133,17 @@ class FileStream : public base::RefCounted<FileStream> {
   // TODO(crbug.com/359400): Currently, poll uses IsSelect*Ready() family
   // incorrectly, due to historical reason. Fix the implementation.
 
+  // Registers |waiter| to be signaled whenever the poll/select state of the
+  // stream may have changed, i.e. whenever the stream notifies its listeners
+  // or loses its last file reference. This allows poll() and select() to
+  // sleep on their own condition variable rather than on the global one.
+  // Returns false if the stream does not support listeners, in which case the
+  // caller has to fall back to the global condition variable.
+  // VirtualFileSystem::mutex() must be held, and |waiter| must be removed
+  // with RemovePollWaiter() before it is destroyed.
+  bool AddPollWaiter(base::ConditionVariable* waiter);
+  void RemovePollWaiter(base::ConditionVariable* waiter);
+
   // Called when the memory region [addr, addr+length) associated when the
   // stream is implicitly unmapped without munmap. This happens with the
   // region is overwritten by another mmap call with MAP_FIXED. File handlers
@@ -135,6 +158,43 @@ class FileStream : public base::RefCounted<FileStream> {
   virtual size_t GetSize() const;
   virtual std::string GetAuxInfo() const;
 
+  // Implementations of read() and write() which do not touch any state of the
+  // stream. VirtualFileSystem calls them without its mutex, possibly while
+  // the stream is being closed on another thread. On failure they must
+  // return -1 without any side effect so that the call can be retried through
+  // the locked path to report the error. Either function can be NULL.
+  struct LockFreeOps {
+    ssize_t (*read)(void* buf, size_t count);
+    ssize_t (*write)(const void* buf, size_t count);
+  };
+
+  // Returns the lock-free operations of the stream, or NULL if all calls have
+  // to go through the VirtualFileSystem mutex, which is the default. The
+  // returned pointer must stay valid forever.
+  virtual const LockFreeOps* GetLockFreeOps() const;
+
+  // Lets sendfile() and splice() write the content at |offset| to another
+  // stream without copying it to a temporary buffer. Returns false if the
+  // content is not in memory, which is the default. Otherwise sets |out_buf|
+  // to the content and |out_size| to its size, at most |count| and zero at
+  // the end of the file. The content is valid until the next call to the
+  // stream or until the VirtualFileSystem mutex is released.
+  virtual bool GetContentBuffer(off64_t offset, size_t count,
+                                const void** out_buf, size_t* out_size);
+
+  // Lets splice() read no more from a pipe than this stream can take. Returns
+  // false if write() takes the whole buffer once IsSelectWriteReady() is
+  // true, which is the default. Otherwise sets |out_size| to the number of
+  // bytes write() takes now.
+  virtual bool GetWritableSize(size_t* out_size) const;
+
+  // Returns the slot which records the I/O statistics of this stream. Streams
+  // which are not opened by a handler are recorded without a handler name.
+  // The VirtualFileSystem mutex must be held.
+  IOStats::Slot* GetIOStatsSlot();
+  // Records the I/O statistics of this stream under |handler_name|.
+  void SetIOStatsHandlerName(const std::string& handler_name);
+
   // A debug-only version of write used for saving stdout/stderr logs to disk.
   virtual void debug_write(const void* buf, size_t count) {}
 
@@ -147,7 +207,7 @@ class FileStream : public base::RefCounted<FileStream> {
   int oflag() const { return oflag_; }
   void set_oflag(int oflag) { oflag_ = oflag; }
   ino_t inode() const { return inode_; }
-  const std::string& pathname() const { return pathname_; }
+  const std::string& pathname() const { return pathname_->value(); }
 
  protected:
   friend class base::RefCounted<FileStream>;
@@ -175,7 +235,7 @@ class FileStream : public base::RefCounted<FileStream> {
   // Listener invokes this on itself to stop listening to a particular file.
   void StopListeningTo(scoped_refptr<FileStream> file);
 
-  // Notifies all registered listeners.
+  // Notifies all registered listeners and poll waiters.
   void NotifyListeners();
 
   // Called on listener to notify about a change in file.
@@ -186,16 +246,22 @@ class FileStream : public base::RefCounted<FileStream> {
   bool IsClosed() const;
 
  private:
+  // Signals all condition variables registered with AddPollWaiter().
+  void SignalPollWaiters();
+
   // The key is FileStream*, obfuscated to avoid direct use.
   typedef std::map<void*, scoped_refptr<FileStream> > FileMap;
 
   int oflag_;
   // -1 when the stream is not associated with a file (e.g. socket).
   ino_t inode_;
-  // "" when the stream is not associated with a file (e.g. socket).
-  const std::string pathname_;
+  // "" when the stream is not associated with a file (e.g. socket). Interned
+  // by FileStreamPool so that streams for the same file share it.
+  FileStreamPool::Pathname* const pathname_;
   bool is_listening_enabled_;
   FileMap listeners_;
+  // Condition variables of poll() and select() calls waiting for this stream.
+  std::vector<base::ConditionVariable*> poll_waiters_;
   // Permission of this file. VirtualFileSystem sets this value for
   // FileStream created by FileSystemHandler. Other FileStream should fill
   // this by themselves.
@@ -209,6 +275,9 @@ class FileStream : public base::RefCounted<FileStream> {
   // True if this stream ever had positive file_ref_count_.
   // This field is needed for integrity checks only.
   bool had_file_refs_;
+  // Resolved lazily since GetStreamType() cannot be called in the
+  // constructor.
+  IOStats::Slot* io_stats_slot_;
 };
 
 }  // namespace posix_translation
@@ -0,0 +1,172 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "posix_translation/file_stream_pool.h"
+
+#include <pthread.h>
+
+#include <new>
+
+#include "common/alog.h"
+#include "common/thread_local.h"
+
+namespace posix_translation {
+
+namespace {
+
+const size_t kSizeClassGranularity = 32;
+const size_t kNumSizeClasses =
+    FileStreamPool::kMaxPooledSize / kSizeClassGranularity;
+// The number of recently opened pathnames which new streams can share.
+const size_t kNumRecentPathnames = 64;
+
+// Stored in the first bytes of a freed object.
+struct FreeObject {
+  FreeObject* next;
+};
+
+// The free objects of a thread. Since each thread has its own lists,
+// Allocate() and Free() do not need a lock.
+struct ThreadFreeLists {
+  ThreadFreeLists() : heap_allocations(0), pooled_allocations(0) {
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+      lists[i] = NULL;
+      sizes[i] = 0;
+    }
+  }
+
+  ~ThreadFreeLists() {
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+      while (lists[i]) {
+        FreeObject* object = lists[i];
+        lists[i] = object->next;
+        ::operator delete(object);
+      }
+    }
+  }
+
+  FreeObject* lists[kNumSizeClasses];
+  size_t sizes[kNumSizeClasses];
+  uint64_t heap_allocations;
+  uint64_t pooled_allocations;
+};
+
+DEFINE_THREAD_LOCAL(ThreadFreeLists, g_free_lists);
+
+pthread_once_t g_empty_pathname_once = PTHREAD_ONCE_INIT;
+// Allocated in InitializeEmptyPathname() and never freed to avoid a static
+// initializer.
+FileStreamPool::Pathname* g_empty_pathname;
+
+// Each of these holds a reference to its pathname. Guarded by the
+// VirtualFileSystem mutex.
+FileStreamPool::Pathname* g_recent_pathnames[kNumRecentPathnames];
+
+size_t GetSizeClass(size_t size) {
+  return (size - 1) / kSizeClassGranularity;
+}
+
+// Returns the FNV-1a hash of |str|.
+uint32_t HashPathname(const std::string& str) {
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < str.size(); ++i) {
+    hash ^= static_cast<unsigned char>(str[i]);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+}  // namespace
+
+const size_t FileStreamPool::kMaxPooledSize;
+const size_t FileStreamPool::kMaxFreeObjectsPerSizeClass;
+
+FileStreamPool::Pathname::Pathname(const std::string& value)
+    : value_(value), ref_count_(1) {
+}
+
+FileStreamPool::Pathname::~Pathname() {
+}
+
+void* FileStreamPool::Allocate(size_t size) {
+  if (size == 0 || size > kMaxPooledSize)
+    return ::operator new(size);
+  const size_t size_class = GetSizeClass(size);
+  ThreadFreeLists& free_lists = g_free_lists.Ref();
+  FreeObject* object = free_lists.lists[size_class];
+  if (object) {
+    free_lists.lists[size_class] = object->next;
+    --free_lists.sizes[size_class];
+    ++free_lists.pooled_allocations;
+    return object;
+  }
+  ++free_lists.heap_allocations;
+  // Allocate the largest size in the class so that the object can be reused
+  // for any size in it.
+  return ::operator new((size_class + 1) * kSizeClassGranularity);
+}
+
+void FileStreamPool::Free(void* ptr, size_t size) {
+  if (!ptr)
+    return;
+  if (size > 0 && size <= kMaxPooledSize) {
+    const size_t size_class = GetSizeClass(size);
+    ThreadFreeLists& free_lists = g_free_lists.Ref();
+    if (free_lists.sizes[size_class] < kMaxFreeObjectsPerSizeClass) {
+      FreeObject* object = static_cast<FreeObject*>(ptr);
+      object->next = free_lists.lists[size_class];
+      free_lists.lists[size_class] = object;
+      ++free_lists.sizes[size_class];
+      return;
+    }
+  }
+  ::operator delete(ptr);
+}
+
+// static
+void FileStreamPool::InitializeEmptyPathname() {
+  g_empty_pathname = new Pathname(std::string());
+}
+
+FileStreamPool::Pathname* FileStreamPool::InternPathname(
+    const std::string& pathname) {
+  if (pathname.empty()) {
+    pthread_once(&g_empty_pathname_once, &InitializeEmptyPathname);
+    return g_empty_pathname;
+  }
+  // Only the most recent pathname with each hash is kept so that paths
+  // opened once do not stay in memory.
+  Pathname*& recent =
+      g_recent_pathnames[HashPathname(pathname) % kNumRecentPathnames];
+  if (recent && recent->value_ == pathname) {
+    // The reference of |g_recent_pathnames| keeps the count positive, so
+    // ReleasePathname() calls without the mutex cannot free it here.
+    __sync_add_and_fetch(&recent->ref_count_, 1);
+    return recent;
+  }
+  Pathname* interned = new Pathname(pathname);
+  // One reference for |g_recent_pathnames| and one for the caller.
+  interned->ref_count_ = 2;
+  if (recent)
+    ReleasePathname(recent);
+  recent = interned;
+  return interned;
+}
+
+void FileStreamPool::ReleasePathname(Pathname* pathname) {
+  if (pathname == g_empty_pathname)
+    return;
+  const int ref_count = __sync_sub_and_fetch(&pathname->ref_count_, 1);
+  ALOG_ASSERT(ref_count >= 0);
+  if (ref_count == 0)
+    delete pathname;
+}
+
+void FileStreamPool::GetStats(Stats* out_stats) {
+  const ThreadFreeLists& free_lists = g_free_lists.Ref();
+  out_stats->heap_allocations = free_lists.heap_allocations;
+  out_stats->pooled_allocations = free_lists.pooled_allocations;
+}
+
+}  // namespace posix_translation
@@ -0,0 +1,83 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Memory pool for FileStream objects and their pathnames.
+
+#ifndef POSIX_TRANSLATION_FILE_STREAM_POOL_H_
+#define POSIX_TRANSLATION_FILE_STREAM_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "common/export.h"
+
+namespace posix_translation {
+
+// Keeps freed FileStream objects in per-thread, per-size-class free lists so
+// that apps which open and close many sockets, pipes, or /proc files do not
+// allocate from the heap for every stream. It also lets streams which open
+// the same pathname in a row share one copy of it.
+class ARC_EXPORT FileStreamPool {
+ public:
+  // Objects up to this size are pooled. Larger ones use the heap directly.
+  static const size_t kMaxPooledSize = 1024;
+  // The maximum number of free objects kept for each size class and thread.
+  static const size_t kMaxFreeObjectsPerSizeClass = 64;
+
+  // The allocation counts of the calling thread.
+  struct Stats {
+    // Allocate() calls for pooled sizes which had to use the heap.
+    uint64_t heap_allocations;
+    // Allocate() calls which reused a pooled object.
+    uint64_t pooled_allocations;
+  };
+
+  // A reference counted pathname.
+  class Pathname {
+   public:
+    const std::string& value() const { return value_; }
+
+   private:
+    friend class FileStreamPool;
+
+    explicit Pathname(const std::string& value);
+    ~Pathname();
+
+    const std::string value_;
+    int ref_count_;
+
+    DISALLOW_COPY_AND_ASSIGN(Pathname);
+  };
+
+  // These are used by FileStream::operator new and delete. |size| passed to
+  // Free() must be the one passed to Allocate(). An object can be freed on a
+  // thread other than the one which allocated it.
+  static void* Allocate(size_t size);
+  static void Free(void* ptr, size_t size);
+
+  // Returns |pathname|, which is shared with the other streams if it has
+  // been opened recently. This must be called with the VirtualFileSystem
+  // mutex held unless |pathname| is empty. The empty pathname, which most
+  // sockets have, is never reference counted.
+  static Pathname* InternPathname(const std::string& pathname);
+  // Releases a pathname returned by InternPathname(). This does not need
+  // the VirtualFileSystem mutex.
+  static void ReleasePathname(Pathname* pathname);
+
+  static void GetStats(Stats* out_stats);
+
+ private:
+  static void InitializeEmptyPathname();
+
+  FileStreamPool();
+
+  DISALLOW_COPY_AND_ASSIGN(FileStreamPool);
+};
+
+}  // namespace posix_translation
+
+#endif  // POSIX_TRANSLATION_FILE_STREAM_POOL_H_
@@ -0,0 +1,105 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+#include "posix_translation/file_stream_pool.h"
+
+namespace posix_translation {
+
+TEST(FileStreamPoolTest, ReuseFreedObject) {
+  FileStreamPool::Stats before;
+  FileStreamPool::GetStats(&before);
+  void* ptr = FileStreamPool::Allocate(100);
+  ASSERT_TRUE(ptr != NULL);
+  FileStreamPool::Free(ptr, 100);
+
+  // Any size in the same size class reuses the object.
+  void* ptr2 = FileStreamPool::Allocate(120);
+  EXPECT_EQ(ptr, ptr2);
+  FileStreamPool::Stats after;
+  FileStreamPool::GetStats(&after);
+  EXPECT_EQ(before.pooled_allocations + 1, after.pooled_allocations);
+  FileStreamPool::Free(ptr2, 120);
+
+  // Objects which are too large are not pooled.
+  const size_t kLargeSize = FileStreamPool::kMaxPooledSize + 1;
+  void* large = FileStreamPool::Allocate(kLargeSize);
+  ASSERT_TRUE(large != NULL);
+  FileStreamPool::Free(large, kLargeSize);
+  FileStreamPool::GetStats(&before);
+  EXPECT_EQ(after.heap_allocations, before.heap_allocations);
+  EXPECT_EQ(after.pooled_allocations, before.pooled_allocations);
+}
+
+TEST(FileStreamPoolTest, FreeListLimit) {
+  static const size_t kNumObjects =
+      FileStreamPool::kMaxFreeObjectsPerSizeClass * 2;
+  static const size_t kSize = 200;
+  void* objects[kNumObjects];
+  for (size_t i = 0; i < kNumObjects; ++i)
+    objects[i] = FileStreamPool::Allocate(kSize);
+  for (size_t i = 0; i < kNumObjects; ++i)
+    FileStreamPool::Free(objects[i], kSize);
+
+  // Only kMaxFreeObjectsPerSizeClass objects are kept.
+  FileStreamPool::Stats before;
+  FileStreamPool::GetStats(&before);
+  for (size_t i = 0; i < kNumObjects; ++i)
+    objects[i] = FileStreamPool::Allocate(kSize);
+  FileStreamPool::Stats after;
+  FileStreamPool::GetStats(&after);
+  EXPECT_EQ(before.pooled_allocations +
+            FileStreamPool::kMaxFreeObjectsPerSizeClass,
+            after.pooled_allocations);
+  EXPECT_EQ(before.heap_allocations +
+            kNumObjects - FileStreamPool::kMaxFreeObjectsPerSizeClass,
+            after.heap_allocations);
+  for (size_t i = 0; i < kNumObjects; ++i)
+    FileStreamPool::Free(objects[i], kSize);
+}
+
+TEST(FileStreamPoolTest, InternPathname) {
+  FileStreamPool::Pathname* a = FileStreamPool::InternPathname("/a");
+  FileStreamPool::Pathname* a2 =
+      FileStreamPool::InternPathname(std::string("/a"));
+  FileStreamPool::Pathname* b = FileStreamPool::InternPathname("/b");
+  EXPECT_EQ("/a", a->value());
+  EXPECT_EQ(a, a2);
+  EXPECT_EQ("/b", b->value());
+  EXPECT_NE(a, b);
+
+  // The pathname stays until all users release it.
+  FileStreamPool::ReleasePathname(a);
+  EXPECT_EQ("/a", a2->value());
+  FileStreamPool::ReleasePathname(a2);
+  FileStreamPool::ReleasePathname(b);
+
+  // The empty pathname is always shared.
+  FileStreamPool::Pathname* empty = FileStreamPool::InternPathname("");
+  EXPECT_EQ("", empty->value());
+  EXPECT_EQ(empty, FileStreamPool::InternPathname(""));
+  FileStreamPool::ReleasePathname(empty);
+  FileStreamPool::ReleasePathname(empty);
+}
+
+TEST(FileStreamPoolTest, InternManyPathnames) {
+  // Only recently opened pathnames are shared, but each returned pathname
+  // stays valid until it is released.
+  static const size_t kNumPathnames = 1000;
+  FileStreamPool::Pathname* pathnames[kNumPathnames];
+  for (size_t i = 0; i < kNumPathnames; ++i) {
+    pathnames[i] = FileStreamPool::InternPathname(
+        base::StringPrintf("/proc/%zu/stat", i));
+  }
+  for (size_t i = 0; i < kNumPathnames; ++i) {
+    EXPECT_EQ(base::StringPrintf("/proc/%zu/stat", i),
+              pathnames[i]->value());
+    FileStreamPool::ReleasePathname(pathnames[i]);
+  }
+}
+
+}  // namespace posix_translation
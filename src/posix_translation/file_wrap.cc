@@ -18,6 +18,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -122,10 +123,14 @@ ARC_EXPORT off64_t __wrap_lseek64(int fd, off64_t offset, int whence);
 ARC_EXPORT ssize_t __wrap_pread(int fd, void* buf, size_t count, off_t offset);
 ARC_EXPORT ssize_t __wrap_pwrite(
     int fd, const void* buf, size_t count, off_t offset);
+ARC_EXPORT ssize_t __wrap_sendfile(
+    int out_fd, int in_fd, off_t* offset, size_t count);
 ARC_EXPORT ssize_t __wrap_pread64(
     int fd, void* buf, size_t count, off64_t offset);
 ARC_EXPORT ssize_t __wrap_pwrite64(
     int fd, const void* buf, size_t count, off64_t offset);
+ARC_EXPORT ssize_t __wrap_sendfile64(
+    int out_fd, int in_fd, off64_t* offset, size_t count);
 ARC_EXPORT int __wrap_truncate64(const char* path, off64_t length);
 
 // sorted by function name.
@@ -147,6 +152,9 @@ ARC_EXPORT ssize_t __wrap_read(int fd, void* buf, size_t count);
 ARC_EXPORT ssize_t __wrap___read_chk(
     int fd, void* buf, size_t count, size_t buflen);
 ARC_EXPORT ssize_t __wrap_readv(int fd, const struct iovec* iov, int iovcnt);
+ARC_EXPORT ssize_t __wrap_splice(int fd_in, off64_t* off_in, int fd_out,
+                                 off64_t* off_out, size_t len,
+                                 unsigned int flags);
 ARC_EXPORT ssize_t __wrap_write(int fd, const void* buf, size_t count);
 ARC_EXPORT ssize_t __wrap_writev(int fd, const struct iovec* iov, int iovcnt);
 }  // extern "C"
@@ -202,6 +210,18 @@ const char* StripSystemLibPrefix(const char* path) {
       path : path + sizeof(kSystemLib) - 1;
 }
 
+// Returns true if mmap and munmap should be recorded for the memory viewer.
+// The verbose memory viewer records all mappings. Otherwise, recording is
+// off unless ARC_MMAP_SAMPLING_RATE is set or a sampling rate is set at
+// runtime.
+bool ShouldRecordMappings() {
+#if defined(USE_VERBOSE_MEMORY_VIEWER)
+  return true;
+#else
+  return arc::MemoryMappingBacktraceMap::IsEnabled();
+#endif
+}
+
 }  // namespace
 
 // sorted by function name.
@@ -810,11 +830,10 @@ void* __wrap_mmap(
 
   void* result = VirtualFileSystem::GetVirtualFileSystem()->mmap(
       addr, length, prot, flags, fd, offset);
-#if defined(USE_VERBOSE_MEMORY_VIEWER)
-  if (result != MAP_FAILED)
+  if (result != MAP_FAILED && ShouldRecordMappings()) {
     arc::MemoryMappingBacktraceMap::GetInstance()->
         MapCurrentStackFrame(result, length);
-#endif
+  }
 
   if (result == MAP_FAILED)
     ARC_STRACE_ALWAYS_WARN_FAILURE();
@@ -874,10 +893,8 @@ int __wrap_munmap(void* addr, size_t length) {
     if (!result && errno == ENOSYS)
       errno = errno_orig;  // restore |errno| overwritten by posix_translation
   }
-#if defined(USE_VERBOSE_MEMORY_VIEWER)
-  if (result == 0)
+  if (result == 0 && ShouldRecordMappings())
     arc::MemoryMappingBacktraceMap::GetInstance()->Unmap(addr, length);
-#endif
   ARC_STRACE_RETURN(result);
 }
 
@@ -969,7 +986,39 @@ ssize_t __wrap_pwrite64(int fd, const void* buf, size_t count,
   return PwriteImpl(fd, buf, count, offset);
 }
 
+template <typename OffsetType>
+static ssize_t SendfileImpl(int out_fd, int in_fd, OffsetType* offset,
+                            size_t count) {
+  ARC_STRACE_ENTER_FD("sendfile", "%d, %d, %p, %zu",
+                      out_fd, in_fd, offset, count);
+  off64_t offset64 = offset ? *offset : 0;
+  ssize_t result = VirtualFileSystem::GetVirtualFileSystem()->sendfile(
+      out_fd, in_fd, offset ? &offset64 : NULL, count);
+  if (offset)
+    *offset = offset64;
+  if (result == -1 && errno != EAGAIN)
+    ARC_STRACE_ALWAYS_WARN_FAILURE();
+  ARC_STRACE_RETURN(result);
+}
+
+ssize_t __wrap_sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+  return SendfileImpl(out_fd, in_fd, offset, count);
+}
+
+ssize_t __wrap_sendfile64(int out_fd, int in_fd, off64_t* offset,
+                          size_t count) {
+  return SendfileImpl(out_fd, in_fd, offset, count);
+}
+
 ssize_t __wrap_read(int fd, void* buf, size_t count) {
+  // Fast path for streams like /dev/zero which need neither the
+  // VirtualFileSystem mutex nor ARC strace.
+  ssize_t lock_free_result;
+  if (!arc::StraceEnabled() &&
+      VirtualFileSystem::GetVirtualFileSystem()->TryLockFreeRead(
+          fd, buf, count, &lock_free_result)) {
+    return lock_free_result;
+  }
   ARC_STRACE_ENTER_FD("read", "%d, %p, %zu", fd, buf, count);
   ssize_t result = VirtualFileSystem::GetVirtualFileSystem()->read(
       fd, buf, count);
@@ -995,6 +1044,17 @@ ssize_t __wrap_readv(int fd, const struct iovec* iov, int iovcnt) {
   ARC_STRACE_RETURN(result);
 }
 
+ssize_t __wrap_splice(int fd_in, off64_t* off_in, int fd_out,
+                      off64_t* off_out, size_t len, unsigned int flags) {
+  ARC_STRACE_ENTER_FD("splice", "%d, %p, %d, %p, %zu, %u",
+                      fd_in, off_in, fd_out, off_out, len, flags);
+  ssize_t result = VirtualFileSystem::GetVirtualFileSystem()->splice(
+      fd_in, off_in, fd_out, off_out, len, flags);
+  if (result == -1 && errno != EAGAIN)
+    ARC_STRACE_ALWAYS_WARN_FAILURE();
+  ARC_STRACE_RETURN(result);
+}
+
 int __wrap_rmdir(const char* pathname) {
   ARC_STRACE_ENTER("rmdir", "\"%s\"", SAFE_CSTR(pathname));
   int result = VirtualFileSystem::GetVirtualFileSystem()->rmdir(pathname);
@@ -1013,6 +1073,14 @@ int __wrap_utime(const char* filename, const struct utimbuf* times) {
 }
 
 ssize_t __wrap_write(int fd, const void* buf, size_t count) {
+  // See __wrap_read. This is safe to call even inside __wrap_write since the
+  // lock-free operations do not write to stdio.
+  ssize_t lock_free_result;
+  if (!arc::StraceEnabled() &&
+      VirtualFileSystem::GetVirtualFileSystem()->TryLockFreeWrite(
+          fd, buf, count, &lock_free_result)) {
+    return lock_free_result;
+  }
   const int wrap_write_nest_count = g_wrap_write_nest_count.Get();
   if (wrap_write_nest_count) {
     // Calling write() to a stdio descriptor inside __wrap_write may cause
@@ -22,6 +22,13 @@
 namespace posix_translation {
 namespace {
 
+// The limits of the resolution results cache. Pepper does not tell the TTLs
+// of DNS records, so fixed ones are used. Failures are kept shorter so that
+// a transient failure does not last long.
+const size_t kMaxCacheEntries = 256;
+const int kCacheTTLInSeconds = 60;
+const int kNegativeCacheTTLInSeconds = 10;
+
 pthread_once_t g_host_ent_once = PTHREAD_ONCE_INIT;
 pthread_key_t g_host_ent_key;
 
@@ -78,7 +85,10 @@ struct hostent* GetCleanHostEnt() {
 }  // namespace
 
 HostResolver::HostResolver(const pp::InstanceHandle& instance)
-    : instance_(instance) {
+    : instance_(instance),
+      cache_(kMaxCacheEntries,
+             base::TimeDelta::FromSeconds(kCacheTTLInSeconds),
+             base::TimeDelta::FromSeconds(kNegativeCacheTTLInSeconds)) {
 }
 
 HostResolver::~HostResolver() {
@@ -145,6 +155,37 @@ int HostResolver::getaddrinfo(const char* hostname, const char* servname,
   if (hints->ai_flags & AI_NUMERICHOST)
     return EAI_NONAME;
 
+  // The result does not depend on the port, which is replaced below, so
+  // lookups for different services can share a cached result.
+  const std::string key = HostResolverCache::MakeKey(
+      hostname, hints->ai_family, hints->ai_flags);
+  HostResolverCache::Entry entry;
+  if (!cache_.Lookup(key, &entry)) {
+    ResolveWithPepper(hostname, sin_port, hints, &entry);
+    cache_.Add(key, entry);
+  }
+  if (entry.error)
+    return entry.error;
+
+  for (size_t i = 0; i < entry.addresses.size(); ++i) {
+    storage = entry.addresses[i];
+    if (entry.port != sin_port) {
+      if (storage.ss_family == AF_INET6)
+        reinterpret_cast<sockaddr_in6*>(&storage)->sin6_port = sin_port;
+      else
+        reinterpret_cast<sockaddr_in*>(&storage)->sin_port = sin_port;
+    }
+    *res = internal::SockAddrStorageToAddrInfo(
+        storage, hints->ai_socktype, hints->ai_protocol,
+        entry.canonical_name);
+    res = &(*res)->ai_next;
+  }
+  return 0;
+}
+
+void HostResolver::ResolveWithPepper(const char* hostname, uint16_t sin_port,
+                                     const addrinfo* hints,
+                                     HostResolverCache::Entry* out_entry) {
   PP_HostResolver_Hint hint = {
       PP_NETADDRESS_FAMILY_UNSPECIFIED,
       hints->ai_flags & AI_CANONNAME ? PP_HOSTRESOLVER_FLAG_CANONNAME : 0
@@ -153,6 +194,7 @@ int HostResolver::getaddrinfo(const char* hostname, const char* servname,
   TRACE_EVENT1(ARC_TRACE_CATEGORY, "HostResolver::getaddrinfo - IPC",
                "hostname", std::string(hostname));
 
+  out_entry->port = sin_port;
   // Should we retry IPv6, and then UNSPEC?
   pp::HostResolver resolver(instance_);
   // Resolve needs the port number in the host byte order
@@ -161,25 +203,24 @@ int HostResolver::getaddrinfo(const char* hostname, const char* servname,
       hostname, ntohs(sin_port), hint, pp::BlockUntilComplete());
   if (result != PP_OK) {
     // TODO(igorc): Check whether this should be EAI_NODATA
-    return EAI_NONAME;
+    out_entry->error = EAI_NONAME;
+    return;
   }
 
-  int count = 0;
-  std::string host_name = resolver.GetCanonicalName().AsString();
+  out_entry->canonical_name = resolver.GetCanonicalName().AsString();
   uint32_t resolved_addr_count = resolver.GetNetAddressCount();
   for (uint32_t i = 0; i < resolved_addr_count; i++) {
+    sockaddr_storage storage;
     if (!internal::NetAddressToSockAddrStorage(
             resolver.GetNetAddress(i),
             hints->ai_family, hints->ai_flags & AI_V4MAPPED, &storage))
       continue;
-    *res = internal::SockAddrStorageToAddrInfo(
-        storage, hints->ai_socktype, hints->ai_protocol, host_name);
-    res = &(*res)->ai_next;
-    ++count;
+    out_entry->addresses.push_back(storage);
     // TODO(igorc): Remove IPv4/IPv6 duplicates.
   }
 
-  return (count == 0 ? EAI_NODATA : 0);
+  if (out_entry->addresses.empty())
+    out_entry->error = EAI_NODATA;
 }
 
 void HostResolver::freeaddrinfo(addrinfo* res) {
@@ -311,6 +352,14 @@ hostent* HostResolver::gethostbyaddr(
   return hostent;
 }
 
+void HostResolver::OnNetworkChanged() {
+  cache_.Clear();
+}
+
+std::string HostResolver::GetCacheStatsAsString() const {
+  return cache_.GetStatsAsString();
+}
+
 int HostResolver::getnameinfo(const sockaddr* sa, socklen_t salen,
                               char* host, size_t hostlen,
                               char* serv, size_t servlen, int flags) {
@@ -8,7 +8,10 @@
 #include <netdb.h>
 #include <sys/socket.h>
 
+#include <string>
+
 #include "base/basictypes.h"
+#include "posix_translation/host_resolver_cache.h"
 #include "ppapi/cpp/instance_handle.h"
 
 namespace posix_translation {
@@ -40,8 +43,20 @@ class HostResolver {
                   char* host, size_t hostlen,
                   char* serv, size_t servlen, int flags);
 
+  // Drops all cached results. This should be called when the network
+  // configuration changes.
+  void OnNetworkChanged();
+
+  std::string GetCacheStatsAsString() const;
+
  private:
+  // Resolves |hostname| with Pepper and fills |out_entry| with the result.
+  void ResolveWithPepper(const char* hostname, uint16_t sin_port,
+                         const addrinfo* hints,
+                         HostResolverCache::Entry* out_entry);
+
   pp::InstanceHandle instance_;
+  HostResolverCache cache_;
 
   DISALLOW_COPY_AND_ASSIGN(HostResolver);
 };
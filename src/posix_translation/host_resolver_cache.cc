@@ -0,0 +1,161 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "posix_translation/host_resolver_cache.h"
+
+#include <netdb.h>
+
+#include "base/strings/stringprintf.h"
+#include "common/alog.h"
+#include "common/arc_strace.h"
+
+namespace posix_translation {
+
+HostResolverCache::Entry::Entry() : error(0), port(0) {
+}
+
+HostResolverCache::CachedEntry::CachedEntry()
+    : in_flight(false), invalidated(false) {
+}
+
+HostResolverCache::HostResolverCache(size_t max_entries,
+                                     const base::TimeDelta& ttl,
+                                     const base::TimeDelta& negative_ttl)
+    : max_entries_(max_entries),
+      ttl_(ttl),
+      negative_ttl_(negative_ttl),
+      cond_(&mutex_),
+      hit_count_(0),
+      miss_count_(0),
+      coalesced_count_(0),
+      eviction_count_(0) {
+  ALOG_ASSERT(max_entries_ > 0);
+}
+
+HostResolverCache::~HostResolverCache() {
+}
+
+// static
+std::string HostResolverCache::MakeKey(const char* hostname, int family,
+                                       int flags) {
+  // Only these flags affect the result of the resolution.
+  flags &= AI_CANONNAME | AI_V4MAPPED;
+  return base::StringPrintf("%d:%d:%s", family, flags, hostname);
+}
+
+bool HostResolverCache::Lookup(const std::string& key, Entry* out_entry) {
+  base::AutoLock lock(mutex_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it != entries_.end() && it->second.in_flight) {
+    // Another thread is resolving the same host name. Wait for its result,
+    // which is returned even if it has been invalidated in the meantime.
+    ++coalesced_count_;
+    ARC_STRACE_REPORT("Waiting for the resolution in flight: %s",
+                      key.c_str());
+    do {
+      cond_.Wait();
+      it = entries_.find(key);
+    } while (it != entries_.end() && it->second.in_flight);
+    if (it != entries_.end()) {
+      *out_entry = it->second.entry;
+      return true;
+    }
+  } else if (it != entries_.end() &&
+             base::TimeTicks::Now() < it->second.expiration) {
+    ++hit_count_;
+    *out_entry = it->second.entry;
+    return true;
+  }
+
+  ++miss_count_;
+  if (it == entries_.end()) {
+    EvictIfNeededLocked(base::TimeTicks::Now());
+    it = entries_.insert(std::make_pair(key, CachedEntry())).first;
+  }
+  it->second.in_flight = true;
+  it->second.invalidated = false;
+  return false;
+}
+
+void HostResolverCache::Add(const std::string& key, const Entry& entry) {
+  base::AutoLock lock(mutex_);
+  EntryMap::iterator it = entries_.find(key);
+  ALOG_ASSERT(it != entries_.end() && it->second.in_flight);
+  CachedEntry& cached = it->second;
+  cached.entry = entry;
+  cached.in_flight = false;
+  if (cached.invalidated) {
+    // Let the waiting threads take the result, but do not return it for
+    // later lookups.
+    cached.expiration = base::TimeTicks();
+  } else {
+    cached.expiration = base::TimeTicks::Now() +
+        (entry.error ? negative_ttl_ : ttl_);
+  }
+  cond_.Broadcast();
+}
+
+void HostResolverCache::Clear() {
+  base::AutoLock lock(mutex_);
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end();) {
+    if (it->second.in_flight) {
+      it->second.invalidated = true;
+      ++it;
+    } else {
+      entries_.erase(it++);
+    }
+  }
+}
+
+std::string HostResolverCache::GetStatsAsString() const {
+  base::AutoLock lock(mutex_);
+  return base::StringPrintf("HostResolverCache: Entries:%zu Hit:%zu Miss:%zu "
+                            "Coalesced:%zu Evicted:%zu",
+                            entries_.size(), hit_count_, miss_count_,
+                            coalesced_count_, eviction_count_);
+}
+
+size_t HostResolverCache::hit_count() const {
+  base::AutoLock lock(mutex_);
+  return hit_count_;
+}
+
+size_t HostResolverCache::miss_count() const {
+  base::AutoLock lock(mutex_);
+  return miss_count_;
+}
+
+size_t HostResolverCache::coalesced_count() const {
+  base::AutoLock lock(mutex_);
+  return coalesced_count_;
+}
+
+void HostResolverCache::EvictIfNeededLocked(const base::TimeTicks& now) {
+  mutex_.AssertAcquired();
+  if (entries_.size() < max_entries_)
+    return;
+
+  // Drop expired entries first, then the one which expires first.
+  EntryMap::iterator oldest = entries_.end();
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end();) {
+    if (it->second.in_flight) {
+      ++it;
+    } else if (it->second.expiration <= now) {
+      entries_.erase(it++);
+      ++eviction_count_;
+    } else {
+      if (oldest == entries_.end() ||
+          it->second.expiration < oldest->second.expiration) {
+        oldest = it;
+      }
+      ++it;
+    }
+  }
+  if (entries_.size() >= max_entries_ && oldest != entries_.end()) {
+    entries_.erase(oldest);
+    ++eviction_count_;
+  }
+}
+
+}  // namespace posix_translation
@@ -0,0 +1,109 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef POSIX_TRANSLATION_HOST_RESOLVER_CACHE_H_
+#define POSIX_TRANSLATION_HOST_RESOLVER_CACHE_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+
+namespace posix_translation {
+
+// A cache of host name resolution results shared by all threads. Both
+// successful and failed results are cached, each with its own TTL. While a
+// thread is resolving a host name, other threads looking up the same key wait
+// for the result instead of resolving it again.
+// This class is thread-safe. Unlike most classes in posix_translation, it
+// uses its own lock because resolving a host name may take seconds and must
+// not be done with VirtualFileSystem::mutex() held.
+class HostResolverCache {
+ public:
+  struct Entry {
+    Entry();
+
+    // 0, or an EAI_* error code for a failed resolution.
+    int error;
+    std::string canonical_name;
+    // The port used for the resolution, in network byte order.
+    uint16_t port;
+    std::vector<sockaddr_storage> addresses;
+  };
+
+  // Successful results are kept for |ttl|, and failed ones for
+  // |negative_ttl|. At most |max_entries| results are kept.
+  HostResolverCache(size_t max_entries,
+                    const base::TimeDelta& ttl,
+                    const base::TimeDelta& negative_ttl);
+  ~HostResolverCache();
+
+  // Returns a cache key for resolving |hostname| with the address |family|
+  // and getaddrinfo() |flags|.
+  static std::string MakeKey(const char* hostname, int family, int flags);
+
+  // Returns true and fills |out_entry| if a result for |key| is cached. If
+  // another thread is resolving |key|, waits for it and returns its result.
+  // Otherwise, returns false. In that case, the caller must resolve the host
+  // name and call Add(), and other threads looking up |key| wait until then.
+  bool Lookup(const std::string& key, Entry* out_entry);
+
+  // Adds the result for |key| which Lookup() has returned false for, and
+  // wakes up the threads waiting for it.
+  void Add(const std::string& key, const Entry& entry);
+
+  // Drops all cached results, e.g. when the network configuration changes.
+  // The results of resolutions in flight are passed to the waiting threads
+  // but not cached.
+  void Clear();
+
+  std::string GetStatsAsString() const;
+
+  // Statistics for testing.
+  size_t hit_count() const;
+  size_t miss_count() const;
+  size_t coalesced_count() const;
+
+ private:
+  struct CachedEntry {
+    CachedEntry();
+
+    Entry entry;
+    base::TimeTicks expiration;
+    // True while a thread is resolving the host name.
+    bool in_flight;
+    // True if Clear() is called while |in_flight| is true.
+    bool invalidated;
+  };
+  typedef std::map<std::string, CachedEntry> EntryMap;
+
+  // Makes room for a new entry if the cache is full.
+  void EvictIfNeededLocked(const base::TimeTicks& now);
+
+  const size_t max_entries_;
+  const base::TimeDelta ttl_;
+  const base::TimeDelta negative_ttl_;
+
+  mutable base::Lock mutex_;
+  // Signaled when a resolution in flight completes.
+  base::ConditionVariable cond_;
+  EntryMap entries_;
+
+  size_t hit_count_;
+  size_t miss_count_;
+  size_t coalesced_count_;
+  size_t eviction_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(HostResolverCache);
+};
+
+}  // namespace posix_translation
+#endif  // POSIX_TRANSLATION_HOST_RESOLVER_CACHE_H_
@@ -0,0 +1,177 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <netdb.h>
+#include <netinet/in.h>
+
+#include <string>
+
+#include "base/compiler_specific.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+#include "posix_translation/host_resolver_cache.h"
+
+namespace posix_translation {
+
+namespace {
+
+const size_t kMaxEntries = 3;
+
+HostResolverCache::Entry MakeEntry(uint32_t addr) {
+  HostResolverCache::Entry entry;
+  sockaddr_storage storage = {};
+  sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(&storage);
+  sin->sin_family = AF_INET;
+  sin->sin_addr.s_addr = addr;
+  entry.addresses.push_back(storage);
+  return entry;
+}
+
+uint32_t GetAddr(const HostResolverCache::Entry& entry) {
+  EXPECT_EQ(1U, entry.addresses.size());
+  return reinterpret_cast<const sockaddr_in*>(
+      &entry.addresses[0])->sin_addr.s_addr;
+}
+
+// Looks up a key on a separate thread, adding |entry| on a miss.
+class LookupThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  LookupThread(HostResolverCache* cache, const std::string& key,
+               const HostResolverCache::Entry& entry)
+      : cache_(cache), key_(key), entry_(entry),
+        thread_(this, "lookup_thread") {}
+
+  void Start() {
+    thread_.Start();
+  }
+
+  void Join() {
+    thread_.Join();
+  }
+
+  const HostResolverCache::Entry& result() const { return result_; }
+
+ private:
+  // base::DelegateSimpleThread::Delegate override.
+  virtual void Run() OVERRIDE {
+    if (!cache_->Lookup(key_, &result_)) {
+      result_ = entry_;
+      cache_->Add(key_, entry_);
+    }
+  }
+
+  HostResolverCache* cache_;
+  const std::string key_;
+  const HostResolverCache::Entry entry_;
+  HostResolverCache::Entry result_;
+  base::DelegateSimpleThread thread_;
+};
+
+}  // namespace
+
+TEST(HostResolverCacheTest, TestMakeKey) {
+  EXPECT_EQ(HostResolverCache::MakeKey("example.com", AF_INET, 0),
+            HostResolverCache::MakeKey("example.com", AF_INET, AI_PASSIVE));
+  EXPECT_NE(HostResolverCache::MakeKey("example.com", AF_INET, 0),
+            HostResolverCache::MakeKey("example.com", AF_INET6, 0));
+  EXPECT_NE(HostResolverCache::MakeKey("example.com", AF_INET6, 0),
+            HostResolverCache::MakeKey("example.com", AF_INET6, AI_V4MAPPED));
+  EXPECT_NE(HostResolverCache::MakeKey("example.com", AF_INET, 0),
+            HostResolverCache::MakeKey("example.com", AF_INET, AI_CANONNAME));
+  EXPECT_NE(HostResolverCache::MakeKey("example.com", AF_INET, 0),
+            HostResolverCache::MakeKey("example.org", AF_INET, 0));
+}
+
+TEST(HostResolverCacheTest, TestLookup) {
+  HostResolverCache cache(kMaxEntries, base::TimeDelta::FromHours(1),
+                          base::TimeDelta::FromHours(1));
+  HostResolverCache::Entry entry;
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+  cache.Add("a", MakeEntry(1));
+  EXPECT_TRUE(cache.Lookup("a", &entry));
+  EXPECT_EQ(1U, GetAddr(entry));
+
+  // Failures are cached too.
+  EXPECT_FALSE(cache.Lookup("b", &entry));
+  HostResolverCache::Entry failure;
+  failure.error = EAI_NONAME;
+  cache.Add("b", failure);
+  EXPECT_TRUE(cache.Lookup("b", &entry));
+  EXPECT_EQ(EAI_NONAME, entry.error);
+  EXPECT_TRUE(entry.addresses.empty());
+
+  EXPECT_EQ(2U, cache.hit_count());
+  EXPECT_EQ(2U, cache.miss_count());
+}
+
+TEST(HostResolverCacheTest, TestExpiration) {
+  HostResolverCache cache(kMaxEntries, base::TimeDelta::FromHours(1),
+                          base::TimeDelta());
+  HostResolverCache::Entry entry;
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+  HostResolverCache::Entry failure;
+  failure.error = EAI_NONAME;
+  cache.Add("a", failure);
+  // The failure has expired immediately.
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+  cache.Add("a", MakeEntry(1));
+  EXPECT_TRUE(cache.Lookup("a", &entry));
+  EXPECT_EQ(0, entry.error);
+  EXPECT_EQ(1U, GetAddr(entry));
+}
+
+TEST(HostResolverCacheTest, TestEviction) {
+  HostResolverCache cache(kMaxEntries, base::TimeDelta::FromHours(1),
+                          base::TimeDelta::FromHours(1));
+  HostResolverCache::Entry entry;
+  const char* kKeys[] = { "a", "b", "c", "d" };
+  for (size_t i = 0; i < arraysize(kKeys); ++i) {
+    EXPECT_FALSE(cache.Lookup(kKeys[i], &entry));
+    cache.Add(kKeys[i], MakeEntry(i));
+  }
+  // The entry which expires first has been evicted.
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+  cache.Add("a", MakeEntry(0));
+  EXPECT_TRUE(cache.Lookup("c", &entry));
+  EXPECT_TRUE(cache.Lookup("d", &entry));
+  EXPECT_TRUE(cache.Lookup("a", &entry));
+}
+
+TEST(HostResolverCacheTest, TestClear) {
+  HostResolverCache cache(kMaxEntries, base::TimeDelta::FromHours(1),
+                          base::TimeDelta::FromHours(1));
+  HostResolverCache::Entry entry;
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+  cache.Add("a", MakeEntry(1));
+  EXPECT_FALSE(cache.Lookup("b", &entry));
+
+  // The result of "b" resolved before Clear() should not be cached.
+  cache.Clear();
+  cache.Add("b", MakeEntry(2));
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+  cache.Add("a", MakeEntry(1));
+  EXPECT_FALSE(cache.Lookup("b", &entry));
+  cache.Add("b", MakeEntry(2));
+  EXPECT_TRUE(cache.Lookup("b", &entry));
+  EXPECT_EQ(2U, GetAddr(entry));
+}
+
+TEST(HostResolverCacheTest, TestCoalescing) {
+  HostResolverCache cache(kMaxEntries, base::TimeDelta::FromHours(1),
+                          base::TimeDelta::FromHours(1));
+  HostResolverCache::Entry entry;
+  EXPECT_FALSE(cache.Lookup("a", &entry));
+
+  // While "a" is being resolved, other lookups of "a" should wait for the
+  // result rather than resolving it again.
+  LookupThread thread(&cache, "a", MakeEntry(2));
+  thread.Start();
+  cache.Add("a", MakeEntry(1));
+  thread.Join();
+  EXPECT_EQ(1U, GetAddr(thread.result()));
+  EXPECT_EQ(1U, cache.miss_count());
+  EXPECT_EQ(1U, cache.hit_count() + cache.coalesced_count());
+}
+
+}  // namespace posix_translation
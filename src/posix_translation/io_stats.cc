@@ -0,0 +1,197 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "posix_translation/io_stats.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "base/strings/stringprintf.h"
+#include "common/alog.h"
+#include "common/atomics.h"
+#include "posix_translation/virtual_file_system.h"
+
+namespace posix_translation {
+
+namespace {
+
+const int kMaxSlots = 64;
+const size_t kMaxNameLength = 48;
+
+const char* const kDirectionNames[IOStats::kNumDirections] = {
+  "read",
+  "write",
+};
+
+// The counters are only accessed with __sync builtins.
+void AtomicAdd(uint64_t* counter, uint64_t value) {
+  __sync_fetch_and_add(counter, value);
+}
+
+int GetLatencyBucket(uint64_t latency_us) {
+  int bucket = 0;
+  while (bucket < IOStats::kNumLatencyBuckets - 1 &&
+         latency_us >= (1ULL << bucket)) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+bool CompareEntries(const IOStats::Entry& a, const IOStats::Entry& b) {
+  if (a.handler_name != b.handler_name)
+    return a.handler_name < b.handler_name;
+  return a.stream_type < b.stream_type;
+}
+
+}  // namespace
+
+class IOStats::Slot {
+ public:
+  char handler_name[kMaxNameLength];
+  char stream_type[kMaxNameLength];
+  Counters counters[kNumDirections];
+};
+
+namespace {
+
+IOStats::Slot g_slots[kMaxSlots];
+// The number of used slots in |g_slots|. Only incremented with the
+// VirtualFileSystem mutex held, after the new slot is filled.
+int g_num_slots;
+// Shared by all pairs once |g_slots| is full.
+IOStats::Slot g_overflow_slot = { "", "(overflow)" };
+
+void CopyName(const char* name, char* out) {
+  strncpy(out, name, kMaxNameLength - 1);
+  out[kMaxNameLength - 1] = '\0';
+}
+
+bool SlotHasName(const IOStats::Slot& slot, const char* handler_name,
+                 const char* stream_type) {
+  return !strncmp(slot.handler_name, handler_name, kMaxNameLength - 1) &&
+      !strncmp(slot.stream_type, stream_type, kMaxNameLength - 1);
+}
+
+}  // namespace
+
+// static
+IOStats::Slot* IOStats::GetSlot(const std::string& handler_name,
+                                const char* stream_type) {
+  VirtualFileSystem::GetVirtualFileSystem()->mutex().AssertAcquired();
+  const int num_slots = g_num_slots;
+  for (int i = 0; i < num_slots; ++i) {
+    if (SlotHasName(g_slots[i], handler_name.c_str(), stream_type))
+      return &g_slots[i];
+  }
+  if (num_slots == kMaxSlots) {
+    ALOGW("Too many I/O stats slots for %s:%s",
+          handler_name.c_str(), stream_type);
+    return &g_overflow_slot;
+  }
+  Slot* slot = &g_slots[num_slots];
+  CopyName(handler_name.c_str(), slot->handler_name);
+  CopyName(stream_type, slot->stream_type);
+  // Publish the names before the slot for GetSnapshot().
+  arc::ReleaseStore(&g_num_slots, num_slots + 1);
+  return slot;
+}
+
+// static
+int64_t IOStats::GetStartTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// static
+void IOStats::Record(Slot* slot, Direction direction, ssize_t result,
+                     int64_t start_time) {
+  ALOG_ASSERT(direction >= 0 && direction < kNumDirections);
+  const int64_t elapsed = GetStartTime() - start_time;
+  const uint64_t latency_us = elapsed > 0 ? elapsed : 0;
+  Counters* counters = &slot->counters[direction];
+  AtomicAdd(&counters->calls, 1);
+  if (result < 0)
+    AtomicAdd(&counters->errors, 1);
+  else
+    AtomicAdd(&counters->bytes, result);
+  AtomicAdd(&counters->total_latency_us, latency_us);
+  AtomicAdd(&counters->latency_buckets[GetLatencyBucket(latency_us)], 1);
+}
+
+// static
+void IOStats::GetSnapshot(std::vector<Entry>* out_entries) {
+  out_entries->clear();
+  const int num_slots = arc::AcquireLoad(&g_num_slots);
+  for (int i = 0; i <= num_slots; ++i) {
+    Slot& slot = i < num_slots ? g_slots[i] : g_overflow_slot;
+    Entry entry;
+    uint64_t calls = 0;
+    for (int d = 0; d < kNumDirections; ++d) {
+      Counters& src = slot.counters[d];
+      Counters* dest = &entry.counters[d];
+      dest->calls = arc::AtomicLoad64(&src.calls);
+      dest->errors = arc::AtomicLoad64(&src.errors);
+      dest->bytes = arc::AtomicLoad64(&src.bytes);
+      dest->total_latency_us = arc::AtomicLoad64(&src.total_latency_us);
+      for (int b = 0; b < kNumLatencyBuckets; ++b)
+        dest->latency_buckets[b] = arc::AtomicLoad64(&src.latency_buckets[b]);
+      calls += dest->calls;
+    }
+    if (!calls)
+      continue;
+    entry.handler_name = slot.handler_name;
+    entry.stream_type = slot.stream_type;
+    out_entries->push_back(entry);
+  }
+  std::sort(out_entries->begin(), out_entries->end(), CompareEntries);
+}
+
+// static
+std::string IOStats::GetSnapshotAsString() {
+  std::vector<Entry> entries;
+  GetSnapshot(&entries);
+  std::string result =
+      "# handler stream op calls errors bytes total_us latency_histogram";
+  for (int b = 0; b < kNumLatencyBuckets - 1; ++b)
+    base::StringAppendF(&result, " <%lluus", 1ULL << b);
+  base::StringAppendF(&result, " >=%lluus\n",
+                      1ULL << (kNumLatencyBuckets - 2));
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const Entry& entry = entries[i];
+    for (int d = 0; d < kNumDirections; ++d) {
+      const Counters& c = entry.counters[d];
+      if (!c.calls)
+        continue;
+      base::StringAppendF(
+          &result, "%s %s %s %llu %llu %llu %llu",
+          entry.handler_name.empty() ? "-" : entry.handler_name.c_str(),
+          entry.stream_type.c_str(), kDirectionNames[d],
+          static_cast<unsigned long long>(c.calls),
+          static_cast<unsigned long long>(c.errors),
+          static_cast<unsigned long long>(c.bytes),
+          static_cast<unsigned long long>(c.total_latency_us));
+      for (int b = 0; b < kNumLatencyBuckets; ++b) {
+        base::StringAppendF(
+            &result, " %llu",
+            static_cast<unsigned long long>(c.latency_buckets[b]));
+      }
+      result += "\n";
+    }
+  }
+  return result;
+}
+
+// static
+void IOStats::ResetForTest() {
+  const int num_slots = arc::AcquireLoad(&g_num_slots);
+  for (int i = 0; i <= num_slots; ++i) {
+    Slot* slot = i < num_slots ? &g_slots[i] : &g_overflow_slot;
+    memset(slot->counters, 0, sizeof(slot->counters));
+  }
+}
+
+}  // namespace posix_translation
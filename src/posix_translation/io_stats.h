@@ -0,0 +1,89 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// I/O statistics per file system handler and stream type.
+
+#ifndef POSIX_TRANSLATION_IO_STATS_H_
+#define POSIX_TRANSLATION_IO_STATS_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "common/export.h"
+
+namespace posix_translation {
+
+// Counts calls, bytes, and latencies of the read-like and write-like calls
+// going through VirtualFileSystem. Each FileStream is bound to a slot keyed
+// by the name of the handler which opened it and its stream type, so the
+// recording path only does a few relaxed atomic additions and never takes a
+// lock.
+class ARC_EXPORT IOStats {
+ public:
+  enum Direction {
+    // read, pread, readv, recv, recvfrom, and recvmsg.
+    kRead = 0,
+    // write, pwrite, writev, send, sendto, and sendmsg.
+    kWrite,
+    kNumDirections
+  };
+
+  // Bucket i counts the calls which took less than 2^i microseconds. The
+  // last bucket also counts all slower calls.
+  static const int kNumLatencyBuckets = 20;
+
+  struct Counters {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t total_latency_us;
+    uint64_t latency_buckets[kNumLatencyBuckets];
+  };
+
+  struct Entry {
+    // Empty for streams which are not opened by a handler, e.g. sockets.
+    std::string handler_name;
+    std::string stream_type;
+    Counters counters[kNumDirections];
+  };
+
+  class Slot;
+
+  // Returns the slot for the pair. Slots live forever. Once all slots are
+  // used, the pairs share an overflow slot.
+  static Slot* GetSlot(const std::string& handler_name,
+                       const char* stream_type);
+
+  // Returns the current time for Record().
+  static int64_t GetStartTime();
+
+  // Records a call which returned |result| and started at |start_time|.
+  // A negative |result| is counted as an error.
+  static void Record(Slot* slot, Direction direction, ssize_t result,
+                     int64_t start_time);
+
+  // Returns the counters of all slots with at least one call, sorted by
+  // handler name and stream type. Each counter is read atomically, but the
+  // counters are not read at the same instant.
+  static void GetSnapshot(std::vector<Entry>* out_entries);
+
+  // Returns the snapshot as the text served as /proc/arc/iostats.
+  static std::string GetSnapshotAsString();
+
+  // Clears all counters. For testing.
+  static void ResetForTest();
+
+ private:
+  IOStats();
+
+  DISALLOW_COPY_AND_ASSIGN(IOStats);
+};
+
+}  // namespace posix_translation
+
+#endif  // POSIX_TRANSLATION_IO_STATS_H_
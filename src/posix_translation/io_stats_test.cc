@@ -0,0 +1,113 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/compiler_specific.h"
+#include "gtest/gtest.h"
+#include "posix_translation/io_stats.h"
+#include "posix_translation/test_util/file_system_test_common.h"
+
+namespace posix_translation {
+
+class IOStatsTest : public FileSystemTestCommon {
+ protected:
+  IOStatsTest() {}
+
+  virtual void SetUp() OVERRIDE {
+    FileSystemTestCommon::SetUp();
+    IOStats::ResetForTest();
+  }
+
+  // Returns the entry for the pair, or NULL if it has no calls.
+  const IOStats::Entry* FindEntry(const std::string& handler_name,
+                                  const std::string& stream_type) {
+    IOStats::GetSnapshot(&entries_);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      if (entries_[i].handler_name == handler_name &&
+          entries_[i].stream_type == stream_type)
+        return &entries_[i];
+    }
+    return NULL;
+  }
+
+ private:
+  std::vector<IOStats::Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(IOStatsTest);
+};
+
+TEST_F(IOStatsTest, TestGetSlot) {
+  IOStats::Slot* slot = IOStats::GetSlot("IOStatsTestHandler", "a");
+  EXPECT_TRUE(slot);
+  EXPECT_EQ(slot, IOStats::GetSlot("IOStatsTestHandler", "a"));
+  EXPECT_NE(slot, IOStats::GetSlot("IOStatsTestHandler", "b"));
+  EXPECT_NE(slot, IOStats::GetSlot("", "a"));
+}
+
+TEST_F(IOStatsTest, TestRecord) {
+  IOStats::Slot* slot = IOStats::GetSlot("IOStatsTestHandler", "a");
+  EXPECT_FALSE(FindEntry("IOStatsTestHandler", "a"));
+
+  const int64_t now = IOStats::GetStartTime();
+  IOStats::Record(slot, IOStats::kRead, 100, now);
+  IOStats::Record(slot, IOStats::kRead, -1, now);
+  IOStats::Record(slot, IOStats::kWrite, 20, now);
+  // 3 ms ago.
+  IOStats::Record(slot, IOStats::kWrite, 0, now - 3000);
+
+  const IOStats::Entry* entry = FindEntry("IOStatsTestHandler", "a");
+  ASSERT_TRUE(entry);
+  const IOStats::Counters& read = entry->counters[IOStats::kRead];
+  EXPECT_EQ(2U, read.calls);
+  EXPECT_EQ(1U, read.errors);
+  EXPECT_EQ(100U, read.bytes);
+  const IOStats::Counters& write = entry->counters[IOStats::kWrite];
+  EXPECT_EQ(2U, write.calls);
+  EXPECT_EQ(0U, write.errors);
+  EXPECT_EQ(20U, write.bytes);
+  EXPECT_LE(3000U, write.total_latency_us);
+
+  uint64_t total = 0;
+  for (int i = 0; i < IOStats::kNumLatencyBuckets; ++i)
+    total += write.latency_buckets[i];
+  EXPECT_EQ(2U, total);
+  // 3000 us is in [2^11, 2^12).
+  EXPECT_LE(1U, write.latency_buckets[12] + write.latency_buckets[13]);
+
+  IOStats::ResetForTest();
+  EXPECT_FALSE(FindEntry("IOStatsTestHandler", "a"));
+}
+
+TEST_F(IOStatsTest, TestSnapshotIsSorted) {
+  const int64_t now = IOStats::GetStartTime();
+  IOStats::Record(IOStats::GetSlot("IOStatsTestB", "x"), IOStats::kRead, 1,
+                  now);
+  IOStats::Record(IOStats::GetSlot("IOStatsTestA", "y"), IOStats::kRead, 1,
+                  now);
+  IOStats::Record(IOStats::GetSlot("IOStatsTestA", "x"), IOStats::kRead, 1,
+                  now);
+
+  std::vector<IOStats::Entry> entries;
+  IOStats::GetSnapshot(&entries);
+  ASSERT_EQ(3U, entries.size());
+  EXPECT_EQ("IOStatsTestA", entries[0].handler_name);
+  EXPECT_EQ("x", entries[0].stream_type);
+  EXPECT_EQ("IOStatsTestA", entries[1].handler_name);
+  EXPECT_EQ("y", entries[1].stream_type);
+  EXPECT_EQ("IOStatsTestB", entries[2].handler_name);
+}
+
+TEST_F(IOStatsTest, TestGetSnapshotAsString) {
+  IOStats::Record(IOStats::GetSlot("", "tcp"), IOStats::kWrite, 42,
+                  IOStats::GetStartTime());
+  const std::string s = IOStats::GetSnapshotAsString();
+  EXPECT_EQ(0U, s.find("# handler stream op calls errors bytes total_us "));
+  // Streams without a handler are shown with "-".
+  EXPECT_NE(std::string::npos, s.find("\n- tcp write 1 0 42 "));
+  EXPECT_EQ(std::string::npos, s.find("tcp read"));
+}
+
+}  // namespace posix_translation
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <string>
 
+#include "base/synchronization/condition_variable.h"
 #include "common/alog.h"
 #include "common/process_emulator.h"
 #include "posix_translation/socket_util.h"
@@ -20,11 +21,74 @@ namespace posix_translation {
 // 224K is the default SO_SNDBUF/SO_RCVBUF in the linux kernel.
 static const int kBufferSize = 224*1024;
 
+// Limits for the datagram buffers kept for reuse per socket.
+static const size_t kMaxPooledDatagramBuffers = 16;
+static const size_t kMaxPooledDatagramBufferSize = 64*1024;
+
+namespace {
+
+// Copies data from |src| to |dest| until either of them is exhausted. Returns
+// the number of bytes copied.
+size_t CopyIovecs(const struct iovec* src, size_t src_count,
+                  const struct iovec* dest, size_t dest_count) {
+  size_t copied = 0;
+  size_t src_index = 0;
+  size_t src_offset = 0;
+  size_t dest_index = 0;
+  size_t dest_offset = 0;
+  while (src_index < src_count && dest_index < dest_count) {
+    if (src_offset >= src[src_index].iov_len) {
+      src_offset = 0;
+      ++src_index;
+      continue;
+    }
+    if (dest_offset >= dest[dest_index].iov_len) {
+      dest_offset = 0;
+      ++dest_index;
+      continue;
+    }
+    const size_t len = std::min(src[src_index].iov_len - src_offset,
+                                dest[dest_index].iov_len - dest_offset);
+    memcpy(static_cast<char*>(dest[dest_index].iov_base) + dest_offset,
+           static_cast<const char*>(src[src_index].iov_base) + src_offset,
+           len);
+    src_offset += len;
+    dest_offset += len;
+    copied += len;
+  }
+  return copied;
+}
+
+size_t GetIovecsSize(const struct iovec* iov, size_t count) {
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i)
+    size += iov[i].iov_len;
+  return size;
+}
+
+}  // namespace
+
+struct LocalSocket::PendingRead {
+  PendingRead(struct msghdr* msg, base::Lock* mutex)
+      : msg(msg), cond(mutex), bytes_read(0), done(false) {
+  }
+
+  // The buffers of the reader to copy the data to.
+  struct msghdr* msg;
+  // Signaled when the writer has copied data to |msg|, or the socket state
+  // has changed.
+  base::ConditionVariable cond;
+  // Filled by the writer.
+  ssize_t bytes_read;
+  ucred cred;
+  bool done;
+};
+
 LocalSocket::LocalSocket(int oflag, int socket_type,
                          StreamDir stream_dir)
     : SocketStream(AF_UNIX, oflag), socket_type_(socket_type),
       connect_state_(SOCKET_NEW), stream_dir_(stream_dir),
-      connection_backlog_(0), pass_cred_(0) {
+      connection_backlog_(0), pending_read_(NULL), pass_cred_(0) {
   if (socket_type == SOCK_STREAM && stream_dir != WRITE_ONLY)
     buffer_.set_capacity(kBufferSize);
   my_cred_.pid = arc::ProcessEmulator::GetPid();
@@ -38,6 +102,7 @@ LocalSocket::LocalSocket(int oflag, int socket_type,
 }
 
 LocalSocket::~LocalSocket() {
+  ALOG_ASSERT(!pending_read_);
 }
 
 bool LocalSocket::IsAllowedOnMainThread() const {
@@ -46,11 +111,14 @@ bool LocalSocket::IsAllowedOnMainThread() const {
 
 void LocalSocket::OnLastFileRef() {
   if (peer_) {
+    scoped_refptr<LocalSocket> peer = peer_;
     peer_->peer_ = NULL;
     peer_ = NULL;
     // Note that the peer_ == NULL and connect_state_ == SOCKET_CONNECTED
     // means the connection has been closed.
     VirtualFileSystem::GetVirtualFileSystem()->Broadcast();
+    // Let poll, select, and epoll on the peer see the hang-up.
+    peer->NotifyListeners();
   }
 
   if (!abstract_name_.empty()) {
@@ -412,16 +480,16 @@ int LocalSocket::recvmsg(struct msghdr* msg, int flags) {
   }
 
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  if (is_block() && !(flags & MSG_DONTWAIT)) {
-    while (peer_ && !IsSelectReadReady()) {
-      sys->Wait();
-    }
-  }
-
   msg->msg_flags = 0;
-  ssize_t bytes_read = 0;
+  ssize_t bytes_handed_off = 0;
   ucred cred;
-  if (socket_type_ == SOCK_STREAM) {
+  if (is_block() && !(flags & MSG_DONTWAIT) && peer_ && !IsSelectReadReady())
+    bytes_handed_off = WaitForReadableLocked(msg, &cred);
+
+  ssize_t bytes_read = bytes_handed_off;
+  if (bytes_handed_off > 0) {
+    // The writer has copied the data to |msg| directly.
+  } else if (socket_type_ == SOCK_STREAM) {
     cred = peer_cred_;
     if (buffer_.size() > 0) {
       for (size_t i = 0; i < msg->msg_iovlen && buffer_.size() > 0; ++i) {
@@ -431,7 +499,7 @@ int LocalSocket::recvmsg(struct msghdr* msg, int flags) {
     }
   } else {
     if (!queue_.empty()) {
-      const Datagram& datagram = queue_.front();
+      Datagram& datagram = queue_.front();
       cred = datagram.cred_;
       std::vector<char>::const_iterator iter = datagram.content_.begin();
       size_t remaining = datagram.content_.size();
@@ -445,6 +513,7 @@ int LocalSocket::recvmsg(struct msghdr* msg, int flags) {
       if (remaining > 0)
         msg->msg_flags |= MSG_TRUNC;
       bytes_read = datagram.content_.size() - remaining;
+      RecycleDatagramBuffer(&datagram.content_);
       queue_.pop_front();
     }
   }
@@ -457,7 +526,9 @@ int LocalSocket::recvmsg(struct msghdr* msg, int flags) {
     size_t msg_controllen = 0;
     struct cmsghdr* cmsg_last = NULL;
 
-    if (!cmsg_fd_queue_.empty()) {
+    // Data with control messages is never handed off, so the queued file
+    // descriptors belong to data which has not been read yet.
+    if (!bytes_handed_off && !cmsg_fd_queue_.empty()) {
       std::vector<int>& fds = cmsg_fd_queue_.front();
 
       socklen_t cmsg_len = CMSG_LEN(fds.size() * sizeof(int));  // NOLINT
@@ -662,6 +733,14 @@ int16_t LocalSocket::GetPollEvents() const {
   }
 }
 
+bool LocalSocket::GetWritableSize(size_t* out_size) const {
+  // Datagrams are queued without a limit, and writes fail without a peer.
+  if (socket_type_ != SOCK_STREAM || peer_ == NULL)
+    return false;
+  *out_size = peer_->buffer_.remaining();
+  return true;
+}
+
 bool LocalSocket::CanRead() const {
   ALOG_ASSERT(stream_dir_ == READ_WRITE);
   // If the peer has been closed, whether the socket is readable depends on
@@ -688,6 +767,68 @@ bool LocalSocket::CanWrite() const {
   return true;
 }
 
+ssize_t LocalSocket::WaitForReadableLocked(struct msghdr* msg,
+                                           ucred* out_cred) {
+  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
+  PendingRead pending_read(msg, &sys->mutex());
+  // Only the first blocked reader receives data directly. Readers which do
+  // not have room for the data just wait for it to be buffered.
+  if (!pending_read_ && GetIovecsSize(msg->msg_iov, msg->msg_iovlen) > 0)
+    pending_read_ = &pending_read;
+  // The condition variable is also signaled by NotifyListeners() when the
+  // data is buffered or the peer is closed, and when this socket is closed.
+  const bool added = AddPollWaiter(&pending_read.cond);
+  ALOG_ASSERT(added);
+  while (peer_ && !IsSelectReadReady() && !pending_read.done)
+    pending_read.cond.Wait();
+  RemovePollWaiter(&pending_read.cond);
+  if (pending_read_ == &pending_read)
+    pending_read_ = NULL;
+
+  if (!pending_read.done)
+    return 0;
+  *out_cred = pending_read.cred;
+  return pending_read.bytes_read;
+}
+
+size_t LocalSocket::HandOffToPendingReadLocked(const struct msghdr* msg,
+                                               const ucred& peer_cred) {
+  ALOG_ASSERT(pending_read_ && !pending_read_->done);
+  struct msghdr* dest = pending_read_->msg;
+  const size_t size = GetIovecsSize(msg->msg_iov, msg->msg_iovlen);
+  const size_t copied = CopyIovecs(msg->msg_iov, msg->msg_iovlen,
+                                   dest->msg_iov, dest->msg_iovlen);
+  pending_read_->bytes_read = copied;
+  pending_read_->cred = peer_cred;
+  pending_read_->done = true;
+  if (socket_type_ == SOCK_STREAM) {
+    // The rest of the data is buffered by the caller.
+    return copied;
+  }
+  // The rest of the datagram is discarded like recvmsg() does.
+  if (copied < size)
+    dest->msg_flags |= MSG_TRUNC;
+  return size;
+}
+
+void LocalSocket::GetDatagramBuffer(std::vector<char>* out_buffer) {
+  ALOG_ASSERT(out_buffer->empty());
+  if (datagram_buffer_pool_.empty())
+    return;
+  out_buffer->swap(datagram_buffer_pool_.back());
+  datagram_buffer_pool_.pop_back();
+}
+
+void LocalSocket::RecycleDatagramBuffer(std::vector<char>* buffer) {
+  if (datagram_buffer_pool_.size() >= kMaxPooledDatagramBuffers ||
+      buffer->capacity() > kMaxPooledDatagramBufferSize) {
+    return;
+  }
+  buffer->clear();
+  datagram_buffer_pool_.push_back(std::vector<char>());
+  datagram_buffer_pool_.back().swap(*buffer);
+}
+
 int LocalSocket::HandleSendmsgLocked(const struct msghdr* msg,
                                      const ucred& peer_cred) {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
@@ -698,25 +839,48 @@ int LocalSocket::HandleSendmsgLocked(const struct msghdr* msg,
 
   ssize_t bytes_sent = 0;
   size_t bytes_attempted = 0;
-  if (len > 0) {
-    if (socket_type_ == SOCK_STREAM) {
-      ALOG_ASSERT(memcmp(&peer_cred, &peer_cred_, sizeof(peer_cred)) == 0);
-      for (size_t i = 0; i < len; ++i) {
-        bytes_attempted += buf[i].iov_len;
-        bytes_sent += buffer_.write(static_cast<const char*>(buf[i].iov_base),
-                                    buf[i].iov_len);
+  bool handed_off = false;
+  size_t bytes_handed_off = 0;
+  if (pending_read_ && !pending_read_->done && msg->msg_controllen == 0 &&
+      buffer_.size() == 0 && queue_.empty() && cmsg_fd_queue_.empty() &&
+      GetIovecsSize(buf, len) > 0) {
+    // A reader is blocked waiting for data. Copy the data to its buffer
+    // directly instead of copying it to our buffer first.
+    bytes_handed_off = HandOffToPendingReadLocked(msg, peer_cred);
+    handed_off = true;
+  }
+
+  if (len > 0 && socket_type_ == SOCK_STREAM) {
+    ALOG_ASSERT(memcmp(&peer_cred, &peer_cred_, sizeof(peer_cred)) == 0);
+    bytes_sent = bytes_handed_off;
+    size_t skip = bytes_handed_off;
+    for (size_t i = 0; i < len; ++i) {
+      bytes_attempted += buf[i].iov_len;
+      const size_t skipped = std::min(skip, buf[i].iov_len);
+      skip -= skipped;
+      if (skipped < buf[i].iov_len) {
+        bytes_sent += buffer_.write(
+            static_cast<const char*>(buf[i].iov_base) + skipped,
+            buf[i].iov_len - skipped);
       }
+    }
+  } else if (len > 0) {
+    bytes_attempted = GetIovecsSize(buf, len);
+    if (handed_off) {
+      // The whole datagram has been delivered to the pending read.
+      bytes_sent = bytes_attempted;
     } else {
       queue_.push_back(Datagram());
       Datagram& datagram = queue_.back();
       datagram.cred_ = peer_cred;
+      GetDatagramBuffer(&datagram.content_);
+      datagram.content_.reserve(bytes_attempted);
       for (size_t i = 0; i < len; ++i) {
         const char* begin = static_cast<const char*>(buf[i].iov_base);
         const char* end = begin + buf[i].iov_len;
         datagram.content_.insert(datagram.content_.end(), begin, end);
-        bytes_attempted += buf[i].iov_len;
-        bytes_sent += buf[i].iov_len;
       }
+      bytes_sent = bytes_attempted;
     }
   }
 
@@ -751,7 +915,10 @@ int LocalSocket::HandleSendmsgLocked(const struct msghdr* msg,
     }
   }
 
-  if (bytes_sent > 0) {
+  if (handed_off)
+    pending_read_->cond.Signal();
+  // Others need to be woken up only when some data has been buffered.
+  if (bytes_sent > static_cast<ssize_t>(bytes_handed_off)) {
     sys->Broadcast();
     NotifyListeners();
   }
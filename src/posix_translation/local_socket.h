@@ -77,6 +77,7 @@ class LocalSocket : public SocketStream {
   virtual bool IsSelectWriteReady() const OVERRIDE;
   virtual bool IsSelectExceptionReady() const OVERRIDE;
   virtual int16_t GetPollEvents() const OVERRIDE;
+  virtual bool GetWritableSize(size_t* out_size) const OVERRIDE;
 
   virtual const char* GetStreamType() const OVERRIDE;
 
@@ -104,10 +105,24 @@ class LocalSocket : public SocketStream {
   typedef std::deque<std::vector<int> > ControlMessageFDQueue;
   typedef std::deque<Datagram> DatagramQueue;
   typedef std::vector<scoped_refptr<LocalSocket> > SocketVector;
+  // A read blocked in recvmsg() which accepts data directly from the writer.
+  struct PendingRead;
 
   bool CanRead() const;
   bool CanWrite() const;
   int HandleSendmsgLocked(const struct msghdr* msg, const ucred& peer_cred);
+  // Blocks until the socket becomes readable. Returns the number of bytes the
+  // writer has copied to |msg| directly, or 0 if the data should be read from
+  // the buffer as usual.
+  ssize_t WaitForReadableLocked(struct msghdr* msg, ucred* out_cred);
+  // Copies the data in |msg| to the buffer of |pending_read_|. Returns the
+  // number of bytes consumed from |msg|.
+  size_t HandOffToPendingReadLocked(const struct msghdr* msg,
+                                    const ucred& peer_cred);
+  // Returns an empty buffer for a new datagram, reusing a pooled one if any.
+  void GetDatagramBuffer(std::vector<char>* out_buffer);
+  // Returns the buffer of a consumed datagram to the pool.
+  void RecycleDatagramBuffer(std::vector<char>* buffer);
   bool HandleConnectLocked(LocalSocket* bound_socket);
   void WaitForLocalSocketConnect();
   void WaitForOpenedConnectToAccept();
@@ -133,6 +148,11 @@ class LocalSocket : public SocketStream {
   arc::CircularBuffer buffer_;
   scoped_refptr<LocalSocket> peer_;
   DatagramQueue queue_;
+  // Buffers of consumed datagrams kept for reuse so that SOCK_DGRAM and
+  // SOCK_SEQPACKET messages do not allocate a new buffer each time.
+  std::vector<std::vector<char> > datagram_buffer_pool_;
+  // Not owned. The first reader blocked on this socket, if any.
+  PendingRead* pending_read_;
   ControlMessageFDQueue cmsg_fd_queue_;
   std::string abstract_name_;
   // TODO(crbug/513081): Implement UNIX domain socket with names and remove this
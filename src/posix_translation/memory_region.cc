@@ -7,6 +7,7 @@
 #include "posix_translation/memory_region.h"
 
 #include <inttypes.h>
+#include <sys/mman.h>
 #include <algorithm>  // for min and max
 #include <utility>
 
@@ -14,6 +15,7 @@
 #include "base/strings/stringprintf.h"
 #include "common/arc_strace.h"
 #include "common/alog.h"
+#include "common/memory_counters.h"
 #include "posix_translation/address_util.h"
 #include "posix_translation/file_stream.h"
 #include "posix_translation/virtual_file_system.h"
@@ -40,6 +42,13 @@ std::string GetStreamPathname(scoped_refptr<FileStream> stream) {
   return result;
 }
 
+// Returns the memory counter for regions mapped with |flags|.
+arc::MemoryCounters::Type GetMemoryCounterType(int flags) {
+  return (flags & (MAP_ANON | MAP_ANONYMOUS)) ?
+      arc::MemoryCounters::kAnonymousMappedBytes :
+      arc::MemoryCounters::kFileMappedBytes;
+}
+
 class AdviseVisitor : public MemoryRegion::PageMapVisitor {
  public:
   explicit AdviseVisitor(int advice);
@@ -57,7 +66,7 @@ class AdviseVisitor : public MemoryRegion::PageMapVisitor {
 
 class ProtectionVisitor : public MemoryRegion::PageMapVisitor {
  public:
-  ProtectionVisitor(int prot, std::set<ino_t>* out_write_mapped);
+  explicit ProtectionVisitor(int prot);
   virtual ~ProtectionVisitor();
 
   int Finish();
@@ -68,7 +77,6 @@ class ProtectionVisitor : public MemoryRegion::PageMapVisitor {
  private:
   bool visited_;
   const int prot_;
-  std::set<ino_t>* write_mapped_;
 };
 
 AdviseVisitor::AdviseVisitor(int advice)
@@ -113,8 +121,8 @@ int AdviseVisitor::Finish() {
   return -1;
 }
 
-ProtectionVisitor::ProtectionVisitor(int prot, std::set<ino_t>* write_mapped)
-    : visited_(false), prot_(prot), write_mapped_(write_mapped) {
+ProtectionVisitor::ProtectionVisitor(int prot)
+    : visited_(false), prot_(prot) {
 }
 
 ProtectionVisitor::~ProtectionVisitor() {
@@ -122,17 +130,13 @@ ProtectionVisitor::~ProtectionVisitor() {
 
 bool ProtectionVisitor::Visit(const MemoryRegion::PageMapValue& page_map,
                               char* start_addr, char* end_addr) {
-  // TODO(crbug.com/427417): Split page_map if prot is inconsistent.
   ARC_STRACE_REPORT_HANDLER(page_map.stream->GetStreamType());
   ARC_STRACE_REPORT("(%p-%p \"%s\")",
                       start_addr,
                       end_addr + 1,
                       GetStreamPathname(page_map.stream).c_str());
   size_t length = end_addr - start_addr + 1;
-  if (!page_map.stream->mprotect(start_addr, length, prot_)) {
-    if (prot_ & PROT_WRITE)
-      write_mapped_->insert(page_map.stream->inode());
-  } else {
+  if (page_map.stream->mprotect(start_addr, length, prot_)) {
     WriteFailureLog(
         "mprotect", visited_, start_addr, end_addr, page_map.stream);
     return false;  // return early on error
@@ -157,6 +161,11 @@ MemoryRegion::MemoryRegion() : abort_on_unexpected_memory_maps_(true) {
 }
 
 MemoryRegion::~MemoryRegion() {
+  for (RegionMap::const_iterator it = map_.begin(); it != map_.end(); ++it) {
+    arc::MemoryCounters::Add(
+        GetMemoryCounterType(it->second.flags),
+        -static_cast<int64_t>(it->second.end - it->first + 1));
+  }
 }
 
 bool MemoryRegion::AddFileStreamByAddr(
@@ -193,45 +202,23 @@ bool MemoryRegion::AddFileStreamByAddr(
     }
   }
 
-  const PageMapValue value(1, offset, stream);
-  typedef std::pair<PageToStream::iterator, bool> InsertResult;
-  InsertResult result_addr_start =
-      map_.insert(std::make_pair(addr_start, value));
-
-  // Fail if |addr_start| already exists in the map.
-  if (!result_addr_start.second)
-    return false;
-  PageToStream::iterator addr_start_it = result_addr_start.first;
-
   char* const addr_end = addr_start + length - 1;
   ALOG_ASSERT(IsPageEndAddress(addr_end));
-  InsertResult result_addr_end = map_.insert(std::make_pair(addr_end, value));
 
-  // Fail if |addr_end| already exists in the map.
-  if (!result_addr_end.second) {
-    map_.erase(addr_start_it);
-    return false;
-  }
-  PageToStream::iterator addr_end_it = result_addr_end.first;
-
-  // Fail if [addr_start, addr_end) overlaps with one of the existing regions.
+  // Fail if [addr_start, addr_end] overlaps with one of the existing regions.
   // It happens for the following cases using MemoryFile.
   //   fd = ashmem_create_region();
   //   mmap(fd, 4096 /* length */);
   //   mmap(fd, 8192 /* different length */);  // fail here
   // If the second length is the same, FindRegion() in this function returns
   // the first region and works.
-  if (IsOverlap(addr_start_it, addr_end_it)) {
-    map_.erase(addr_start_it);
-    map_.erase(addr_end_it);
+  RegionMap::const_iterator it = FindFirstRegion(addr_start);
+  if (it != map_.end() && it->first <= addr_end)
     return false;
-  }
 
-  if (stream) {
-    const ino_t inode = stream->inode();
-    if (prot & PROT_WRITE)
-      write_mapped_.insert(inode);
-  }
+  InsertRegion(addr_start,
+               PageMapValue(addr_end, 1, offset, prot, flags, stream));
+  arc::MemoryCounters::Add(GetMemoryCounterType(flags), length);
 
   // You can uncomment this to print the memory mappings.
   //  ALOGI("\n%s", GetMemoryMapAsString().c_str());
@@ -240,7 +227,6 @@ bool MemoryRegion::AddFileStreamByAddr(
 
 int MemoryRegion::RemoveFileStreamsByAddr(
     void* addr, size_t length, bool call_munmap) {
-  // TODO(toyoshim): Rewrite this function to use PageMapVisitor.
   ALOG_ASSERT(!IsPageEndAddress(addr) && !(length % 2));
   if (!length) {
     errno = EINVAL;
@@ -257,74 +243,68 @@ int MemoryRegion::RemoveFileStreamsByAddr(
   char* const remove_end = remove_start + length - 1;
 
   // Find the first region.
-  PageToStream::iterator it = map_.lower_bound(remove_start);
-  if (it == map_.end()) {
+  RegionMap::iterator it = FindFirstRegion(remove_start);
+  if (it == map_.end() || remove_end < it->first) {
     // TODO(crbug.com/362862): Stop returning ENOSYS.
     errno = ENOSYS;
     return -1;
   }
-  if (IsPageEndAddress(it->first)) {
-    // An IsPageEndAddress element should not be the first one.
-    ALOG_ASSERT(it != map_.begin());
-
-    // This condition means that |remove_start| is in the midst of an existing
-    // region.
-    // <start A>                <end A>  <start B>    <end B>
-    //     *-----------------------*         *-----------*
-    //               ^             ^
-    //         |remove_start|  |it->first|
-    // The iterator should point <start A> so to shrink the region A.
-    --it;
-  }
-
-  bool is_region_found = false;
-  while (it != map_.end()) {
-    PageToStream::iterator region_start_it = it;
-    PageToStream::iterator region_end_it = ++it;
-    // Since |region_start_it|, which is a !IsPageEndAddress element, is a valid
-    // iterator, |region_end_it| (and |it| here) should also be valid.
-    ALOG_ASSERT(it != map_.end());
-
-    // Check if [region_start_it->first, region_end_it->first] overlaps
-    // [remove_start, remove_end].
-    if (remove_end < region_start_it->first)
-      break;  // No overlap. No more memory regions to modify.
 
+  for (RegionMap::const_iterator check_it = it;
+       check_it != map_.end() && check_it->first <= remove_end; ++check_it) {
     // We do not support partial unmapping for a duplicated mmap region. Note
-    // that memory_file.cc would return the same address from the two mmap calls
-    // below:
+    // that memory_file.cc would return the same address from the two mmap
+    // calls below:
     //   fd = ashmem_create_region();
     //   void* addr1 = mmap(fd, 4096*3 /* length */);
     //   void* addr2 = mmap(fd, 4096*3 /* the same length */);
     //   munmap(addr1 + 4096, 4096);  // fail
     ALOG_ASSERT((!abort_on_unexpected_memory_maps_) ||
-                (region_start_it->second.ref == 1),
+                (check_it->second.ref == 1),
                 "Cannot partially unmap a ref-counted region: "
                 "unmap_addr=%p, unmap_length=%zu, "
                 "mapped_addr=%p, mapped_length=%td",
-                addr, length, region_start_it->first,
-                region_end_it->first - region_start_it->first + 1);
-    if (region_start_it->second.ref > 1) {
+                addr, length, check_it->first,
+                check_it->second.end - check_it->first + 1);
+    if (check_it->second.ref > 1) {
       errno = ENOSYS;  // return ENOSYS for unit tests.
       return -1;
     }
+  }
 
-    char* remove_start_in_region =
-        std::max(remove_start, region_start_it->first);
-    char* remove_end_in_region = std::min(remove_end, region_end_it->first);
-
-    // These two variables have to be assigned/updated here since
-    // RemoveOneRegion might invalidate iterators.
-    scoped_refptr<FileStream> current_stream = region_start_it->second.stream;
-    ++it;  // for the next iteration.
-
-    const PageMapValue value(1, region_start_it->second.offset, current_stream);
-    RemoveOneRegion(value,
-                    remove_start_in_region, remove_end_in_region,
-                    region_start_it->first, region_end_it->first);
-    is_region_found = true;  // modified at least one memory region.
-
-    // IsMemoryRangeAvailable() may insert a null stream.
+  // If |remove_start| is in the midst of an existing region, shrink the region
+  // by splitting it.
+  // <start A>                <end A>  <start B>    <end B>
+  //     *-----------------------*         *-----------*
+  //               ^
+  //         |remove_start|
+  if (it->first < remove_start)
+    it = SplitRegion(it, remove_start);
+
+  while (it != map_.end() && it->first <= remove_end) {
+    // Find the last region which is a continuation of the same mapping so that
+    // the underlying munmap() is called once for them.
+    RegionMap::iterator last_it = it;
+    for (RegionMap::iterator next_it = last_it;
+         ++next_it != map_.end() && next_it->first <= remove_end &&
+             IsContinuation(last_it, next_it, false);) {
+      last_it = next_it;
+    }
+    if (remove_end < last_it->second.end)
+      SplitRegion(last_it, remove_end + 1);
+
+    char* const remove_start_in_region = it->first;
+    char* const remove_end_in_region = last_it->second.end;
+    scoped_refptr<FileStream> current_stream = it->second.stream;
+    arc::MemoryCounters::Add(
+        GetMemoryCounterType(it->second.flags),
+        -static_cast<int64_t>(remove_end_in_region - remove_start_in_region +
+                              1));
+    ++last_it;
+    while (it != last_it)
+      EraseRegion(it++);
+
+    // AddFileStreamByAddr() accepts a null stream.
     if (current_stream) {
       // Call REPORT_HANDLER() so that the current function call is
       // categorized as |current_stream->GetStreamType()| rather than
@@ -374,69 +354,13 @@ int MemoryRegion::RemoveFileStreamsByAddr(
             remove_start_in_region, length);
       }
     }
-
-    ALOG_ASSERT(it == map_.end() || !IsPageEndAddress(it->first));
   }
 
-  if (!is_region_found) {
-    // TODO(crbug.com/362862): Stop returning ENOSYS.
-    errno = ENOSYS;
-    return -1;
-  }
   // You can uncomment this to print the updated memory mappings.
   //  ALOGI("\n%s", GetMemoryMapAsString().c_str());
   return 0;
 }
 
-void MemoryRegion::RemoveOneRegion(PageMapValue value,
-                                   char* remove_start, char* remove_end,
-                                   char* region_start, char* region_end) {
-  ALOG_ASSERT(!IsPageEndAddress(remove_start));
-  ALOG_ASSERT(IsPageEndAddress(remove_end));
-  ALOG_ASSERT(!IsPageEndAddress(region_start));
-  ALOG_ASSERT(IsPageEndAddress(region_end));
-
-  // Split [region_start, region_end] if needed.
-  //
-  // [new_region_right_start, new_region_right_end] might be created as a result
-  // of the removal. For example, if the original region is [0,4], and [2,2] is
-  // removed, new_region_left will be [0,1] and new_region_right will be [3,4].
-  char* const new_region_right_start = remove_end + 1;
-  char* const new_region_right_end = region_end;
-  ptrdiff_t new_region_right_len =
-      new_region_right_end - new_region_right_start + 1;
-  ALOG_ASSERT(new_region_right_len >= 0);
-
-  // [new_region_left_start, new_region_left_end] might also be created after
-  // the removal.
-  char* const new_region_left_start = region_start;
-  char* const new_region_left_end = remove_start - 1;
-  ptrdiff_t new_region_left_len =
-      new_region_left_end - new_region_left_start + 1;
-  ALOG_ASSERT(new_region_left_len >= 0);
-
-  // Delete the memory region (and create new one(s) if it's partial unmapping).
-  if (new_region_left_len > 0) {
-    ALOG_ASSERT(IsPageEndAddress(new_region_left_end));
-    bool result = map_.insert(
-        std::make_pair(new_region_left_end, value)).second;
-    ALOG_ASSERT(result);
-  } else {
-    size_t result = map_.erase(new_region_left_start);
-    ALOG_ASSERT(result == 1);
-  }
-
-  if (new_region_right_len > 0) {
-    ALOG_ASSERT(!IsPageEndAddress(new_region_right_start));
-    bool result = map_.insert(
-        std::make_pair(new_region_right_start, value)).second;
-    ALOG_ASSERT(result);
-  } else {
-    size_t result = map_.erase(new_region_right_end);
-    ALOG_ASSERT(result == 1);
-  }
-}
-
 int MemoryRegion::SetAdviceByAddr(void* addr, size_t length, int advice) {
   // Note: zero-length madvise succeeds on Linux. It returns with 0 without
   // setting advice.
@@ -455,27 +379,75 @@ int MemoryRegion::ChangeProtectionModeByAddr(
   if (!length)
     return 0;
 
-  ProtectionVisitor visitor(prot, &write_mapped_);
+  ProtectionVisitor visitor(prot);
   CallByAddr(static_cast<char*>(addr), length, &visitor);
-  return visitor.Finish();
+  const int result = visitor.Finish();
+  if (!result)
+    UpdateProtectionMode(static_cast<char*>(addr), length, prot);
+  return result;
 }
 
-bool MemoryRegion::IsWriteMapped(ino_t inode) const {
-  return write_mapped_.count(inode) > 0;
+void MemoryRegion::UpdateProtectionMode(char* addr, size_t length, int prot) {
+  char* const start_addr = addr;
+  char* const end_addr = start_addr + length - 1;
+
+  RegionMap::iterator it = FindFirstRegion(start_addr);
+  if (it == map_.end() || end_addr < it->first)
+    return;
+  // A ref-counted region cannot be split. Such a region keeps the original
+  // protection mode unless it is changed as a whole.
+  if (it->first < start_addr && it->second.ref == 1)
+    it = SplitRegion(it, start_addr);
+
+  const RegionMap::iterator first_it = it;
+  for (; it != map_.end() && it->first <= end_addr; ++it) {
+    PageMapValue& region = it->second;
+    if (end_addr < region.end && region.ref == 1)
+      SplitRegion(it, end_addr + 1);
+    if (start_addr <= it->first && region.end <= end_addr) {
+      region.prot = prot;
+      if (prot & PROT_WRITE)
+        region.write_mapped = true;
+    }
+  }
+
+  // Merge the modified regions as well as the next one with their neighbors.
+  for (it = first_it; it != map_.end() && it->first <= end_addr + 1; ++it)
+    it = MergeWithPreviousRegion(it);
+
+  // You can uncomment this to print the updated memory mappings.
+  //  ALOGI("\n%s", GetMemoryMapAsString().c_str());
 }
 
-bool MemoryRegion::IsCurrentlyMapped(ino_t inode) const {
-  for (PageToStream::const_iterator it = map_.begin(); it != map_.end(); ++it) {
-    scoped_refptr<FileStream> stream = it->second.stream;
-    if (stream && (stream->inode() == inode))
+bool MemoryRegion::IsMemoryRangeAvailable(void* addr, size_t length) const {
+  if (!length)
+    return true;
+  char* const start_addr = static_cast<char*>(addr);
+  char* const end_addr = start_addr + length - 1;
+  RegionMap::const_iterator it = FindFirstRegion(start_addr);
+  return it == map_.end() || end_addr < it->first;
+}
+
+bool MemoryRegion::IsWriteMappedByAddr(void* addr, size_t length) const {
+  if (!length)
+    return false;
+  char* const start_addr = static_cast<char*>(addr);
+  char* const end_addr = start_addr + length - 1;
+  for (RegionMap::const_iterator it = FindFirstRegion(start_addr);
+       it != map_.end() && it->first <= end_addr; ++it) {
+    if (it->second.write_mapped)
       return true;
   }
   return false;
 }
 
+bool MemoryRegion::IsCurrentlyMapped(ino_t inode) const {
+  return mapped_inodes_.count(inode) > 0;
+}
+
 std::string MemoryRegion::GetMemoryMapAsString() const {
   std::string result =
-    "Range                 Length           Offset     Backend  FileSize"
+    "Range                 Length           Offset     Perm Backend  FileSize"
     "         Ref  Name\n";
   if (map_.empty()) {
     result += "(No memory mapped files)\n";
@@ -485,18 +457,13 @@ std::string MemoryRegion::GetMemoryMapAsString() const {
   typedef base::hash_map<std::string, size_t> BackendStat;  // NOLINT
   BackendStat per_backend;
 
-  for (PageToStream::const_iterator it = map_.begin(); it != map_.end(); ++it) {
+  for (RegionMap::const_iterator it = map_.begin(); it != map_.end(); ++it) {
     char* start = it->first;
+    char* end = it->second.end;
     int ref = it->second.ref;
     off64_t off = it->second.offset;
+    const int prot = it->second.prot;
     scoped_refptr<FileStream> stream = it->second.stream;
-    ++it;
-    if (it == map_.end()) {
-      ALOG_ASSERT("map_ is corrupted" == NULL);
-      result += "memory map is corrupted!\n";
-      break;
-    }
-    char* end = it->first;
     if (!stream)
       continue;
 
@@ -504,14 +471,18 @@ std::string MemoryRegion::GetMemoryMapAsString() const {
     const std::string backend = stream->GetStreamType();
 
     result += base::StringPrintf(
-        "0x%08" PRIxPTR "-0x%08" PRIxPTR " 0x%08x %4zuM 0x%08llx %-8s 0x%08x "
-        "%4zuM %-4d %s\n",
+        "0x%08" PRIxPTR "-0x%08" PRIxPTR " 0x%08x %4zuM 0x%08llx %c%c%c%c "
+        "%-8s 0x%08x %4zuM %-4d %s\n",
         reinterpret_cast<uintptr_t>(start),
         // Add one to make it look more like /proc/<pid>/maps.
         reinterpret_cast<uintptr_t>(end) + 1,
         len,
         len / 1024 / 1024,
         static_cast<uint64_t>(off),
+        (prot & PROT_READ) ? 'r' : '-',
+        (prot & PROT_WRITE) ? 'w' : '-',
+        (prot & PROT_EXEC) ? 'x' : '-',
+        (it->second.flags & MAP_SHARED) ? 's' : 'p',
         backend.c_str(),
         stream->GetSize(),
         stream->GetSize() / 1024 / 1024,
@@ -536,29 +507,6 @@ std::string MemoryRegion::GetMemoryMapAsString() const {
   return result;
 }
 
-bool MemoryRegion::IsOverlap(PageToStream::const_iterator begin,
-                             PageToStream::const_iterator end) const {
-  // Return true if there is another element between |addr_start| and
-  // |addr_end|.
-  if (std::distance(begin, end) != 1)
-    return true;
-
-  // Return true if there are two "start" elements in a row.
-  if (begin != map_.begin()) {
-    --begin;
-    const char* previous = begin->first;
-    if (!IsPageEndAddress(previous))
-      return true;
-  }
-
-  // No overlap. Do one more sanity check then return false.
-  if (end != map_.end() && ++end != map_.end()) {
-    const char* next = end->first;
-    ALOG_ASSERT(!IsPageEndAddress(next));
-  }
-  return false;
-}
-
 void MemoryRegion::PageMapVisitor::WriteFailureLog(
   const char* name, bool visited, char* start_addr, char* end_addr,
   const scoped_refptr<FileStream> stream) {
@@ -575,24 +523,114 @@ void MemoryRegion::PageMapVisitor::WriteFailureLog(
         GetStreamPathname(stream).c_str());
 }
 
+MemoryRegion::RegionMap::iterator MemoryRegion::FindFirstRegion(char* addr) {
+  RegionMap::iterator it = map_.upper_bound(addr);
+  if (it != map_.begin()) {
+    RegionMap::iterator prev_it = it;
+    --prev_it;
+    if (addr <= prev_it->second.end)
+      return prev_it;  // |addr| is in the midst of |prev_it|.
+  }
+  return it;
+}
+
+MemoryRegion::RegionMap::const_iterator
+MemoryRegion::FindFirstRegion(char* addr) const {
+  RegionMap::const_iterator it = map_.upper_bound(addr);
+  if (it != map_.begin()) {
+    RegionMap::const_iterator prev_it = it;
+    --prev_it;
+    if (addr <= prev_it->second.end)
+      return prev_it;  // |addr| is in the midst of |prev_it|.
+  }
+  return it;
+}
+
 MemoryRegion::PageMapValue*
 MemoryRegion::FindRegion(char* addr, size_t length) {
-  PageToStream::iterator it = map_.find(addr);
+  RegionMap::iterator it = map_.find(addr);
   if (it == map_.end())
     return NULL;  // |addr| is not registered.
 
-  // Check the 'end' node.
-  PageToStream::iterator end_it(it);
-  ++end_it;
-  ALOG_ASSERT(end_it != map_.end());
   char* end_addr = addr + length - 1;
-
-  if (end_it->first != end_addr)
+  if (it->second.end != end_addr)
     return NULL;
 
   return &(it->second);
 }
 
+MemoryRegion::RegionMap::iterator MemoryRegion::SplitRegion(
+    RegionMap::iterator it, char* addr) {
+  ALOG_ASSERT(it->first < addr && addr <= it->second.end);
+  ALOG_ASSERT(!IsPageEndAddress(addr));
+  ALOG_ASSERT(it->second.ref == 1);
+
+  // For example, if the original region is [0,4], and it is split at 2, the
+  // region will be [0,1] and the new region will be [2,4].
+  PageMapValue latter(it->second);
+  latter.offset += addr - it->first;
+  it->second.end = addr - 1;
+  return InsertRegion(addr, latter);
+}
+
+MemoryRegion::RegionMap::iterator MemoryRegion::MergeWithPreviousRegion(
+    RegionMap::iterator it) {
+  if (it == map_.begin())
+    return it;
+  RegionMap::iterator prev_it = it;
+  --prev_it;
+  if (!IsContinuation(prev_it, it, true))
+    return it;
+  prev_it->second.end = it->second.end;
+  EraseRegion(it);
+  return prev_it;
+}
+
+// static
+bool MemoryRegion::IsContinuation(RegionMap::const_iterator prev,
+                                  RegionMap::const_iterator next,
+                                  bool check_attributes) {
+  const PageMapValue& prev_region = prev->second;
+  const PageMapValue& next_region = next->second;
+  if (prev_region.end + 1 != next->first)
+    return false;  // Not adjacent.
+  if (!prev_region.stream || prev_region.stream != next_region.stream)
+    return false;
+  if (prev_region.ref != 1 || next_region.ref != 1)
+    return false;
+  const off64_t prev_length = prev_region.end - prev->first + 1;
+  if (prev_region.offset + prev_length != next_region.offset)
+    return false;
+  if (check_attributes &&
+      (prev_region.prot != next_region.prot ||
+       prev_region.flags != next_region.flags ||
+       prev_region.write_mapped != next_region.write_mapped)) {
+    return false;
+  }
+  return true;
+}
+
+MemoryRegion::RegionMap::iterator MemoryRegion::InsertRegion(
+    char* start, const PageMapValue& value) {
+  std::pair<RegionMap::iterator, bool> result =
+      map_.insert(std::make_pair(start, value));
+  ALOG_ASSERT(result.second);
+  if (value.stream)
+    ++mapped_inodes_[value.stream->inode()];
+  return result.first;
+}
+
+void MemoryRegion::EraseRegion(RegionMap::iterator it) {
+  scoped_refptr<FileStream> stream = it->second.stream;
+  map_.erase(it);
+  if (stream) {
+    InodeCount::iterator count_it = mapped_inodes_.find(stream->inode());
+    ALOG_ASSERT(count_it != mapped_inodes_.end());
+    if (!--(count_it->second))
+      mapped_inodes_.erase(count_it);
+  }
+}
+
 void MemoryRegion::CallByAddr(
     char* addr, size_t length, PageMapVisitor* visitor) {
   ALOG_ASSERT(!(length % 2));
@@ -601,43 +639,26 @@ void MemoryRegion::CallByAddr(
   char* const start_addr = addr;
   char* const end_addr = start_addr + length - 1;
 
-  // Find the first region.
-  PageToStream::const_iterator it = map_.lower_bound(start_addr);
-  if (it == map_.end())
-    return;
-
-  if (IsPageEndAddress(it->first)) {
-    // An IsPageEndAddress element should not be the first one.
-    ALOG_ASSERT(it != map_.begin());
-    --it;
-  }
+  RegionMap::const_iterator it = FindFirstRegion(start_addr);
+  while (it != map_.end() && it->first <= end_addr) {
+    // Visit the regions split from the same mapping at once.
+    RegionMap::const_iterator last_it = it;
+    for (RegionMap::const_iterator next_it = last_it;
+         ++next_it != map_.end() && next_it->first <= end_addr &&
+             IsContinuation(last_it, next_it, false);) {
+      last_it = next_it;
+    }
 
-  while (it != map_.end()) {
-    PageToStream::const_iterator region_start_it = it;
-    PageToStream::const_iterator region_end_it = ++it;
-    // Since |region_start_it|, which is a !IsPageEndAddress element, is a valid
-    // iterator, |region_end_it| (and |it| here) should also be valid.
-    ALOG_ASSERT(it != map_.end());
-
-    // Check if [region_start_it->first, region_end_it->first] overlaps
-    // [start_addr, end_addr].
-    if (end_addr < region_start_it->first)
-      break;  // No overlap. No more memory regions to visit.
-
-    const PageMapValue& page_map = region_start_it->second;
-    scoped_refptr<FileStream> current_stream = page_map.stream;
-    // IsMemoryRangeAvailable() may insert a null stream.
-    if (current_stream) {
-      char* const start_in_region =
-          std::max<char*>(start_addr, region_start_it->first);
+    const PageMapValue& page_map = it->second;
+    // AddFileStreamByAddr() accepts a null stream.
+    if (page_map.stream) {
+      char* const start_in_region = std::max<char*>(start_addr, it->first);
       char* const end_in_region =
-          std::min<char*>(end_addr, region_end_it->first);
+          std::min<char*>(end_addr, last_it->second.end);
       if (!visitor->Visit(page_map, start_in_region, end_in_region))
         break;
     }
-
-    ++it;  // for the next iteration.
-    ALOG_ASSERT(it == map_.end() || !IsPageEndAddress(it->first));
+    it = ++last_it;
   }
 }
 
@@ -647,8 +668,11 @@ bool MemoryRegion::IsPageEndAddress(const void* addr) {
 }
 
 MemoryRegion::PageMapValue::PageMapValue(
-    size_t in_ref, off64_t in_offset, scoped_refptr<FileStream> in_stream)
-    : ref(in_ref), offset(in_offset), stream(in_stream) {
+    char* in_end, size_t in_ref, off64_t in_offset, int in_prot, int in_flags,
+    scoped_refptr<FileStream> in_stream)
+    : end(in_end), ref(in_ref), offset(in_offset), prot(in_prot),
+      flags(in_flags), write_mapped((in_prot & PROT_WRITE) != 0),
+      stream(in_stream) {
 }
 
 MemoryRegion::PageMapValue::~PageMapValue() {
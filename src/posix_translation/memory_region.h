@@ -10,10 +10,10 @@
 #include <sys/stat.h>  // ino_t
 
 #include <map>
-#include <set>
 #include <string>
 
 #include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
 
 namespace posix_translation {
@@ -22,22 +22,23 @@ class FileStream;
 
 // A class that contains memory regions with corresponding FileStreams for
 // mmap(), and calls underlying munmap() and mprotect() implementation for each
-// FileStream.
+// FileStream. Each region also remembers its protection mode, flags, and file
+// offset. A region is split when it is partially unmapped or its protection
+// mode is partially changed, and adjacent regions are merged again when they
+// become indistinguishable.
 class MemoryRegion {
  public:
   MemoryRegion();
   ~MemoryRegion();
 
-  // Adds [addr, addr+length) to the PageToStream |map_|. Returns true on
-  // success. Returns false if [addr, addr+length) overlaps an existing entry in
-  // |map_|. |addr| must be aligned to 2-byte boundary. |length| must be a
-  // multiple of 2. |offset| is just for printing debug information. |prot| is
-  // a protection mode for the mapping (e.g. PROT_READ).
-  // Note: In PageMapValue, when an address is aligned to 2-byte boundary, it is
-  // treated as a "start" address. When it is not, it is an "end" address. To
-  // fulfill this, |length| must be a multiple of 2. With the rule, we do not
-  // have to have an "address type" member in PageMapValue which simplifies
-  // the code a little.
+  // Adds [addr, addr+length) to |map_|. Returns true on success. Returns false
+  // if [addr, addr+length) overlaps an existing entry in |map_|. |addr| must be
+  // aligned to 2-byte boundary. |length| must be a multiple of 2. |offset| is
+  // the file offset which corresponds to |addr|. |prot| and |flags| are the
+  // ones passed to mmap (e.g. PROT_READ and MAP_PRIVATE).
+  // Note: The 2-byte alignment rule guarantees that the "end" address of a
+  // region, addr+length-1, is never aligned to 2-byte boundary, which is
+  // checked with IsPageEndAddress() to catch callers passing bad ranges.
   bool AddFileStreamByAddr(void* addr, size_t length, off64_t offset, int prot,
                            int flags, scoped_refptr<FileStream> stream);
 
@@ -62,10 +63,12 @@ class MemoryRegion {
   // ENOSYS, is set when no memory region to modify is found.
   int ChangeProtectionModeByAddr(void* addr, size_t length, int prot);
 
-  // Returns true if the file associated with |inode| is or was mmapped with
-  // PROT_WRITE. Note that posix_translation never reuses inode numbers.
-  // TODO(crbug.com/472211): Remove this.
-  bool IsWriteMapped(ino_t inode) const;
+  // Returns true if none of [addr, addr+length) is in |map_|.
+  bool IsMemoryRangeAvailable(void* addr, size_t length) const;
+
+  // Returns true if any memory region in [addr, addr+length) is or was mapped
+  // with PROT_WRITE.
+  bool IsWriteMappedByAddr(void* addr, size_t length) const;
 
   // Returns true if the file associated with |inode| is currently mmapped
   // regardless of the protection mode.
@@ -76,11 +79,19 @@ class MemoryRegion {
   std::string GetMemoryMapAsString() const;
 
   struct PageMapValue {
-    PageMapValue(size_t ref, off64_t offset, scoped_refptr<FileStream> stream);
+    PageMapValue(char* end, size_t ref, off64_t offset, int prot, int flags,
+                 scoped_refptr<FileStream> stream);
     ~PageMapValue();
 
-    size_t ref;  // this field is only for "start" nodes.
+    // The last address of the region. Note that this is inclusive.
+    char* end;
+    size_t ref;
+    // The file offset which corresponds to the start address of the region.
     off64_t offset;
+    int prot;
+    int flags;
+    // True if the region is or was mapped with PROT_WRITE.
+    bool write_mapped;
     // Adding one ref count per a continuous memory region is necessary here.
     // This is because:
     //
@@ -116,46 +127,62 @@ class MemoryRegion {
   friend class MemoryRegionTest;
   friend class FileSystemTestCommon;
 
-  typedef std::map<char*, PageMapValue> PageToStream;
-
-  // Removes [remove_start, remove_end] from an existing memory region,
-  // [region_start, region_end].
-  // Examples:
-  //   1. Complete removal.
-  //   RemoveOneRegion(stream, 0x1000, 0x4000-1, 0x1000, 0x4000-1);
-  //   2. Partial removal.
-  //   RemoveOneRegion(stream, 0x2000, 0x3000-1, 0x1000, 0x4000-1);
-  void RemoveOneRegion(PageMapValue value,
-                       char* remove_start, char* remove_end,
-                       char* region_start, char* region_end);
+  // A map from the start address of a region to the region. Regions in the map
+  // never overlap.
+  typedef std::map<char*, PageMapValue> RegionMap;
+  // A map from an inode number to the number of regions for the inode.
+  typedef base::hash_map<ino_t, size_t> InodeCount;  // NOLINT
 
-  // Returns true if the memory region [begin->first, end->first] overlaps an
-  // existing region in |map_|.
-  bool IsOverlap(PageToStream::const_iterator begin,
-                 PageToStream::const_iterator end) const;
+  // Returns the first region which ends at or after |addr|, or map_.end().
+  RegionMap::iterator FindFirstRegion(char* addr);
+  RegionMap::const_iterator FindFirstRegion(char* addr) const;
 
   // Returns a PageMapValue object if the exact region, [addr, addr+length),
   // already exists in |map_|. Otherwise returns NULL.
   PageMapValue* FindRegion(char* addr, size_t length);
 
-  // Calls |task| on all FileStream in the memory region [addr, addr+length).
+  // Splits the region |it| at |addr| which must be in (it->first,
+  // it->second.end]. Returns the iterator for the latter half.
+  RegionMap::iterator SplitRegion(RegionMap::iterator it, char* addr);
+
+  // Merges the region |it| into the previous region when |it| is a
+  // continuation of the previous one and has the same attributes. Returns the
+  // iterator for the merged region.
+  RegionMap::iterator MergeWithPreviousRegion(RegionMap::iterator it);
+
+  // Records |prot| as the protection mode of [addr, addr+length), splitting
+  // and merging regions as needed.
+  void UpdateProtectionMode(char* addr, size_t length, int prot);
+
+  // Returns true if |next| starts right after |prev| and is a continuation of
+  // the same mapping, i.e. calling munmap or mprotect once for both regions is
+  // equivalent to calling them for each region. When |check_attributes| is
+  // true, prot and flags have to be the same too.
+  static bool IsContinuation(RegionMap::const_iterator prev,
+                             RegionMap::const_iterator next,
+                             bool check_attributes);
+
+  // Adds or removes a region to/from |map_|. These also update
+  // |mapped_inodes_|.
+  RegionMap::iterator InsertRegion(char* start, const PageMapValue& value);
+  void EraseRegion(RegionMap::iterator it);
+
+  // Calls |visitor| on all FileStream in the memory region [addr,
+  // addr+length). Contiguous regions which were split from the same mapping
+  // are visited at once.
   void CallByAddr(char* addr, size_t length, PageMapVisitor* visitor);
 
   // Returns true if |addr| is not aligned to 2-byte boundary.
   static bool IsPageEndAddress(const void* addr);
 
-  // This map is an equivalent to Linux kernel's vm_area_struct AVL tree.
-  // Unlike the tree in kernel which only uses a "start" address as a key,
-  // |map_| uses both "start" and "end" addresses. This is to make
-  // AddFileStreamByAddr, especially the code for detecting memory region
-  // overlaps, very simple.
-  PageToStream map_;
+  // This map is an equivalent to Linux kernel's vm_area_struct tree. Since the
+  // regions never overlap, the region which contains an address is found with
+  // one O(log n) lookup, and visiting k regions in a range costs O(log n + k).
+  RegionMap map_;
   bool abort_on_unexpected_memory_maps_;  // For unit testing.
 
-  // A set of inode numbers that is (or was) mapped with PROT_WRITE. Note that
-  // this set is append-only. RemoveFileStreamsByAddr() does not modify this
-  // set.
-  std::set<ino_t> write_mapped_;
+  // The number of regions in |map_| for each inode, for IsCurrentlyMapped().
+  InodeCount mapped_inodes_;
 
   DISALLOW_COPY_AND_ASSIGN(MemoryRegion);
 };
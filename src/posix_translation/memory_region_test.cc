@@ -5,6 +5,7 @@
 #include <sys/mman.h>
 
 #include "base/compiler_specific.h"
+#include "common/memory_counters.h"
 #include "gtest/gtest.h"
 #include "posix_translation/memory_region.h"
 #include "posix_translation/test_util/file_system_test_common.h"
@@ -37,6 +38,12 @@ class MemoryRegionTest : public FileSystemTestCommon {
     return file_system_->memory_region_->AddFileStreamByAddr(
         addr, length, 0 /* offset */, prot, 0 /* flags */, stream);
   }
+  bool AddFileStreamByAddrWithOffset(void* addr, size_t length,
+                                     off64_t offset, int prot,
+                                     scoped_refptr<FileStream> stream) {
+    return file_system_->memory_region_->AddFileStreamByAddr(
+        addr, length, offset, prot, MAP_PRIVATE, stream);
+  }
   bool RemoveFileStreamsByAddr(void* addr, size_t length) {
     const int result = file_system_->memory_region_->RemoveFileStreamsByAddr(
         addr, length, true);
@@ -69,33 +76,41 @@ class MemoryRegionTest : public FileSystemTestCommon {
     EXPECT_EQ(0, result);
     return true;
   }
-  bool IsWriteMapped(ino_t inode) {
-    return file_system_->memory_region_->IsWriteMapped(inode);
-  }
   bool IsCurrentlyMapped(ino_t inode) {
     return file_system_->memory_region_->IsCurrentlyMapped(inode);
   }
   bool IsPageEndAddress(const void* addr) {
     return MemoryRegion::IsPageEndAddress(addr);
   }
+  bool IsWriteMappedByAddr(void* addr, size_t length) {
+    return file_system_->memory_region_->IsWriteMappedByAddr(addr, length);
+  }
   void ClearAddrMap() {
     file_system_->memory_region_->map_.clear();
+    file_system_->memory_region_->mapped_inodes_.clear();
   }
+  // Returns the number of memory regions in the map.
   size_t GetAddrMapSize() const {
     return file_system_->memory_region_->map_.size();
   }
 
   // Returns true if a memory region [addr, addr+length) exists in the map.
   bool HasMemoryRegion(void* addr, size_t length) const {
-    typedef MemoryRegion::PageToStream::iterator Iterator;
+    return GetRegion(addr, length) != NULL;
+  }
+
+  // Returns the memory region [addr, addr+length) in the map, or NULL.
+  const MemoryRegion::PageMapValue* GetRegion(void* addr,
+                                              size_t length) const {
+    typedef MemoryRegion::RegionMap::const_iterator Iterator;
     char* addr_start = static_cast<char*>(addr);
     char* addr_end = static_cast<char*>(addr) + length - 1;
-    Iterator it_start = file_system_->memory_region_->map_.find(addr_start);
-    Iterator it_end = file_system_->memory_region_->map_.find(addr_end);
-    Iterator not_found = file_system_->memory_region_->map_.end();
-    return (it_start != not_found) && (it_end != not_found) &&
-        (it_start->first < it_end->first) &&
-        (std::distance(it_start, it_end) == 1);
+    Iterator it = file_system_->memory_region_->map_.find(addr_start);
+    if (it == file_system_->memory_region_->map_.end() ||
+        it->second.end != addr_end) {
+      return NULL;
+    }
+    return &it->second;
   }
 };
 
@@ -369,14 +384,14 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [0]-[1]. no-op.
   EXPECT_FALSE(RemoveFileStreamsByAddr(addresses.region[0], kSize * 2));
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [0]-[2]. The first block of |stream1| should be removed.
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region[0], kSize * 3));
@@ -386,7 +401,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[3], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [0]-[4]. |stream1| should be removed.
   RESET();
@@ -396,7 +411,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[2], stream1->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [0]-[5]. |stream1| should be removed.
   RESET();
@@ -406,7 +421,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[2], stream1->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [0]-[7]. |stream1| should be removed.
   RESET();
@@ -416,7 +431,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[2], stream1->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [0]-[8]. |stream1| and the first block of |stream2| should be
   // removed.
@@ -430,7 +445,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [0]-[10]. Both |stream1| and |stream2| should be removed.
   RESET();
@@ -464,7 +479,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Change the base position to [2].
 
@@ -477,7 +492,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[3], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [2]-[4]. |stream1| should be removed.
   RESET();
@@ -487,7 +502,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[2], stream1->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [2]-[5]. |stream1| should be removed.
   RESET();
@@ -497,7 +512,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[2], stream1->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [2]-[7]. |stream1| should be removed.
   RESET();
@@ -507,7 +522,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[2], stream1->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [2]-[8]. |stream1| and the first block of |stream2| should be
   // removed.
@@ -521,7 +536,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [2]-[10]. Both |stream1| and |stream2| should be removed.
   RESET();
@@ -559,7 +574,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[4], kSize));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(6U, GetAddrMapSize());  // The first region should split.
+  EXPECT_EQ(3U, GetAddrMapSize());  // The first region should split.
 
   // Change the base position to [4].
 
@@ -572,7 +587,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [4]-[5]. The last block of |stream1| should be removed.
   RESET();
@@ -583,7 +598,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [4]-[7]. The last block of |stream1| should be removed.
   RESET();
@@ -594,7 +609,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream1->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [4]-[8]. The last block of |stream1| and the first block of
   // |stream2| should be removed.
@@ -609,7 +624,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [4]-[10]. The last block of |stream1| and all blocks of |stream2|
   // should be removed.
@@ -623,7 +638,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [4]-[11]. The last block of |stream1| and all blocks of |stream2|
   // should be removed.
@@ -637,7 +652,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Change the base position to [5].
 
@@ -647,21 +662,21 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [5]-[6]. no-op.
   EXPECT_FALSE(RemoveFileStreamsByAddr(addresses.region[5], kSize * 2));
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [5]-[7]. no-op.
   EXPECT_FALSE(RemoveFileStreamsByAddr(addresses.region[5], kSize * 3));
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [5]-[8]. The first block of |stream2| should be removed.
   RESET();
@@ -672,7 +687,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [5]-[10]. |stream2| should be removed.
   RESET();
@@ -682,7 +697,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [5]-[11]. |stream2| should be removed.
   RESET();
@@ -692,7 +707,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Change the base position to [6].
 
@@ -702,14 +717,14 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [6]-[7]. no-op.
   EXPECT_FALSE(RemoveFileStreamsByAddr(addresses.region[6], kSize * 2));
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Change the base position to [7].
 
@@ -718,7 +733,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [7]-[8]. The first block of |stream2| should be removed.
   RESET();
@@ -729,7 +744,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [7]-[10]. |stream2| should be removed.
   RESET();
@@ -739,7 +754,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [7]-[11]. |stream2| should be removed.
   RESET();
@@ -749,7 +764,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Change the base position to [8].
 
@@ -762,7 +777,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [8]-[10]. |stream2| should be removed.
   RESET();
@@ -772,7 +787,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Delete [8]-[11]. |stream2| should be removed.
   RESET();
@@ -782,7 +797,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(addresses.region[8], stream2->last_munmap_addr);
   EXPECT_EQ(kSize * 3, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Change the base position to [9].
 
@@ -796,7 +811,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[10], kSize));
-  EXPECT_EQ(6U, GetAddrMapSize());  // split
+  EXPECT_EQ(3U, GetAddrMapSize());  // split
 
   // Change the base position to [10].
 
@@ -809,7 +824,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [10]-[11]. The last block of |stream2| should be removed.
   RESET();
@@ -820,7 +835,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Change the base position to [11].
 
@@ -830,7 +845,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [11]-[12]. This should be no-op.
   RESET();
@@ -838,7 +853,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Change the base position to [12].
 
@@ -847,7 +862,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   CHECK_MUNMAP_COUNT();
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [4]-[5]. The last block of |stream1| and the first block of
   // |stream2| should be removed.
@@ -862,7 +877,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream2->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[6], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [2]-[7]. Both streams should be removed.
   RESET2();
@@ -899,7 +914,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_TRUE(HasMemoryRegion(addresses.region[5], kSize));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[7], kSize));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[8], kSize * 3));
-  EXPECT_EQ(8U, GetAddrMapSize());  // split
+  EXPECT_EQ(4U, GetAddrMapSize());  // split
 
   // Delete [7]-[8]. The last block of |stream2| and the first block of
   // |stream3| should be removed.
@@ -915,7 +930,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 3));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[5], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(6U, GetAddrMapSize());
+  EXPECT_EQ(3U, GetAddrMapSize());
 
   // Delete [4]-[8]. The last block of |stream1| and the first block of
   // |stream3| should be removed. |stream2| should be gone.
@@ -933,7 +948,7 @@ TYPED_TEST_F(MemoryRegionTypedTest, TestRemoveStreamByAddr) {
   EXPECT_EQ(kSize, stream3->last_munmap_length);
   EXPECT_TRUE(HasMemoryRegion(addresses.region[2], kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region[9], kSize * 2));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Delete [1]-[11]. |stream1|, |stream2|, and |stream3| should be gone.
   RESET3();
@@ -1264,7 +1279,7 @@ TEST_F(MemoryRegionTest, TestGetMemoryMapAsString) {
   EXPECT_NE(std::string(), GetMemoryMapAsString());
 }
 
-// Tests IsWriteMapped and IsCurrentlyMapped.
+// Tests IsWriteMappedByAddr and IsCurrentlyMapped.
 TEST_F(MemoryRegionTest, TestIsMappedFunctions) {
   static const size_t kSize = 8;
   struct {
@@ -1283,11 +1298,9 @@ TEST_F(MemoryRegionTest, TestIsMappedFunctions) {
   scoped_refptr<StubFileStream> stream4 =
       new StubFileStream(std::string("/path/4"));
 
-  // Initially IsWriteMapped and IsCurrentlyMapped should both return false.
-  EXPECT_FALSE(IsWriteMapped(stream1->inode()));
-  EXPECT_FALSE(IsWriteMapped(stream2->inode()));
-  EXPECT_FALSE(IsWriteMapped(stream3->inode()));
-  EXPECT_FALSE(IsWriteMapped(stream4->inode()));
+  // Initially IsWriteMappedByAddr and IsCurrentlyMapped should both return
+  // false.
+  EXPECT_FALSE(IsWriteMappedByAddr(m.addr1, kSize * 4));
   EXPECT_FALSE(IsCurrentlyMapped(stream1->inode()));
   EXPECT_FALSE(IsCurrentlyMapped(stream2->inode()));
   EXPECT_FALSE(IsCurrentlyMapped(stream3->inode()));
@@ -1304,66 +1317,53 @@ TEST_F(MemoryRegionTest, TestIsMappedFunctions) {
   EXPECT_TRUE(AddFileStreamByAddrWithProt(m.addr4, kSize, PROT_NONE, stream4));
 
   // Test the functions again.
-  EXPECT_FALSE(IsWriteMapped(stream1->inode()));
-  EXPECT_TRUE(IsWriteMapped(stream2->inode()));
-  EXPECT_TRUE(IsWriteMapped(stream3->inode()));
-  EXPECT_FALSE(IsWriteMapped(stream4->inode()));
+  EXPECT_FALSE(IsWriteMappedByAddr(m.addr1, kSize));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr2, kSize));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr3, kSize));
+  EXPECT_FALSE(IsWriteMappedByAddr(m.addr4, kSize));
   EXPECT_TRUE(IsCurrentlyMapped(stream1->inode()));
   EXPECT_TRUE(IsCurrentlyMapped(stream2->inode()));
   EXPECT_TRUE(IsCurrentlyMapped(stream3->inode()));
   EXPECT_TRUE(IsCurrentlyMapped(stream4->inode()));
 
-  // Change from PROT_READ to PROT_WRITE.
-  EXPECT_TRUE(ChangeProtectionModeByAddr(m.addr1, kSize, PROT_WRITE));
-  // Change from PROT_WRITE to PROT_READ.
+  // Change from PROT_READ to PROT_WRITE, then back to PROT_READ. The region
+  // is still considered write-mapped.
   EXPECT_TRUE(ChangeProtectionModeByAddr(m.addr1, kSize, PROT_WRITE));
+  EXPECT_TRUE(ChangeProtectionModeByAddr(m.addr1, kSize, PROT_READ));
 
   // Test the functions again.
-  EXPECT_TRUE(IsWriteMapped(stream1->inode()));
-  EXPECT_TRUE(IsWriteMapped(stream2->inode()));  // still return true
-  EXPECT_TRUE(IsWriteMapped(stream3->inode()));
-  EXPECT_FALSE(IsWriteMapped(stream4->inode()));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr1, kSize));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr2, kSize));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr3, kSize));
+  EXPECT_FALSE(IsWriteMappedByAddr(m.addr4, kSize));
   EXPECT_TRUE(IsCurrentlyMapped(stream1->inode()));
   EXPECT_TRUE(IsCurrentlyMapped(stream2->inode()));
   EXPECT_TRUE(IsCurrentlyMapped(stream3->inode()));
   EXPECT_TRUE(IsCurrentlyMapped(stream4->inode()));
 
   // Partially unmap |m.addr1| and |m.addr2|, then confirm IsXXXMapped still
-  // returns true.
+  // returns true for the rest.
   EXPECT_TRUE(RemoveFileStreamsByAddr(m.addr1, kSize / 2));
-  EXPECT_TRUE(IsWriteMapped(stream1->inode()));
+  EXPECT_FALSE(IsWriteMappedByAddr(m.addr1, kSize / 2));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr1 + kSize / 2, kSize / 2));
   EXPECT_TRUE(IsCurrentlyMapped(stream1->inode()));
   EXPECT_TRUE(RemoveFileStreamsByAddr(
       m.addr2 + 2, kSize / 2));  // split the region into two
-  EXPECT_TRUE(IsWriteMapped(stream2->inode()));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr2, 2));
+  EXPECT_TRUE(IsWriteMappedByAddr(m.addr2 + 2 + kSize / 2, 2));
   EXPECT_TRUE(IsCurrentlyMapped(stream2->inode()));
 
-  // Unmap all memory regions, then test the functions again. IsWriteMapped
-  // should still return true for |stream1|, |stream2|, and |stream3|.
+  // Unmap all memory regions, then test the functions again.
   // Note: Removing the same address twice or more is safe.
   EXPECT_TRUE(RemoveFileStreamsByAddr(m.addr1, kSize));
-  EXPECT_TRUE(IsWriteMapped(stream1->inode()));
   EXPECT_FALSE(IsCurrentlyMapped(stream1->inode()));
-
   EXPECT_TRUE(RemoveFileStreamsByAddr(m.addr2, kSize));
-  EXPECT_TRUE(IsWriteMapped(stream2->inode()));
   EXPECT_FALSE(IsCurrentlyMapped(stream2->inode()));
-
   EXPECT_TRUE(RemoveFileStreamsByAddr(m.addr3, kSize));
-  EXPECT_TRUE(IsWriteMapped(stream3->inode()));
   EXPECT_FALSE(IsCurrentlyMapped(stream3->inode()));
-
   EXPECT_TRUE(RemoveFileStreamsByAddr(m.addr4, kSize));
-  EXPECT_FALSE(IsWriteMapped(stream4->inode()));
   EXPECT_FALSE(IsCurrentlyMapped(stream4->inode()));
-
-  // Final sanity checks.
-  EXPECT_TRUE(IsWriteMapped(stream1->inode()));
-  EXPECT_TRUE(IsWriteMapped(stream2->inode()));
-  EXPECT_TRUE(IsWriteMapped(stream3->inode()));
-  EXPECT_FALSE(IsCurrentlyMapped(stream1->inode()));
-  EXPECT_FALSE(IsCurrentlyMapped(stream2->inode()));
-  EXPECT_FALSE(IsCurrentlyMapped(stream3->inode()));
+  EXPECT_FALSE(IsWriteMappedByAddr(m.addr1, kSize * 4));
 }
 
 // Tests IsCurrentlyMapped more.
@@ -1548,7 +1548,7 @@ TEST_F(MemoryRegionTest, TestAddRemoveStreamByAddrDupRegion) {
   EXPECT_TRUE(HasMemoryRegion(addresses.region1, kSize));
   EXPECT_TRUE(AddFileStreamByAddr(addresses.region1, kSize, stream));
   EXPECT_TRUE(HasMemoryRegion(addresses.region1, kSize));
-  EXPECT_EQ(2U, GetAddrMapSize());  // not 6. it's ref-counted.
+  EXPECT_EQ(1U, GetAddrMapSize());  // not 3. it's ref-counted.
   // Try to remove regions which overlap |region1| in many ways. They should all
   // fail except the "exactly the same" case.
 
@@ -1574,7 +1574,7 @@ TEST_F(MemoryRegionTest, TestAddRemoveStreamByAddrDupRegion) {
   EXPECT_FALSE(RemoveFileStreamsByAddr(addresses.region1 + 2, kSize - 4));
   // Ref count should still be 2.
   EXPECT_TRUE(HasMemoryRegion(addresses.region1, kSize));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
 
   // Remove twice. Ref count goes down to 0.
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region1, kSize));
@@ -1598,7 +1598,7 @@ TEST_F(MemoryRegionTest, TestAddRemoveStreamByAddrDupRegion) {
     ClearAddrMap();                                                          \
     EXPECT_TRUE(AddFileStreamByAddr(addresses.region4, kBlockSize, stream)); \
     EXPECT_TRUE(HasMemoryRegion(addresses.region4, kBlockSize));             \
-    EXPECT_EQ(2U, GetAddrMapSize());                                         \
+    EXPECT_EQ(1U, GetAddrMapSize());                                         \
   } while (false)
 
 // Tests Add/RemoveStreamByAddr usage with FileStream that does not return
@@ -1634,11 +1634,11 @@ TEST_F(MemoryRegionTest, TestAddRemovePosixCompliantFileStream) {
   // Left aligned.
   RESET4();
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region4, kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   // Right aligned.
   RESET4();
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region5, kSize * 3));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   // Overlaps left, right aligned.
   RESET4();
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region3, kSize * 5));
@@ -1654,17 +1654,17 @@ TEST_F(MemoryRegionTest, TestAddRemovePosixCompliantFileStream) {
   // Overlaps left.
   RESET4();
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region1, kSize * 4));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   // Overlaps right.
   RESET4();
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region6, kSize * 4));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   // Contained.
   RESET4();
   EXPECT_TRUE(RemoveFileStreamsByAddr(addresses.region5, kSize * 2));
   EXPECT_TRUE(HasMemoryRegion(addresses.region4, kSize));
   EXPECT_TRUE(HasMemoryRegion(addresses.region7, kSize));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // Remove twice. The second call should fail, but break nothing.
   RESET4();
@@ -1690,16 +1690,16 @@ TEST_F(MemoryRegionTest, TestRemoveStreamWithoutMunmap) {
 
   EXPECT_TRUE(AddFileStreamByAddr(m.addr1, kSize, stream));
   EXPECT_TRUE(HasMemoryRegion(m.addr1, kSize));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   EXPECT_TRUE(AddFileStreamByAddr(m.addr2, kSize, stream));
   EXPECT_TRUE(HasMemoryRegion(m.addr2, kSize));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
   EXPECT_TRUE(AddFileStreamByAddr(m.addr3, kSize, stream));
   EXPECT_TRUE(HasMemoryRegion(m.addr3, kSize));
-  EXPECT_EQ(6U, GetAddrMapSize());
+  EXPECT_EQ(3U, GetAddrMapSize());
   EXPECT_EQ(0U, stream->munmap_count);
   EXPECT_TRUE(RemoveFileStreamsByAddr(m.addr1, kSize));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
   EXPECT_EQ(1U, stream->munmap_count);
   EXPECT_EQ(m.addr1, stream->last_munmap_addr);
   EXPECT_EQ(kSize, stream->last_munmap_length);
@@ -1707,7 +1707,7 @@ TEST_F(MemoryRegionTest, TestRemoveStreamWithoutMunmap) {
   // RemoveFileStreamByAddrWithoutMunmap() should not call underlying munmap()
   // implementation.
   EXPECT_TRUE(RemoveFileStreamsByAddrWithoutMunmap(m.addr2, kSize));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   EXPECT_EQ(1U, stream->munmap_count);
 
   // And RemoveFileStreamByAddr() should call the munmap().
@@ -1718,6 +1718,176 @@ TEST_F(MemoryRegionTest, TestRemoveStreamWithoutMunmap) {
   EXPECT_EQ(kSize, stream->last_munmap_length);
 }
 
+// Tests that a partial mprotect splits a region, and that the split regions
+// are merged again when they become indistinguishable.
+TEST_F(MemoryRegionTest, TestChangeProtectionModeSplitAndMerge) {
+  static const size_t kSize = 8;
+  static const off64_t kOffset = 0x1000;
+  char m[kSize * 4] ALIGN_(2);
+
+  scoped_refptr<StubFileStream> stream = new StubFileStream(false);
+  EXPECT_TRUE(AddFileStreamByAddrWithOffset(
+      m, kSize * 4, kOffset, PROT_READ, stream));
+  EXPECT_FALSE(IsWriteMappedByAddr(m, kSize * 4));
+
+  // Make the second quarter writable. The region should be split into three.
+  EXPECT_TRUE(ChangeProtectionModeByAddr(
+      m + kSize, kSize, PROT_READ | PROT_WRITE));
+  EXPECT_EQ(1U, stream->mprotect_count);
+  EXPECT_EQ(3U, GetAddrMapSize());
+  const MemoryRegion::PageMapValue* region = GetRegion(m, kSize);
+  ASSERT_TRUE(region != NULL);
+  EXPECT_EQ(PROT_READ, region->prot);
+  EXPECT_EQ(kOffset, region->offset);
+  region = GetRegion(m + kSize, kSize);
+  ASSERT_TRUE(region != NULL);
+  EXPECT_EQ(PROT_READ | PROT_WRITE, region->prot);
+  EXPECT_EQ(kOffset + kSize, region->offset);
+  region = GetRegion(m + kSize * 2, kSize * 2);
+  ASSERT_TRUE(region != NULL);
+  EXPECT_EQ(PROT_READ, region->prot);
+  EXPECT_EQ(kOffset + kSize * 2, region->offset);
+
+  EXPECT_FALSE(IsWriteMappedByAddr(m, kSize));
+  EXPECT_TRUE(IsWriteMappedByAddr(m + kSize, kSize));
+  EXPECT_FALSE(IsWriteMappedByAddr(m + kSize * 2, kSize * 2));
+  EXPECT_TRUE(IsWriteMappedByAddr(m, kSize * 4));
+
+  // The split regions are still one mapping for the stream. mprotect should
+  // be called only once.
+  EXPECT_TRUE(ChangeProtectionModeByAddr(m, kSize * 4, PROT_READ));
+  EXPECT_EQ(2U, stream->mprotect_count);
+  EXPECT_EQ(m, stream->last_mprotect_addr);
+  EXPECT_EQ(kSize * 4, stream->last_mprotect_length);
+  // The second quarter is not merged since it was mapped with PROT_WRITE.
+  EXPECT_EQ(3U, GetAddrMapSize());
+  EXPECT_TRUE(IsWriteMappedByAddr(m + kSize, kSize));
+
+  // Split the last half, then restore the protection mode. The two regions
+  // should be merged again.
+  EXPECT_TRUE(ChangeProtectionModeByAddr(m + kSize * 2, kSize, PROT_NONE));
+  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_TRUE(ChangeProtectionModeByAddr(m + kSize * 2, kSize, PROT_READ));
+  EXPECT_EQ(3U, GetAddrMapSize());
+  EXPECT_TRUE(HasMemoryRegion(m + kSize * 2, kSize * 2));
+
+  // munmap should also be called only once.
+  EXPECT_TRUE(RemoveFileStreamsByAddr(m, kSize * 4));
+  EXPECT_EQ(1U, stream->munmap_count);
+  EXPECT_EQ(m, stream->last_munmap_addr);
+  EXPECT_EQ(kSize * 4, stream->last_munmap_length);
+  EXPECT_EQ(0U, GetAddrMapSize());
+  EXPECT_FALSE(IsWriteMappedByAddr(m, kSize * 4));
+}
+
+// Tests that a partial munmap keeps the file offset and the protection mode of
+// the remaining regions.
+TEST_F(MemoryRegionTest, TestPartialUnmapKeepsAttributes) {
+  static const size_t kSize = 8;
+  static const off64_t kOffset = 0x2000;
+  char m[kSize * 4] ALIGN_(2);
+
+  scoped_refptr<StubFileStream> stream = new StubFileStream(false);
+  EXPECT_TRUE(AddFileStreamByAddrWithOffset(
+      m, kSize * 4, kOffset, PROT_READ | PROT_EXEC, stream));
+  EXPECT_TRUE(RemoveFileStreamsByAddr(m + kSize, kSize));
+  EXPECT_EQ(2U, GetAddrMapSize());
+
+  const MemoryRegion::PageMapValue* region = GetRegion(m, kSize);
+  ASSERT_TRUE(region != NULL);
+  EXPECT_EQ(kOffset, region->offset);
+  EXPECT_EQ(PROT_READ | PROT_EXEC, region->prot);
+  EXPECT_EQ(MAP_PRIVATE, region->flags);
+  region = GetRegion(m + kSize * 2, kSize * 2);
+  ASSERT_TRUE(region != NULL);
+  EXPECT_EQ(kOffset + kSize * 2, region->offset);
+  EXPECT_EQ(PROT_READ | PROT_EXEC, region->prot);
+  EXPECT_EQ(MAP_PRIVATE, region->flags);
+
+  // The hole can be reused.
+  EXPECT_TRUE(IsMemoryRangeAvailable(m + kSize, kSize));
+  EXPECT_FALSE(IsMemoryRangeAvailable(m, kSize * 2));
+  EXPECT_FALSE(IsMemoryRangeAvailable(m + kSize, kSize * 2));
+}
+
+// Tests that the memory counters follow mmap and munmap.
+TEST_F(MemoryRegionTest, TestMemoryCounters) {
+  static const size_t kSize = 8;
+  char m[kSize * 4] ALIGN_(2);
+  const int64_t file_bytes =
+      arc::MemoryCounters::Get(arc::MemoryCounters::kFileMappedBytes);
+  const int64_t anonymous_bytes =
+      arc::MemoryCounters::Get(arc::MemoryCounters::kAnonymousMappedBytes);
+
+  scoped_refptr<StubFileStream> stream = new StubFileStream(true);
+  EXPECT_TRUE(AddFileStreamByAddr(m, kSize * 2, stream));
+  // A duplicated mmap of the same region does not map more memory.
+  EXPECT_TRUE(AddFileStreamByAddr(m, kSize * 2, stream));
+  EXPECT_TRUE(file_system_->memory_region_->AddFileStreamByAddr(
+      m + kSize * 2, kSize * 2, 0, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE,
+      new StubFileStream(false)));
+  EXPECT_EQ(file_bytes + static_cast<int64_t>(kSize * 2),
+            arc::MemoryCounters::Get(arc::MemoryCounters::kFileMappedBytes));
+  EXPECT_EQ(anonymous_bytes + static_cast<int64_t>(kSize * 2),
+            arc::MemoryCounters::Get(
+                arc::MemoryCounters::kAnonymousMappedBytes));
+
+  EXPECT_TRUE(RemoveFileStreamsByAddr(m, kSize * 2));
+  EXPECT_EQ(file_bytes + static_cast<int64_t>(kSize * 2),
+            arc::MemoryCounters::Get(arc::MemoryCounters::kFileMappedBytes));
+  EXPECT_TRUE(RemoveFileStreamsByAddr(m, kSize * 2));
+  EXPECT_EQ(file_bytes,
+            arc::MemoryCounters::Get(arc::MemoryCounters::kFileMappedBytes));
+
+  // A partial munmap.
+  EXPECT_TRUE(RemoveFileStreamsByAddr(m + kSize * 3, kSize));
+  EXPECT_EQ(anonymous_bytes + static_cast<int64_t>(kSize),
+            arc::MemoryCounters::Get(
+                arc::MemoryCounters::kAnonymousMappedBytes));
+  EXPECT_TRUE(RemoveFileStreamsByAddr(m + kSize * 2, kSize));
+  EXPECT_EQ(anonymous_bytes,
+            arc::MemoryCounters::Get(
+                arc::MemoryCounters::kAnonymousMappedBytes));
+}
+
+// Measures the bookkeeping cost of mmap, mprotect, and munmap when there are
+// many mappings, which is typical for apps that use JIT, ashmem, and many
+// DSOs.
+TEST_F(MemoryRegionTest, TestManyMappings) {
+  static const size_t kNumMappings = 100;
+  static const size_t kPageSize = 4096;
+  static const size_t kMappingSize = kPageSize * 4;
+  // StubFileStream never touches the memory, so the addresses can be fake.
+  char* const start_addr = reinterpret_cast<char*>(0x10000000);
+
+  scoped_refptr<StubFileStream> stream = new StubFileStream(false);
+  for (size_t i = 0; i < kNumMappings; ++i) {
+    ASSERT_TRUE(AddFileStreamByAddrWithOffset(
+        start_addr + i * kMappingSize, kMappingSize, 0, PROT_READ, stream));
+  }
+
+  // Make the second page of each mapping writable, then read-only again.
+  for (size_t i = 0; i < kNumMappings; ++i) {
+    char* const page = start_addr + i * kMappingSize + kPageSize;
+    ASSERT_TRUE(ChangeProtectionModeByAddr(
+        page, kPageSize, PROT_READ | PROT_WRITE));
+    ASSERT_TRUE(ChangeProtectionModeByAddr(page, kPageSize, PROT_READ));
+  }
+  EXPECT_EQ(kNumMappings * 3, GetAddrMapSize());
+
+  // Unmap the last page of each mapping.
+  for (size_t i = 0; i < kNumMappings; ++i) {
+    ASSERT_TRUE(RemoveFileStreamsByAddr(
+        start_addr + (i + 1) * kMappingSize - kPageSize, kPageSize));
+  }
+
+  // Unmap everything at once.
+  EXPECT_TRUE(RemoveFileStreamsByAddr(
+      start_addr, kNumMappings * kMappingSize));
+  EXPECT_EQ(0U, GetAddrMapSize());
+  EXPECT_EQ(kNumMappings * 2, stream->munmap_count);
+}
+
 TEST_F(MemoryRegionTest, TestSetAdviceByAddr) {
   static const size_t kSize = 8;
   struct {
@@ -1729,10 +1899,10 @@ TEST_F(MemoryRegionTest, TestSetAdviceByAddr) {
   scoped_refptr<StubFileStream> stream = new StubFileStream(false);
   EXPECT_TRUE(AddFileStreamByAddr(m.addr1, kSize, stream));
   EXPECT_TRUE(HasMemoryRegion(m.addr1, kSize));
-  EXPECT_EQ(2U, GetAddrMapSize());
+  EXPECT_EQ(1U, GetAddrMapSize());
   EXPECT_TRUE(AddFileStreamByAddr(m.addr2, kSize, stream));
   EXPECT_TRUE(HasMemoryRegion(m.addr1, kSize));
-  EXPECT_EQ(4U, GetAddrMapSize());
+  EXPECT_EQ(2U, GetAddrMapSize());
 
   // It always pass on zero length.
   EXPECT_TRUE(SetAdviceByAddr(NULL, 0, MADV_NORMAL));
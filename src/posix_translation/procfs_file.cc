@@ -15,9 +15,12 @@
 #include "base/compiler_specific.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "common/memory_state.h"
 #include "common/process_emulator.h"
 #include "posix_translation/dir.h"
 #include "posix_translation/directory_file_stream.h"
+#include "posix_translation/io_stats.h"
 #include "posix_translation/path_util.h"
 #include "posix_translation/readonly_memory_file.h"
 #include "posix_translation/statfs.h"
@@ -52,91 +55,191 @@ const char kProcCpuInfoFooter[] =
     "Revision\t: 0000\n"
     "Serial\t: 0000000000000000\n";
 
+typedef ReadonlyMemoryFile::Content Content;
+
+// An immutable content of a procfs file. A new snapshot is created every time
+// the content is regenerated, and a stream keeps using the snapshot it got
+// last while other streams may already be reading a newer one.
+class ProcfsSnapshot : public base::RefCounted<ProcfsSnapshot> {
+ public:
+  // Takes the ownership of the data in |content|.
+  ProcfsSnapshot(Content* content, size_t generation)
+      : generation_(generation) {
+    content_.swap(*content);
+  }
+
+  const Content& content() const { return content_; }
+  size_t generation() const { return generation_; }
+
+ private:
+  friend class base::RefCounted<ProcfsSnapshot>;
+  ~ProcfsSnapshot() {}
+
+  Content content_;
+  const size_t generation_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcfsSnapshot);
+};
+
+}  // namespace
+
+// Generates the content of a procfs file, and keeps the latest snapshot of it
+// until the content becomes stale. One instance is shared by all streams
+// opened for the same path so that polling a file from several places, or
+// reading it with many short read() calls, does not regenerate the content.
+class ProcfsContent : public base::RefCounted<ProcfsContent> {
+ public:
+  ProcfsContent() : generation_(0) {}
+
+  // Returns the latest snapshot, regenerating it if it is stale.
+  scoped_refptr<ProcfsSnapshot> GetSnapshot() {
+    // Always call IsStale() so that it can consume pending updates.
+    const bool is_stale = IsStale();
+    if (!snapshot_ || is_stale) {
+      Content content;
+      Generate(&content);
+      snapshot_ = new ProcfsSnapshot(&content, ++generation_);
+    }
+    return snapshot_;
+  }
+
+  size_t generation() const { return generation_; }
+
+ protected:
+  friend class base::RefCounted<ProcfsContent>;
+  virtual ~ProcfsContent() {}
+
+  // Returns true if the content has to be regenerated. This is called on
+  // every GetSnapshot() call, including the first one.
+  virtual bool IsStale() = 0;
+  // Generates the current content of the file.
+  virtual void Generate(Content* out_content) = 0;
+
+ private:
+  scoped_refptr<ProcfsSnapshot> snapshot_;
+  // The number of times the content has been generated.
+  size_t generation_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcfsContent);
+};
+
+namespace {
+
+// A stream for all files generated by ProcfsFileHandler.
 class ProcfsFile : public ReadonlyMemoryFile {
  public:
-  explicit ProcfsFile(const std::string& pathname)
-      : ReadonlyMemoryFile(pathname, EIO, 0) {}
+  ProcfsFile(const std::string& pathname, scoped_refptr<ProcfsContent> content)
+      : ReadonlyMemoryFile(pathname, EIO, 0), content_(content) {}
 
  protected:
   virtual ~ProcfsFile() {}
-  virtual void UpdateContentIfNecessary() = 0;
   virtual const Content& GetContent() OVERRIDE {
-    UpdateContentIfNecessary();
+    snapshot_ = content_->GetSnapshot();
     set_mtime(time(NULL));
-    return content_;
+    return snapshot_->content();
   }
   virtual int fstatfs(struct statfs* buf) OVERRIDE {
     return DoStatFsForProc(buf);
   }
 
-  Content content_;
+ private:
+  scoped_refptr<ProcfsContent> content_;
+  // The snapshot returned from the last GetContent() call. Keeping it here
+  // guarantees that the returned reference stays valid even if |content_|
+  // regenerates a newer snapshot for another stream.
+  scoped_refptr<ProcfsSnapshot> snapshot_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcfsFile);
 };
 
-// Implements /proc/cpuinfo.
-class CpuInfoFile : public ProcfsFile {
+// A base class for contents which only change when |producer| has updates.
+class UpdateTrackingContent : public ProcfsContent {
  public:
-  // Creates a ReadonlyMemoryFile stream with |header| and |footer|.
-  // See CpuInfoFileHandler for more details.
-  CpuInfoFile(const std::string& pathname,
-              const std::string& header,
-              const std::string& body,
-              const std::string& footer)
-      // Pass the UNIX epoch. GetContent() below updates this later.
-      : ProcfsFile(pathname),
-        num_online_processors_(-1),
+  explicit UpdateTrackingContent(arc::UpdateProducer* producer)
+      : producer_(producer) {}
+
+ protected:
+  virtual ~UpdateTrackingContent() {}
+
+  virtual bool IsStale() OVERRIDE {
+    return producer_ &&
+        update_consumer_.AreThereUpdatesAndConsumeIfSo(producer_);
+  }
+
+ private:
+  arc::UpdateProducer* producer_;
+  arc::UpdateConsumer update_consumer_;
+
+  DISALLOW_COPY_AND_ASSIGN(UpdateTrackingContent);
+};
+
+// Generates /proc/cpuinfo.
+class CpuInfoContent : public ProcfsContent {
+ public:
+  // |header|, |body|, and |footer| are the template of the file. See
+  // ProcfsFileHandler::SetCpuInfoFileTemplate for more details.
+  CpuInfoContent(const std::string& header,
+                 const std::string& body,
+                 const std::string& footer)
+      : num_online_processors_(-1),
         header_(header), body_(body), footer_(footer) {}
 
  protected:
-  virtual ~CpuInfoFile() {}
+  virtual ~CpuInfoContent() {}
 
-  // Updates |content_| when needed.
-  void UpdateContentIfNecessary() OVERRIDE {
+  virtual bool IsStale() OVERRIDE {
     // The cpuinfo file should be generated based on the number of online
     // CPUs, rather than the number of configured CPUs.
     const int num_online_processors = sysconf(_SC_NPROCESSORS_ONLN);
     ALOG_ASSERT(num_online_processors > 0);
 
     // We should not update the content when it is unnecessary to not slow down
-    // a series of short CpuInfoFile::read() operations to read through the
-    // file. Otherwise, in the worst case, they can touch content_.size()
-    // squared bytes of memory in total, which can be very slow.
+    // a series of short read() operations to read through the file.
+    // Otherwise, in the worst case, they can touch content.size() squared
+    // bytes of memory in total, which can be very slow.
     // TODO(crbug.com/368344): Once _SC_NPROCESSORS_ONLN is fully implemented
     // for Bare Metal ARM, we should check how often the ARM Linux kernel
     // (especially the one for Pit/Pi ARM Chromebooks) changes the number of
     // CPUs in practice.
     if (num_online_processors_ == num_online_processors)
-      return;
+      return false;
     num_online_processors_ = num_online_processors;
+    return true;
+  }
 
+  virtual void Generate(Content* out_content) OVERRIDE {
     std::string s = header_;
-    for (int i = 0; i < num_online_processors; ++i) {
+    for (int i = 0; i < num_online_processors_; ++i) {
       std::vector<std::string> subst;
       subst.push_back(base::StringPrintf("%d", i));
       s += ReplaceStringPlaceholders(body_, subst, NULL);
     }
     s += footer_;
-    content_.assign(s.begin(), s.end());
+    out_content->assign(s.begin(), s.end());
   }
 
+ private:
   int num_online_processors_;
   const std::string header_;
   const std::string body_;
   const std::string footer_;
 
- private:
-  DISALLOW_COPY_AND_ASSIGN(CpuInfoFile);
+  DISALLOW_COPY_AND_ASSIGN(CpuInfoContent);
 };
 
-// Implements /proc/$PID/auxv.
-class ProcessAuxvFile : public ProcfsFile {
+// Generates /proc/$PID/auxv.
+class ProcessAuxvContent : public ProcfsContent {
  public:
-  explicit ProcessAuxvFile(const std::string& pathname)
-      : ProcfsFile(pathname) {}
+  ProcessAuxvContent() {}
 
  protected:
-  virtual ~ProcessAuxvFile() {}
+  virtual ~ProcessAuxvContent() {}
 
-  void UpdateContentIfNecessary() OVERRIDE {
+  virtual bool IsStale() OVERRIDE {
+    return false;
+  }
+
+  virtual void Generate(Content* out_content) OVERRIDE {
     // This came from a file that used to be canned.
     // TODO(kmixter): Generate a sensical auxv byte array.
     static const unsigned char kBytes[] = {
@@ -159,13 +262,11 @@ class ProcessAuxvFile : public ProcfsFile {
       0x0f, 0x00, 0x00, 0x00, 0x5f, 0x47, 0xcc, 0x7e,
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
     };
-    std::vector<unsigned char> bytes;
-    bytes.assign(kBytes, kBytes + sizeof(kBytes));
-    content_.assign(bytes.begin(), bytes.end());
+    out_content->assign(kBytes, kBytes + sizeof(kBytes));
   }
 
  private:
-  DISALLOW_COPY_AND_ASSIGN(ProcessAuxvFile);
+  DISALLOW_COPY_AND_ASSIGN(ProcessAuxvContent);
 };
 
 const char kProcStatFormat[] =
@@ -217,17 +318,18 @@ const char kProcMapsFormat[] =
     "4040a000-40509000 rw-p 4040a000 00:00 0 \n"
     "bec72000-bec87000 rw-p befeb000 00:00 0          [stack]\n";
 
-// Implements files like /proc/$PID/{maps,stat,status}.
-class ProcessFormattedFile : public ProcfsFile {
+// Generates files like /proc/$PID/{maps,stat,status}.
+class ProcessFormattedContent : public UpdateTrackingContent {
  public:
-  ProcessFormattedFile(const std::string& pathname, pid_t pid,
-                      const char* format)
-      : ProcfsFile(pathname), pid_(pid), format_(format) {}
+  ProcessFormattedContent(pid_t pid, const char* format)
+      : UpdateTrackingContent(
+            arc::ProcessEmulator::GetInstance()->GetUpdateProducer()),
+        pid_(pid), format_(format) {}
 
  protected:
-  virtual ~ProcessFormattedFile() {}
+  virtual ~ProcessFormattedContent() {}
 
-  void UpdateContentIfNecessary() OVERRIDE {
+  virtual void Generate(Content* out_content) OVERRIDE {
     std::string argv0;
     std::string s;
     uid_t uid;
@@ -238,88 +340,74 @@ class ProcessFormattedFile : public ProcfsFile {
       subst.push_back(base::StringPrintf("%d", uid));  // $3 - uid
       s = ReplaceStringPlaceholders(format_, subst, NULL);
     }
-    content_.assign(s.begin(), s.end());
+    out_content->assign(s.begin(), s.end());
   }
 
-  pid_t pid_;
+ private:
+  const pid_t pid_;
   const char* format_;
 
- private:
-  DISALLOW_COPY_AND_ASSIGN(ProcessFormattedFile);
+  DISALLOW_COPY_AND_ASSIGN(ProcessFormattedContent);
 };
 
-// A base class to implement procfs files which are arrays of strings that
-// are delimited, like /proc/$PID/{cmdline,environ,mounts}.
-class ProcessDelimitedFile : public ProcfsFile {
- public:
-  ProcessDelimitedFile(const std::string& pathname, unsigned char delimiter)
-      : ProcfsFile(pathname), delimiter_(delimiter) {}
-
- protected:
-  typedef std::vector<std::string> StringVector;
-  virtual ~ProcessDelimitedFile() {}
-
-  // If no updates have occurred, return false, otherwise return true and
-  // update string_vector_.
-  virtual bool UpdateStringVectorIfNecessary() = 0;
-
-  void UpdateContentIfNecessary() OVERRIDE {
-    if (!UpdateStringVectorIfNecessary()) return;
-    size_t resulting_size = 0;
-    content_.clear();
-    for (StringVector::iterator i = string_vector_.begin();
-         i != string_vector_.end(); ++i) {
-      resulting_size += i->size() + 1;
-    }
-    content_.reserve(resulting_size);
-    for (StringVector::iterator i = string_vector_.begin();
-         i != string_vector_.end(); ++i) {
-      for (int j = 0; j < i->size(); ++j)
-        content_.push_back((*i)[j]);
-      content_.push_back(delimiter_);
-    }
-    LOG_ALWAYS_FATAL_IF(content_.size() != resulting_size);
+// Stores |strings| to |out_content|. Each string is followed by |delimiter|.
+// This is for procfs files like /proc/$PID/{cmdline,environ,mounts}.
+void AssignDelimitedStrings(const std::vector<std::string>& strings,
+                            unsigned char delimiter,
+                            Content* out_content) {
+  size_t resulting_size = 0;
+  for (size_t i = 0; i < strings.size(); ++i)
+    resulting_size += strings[i].size() + 1;
+  out_content->clear();
+  out_content->reserve(resulting_size);
+  for (size_t i = 0; i < strings.size(); ++i) {
+    out_content->insert(out_content->end(), strings[i].begin(),
+                        strings[i].end());
+    out_content->push_back(delimiter);
   }
+  LOG_ALWAYS_FATAL_IF(out_content->size() != resulting_size);
+}
 
-  StringVector string_vector_;
-  unsigned char delimiter_;
-};
-
-class ProcessCmdlineFile : public ProcessDelimitedFile {
+// Generates /proc/$PID/cmdline.
+class ProcessCmdlineContent : public UpdateTrackingContent {
  public:
-  ProcessCmdlineFile(const std::string& pathname, pid_t pid)
-      : ProcessDelimitedFile(pathname, '\0'), pid_(pid) {}
+  explicit ProcessCmdlineContent(pid_t pid)
+      : UpdateTrackingContent(
+            arc::ProcessEmulator::GetInstance()->GetUpdateProducer()),
+        pid_(pid) {}
 
  protected:
-  bool UpdateStringVectorIfNecessary() OVERRIDE {
+  virtual ~ProcessCmdlineContent() {}
+
+  virtual void Generate(Content* out_content) OVERRIDE {
     std::string argv0;
-    string_vector_.clear();
-    if (arc::ProcessEmulator::GetInfoByPid(pid_, &argv0, NULL)) {
-      string_vector_.push_back(argv0);
-    }
-    return true;
+    std::vector<std::string> strings;
+    if (arc::ProcessEmulator::GetInfoByPid(pid_, &argv0, NULL))
+      strings.push_back(argv0);
+    AssignDelimitedStrings(strings, '\0', out_content);
   }
 
-  pid_t pid_;
+ private:
+  const pid_t pid_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcessCmdlineContent);
 };
 
-class ProcessMountsFile : public ProcessDelimitedFile {
+// Generates /proc/$PID/mounts.
+class ProcessMountsContent : public UpdateTrackingContent {
  public:
-  ProcessMountsFile(const std::string& pathname,
-                    MountPointManager* manager)
-      : ProcessDelimitedFile(pathname, '\n'),
+  explicit ProcessMountsContent(MountPointManager* manager)
+      : UpdateTrackingContent(manager ? manager->GetUpdateProducer() : NULL),
         manager_(manager) {}
 
  protected:
-  virtual bool UpdateStringVectorIfNecessary() OVERRIDE {
+  virtual ~ProcessMountsContent() {}
+
+  virtual void Generate(Content* out_content) OVERRIDE {
+    std::vector<std::string> strings;
     if (manager_ != NULL) {
       const MountPointManager::MountPointMap* mounts =
           manager_->GetMountPointMap();
-      if (!update_consumer_.AreThereUpdatesAndConsumeIfSo(
-              manager_->GetUpdateProducer())) {
-        return false;
-      }
-      string_vector_.clear();
       typedef std::vector<std::string> StringVector;
       StringVector sorted_mount_paths;
       for (MountPointManager::MountPointMap::const_iterator i = mounts->begin();
@@ -340,35 +428,35 @@ class ProcessMountsFile : public ProcessDelimitedFile {
         // should end just with the directory name.
         if (mount_path != "/")
           util::RemoveTrailingSlashes(&mount_path);
-        string_vector_.push_back(base::StringPrintf(
+        strings.push_back(base::StringPrintf(
             "none %s %s uid=%d%s 0 0",
             mount_path.c_str(), handler->name().c_str(), point->owner_uid,
             is_single_file ? ",single_file" : ""));
       }
     }
-    return true;
+    AssignDelimitedStrings(strings, '\n', out_content);
   }
 
  private:
   MountPointManager* manager_;
-  arc::UpdateConsumer update_consumer_;
 
-  DISALLOW_COPY_AND_ASSIGN(ProcessMountsFile);
+  DISALLOW_COPY_AND_ASSIGN(ProcessMountsContent);
 };
 
-class ProcNetUnixFile : public ProcfsFile {
+// Generates /proc/net/unix.
+class ProcNetUnixContent : public UpdateTrackingContent {
  public:
-  explicit ProcNetUnixFile(const std::string& pathname)
-      : ProcfsFile(pathname) {}
+  ProcNetUnixContent()
+      : UpdateTrackingContent(VirtualFileSystem::GetVirtualFileSystem()->
+                              GetAbstractSocketNamespace()->
+                              GetUpdateProducer()) {}
 
  protected:
-  virtual void UpdateContentIfNecessary() OVERRIDE {
+  virtual ~ProcNetUnixContent() {}
+
+  virtual void Generate(Content* out_content) OVERRIDE {
     VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
     AbstractSocketNamespace* ns = sys->GetAbstractSocketNamespace();
-    if (!update_consumer_.AreThereUpdatesAndConsumeIfSo(
-            ns->GetUpdateProducer())) {
-      return;
-    }
     AbstractSocketNamespace::Streams streams;
     ns->GetAllStreams(&streams);
     // See the code in Chrome adb_device_info_query.cc#MapSocketsToProcesses
@@ -381,13 +469,77 @@ class ProcNetUnixFile : public ProcfsFile {
           "%08d: %08d %08d %08x %04d %02d %d @%s\n",
           0, 1, 0, 0x10000, 0, 1, 0, (*i)->GetBoundAbstractName().c_str()));
     }
-    content_.assign(contents.begin(), contents.end());
+    out_content->assign(contents.begin(), contents.end());
   }
 
  private:
-  arc::UpdateConsumer update_consumer_;
+  DISALLOW_COPY_AND_ASSIGN(ProcNetUnixContent);
+};
+
+// A content which changes all the time, such as statistics. It is
+// regenerated only periodically. Otherwise a series of short read() calls
+// would see a different content on each call.
+class PeriodicContent : public ProcfsContent {
+ public:
+  PeriodicContent() {}
+
+ protected:
+  virtual ~PeriodicContent() {}
+
+  virtual bool IsStale() OVERRIDE {
+    const base::TimeTicks now = base::TimeTicks::Now();
+    if (!last_generated_.is_null() &&
+        now - last_generated_ <
+        base::TimeDelta::FromMilliseconds(kRefreshIntervalInMs)) {
+      return false;
+    }
+    last_generated_ = now;
+    return true;
+  }
+
+ private:
+  static const int kRefreshIntervalInMs = 1000;
+
+  base::TimeTicks last_generated_;
+
+  DISALLOW_COPY_AND_ASSIGN(PeriodicContent);
+};
 
-  DISALLOW_COPY_AND_ASSIGN(ProcNetUnixFile);
+// Generates /proc/arc/iostats. The statistics change on every I/O call
+// including the read() of this file.
+class IOStatsContent : public PeriodicContent {
+ public:
+  IOStatsContent() {}
+
+ protected:
+  virtual ~IOStatsContent() {}
+
+  virtual void Generate(Content* out_content) OVERRIDE {
+    const std::string s = IOStats::GetSnapshotAsString();
+    out_content->assign(s.begin(), s.end());
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(IOStatsContent);
+};
+
+// Generates /proc/arc/mmap_profile, the pprof heap profile of the call sites
+// of mmap. It only has the header unless mmap recording is enabled.
+class MmapProfileContent : public PeriodicContent {
+ public:
+  MmapProfileContent() {}
+
+ protected:
+  virtual ~MmapProfileContent() {}
+
+  virtual void Generate(Content* out_content) OVERRIDE {
+    const std::string s = arc::MemoryMappingBacktraceMap::GetInstance()->
+        ConvertCallSitesToPprof();
+    out_content->assign(s.begin(), s.end());
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MmapProfileContent);
 };
 
 }  // namespace
@@ -406,6 +558,7 @@ void ProcfsFileHandler::SetCpuInfoFileTemplate(const std::string& header,
   cpuinfo_header_ = header;
   cpuinfo_body_ = body;
   cpuinfo_footer_ = footer;
+  contents_.erase("/proc/cpuinfo");
 
   // |body| must contain (exactly) one placeholder, "$1".
   ALOG_ASSERT(cpuinfo_body_.find("$1") != std::string::npos);
@@ -417,6 +570,8 @@ ProcfsFileHandler::~ProcfsFileHandler() {
 
 void ProcfsFileHandler::SetMountPointManager(MountPointManager* manager) {
   mount_point_manager_ = manager;
+  // Cached /proc/$PID/mounts contents refer to the old manager.
+  contents_.clear();
 }
 
 void ProcfsFileHandler::SynchronizeDirectoryTreeStructure() {
@@ -425,6 +580,14 @@ void ProcfsFileHandler::SynchronizeDirectoryTreeStructure() {
           emulator->GetUpdateProducer())) {
     return;
   }
+  // Drop cached contents which are not used by any stream. Contents for live
+  // processes are regenerated on demand.
+  for (ContentMap::iterator it = contents_.begin(); it != contents_.end();) {
+    if (it->second->HasOneRef())
+      contents_.erase(it++);
+    else
+      ++it;
+  }
   file_names_.Clear();
   // We provide cpuinfo's contents.
   file_names_.AddFile("/proc/cpuinfo");
@@ -453,6 +616,10 @@ void ProcfsFileHandler::SynchronizeDirectoryTreeStructure() {
   }
   // We provide the file /proc/net/unix.
   file_names_.AddFile("/proc/net/unix");
+  // We provide the I/O statistics of posix_translation.
+  file_names_.AddFile("/proc/arc/iostats");
+  // We provide the mmap profile for finding mapping leaks.
+  file_names_.AddFile("/proc/arc/mmap_profile");
   // Now add all the files that are provided by the readonlyfs.
   file_names_.AddFile("/proc/cmdline");
   file_names_.AddFile("/proc/loadavg");
@@ -509,31 +676,15 @@ scoped_refptr<FileStream> ProcfsFileHandler::open(
   if (file_names_.StatDirectory(pathname))
     return new DirectoryFileStream("procfs", pathname, this);
 
+  scoped_refptr<ProcfsContent> content = FindOrCreateContent(pathname);
+  if (content)
+    return new ProcfsFile(pathname, content);
+
   std::string post_pid;
   pid_t pid;
   if (ParsePidBasedPath(pathname, &pid, &post_pid)) {
-    if (arc::ProcessEmulator::GetInfoByPid(pid, NULL, NULL)) {
-      if (post_pid == "/auxv") {
-        return new ProcessAuxvFile(pathname);
-      } else if (post_pid == "/cmdline") {
-        return new ProcessCmdlineFile(pathname, pid);
-      } else if (post_pid == "/maps") {
-        return new ProcessFormattedFile(pathname, pid, kProcMapsFormat);
-      } else if (post_pid == "/mounts") {
-        return new ProcessMountsFile(pathname, mount_point_manager_);
-      } else if (post_pid == "/stat") {
-        return new ProcessFormattedFile(pathname, pid, kProcStatFormat);
-      } else if (post_pid == "/status") {
-        return new ProcessFormattedFile(pathname, pid, kProcStatusFormat);
-      }
-    }
     errno = ENOENT;
     return NULL;
-  } else if (pathname == "/proc/cpuinfo") {
-    return new CpuInfoFile(pathname, cpuinfo_header_, cpuinfo_body_,
-                           cpuinfo_footer_);
-  } else if (pathname == "/proc/net/unix") {
-    return new ProcNetUnixFile(pathname);
   } else if (readonly_fs_handler_ != NULL) {
     return readonly_fs_handler_->open(fd, pathname, oflag, cmode);
   } else {
@@ -544,6 +695,61 @@ scoped_refptr<FileStream> ProcfsFileHandler::open(
   }
 }
 
+scoped_refptr<ProcfsContent> ProcfsFileHandler::FindOrCreateContent(
+    const std::string& pathname) {
+  std::string post_pid;
+  pid_t pid;
+  if (ParsePidBasedPath(pathname, &pid, &post_pid) &&
+      !arc::ProcessEmulator::GetInfoByPid(pid, NULL, NULL)) {
+    return NULL;
+  }
+  ContentMap::const_iterator it = contents_.find(pathname);
+  if (it != contents_.end())
+    return it->second;
+  scoped_refptr<ProcfsContent> content = CreateContent(pathname);
+  if (content)
+    contents_.insert(std::make_pair(pathname, content));
+  return content;
+}
+
+scoped_refptr<ProcfsContent> ProcfsFileHandler::CreateContent(
+    const std::string& pathname) {
+  std::string post_pid;
+  pid_t pid;
+  if (ParsePidBasedPath(pathname, &pid, &post_pid)) {
+    if (post_pid == "/auxv")
+      return new ProcessAuxvContent;
+    if (post_pid == "/cmdline")
+      return new ProcessCmdlineContent(pid);
+    if (post_pid == "/maps")
+      return new ProcessFormattedContent(pid, kProcMapsFormat);
+    if (post_pid == "/mounts")
+      return new ProcessMountsContent(mount_point_manager_);
+    if (post_pid == "/stat")
+      return new ProcessFormattedContent(pid, kProcStatFormat);
+    if (post_pid == "/status")
+      return new ProcessFormattedContent(pid, kProcStatusFormat);
+    return NULL;
+  }
+  if (pathname == "/proc/cpuinfo") {
+    return new CpuInfoContent(cpuinfo_header_, cpuinfo_body_,
+                              cpuinfo_footer_);
+  }
+  if (pathname == "/proc/net/unix")
+    return new ProcNetUnixContent;
+  if (pathname == "/proc/arc/iostats")
+    return new IOStatsContent;
+  if (pathname == "/proc/arc/mmap_profile")
+    return new MmapProfileContent;
+  return NULL;
+}
+
+size_t ProcfsFileHandler::GetContentGeneration(
+    const std::string& pathname) const {
+  ContentMap::const_iterator it = contents_.find(pathname);
+  return it != contents_.end() ? it->second->generation() : 0;
+}
+
 int ProcfsFileHandler::stat(const std::string& pathname, struct stat* out) {
   scoped_refptr<FileStream> file = this->open(-1, pathname, O_RDONLY, 0);
   if (!file) {
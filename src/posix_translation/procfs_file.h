@@ -5,10 +5,12 @@
 #ifndef POSIX_TRANSLATION_PROCFS_FILE_H_
 #define POSIX_TRANSLATION_PROCFS_FILE_H_
 
+#include <map>
 #include <string>
 
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
+#include "base/memory/ref_counted.h"
 #include "common/export.h"
 #include "common/update_tracking.h"
 #include "posix_translation/directory_manager.h"
@@ -16,6 +18,8 @@
 
 namespace posix_translation {
 
+class ProcfsContent;
+
 // A handler for /proc/cpuinfo. This handler returns a file based on the actual
 // online processor count.
 class ARC_EXPORT ProcfsFileHandler : public FileSystemHandler {
@@ -39,8 +43,22 @@ class ARC_EXPORT ProcfsFileHandler : public FileSystemHandler {
   friend class ProcfsHandlerTest;
   FRIEND_TEST(ProcfsHandlerTest, TestParsePidBasedPathMalformed);
   FRIEND_TEST(ProcfsHandlerTest, TestParsePidBasedPathValid);
+  typedef std::map<std::string, scoped_refptr<ProcfsContent> > ContentMap;
+
   void SynchronizeDirectoryTreeStructure();
 
+  // Returns the generator of the content of |pathname|. Streams opened for
+  // the same path share the same generator, and hence its latest snapshot of
+  // the content. Returns NULL if |pathname| is not a file generated by this
+  // handler.
+  scoped_refptr<ProcfsContent> FindOrCreateContent(
+      const std::string& pathname);
+  scoped_refptr<ProcfsContent> CreateContent(const std::string& pathname);
+
+  // Returns how many times the cached content of |pathname| has been
+  // generated, or 0 if it is not cached. For testing.
+  size_t GetContentGeneration(const std::string& pathname) const;
+
   bool ParsePidBasedPath(const std::string& pathname, pid_t* out_pid,
                          std::string* out_post_pid);
 
@@ -61,6 +79,9 @@ class ARC_EXPORT ProcfsFileHandler : public FileSystemHandler {
   std::string cpuinfo_footer_;
   arc::UpdateConsumer update_consumer_;
 
+  // A cache of content generators keyed by path.
+  ContentMap contents_;
+
   FileSystemHandler* readonly_fs_handler_;
 
   DirectoryManager file_names_;
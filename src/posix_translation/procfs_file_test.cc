@@ -11,6 +11,7 @@
 #include "common/process_emulator.h"
 #include "common/tests/option_test_helper.h"
 #include "gtest/gtest.h"
+#include "posix_translation/io_stats.h"
 #include "posix_translation/mount_point_manager.h"
 #include "posix_translation/procfs_file.h"
 #include "posix_translation/test_util/file_system_test_common.h"
@@ -183,6 +184,97 @@ TEST_F(ProcfsHandlerTest, TestCmdlineFileContents) {
   EXPECT_STREQ("proc_201_1000", buf);
 }
 
+TEST_F(ProcfsHandlerTest, TestContentIsSharedBetweenStreams) {
+  scoped_refptr<FileStream> stream1 = handler_->open(-1, "/proc/201/status",
+                                                     O_RDONLY, 0);
+  scoped_refptr<FileStream> stream2 = handler_->open(-1, "/proc/201/status",
+                                                     O_RDONLY, 0);
+  ASSERT_TRUE(stream1);
+  ASSERT_TRUE(stream2);
+  EXPECT_EQ(0U, handler_->GetContentGeneration("/proc/201/status"));
+
+  // Read the file with many short reads from both streams. The content should
+  // be generated only once.
+  std::string content1, content2;
+  char c;
+  while (stream1->read(&c, 1) == 1)
+    content1 += c;
+  while (stream2->read(&c, 1) == 1)
+    content2 += c;
+  EXPECT_EQ(content1, content2);
+  EXPECT_NE(std::string::npos, content1.find("Name:   proc_201_1000\n"));
+  EXPECT_EQ(1U, handler_->GetContentGeneration("/proc/201/status"));
+
+  // A new stream also reuses the snapshot.
+  struct stat st;
+  EXPECT_EQ(0, handler_->stat("/proc/201/status", &st));
+  EXPECT_EQ(static_cast<off_t>(content1.size()), st.st_size);
+  EXPECT_EQ(1U, handler_->GetContentGeneration("/proc/201/status"));
+  // Other files have their own contents.
+  EXPECT_EQ(0U, handler_->GetContentGeneration("/proc/202/status"));
+}
+
+TEST_F(ProcfsHandlerTest, TestContentIsRegeneratedOnProcessUpdate) {
+  scoped_refptr<FileStream> stream = handler_->open(-1, "/proc/201/cmdline",
+                                                    O_RDONLY, 0);
+  ASSERT_TRUE(stream);
+  char buf[128] = {};
+  EXPECT_EQ(14, stream->read(buf, sizeof(buf)));
+  EXPECT_STREQ("proc_201_1000", buf);
+  EXPECT_EQ(1U, handler_->GetContentGeneration("/proc/201/cmdline"));
+
+  arc::ProcessEmulator::AddProcessForTest(201, 1000, "renamed");
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(0, stream->lseek(0, SEEK_SET));
+  EXPECT_EQ(8, stream->read(buf, sizeof(buf)));
+  EXPECT_STREQ("renamed", buf);
+  EXPECT_EQ(2U, handler_->GetContentGeneration("/proc/201/cmdline"));
+}
+
+TEST_F(ProcfsHandlerTest, TestCachedContentForUnknownPid) {
+  EXPECT_TRUE(handler_->open(-1, "/proc/201/stat", O_RDONLY, 0));
+  arc::ProcessEmulator::ResetForTest();
+  // The cached content must not be used once the process is gone.
+  errno = 0;
+  EXPECT_FALSE(handler_->open(-1, "/proc/201/stat", O_RDONLY, 0));
+  EXPECT_EQ(ENOENT, errno);
+}
+
+TEST_F(ProcfsHandlerTest, TestRepeatedOpenSharesContent) {
+  // Polling a status file opens and reads it again and again. As long as the
+  // process does not change, the content is generated only once.
+  char buf[64];
+  for (int i = 0; i < 3; ++i) {
+    scoped_refptr<FileStream> stream = handler_->open(-1, "/proc/201/status",
+                                                      O_RDONLY, 0);
+    ASSERT_TRUE(stream);
+    while (stream->read(buf, sizeof(buf)) > 0) {
+    }
+  }
+  EXPECT_EQ(1U, handler_->GetContentGeneration("/proc/201/status"));
+}
+
+TEST_F(ProcfsHandlerTest, TestIOStatsFileContents) {
+  IOStats::ResetForTest();
+  IOStats::Record(IOStats::GetSlot("ProcfsHandlerTest", "test"),
+                  IOStats::kRead, 10, IOStats::GetStartTime());
+  scoped_refptr<FileStream> stream = handler_->open(-1, "/proc/arc/iostats",
+                                                    O_RDONLY, 0);
+  ASSERT_TRUE(stream);
+  char buf[1024] = {};  // for easier \0 termination.
+  EXPECT_LT(0, stream->read(buf, sizeof(buf) - 1));
+  EXPECT_TRUE(strstr(buf, "\nProcfsHandlerTest test read 1 0 10 "));
+}
+
+TEST_F(ProcfsHandlerTest, TestMmapProfileFileContents) {
+  scoped_refptr<FileStream> stream = handler_->open(
+      -1, "/proc/arc/mmap_profile", O_RDONLY, 0);
+  ASSERT_TRUE(stream);
+  char buf[64] = {};  // for easier \0 termination.
+  EXPECT_LT(0, stream->read(buf, sizeof(buf) - 1));
+  EXPECT_EQ(buf, strstr(buf, "heap profile: "));
+}
+
 TEST_F(ProcfsHandlerTest, TestMountsFileContentsWhenNoMountPointManager) {
   scoped_refptr<FileStream> stream = handler_->open(-1, "/proc/201/mounts",
                                                     O_RDONLY, 0);
@@ -0,0 +1,141 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "posix_translation/readonly_block_cache.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/alog.h"
+#include "common/arc_strace.h"
+#include "posix_translation/file_stream.h"
+#include "posix_translation/readonly_fs_reader.h"
+#include "zlib.h"  // NOLINT(build/include)
+
+namespace posix_translation {
+
+ReadonlyBlockCache::ReadonlyBlockCache(scoped_refptr<FileStream> image_stream,
+                                       off_t content_offset,
+                                       size_t content_size,
+                                       const std::vector<uint32_t>& block_table,
+                                       size_t max_cached_blocks)
+    : image_stream_(image_stream),
+      content_offset_(content_offset),
+      content_size_(content_size),
+      block_table_(block_table),
+      max_cached_blocks_(max_cached_blocks),
+      hit_count_(0),
+      miss_count_(0) {
+  ALOG_ASSERT(image_stream_);
+  ALOG_ASSERT(!block_table_.empty());
+  ALOG_ASSERT(max_cached_blocks_ > 0);
+}
+
+ReadonlyBlockCache::~ReadonlyBlockCache() {
+}
+
+ssize_t ReadonlyBlockCache::pread(void* buf, size_t count, off64_t offset) {
+  static const size_t kBlockSize = ReadonlyFsReader::kCompressedBlockSize;
+  ALOG_ASSERT(offset >= content_offset_);
+
+  const off64_t content_pos = offset - content_offset_;
+  if (content_pos >= static_cast<off64_t>(content_size_))
+    return 0;
+  count = std::min<size_t>(count, content_size_ - content_pos);
+
+  uint8_t* dest = static_cast<uint8_t*>(buf);
+  size_t copied = 0;
+  while (copied < count) {
+    const off64_t pos = content_pos + copied;
+    const std::vector<uint8_t>* block = GetBlock(pos / kBlockSize);
+    if (!block)
+      return copied ? copied : -1;
+    const size_t offset_in_block = pos % kBlockSize;
+    ALOG_ASSERT(offset_in_block < block->size());
+    const size_t copy_size =
+        std::min(count - copied, block->size() - offset_in_block);
+    memcpy(dest + copied, &(*block)[0] + offset_in_block, copy_size);
+    copied += copy_size;
+  }
+  return copied;
+}
+
+void ReadonlyBlockCache::Clear() {
+  blocks_.clear();
+  lru_.clear();
+}
+
+const std::vector<uint8_t>* ReadonlyBlockCache::GetBlock(size_t index) {
+  BlockMap::iterator it = blocks_.find(index);
+  if (it != blocks_.end()) {
+    ++hit_count_;
+    // Move the block to the front of the LRU list.
+    lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    return &it->second.data;
+  }
+
+  ++miss_count_;
+  std::vector<uint8_t> data;
+  if (!ReadBlock(index, &data))
+    return NULL;
+
+  if (blocks_.size() >= max_cached_blocks_) {
+    const size_t victim = lru_.back();
+    lru_.pop_back();
+    blocks_.erase(victim);
+  }
+  lru_.push_front(index);
+  CachedBlock& cached = blocks_[index];
+  cached.data.swap(data);
+  cached.lru_position = lru_.begin();
+  return &cached.data;
+}
+
+bool ReadonlyBlockCache::ReadBlock(size_t index,
+                                   std::vector<uint8_t>* out_data) {
+  static const size_t kBlockSize = ReadonlyFsReader::kCompressedBlockSize;
+  if (index + 1 >= block_table_.size()) {
+    errno = EIO;
+    return false;
+  }
+  const size_t block_size =
+      std::min(kBlockSize, content_size_ - index * kBlockSize);
+  const size_t compressed_size = block_table_[index + 1] - block_table_[index];
+  const off64_t compressed_offset = content_offset_ + block_table_[index];
+  ALOG_ASSERT(compressed_size <= block_size);
+
+  compressed_buf_.resize(compressed_size);
+  const ssize_t result = image_stream_->pread(
+      &compressed_buf_[0], compressed_size, compressed_offset);
+  if (result != static_cast<ssize_t>(compressed_size)) {
+    ALOGE("Failed to read a compressed block %zu at 0x%08llx (result=%zd)",
+          index, compressed_offset, result);
+    if (result >= 0)
+      errno = EIO;
+    return false;
+  }
+
+  out_data->resize(block_size);
+  if (compressed_size == block_size) {
+    // The block is stored as is.
+    memcpy(&(*out_data)[0], &compressed_buf_[0], block_size);
+    return true;
+  }
+  uLongf uncompressed_size = block_size;
+  const int zlib_result = uncompress(&(*out_data)[0], &uncompressed_size,
+                                     &compressed_buf_[0], compressed_size);
+  if (zlib_result != Z_OK || uncompressed_size != block_size) {
+    ALOGE("Failed to decompress block %zu (zlib error %d)",
+          index, zlib_result);
+    errno = EIO;
+    return false;
+  }
+  ARC_STRACE_REPORT("Decompressed block %zu (%zu bytes -> %zu bytes)",
+                    index, compressed_size, block_size);
+  return true;
+}
+
+}  // namespace posix_translation
@@ -0,0 +1,93 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef POSIX_TRANSLATION_READONLY_BLOCK_CACHE_H_
+#define POSIX_TRANSLATION_READONLY_BLOCK_CACHE_H_
+
+#include <sys/types.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "gtest/gtest_prod.h"
+
+namespace posix_translation {
+
+class FileStream;
+
+// A size-bounded cache of decompressed blocks of a compressed readonly file
+// system image (see scripts/create_readonly_fs_image.py for the format). One
+// instance is shared by all ReadonlyFile streams for the image so that a
+// block is decompressed only once while it stays in the cache. Least recently
+// used blocks are evicted first.
+// Note: This class is not thread-safe. VirtualFileSystem::mutex() must be
+// held when calling its methods.
+class ReadonlyBlockCache : public base::RefCounted<ReadonlyBlockCache> {
+ public:
+  // |image_stream| is a stream for the compressed image. |content_offset|,
+  // |content_size|, and |block_table| are the ones returned from
+  // ReadonlyFsReader::GetCompressedBlockTable(). At most |max_cached_blocks|
+  // decompressed blocks are kept in memory.
+  ReadonlyBlockCache(scoped_refptr<FileStream> image_stream,
+                     off_t content_offset,
+                     size_t content_size,
+                     const std::vector<uint32_t>& block_table,
+                     size_t max_cached_blocks);
+
+  // Reads up to |count| bytes at |offset| in the image as if the image were
+  // not compressed. |offset| must not be in the metadata part of the image.
+  // Returns the number of bytes read, or -1 with errno on error.
+  ssize_t pread(void* buf, size_t count, off64_t offset);
+
+  // Drops all cached blocks.
+  void Clear();
+
+  // Statistics for testing and benchmarking.
+  size_t hit_count() const { return hit_count_; }
+  size_t miss_count() const { return miss_count_; }
+
+ private:
+  friend class base::RefCounted<ReadonlyBlockCache>;
+  FRIEND_TEST(ReadonlyBlockCacheTest, TestEviction);
+
+  struct CachedBlock {
+    std::vector<uint8_t> data;
+    // The position of the block in |lru_|.
+    std::list<size_t>::iterator lru_position;
+  };
+  typedef std::map<size_t, CachedBlock> BlockMap;
+
+  ~ReadonlyBlockCache();
+
+  // Returns the decompressed |index|-th block. Returns NULL with errno on
+  // error.
+  const std::vector<uint8_t>* GetBlock(size_t index);
+
+  // Reads and decompresses the |index|-th block into |out_data|. Returns
+  // false with errno on error.
+  bool ReadBlock(size_t index, std::vector<uint8_t>* out_data);
+
+  scoped_refptr<FileStream> image_stream_;
+  const off_t content_offset_;
+  const size_t content_size_;
+  const std::vector<uint32_t> block_table_;
+  const size_t max_cached_blocks_;
+
+  BlockMap blocks_;
+  // Indexes of cached blocks, the most recently used first.
+  std::list<size_t> lru_;
+  // A buffer for reading a compressed block.
+  std::vector<uint8_t> compressed_buf_;
+
+  size_t hit_count_;
+  size_t miss_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadonlyBlockCache);
+};
+
+}  // namespace posix_translation
+#endif  // POSIX_TRANSLATION_READONLY_BLOCK_CACHE_H_
@@ -0,0 +1,143 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/compiler_specific.h"
+#include "gtest/gtest.h"
+#include "posix_translation/readonly_block_cache.h"
+#include "posix_translation/readonly_fs_reader.h"
+#include "posix_translation/readonly_memory_file.h"
+#include "posix_translation/test_util/file_system_test_common.h"
+#include "zlib.h"  // NOLINT(build/include)
+
+namespace posix_translation {
+
+namespace {
+
+const size_t kBlockSize = ReadonlyFsReader::kCompressedBlockSize;
+// Pretend that there is a 64k metadata part before the content.
+const off_t kContentOffset = 64 * 1024;
+
+class TestImageStream : public ReadonlyMemoryFile {
+ public:
+  explicit TestImageStream(const Content& content)
+      : ReadonlyMemoryFile("/test.img", 0, 0), content_(content) {
+  }
+  virtual ~TestImageStream() {}
+
+ private:
+  virtual const Content& GetContent() OVERRIDE {
+    return content_;
+  }
+
+  const Content content_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestImageStream);
+};
+
+}  // namespace
+
+class ReadonlyBlockCacheTest : public FileSystemTestCommon {
+ protected:
+  ReadonlyBlockCacheTest() {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    FileSystemTestCommon::SetUp();
+
+    // Create three blocks: a compressible one, an incompressible one which is
+    // stored as is, and a short one at the end.
+    content_.resize(kBlockSize * 2 + 100);
+    memset(&content_[0], 'A', kBlockSize);
+    uint32_t seed = 1;
+    for (size_t i = kBlockSize; i < kBlockSize * 2; ++i) {
+      seed = seed * 1103515245 + 12345;
+      content_[i] = seed >> 16;
+    }
+    memset(&content_[kBlockSize * 2], 'B', 100);
+
+    std::vector<uint8_t> image(kContentOffset);
+    std::vector<uint32_t> block_table;
+    for (size_t offset = 0; offset < content_.size(); offset += kBlockSize) {
+      const size_t size = std::min(kBlockSize, content_.size() - offset);
+      std::vector<uint8_t> compressed(compressBound(size));
+      uLongf compressed_size = compressed.size();
+      ASSERT_EQ(Z_OK, compress2(&compressed[0], &compressed_size,
+                                &content_[offset], size, 9));
+      if (compressed_size >= size) {
+        compressed.assign(&content_[offset], &content_[offset] + size);
+        compressed_size = size;
+      }
+      block_table.push_back(image.size() - kContentOffset);
+      image.insert(image.end(), compressed.begin(),
+                   compressed.begin() + compressed_size);
+    }
+    block_table.push_back(image.size() - kContentOffset);
+
+    cache_ = new ReadonlyBlockCache(new TestImageStream(image),
+                                    kContentOffset, content_.size(),
+                                    block_table, 2 /* max_cached_blocks */);
+  }
+
+  std::vector<uint8_t> content_;
+  scoped_refptr<ReadonlyBlockCache> cache_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ReadonlyBlockCacheTest);
+};
+
+TEST_F(ReadonlyBlockCacheTest, TestRead) {
+  std::vector<uint8_t> buf(content_.size() + 10);
+  EXPECT_EQ(static_cast<ssize_t>(content_.size()),
+            cache_->pread(&buf[0], buf.size(), kContentOffset));
+  EXPECT_EQ(0, memcmp(&content_[0], &buf[0], content_.size()));
+
+  // Read across block boundaries.
+  const off64_t kOffset = kBlockSize - 10;
+  EXPECT_EQ(static_cast<ssize_t>(kBlockSize + 20),
+            cache_->pread(&buf[0], kBlockSize + 20, kContentOffset + kOffset));
+  EXPECT_EQ(0, memcmp(&content_[kOffset], &buf[0], kBlockSize + 20));
+
+  // Read at and beyond the end.
+  EXPECT_EQ(10, cache_->pread(&buf[0], 100,
+                              kContentOffset + content_.size() - 10));
+  EXPECT_EQ('B', buf[9]);
+  EXPECT_EQ(0, cache_->pread(&buf[0], 100, kContentOffset + content_.size()));
+  EXPECT_EQ(0, cache_->pread(&buf[0], 100, kContentOffset + kBlockSize * 10));
+}
+
+TEST_F(ReadonlyBlockCacheTest, TestEviction) {
+  uint8_t c = 0;
+  EXPECT_EQ(1, cache_->pread(&c, 1, kContentOffset));
+  EXPECT_EQ(0U, cache_->hit_count());
+  EXPECT_EQ(1U, cache_->miss_count());
+  EXPECT_EQ(1, cache_->pread(&c, 1, kContentOffset + 1));
+  EXPECT_EQ(1U, cache_->hit_count());
+  EXPECT_EQ(1U, cache_->miss_count());
+
+  // Fill the cache and touch block 0 again, then read the third block. The
+  // least recently used block, block 1, should be evicted.
+  EXPECT_EQ(1, cache_->pread(&c, 1, kContentOffset + kBlockSize));
+  EXPECT_EQ(1, cache_->pread(&c, 1, kContentOffset));
+  EXPECT_EQ(1, cache_->pread(&c, 1, kContentOffset + kBlockSize * 2));
+  EXPECT_EQ('B', c);
+  EXPECT_EQ(2U, cache_->blocks_.size());
+  EXPECT_EQ(1U, cache_->blocks_.count(0));
+  EXPECT_EQ(0U, cache_->blocks_.count(1));
+  EXPECT_EQ(1U, cache_->blocks_.count(2));
+  EXPECT_EQ(2U, cache_->hit_count());
+  EXPECT_EQ(3U, cache_->miss_count());
+
+  cache_->Clear();
+  EXPECT_TRUE(cache_->blocks_.empty());
+  EXPECT_EQ(1, cache_->pread(&c, 1, kContentOffset));
+  EXPECT_EQ('A', c);
+  EXPECT_EQ(4U, cache_->miss_count());
+}
+
+}  // namespace posix_translation
@@ -19,11 +19,21 @@
 #include "common/arc_strace.h"
 #include "posix_translation/dir.h"
 #include "posix_translation/directory_file_stream.h"
+#include "posix_translation/address_util.h"
 #include "posix_translation/nacl_manifest_file.h"
 #include "posix_translation/statfs.h"
+#include "posix_translation/virtual_file_system.h"
 
 namespace posix_translation {
 
+namespace {
+
+// The maximum number of decompressed blocks kept in memory for a compressed
+// image (i.e. 4MB).
+const size_t kMaxCachedBlocks = 64;
+
+}  // namespace
+
 ReadonlyFileHandler::ReadonlyFileHandler(const std::string& image_filename,
                                          size_t read_ahead_size,
                                          FileSystemHandler* underlying_handler)
@@ -32,6 +42,8 @@ ReadonlyFileHandler::ReadonlyFileHandler(const std::string& image_filename,
       read_ahead_size_(read_ahead_size),
       underlying_handler_(underlying_handler),
       image_stream_(NULL),
+      image_index_(NULL),
+      image_index_size_(0),
       directory_mtime_(0) {
   if (!underlying_handler)
     ALOGW("NULL underlying handler is passed");  // this is okay for unit tests
@@ -39,6 +51,10 @@ ReadonlyFileHandler::ReadonlyFileHandler(const std::string& image_filename,
 }
 
 ReadonlyFileHandler::~ReadonlyFileHandler() {
+  // The reader may refer to the index until it is destroyed.
+  image_reader_.reset();
+  if (image_index_)
+    image_stream_->munmap(image_index_, image_index_size_);
   // Destructing |image_stream_| without holding the VirtualFileSystem::mutex_
   // lock is safe because |image_stream_| is the only object that manipulates
   // the ref counter in the file stream obtained from |underlying_handler|.
@@ -53,13 +69,41 @@ bool ReadonlyFileHandler::ParseReadonlyFsImage() {
     return false;
   }
 
+  uint8_t header[ReadonlyFsReader::kImageHeaderSize] = {};
+  if (image_stream_->pread(header, sizeof(header), 0) !=
+      static_cast<ssize_t>(sizeof(header))) {
+    ALOGE("Failed to read the header of %s", image_filename_.c_str());
+    return false;
+  }
+  // A version 2 image has an index which the reader queries in place. Map
+  // only the index and keep it mapped. A version 1 image has to be mapped
+  // entirely to be parsed.
+  const size_t index_size = ReadonlyFsReader::GetIndexSize(header);
+  const size_t map_size = index_size ? index_size : buf.st_size;
+
   void* addr = image_stream_->mmap(
-      NULL, buf.st_size, PROT_READ, MAP_PRIVATE, 0);
+      NULL, map_size, PROT_READ, MAP_PRIVATE, 0);
   if (addr == MAP_FAILED) {
     ALOGE("mmap %s failed", image_filename_.c_str());
     return false;
   }
   image_reader_.reset(new ReadonlyFsReader(static_cast<uint8_t*>(addr)));
+  directory_mtime_ = buf.st_mtime;
+  if (image_reader_->IsCompressed()) {
+    off_t content_offset = 0;
+    size_t content_size = 0;
+    std::vector<uint32_t> block_table;
+    image_reader_->GetCompressedBlockTable(
+        &content_offset, &content_size, &block_table);
+    block_cache_ = new ReadonlyBlockCache(
+        image_stream_, content_offset, content_size, block_table,
+        kMaxCachedBlocks);
+  }
+  if (index_size) {
+    image_index_ = addr;
+    image_index_size_ = index_size;
+    return true;
+  }
 
   // Unmap the image immediately so that it will not take up virtual address
   // space. However, keep the stream open for later use.
@@ -68,8 +112,6 @@ bool ReadonlyFileHandler::ParseReadonlyFsImage() {
           addr, static_cast<uint64_t>(buf.st_size));
     return false;
   }
-  directory_mtime_ = buf.st_mtime;
-
   return true;
 }
 
@@ -88,7 +130,8 @@ scoped_refptr<FileStream> ReadonlyFileHandler::CreateFileLocked(
     return NULL;
   }
 
-  return new ReadonlyFile(image_stream_, read_ahead_size_, pathname,
+  return new ReadonlyFile(image_stream_, block_cache_, read_ahead_size_,
+                          pathname,
                           metadata.offset, metadata.size, metadata.mtime,
                           oflag);
 }
@@ -216,12 +259,14 @@ ssize_t ReadonlyFileHandler::readlink(const std::string& pathname,
 //------------------------------------------------------------------------------
 
 ReadonlyFile::ReadonlyFile(scoped_refptr<FileStream> image_stream,
+                           scoped_refptr<ReadonlyBlockCache> block_cache,
                            size_t read_ahead_size,
                            const std::string& pathname,
                            off_t file_offset, size_t file_size, time_t mtime,
                            int oflag)
   : FileStream(oflag, pathname),
-    write_mapped_(false), image_stream_(image_stream),
+    image_stream_(image_stream),
+    block_cache_(block_cache),
     read_ahead_buf_max_size_(read_ahead_size), read_ahead_buf_offset_(0),
     offset_in_image_(file_offset), size_(file_size), mtime_(mtime), pos_(0) {
   ALOG_ASSERT(image_stream_);
@@ -236,10 +281,8 @@ int ReadonlyFile::madvise(void* addr, size_t length, int advice) {
   if (advice != MADV_DONTNEED)
     return FileStream::madvise(addr, length, advice);
 
-  // Note: We should have |write_mapped_| here rather than in NaClManifestFile
-  // because the underlying stream is shared by all ReadonlyFile streams.
-
-  if (write_mapped_) {
+  if (VirtualFileSystem::GetVirtualFileSystem()->IsWriteMappedLocked(
+          addr, length)) {
     // madvise(MADV_DONTNEED) is called against a region possibly mapped with
     // PROT_WRITE and MAP_PRIVATE (yes, creating a writable map backed by a
     // read-only file is possible). Since there is no reliable way to determine
@@ -259,9 +302,9 @@ int ReadonlyFile::madvise(void* addr, size_t length, int advice) {
   // this does not properly reduce the resident memory usage.
   // TODO(crbug.com/425955): For better resident memory usage, do either of
   // the following: (1) Add mprotect IRT to SFI and non-SFI NaCl and just call
-  // it, or (2) add a way to query the current prot, flags, and file offset of
-  // the |addr| (likely by improving the MemoryRegion class), and call mmap IRT
-  // again with these parameters plus MAP_FIXED. Both ways can be applied to
+  // it, or (2) get the current prot, flags, and file offset of the |addr|
+  // from MemoryRegion which now records them, and call mmap IRT again with
+  // these parameters plus MAP_FIXED. Both ways can be applied to
   // nacl_manifest_file.cc (which is almost always mapped with PROT_WRITE to
   // make .bss work) and pepper_file.cc (which is writable persistent file
   // system) too.
@@ -279,7 +322,6 @@ void* ReadonlyFile::mmap(
     errno = EIO;
     return MAP_FAILED;
   }
-  write_mapped_ |= prot & PROT_WRITE;
   // Note: We should check neither |length| nor |offset| here to be consistent
   // with Linux kernel's behavior. The kernel allows |length| and |offset|
   // values greater than the size of the file as long as the |length| fits in
@@ -288,16 +330,68 @@ void* ReadonlyFile::mmap(
   // (i.e. SIGBUS when touched). We are not always able to raise SIGBUS
   // (instead, subsequent files in the image might be accessed), but this is
   // much better than returing MAP_FAILED here in terms of app compatibility.
+  if (block_cache_)
+    return MmapCompressed(addr, length, prot, flags, offset);
   return image_stream_->mmap(
       addr, length, prot, flags, offset + offset_in_image_);
 }
 
+void* ReadonlyFile::MmapCompressed(
+    void* addr, size_t length, int prot, int flags, off_t offset) {
+  if ((prot & PROT_WRITE) && (flags & MAP_SHARED)) {
+    errno = EACCES;
+    return MAP_FAILED;
+  }
+  if (!length || (offset % util::GetPageSize())) {
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+
+  // Since the content of the file never changes, a private anonymous copy is
+  // indistinguishable from a MAP_SHARED mapping. Decompress the whole range
+  // when it is mapped as the pages cannot be filled lazily on fault.
+  const int anonymous_flags =
+      (flags & ~MAP_SHARED) | MAP_PRIVATE | MAP_ANONYMOUS;
+  uint8_t* result = static_cast<uint8_t*>(::mmap(
+      // We need PROT_WRITE for filling the pages.
+      addr, length, prot | PROT_WRITE, anonymous_flags, -1, 0));
+  if (result == MAP_FAILED)
+    return MAP_FAILED;
+
+  if (offset < size_) {
+    const size_t fill_size = std::min<size_t>(
+        size_ - offset, util::RoundToPageSize(length));
+    const ssize_t read_size =
+        PreadFromImage(result, fill_size, offset_in_image_ + offset);
+    if (read_size != static_cast<ssize_t>(fill_size)) {
+      ALOGE("Failed to decompress %s for mmap (result=%zd)",
+            pathname().c_str(), read_size);
+      ::munmap(result, length);
+      errno = EIO;
+      return MAP_FAILED;
+    }
+  }
+
+  if (!(prot & PROT_WRITE)) {
+    // Drop PROT_WRITE added for filling the pages.
+    if (::mprotect(result, length, prot) == -1) {
+      ALOGE("mprotect failed: prot=%d, errno=%d", prot, errno);
+      ::munmap(result, length);
+      return MAP_FAILED;
+    }
+  }
+  return result;
+}
+
 int ReadonlyFile::mprotect(void* addr, size_t length, int prot) {
-  write_mapped_ |= prot & PROT_WRITE;
+  if (block_cache_)
+    return ::mprotect(addr, length, prot);
   return image_stream_->mprotect(addr, length, prot);
 }
 
 int ReadonlyFile::munmap(void* addr, size_t length) {
+  if (block_cache_)
+    return ::munmap(addr, length);
   return image_stream_->munmap(addr, length);
 }
 
@@ -344,21 +438,59 @@ ssize_t ReadonlyFile::PreadImpl(void* buf, size_t count, off64_t offset,
   if ((read_size >= read_ahead_buf_max_size_) || !can_read_ahead) {
     ARC_STRACE_REPORT("pread %zu bytes from the image at offset 0x%08llx",
                         read_size, pread_offset_in_image);
-    return image_stream_->pread(buf, read_size, pread_offset_in_image);
+    return PreadFromImage(buf, read_size, pread_offset_in_image);
   }
 
+  const ssize_t pread_result = FillReadAheadBuffer(offset);
+  if (pread_result <= 0)
+    return pread_result;
+
+  // Call min() again not to overflow the |buf| buffer.
+  const size_t copy_size = std::min<size_t>(read_size, pread_result);
+  memcpy(buf, &read_ahead_buf_[0], copy_size);
+  return copy_size;
+}
+
+bool ReadonlyFile::GetContentBuffer(off64_t offset, size_t count,
+                                    const void** out_buf, size_t* out_size) {
+  if (offset >= size_) {
+    *out_buf = NULL;
+    *out_size = 0;
+    return true;
+  }
+  if (!IsInReadAheadBuffer(offset)) {
+    if (!read_ahead_buf_max_size_)
+      return false;
+    // Let pread() report the error, if any.
+    if (FillReadAheadBuffer(offset) <= 0)
+      return false;
+  }
+  const size_t offset_in_cache = offset - read_ahead_buf_offset_;
+  *out_buf = &read_ahead_buf_[0] + offset_in_cache;
+  *out_size = std::min(count, read_ahead_buf_.size() - offset_in_cache);
+  return true;
+}
+
+bool ReadonlyFile::IsInReadAheadBuffer(off64_t offset) const {
+  return read_ahead_buf_offset_ <= offset &&
+      offset < static_cast<int64_t>(read_ahead_buf_offset_ +
+                                    read_ahead_buf_.size());
+}
+
+ssize_t ReadonlyFile::FillReadAheadBuffer(off64_t offset) {
   // We should not read beyond the end of the file even though the underlying
   // handler may allow it. Therefore the min() call.
+  const int64_t pread_offset_in_image = offset_in_image_ + offset;
   read_ahead_buf_.resize(read_ahead_buf_max_size_);
   const size_t read_ahead_size =
-      std::min<size_t>(read_ahead_buf_max_size_, read_max);
+      std::min<size_t>(read_ahead_buf_max_size_, size_ - offset);
   ARC_STRACE_REPORT("Cache miss: "
                       "pread-ahead %zu bytes from the image at offset 0x%08llx",
                       read_ahead_size, pread_offset_in_image);
 
   // Note: The underlying pread() is allowed to return a value smaller than
   // |read_ahead_size| although it does not do that in practice.
-  const ssize_t pread_result = image_stream_->pread(
+  const ssize_t pread_result = PreadFromImage(
       &read_ahead_buf_[0], read_ahead_size, pread_offset_in_image);
   if (pread_result <= 0) {
     if (pread_result < 0 && errno == EINTR)
@@ -372,11 +504,14 @@ ssize_t ReadonlyFile::PreadImpl(void* buf, size_t count, off64_t offset,
                     pread_result, pread_offset_in_image);
   read_ahead_buf_.resize(pread_result);
   read_ahead_buf_offset_ = offset;
+  return pread_result;
+}
 
-  // Call min() again not to overflow the |buf| buffer.
-  const size_t copy_size = std::min<size_t>(read_size, pread_result);
-  memcpy(buf, &read_ahead_buf_[0], copy_size);
-  return copy_size;
+ssize_t ReadonlyFile::PreadFromImage(void* buf, size_t count,
+                                     off64_t offset_in_image) {
+  if (block_cache_)
+    return block_cache_->pread(buf, count, offset_in_image);
+  return image_stream_->pread(buf, count, offset_in_image);
 }
 
 off64_t ReadonlyFile::lseek(off64_t offset, int whence) {
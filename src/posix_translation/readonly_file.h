@@ -19,6 +19,7 @@
 #include "common/export.h"
 #include "gtest/gtest_prod.h"
 #include "posix_translation/file_system_handler.h"
+#include "posix_translation/readonly_block_cache.h"
 #include "posix_translation/readonly_fs_reader.h"
 #include "posix_translation/virtual_file_system.h"
 
@@ -31,7 +32,8 @@ class ReadonlyFile;
 // require an IPC to the browser process and therefore are very fast. Only
 // one-time Initialize() call could require it depending on the actual type
 // of the |underlying_handler|. You can find the format of the image file
-// in scripts/create_readonly_fs_image.py.
+// in scripts/create_readonly_fs_image.py. When the image is compressed, file
+// content is decompressed on demand into a block cache shared by all files.
 class ARC_EXPORT ReadonlyFileHandler : public FileSystemHandler {
  public:
   // |image_filename| is the full path name of the image. Can be NULL for
@@ -72,6 +74,12 @@ class ARC_EXPORT ReadonlyFileHandler : public FileSystemHandler {
   scoped_ptr<ReadonlyFsReader> image_reader_;
   FileSystemHandler* underlying_handler_;
   scoped_refptr<FileStream> image_stream_;
+  // Non-NULL when the image is compressed.
+  scoped_refptr<ReadonlyBlockCache> block_cache_;
+  // The index part of a version 2 image, which |image_reader_| refers to.
+  // NULL for a version 1 image.
+  void* image_index_;
+  size_t image_index_size_;
   time_t directory_mtime_;
 
   DISALLOW_COPY_AND_ASSIGN(ReadonlyFileHandler);
@@ -85,7 +93,9 @@ class ARC_EXPORT ReadonlyFileHandler : public FileSystemHandler {
 // memory efficient one like NaClManifestFile, so does ReadonlyFile.
 class ReadonlyFile : public FileStream {
  public:
+  // |block_cache| should be NULL unless the image is compressed.
   ReadonlyFile(scoped_refptr<FileStream> image_stream,
+               scoped_refptr<ReadonlyBlockCache> block_cache,
                size_t read_ahead_size,
                const std::string& pathname, off_t file_offset,
                size_t file_size, time_t file_mtime, int oflag);
@@ -103,6 +113,9 @@ class ReadonlyFile : public FileStream {
   virtual ssize_t pread(void* buf, size_t count, off64_t offset) OVERRIDE;
   virtual ssize_t read(void* buf, size_t count) OVERRIDE;
   virtual ssize_t write(const void* buf, size_t count) OVERRIDE;
+  virtual bool GetContentBuffer(off64_t offset, size_t count,
+                                const void** out_buf,
+                                size_t* out_size) OVERRIDE;
 
   // Although ReadonlyFile does not support select/poll, override the function
   // just in case.
@@ -120,13 +133,26 @@ class ReadonlyFile : public FileStream {
   ssize_t PreadImpl(void* buf, size_t count, off64_t offset,
                     bool can_read_ahead);
 
-  // True if the stream is possibly mapped with PROT_WRITE.
-  // TODO(crbug.com/425955): Remove this once MemoryRegion has rich information
-  // about each memory page such as prot, flags, and file offset.
-  bool write_mapped_;
+  // Returns true if the byte at |offset| is in |read_ahead_buf_|.
+  bool IsInReadAheadBuffer(off64_t offset) const;
+
+  // Fills |read_ahead_buf_| with the content at |offset|, and returns the
+  // result of the underlying pread().
+  ssize_t FillReadAheadBuffer(off64_t offset);
+
+  // Reads the image at |offset_in_image| either directly or through
+  // |block_cache_|.
+  ssize_t PreadFromImage(void* buf, size_t count, off64_t offset_in_image);
+
+  // Emulates mmap for a file in a compressed image by decompressing the
+  // content into anonymous pages.
+  void* MmapCompressed(void* addr, size_t length, int prot, int flags,
+                       off_t offset);
 
   // A stream of the readonly filesystem image.
   scoped_refptr<FileStream> image_stream_;
+  // A cache of decompressed blocks. NULL if the image is not compressed.
+  scoped_refptr<ReadonlyBlockCache> block_cache_;
 
   // For read-ahead caching.
   const size_t read_ahead_buf_max_size_;
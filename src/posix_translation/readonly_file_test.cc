@@ -7,6 +7,7 @@
 #include <unistd.h>
 
 #include <string>
+#include <vector>
 
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
@@ -23,6 +24,7 @@ namespace {
 
 const char kBadFile[] = "does_not_exist";
 const char kImageFile[] = "/tmp/test.img";
+const char kCompressedImageFile[] = "/tmp/test_compressed.img";
 const ssize_t kReadAheadSize = 256;
 const time_t kImageFileMtime = 12345;
 
@@ -54,7 +56,9 @@ class TestUnderlyingHandler : public FileSystemHandler {
   TestUnderlyingHandler() : FileSystemHandler("TestUnderlyingHandler") {
     initialized_ = test_image_.Init(
         ARC_TARGET_PATH "/posix_translation_fs_images/"
-        "test_readonly_fs_image.img");
+        "test_readonly_fs_image.img") && test_compressed_image_.Init(
+        ARC_TARGET_PATH "/posix_translation_fs_images/"
+        "test_readonly_fs_image_compressed.img");
   }
   virtual ~TestUnderlyingHandler() {}
 
@@ -65,6 +69,10 @@ class TestUnderlyingHandler : public FileSystemHandler {
       return new TestUnderlyingStream(reinterpret_cast<const uint8_t*>(
           test_image_.data()), test_image_.size());
     }
+    if (pathname == kCompressedImageFile) {
+      return new TestUnderlyingStream(reinterpret_cast<const uint8_t*>(
+          test_compressed_image_.data()), test_compressed_image_.size());
+    }
     errno = ENOENT;
     return NULL;
   }
@@ -80,6 +88,7 @@ class TestUnderlyingHandler : public FileSystemHandler {
 
  private:
   MmappedFile test_image_;
+  MmappedFile test_compressed_image_;
   bool initialized_;
 
   DISALLOW_COPY_AND_ASSIGN(TestUnderlyingHandler);
@@ -100,19 +109,46 @@ class ReadonlyFileTest : public FileSystemTestCommon {
     // test. Assuming ReadonlyMemoryFileHandler works fine, we use it as a
     // replacement.
     underlying_handler_.reset(new TestUnderlyingHandler);
-    handler_.reset(new ReadonlyFileHandler(kImageFile, kReadAheadSize,
-                                           underlying_handler_.get()));
-    handler_->Initialize();
+    handler_.reset(CreateHandler(kImageFile));
     ASSERT_TRUE(handler_->IsInitialized());
+    compressed_handler_.reset(CreateHandler(kCompressedImageFile));
+    ASSERT_TRUE(compressed_handler_->IsInitialized());
   }
 
   virtual void TearDown() OVERRIDE {
+    compressed_handler_.reset();
+    handler_.reset();
     underlying_handler_.reset();
     FileSystemTestCommon::TearDown();
   }
   void CallIoctl(scoped_refptr<FileStream> stream, int request, ...);
 
+  ReadonlyFileHandler* CreateHandler(const char* image_file) {
+    ReadonlyFileHandler* handler = new ReadonlyFileHandler(
+        image_file, kReadAheadSize, underlying_handler_.get());
+    handler->Initialize();
+    return handler;
+  }
+
+  // Reads all files in the test image with |handler| and returns the total
+  // number of bytes read.
+  size_t ReadAllFiles(ReadonlyFileHandler* handler) {
+    size_t total = 0;
+    for (size_t i = 0; i < kNumTestFiles; ++i) {
+      scoped_refptr<FileStream> stream =
+          handler->open(-1, kTestFiles[i].filename, O_RDONLY, 0);
+      if (!stream)
+        return 0;
+      char buf[4096];
+      ssize_t result;
+      while ((result = stream->read(buf, sizeof(buf))) > 0)
+        total += result;
+    }
+    return total;
+  }
+
   scoped_ptr<ReadonlyFileHandler> handler_;
+  scoped_ptr<ReadonlyFileHandler> compressed_handler_;
 
  private:
   scoped_ptr<FileSystemHandler> underlying_handler_;
@@ -221,6 +257,102 @@ TEST_F(ReadonlyFileTest, TestMmap) {
   EXPECT_EQ(EINVAL, errno);
 }
 
+TEST_F(ReadonlyFileTest, TestCompressedRead) {
+  for (size_t i = 0; i < kNumTestFiles; ++i) {
+    scoped_refptr<FileStream> stream =
+        handler_->open(-1, kTestFiles[i].filename, O_RDONLY, 0);
+    ASSERT_TRUE(stream);
+    scoped_refptr<FileStream> compressed_stream =
+        compressed_handler_->open(-1, kTestFiles[i].filename, O_RDONLY, 0);
+    ASSERT_TRUE(compressed_stream);
+
+    const size_t size = kTestFiles[i].size;
+    std::vector<char> expected(size + 1);
+    std::vector<char> actual(size + 1);
+    EXPECT_EQ(static_cast<ssize_t>(size),
+              stream->pread(&expected[0], size + 1, 0)) << i;
+    EXPECT_EQ(static_cast<ssize_t>(size),
+              compressed_stream->pread(&actual[0], size + 1, 0)) << i;
+    EXPECT_EQ(0, memcmp(&expected[0], &actual[0], size)) << i;
+  }
+
+  // Test read() across the 64k block boundary with read-ahead.
+  scoped_refptr<FileStream> stream =
+      compressed_handler_->open(-1, kTestFiles[1].filename, O_RDONLY, 0);
+  ASSERT_TRUE(stream);
+  char buf[kReadAheadSize * 2];
+  const off64_t kBoundary = 64 * 1024;
+  EXPECT_EQ(kBoundary - 1, stream->lseek(kBoundary - 1, SEEK_SET));
+  EXPECT_EQ(2, stream->read(buf, 2));
+  EXPECT_EQ('\0', buf[0]);
+  EXPECT_EQ('\0', buf[1]);
+  EXPECT_EQ(89999, stream->lseek(89999, SEEK_SET));
+  EXPECT_EQ(static_cast<ssize_t>(sizeof(buf)), stream->read(buf, sizeof(buf)));
+  EXPECT_EQ('\0', buf[0]);
+  EXPECT_EQ('X', buf[1]);
+  EXPECT_EQ('X', buf[sizeof(buf) - 1]);
+}
+
+TEST_F(ReadonlyFileTest, TestCompressedMmap) {
+  scoped_refptr<FileStream> stream =
+      compressed_handler_->open(-1, kTestFiles[1].filename, O_RDONLY, 0);
+  ASSERT_TRUE(stream);
+  const size_t kPageSizeMultiple = 64 * 1024;
+  char* file1 = reinterpret_cast<char*>(stream->mmap(
+      NULL, kPageSizeMultiple * 2, PROT_READ, MAP_PRIVATE, 0));
+  ASSERT_NE(MAP_FAILED, file1);
+  EXPECT_EQ(0, file1[0]);
+  EXPECT_EQ(0, file1[89999]);
+  EXPECT_EQ('X', file1[90000]);
+  EXPECT_EQ('X', file1[kTestFiles[1].size - 1]);
+  // Bytes beyond the end of the file are zero-filled.
+  EXPECT_EQ(0, file1[kTestFiles[1].size]);
+  EXPECT_EQ(0, stream->munmap(file1, kPageSizeMultiple * 2));
+
+  file1 = reinterpret_cast<char*>(stream->mmap(
+      NULL, kPageSizeMultiple, PROT_READ, MAP_SHARED, kPageSizeMultiple));
+  ASSERT_NE(MAP_FAILED, file1);
+  EXPECT_EQ(0, file1[89999 - kPageSizeMultiple]);
+  EXPECT_EQ('X', file1[90000 - kPageSizeMultiple]);
+  EXPECT_EQ(0, stream->munmap(file1, kPageSizeMultiple));
+
+  // A writable private mapping is allowed, but a writable shared one is not.
+  file1 = reinterpret_cast<char*>(stream->mmap(
+      NULL, kPageSizeMultiple, PROT_READ | PROT_WRITE, MAP_PRIVATE, 0));
+  ASSERT_NE(MAP_FAILED, file1);
+  file1[0] = 'Y';
+  EXPECT_EQ(0, stream->munmap(file1, kPageSizeMultiple));
+  errno = 0;
+  EXPECT_EQ(MAP_FAILED, stream->mmap(
+      NULL, kPageSizeMultiple, PROT_READ | PROT_WRITE, MAP_SHARED, 0));
+  EXPECT_EQ(EACCES, errno);
+
+  // The private write above must not leak into the shared block cache.
+  char c = 0;
+  EXPECT_EQ(1, stream->pread(&c, 1, 0));
+  EXPECT_EQ(0, c);
+
+  errno = 0;
+  EXPECT_EQ(MAP_FAILED, stream->mmap(NULL, 0, PROT_READ, MAP_PRIVATE, 0));
+  EXPECT_EQ(EINVAL, errno);
+  errno = 0;
+  EXPECT_EQ(MAP_FAILED, stream->mmap(NULL, 1, PROT_READ, MAP_PRIVATE, 1));
+  EXPECT_EQ(EINVAL, errno);
+}
+
+// Reads the compressed image with a new handler, so that neither the block
+// cache nor the read-ahead buffer is warm, and checks it has the same amount
+// of content as the uncompressed one.
+TEST_F(ReadonlyFileTest, TestColdRead) {
+  scoped_ptr<ReadonlyFileHandler> handler(CreateHandler(kImageFile));
+  ASSERT_TRUE(handler->IsInitialized());
+  const size_t read_size = ReadAllFiles(handler.get());
+  EXPECT_LT(0U, read_size);
+  handler.reset(CreateHandler(kCompressedImageFile));
+  ASSERT_TRUE(handler->IsInitialized());
+  EXPECT_EQ(read_size, ReadAllFiles(handler.get()));
+}
+
 TEST_F(ReadonlyFileTest, TestMkdir) {
   // mkdir is not supported.
   EXPECT_EQ(-1, handler_->mkdir("/tmp/directory", 0777));
@@ -5,6 +5,7 @@
 #include "posix_translation/readonly_fs_reader.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <string.h>
 #include <vector>
 
@@ -18,6 +19,59 @@ namespace posix_translation {
 
 namespace {
 
+// Constants for the version 2 format, which should be consistent with ones in
+// create_readonly_fs_image.py.
+const uint32_t kImageMagic = 0x41524f46;  // 'AROF'
+const uint32_t kFormatVersion2 = 2;
+const uint32_t kFormatVersion3 = 3;
+const uint32_t kNoString = 0xffffffff;
+
+// Indexes of 32-bit integers in the version 2 header and records.
+enum HeaderIndex {
+  kHeaderMagic,
+  kHeaderVersion,
+  kHeaderNumFiles,
+  kHeaderNumDirs,
+  kHeaderNumChildren,
+  kHeaderFilesOffset,
+  kHeaderDirsOffset,
+  kHeaderChildrenOffset,
+  kHeaderStringsOffset,
+  kHeaderContentOffset,
+  kHeaderWords,
+  // Only in the version 3 header.
+  kHeaderNumBlocks = kHeaderWords,
+  kHeaderBlockTableOffset,
+  kHeaderContentSize
+};
+
+enum FileRecordIndex {
+  kFileName,
+  kFileOffset,
+  kFileSize,
+  kFileMtime,
+  kFileType,
+  kFileLinkTarget,
+  kFileWords
+};
+
+enum DirRecordIndex {
+  kDirName,
+  kDirFirstChild,
+  kDirNumChildren,
+  kDirWords
+};
+
+enum ChildRecordIndex {
+  kChildName,
+  kChildType,
+  kChildWords
+};
+
+COMPILE_ASSERT(
+    ReadonlyFsReader::kImageHeaderSize == kHeaderWords * sizeof(uint32_t),
+    header_size_mismatch);
+
 struct FileInfo_ {
   std::string filename;
   std::string link_target;
@@ -29,15 +83,36 @@ struct FileInfo_ {
 
 }  // namespace
 
-ReadonlyFsReader::ReadonlyFsReader(const unsigned char* filesystem_image) {
-  ParseImage(filesystem_image);
+ReadonlyFsReader::ReadonlyFsReader(const unsigned char* filesystem_image)
+    : image_(NULL), files_(NULL), dirs_(NULL), children_(NULL),
+      strings_(NULL), num_files_(0), num_dirs_(0), content_offset_(0),
+      compressed_(false) {
+  if (GetIndexSize(filesystem_image))
+    ParseIndexedImage(filesystem_image);
+  else
+    ParseImage(filesystem_image);
 }
 
 ReadonlyFsReader::~ReadonlyFsReader() {
 }
 
+// static
+size_t ReadonlyFsReader::GetIndexSize(const unsigned char* image_header) {
+  if (GetUInt32BE(image_header, kHeaderMagic) != kImageMagic)
+    return 0;  // The version 1 image starts with the number of files.
+  return GetUInt32BE(image_header, kHeaderContentOffset);
+}
+
 bool ReadonlyFsReader::GetMetadata(const std::string& filename,
                                    Metadata* metadata) const {
+  if (image_) {
+    const unsigned char* record =
+        FindRecord(files_, num_files_, kFileWords, filename.c_str());
+    if (!record)
+      return false;
+    GetMetadataFromRecord(record, metadata);
+    return true;
+  }
   FileToMemory::const_iterator it = file_objects_.find(filename);
   if (it == file_objects_.end())
     return false;
@@ -46,17 +121,48 @@ bool ReadonlyFsReader::GetMetadata(const std::string& filename,
 }
 
 bool ReadonlyFsReader::Exist(const std::string& filename) const {
+  if (image_) {
+    if (FindRecord(files_, num_files_, kFileWords, filename.c_str()))
+      return true;
+    return FindDirectory(filename);
+  }
   if (file_objects_.count(filename) > 0)
     return true;
   return file_names_.StatDirectory(filename);
 }
 
 bool ReadonlyFsReader::IsDirectory(const std::string& filename) const {
+  if (image_)
+    return FindDirectory(filename);
   return file_names_.StatDirectory(filename);
 }
 
 Dir* ReadonlyFsReader::OpenDirectory(const std::string& name) {
-  return file_names_.OpenDirectory(name);
+  if (!image_)
+    return file_names_.OpenDirectory(name);
+
+  if (FindRecord(files_, num_files_, kFileWords, name.c_str())) {
+    errno = ENOTDIR;
+    return NULL;
+  }
+  const unsigned char* dir = FindDirectory(name);
+  if (!dir) {
+    errno = ENOENT;
+    return NULL;
+  }
+  // Only the entries of the directory being opened are copied to the heap.
+  DirectoryManager::FilesInDir files;
+  const uint32_t first_child = GetUInt32BE(dir, kDirFirstChild);
+  const uint32_t num_children = GetUInt32BE(dir, kDirNumChildren);
+  for (uint32_t i = first_child; i < first_child + num_children; ++i) {
+    const unsigned char* child =
+        children_ + i * kChildWords * sizeof(uint32_t);
+    files.insert(std::make_pair(
+        GetString(GetUInt32BE(child, kChildName)),
+        static_cast<Dir::Type>(GetUInt32BE(child, kChildType))));
+  }
+  return DirectoryManager::CreateDir(GetString(GetUInt32BE(dir, kDirName)),
+                                     files);
 }
 
 void ReadonlyFsReader::ParseImage(const unsigned char* image_metadata) {
@@ -128,6 +234,125 @@ void ReadonlyFsReader::ParseImage(const unsigned char* image_metadata) {
   }
 }
 
+void ReadonlyFsReader::GetCompressedBlockTable(
+    off_t* out_content_offset, size_t* out_content_size,
+    std::vector<uint32_t>* out_block_table) const {
+  ALOG_ASSERT(compressed_);
+  *out_content_offset = content_offset_;
+  *out_content_size = GetUInt32BE(image_, kHeaderContentSize);
+  // The table has one more entry than the number of blocks so that the size
+  // of the last block can be computed.
+  const size_t num_entries = GetUInt32BE(image_, kHeaderNumBlocks) + 1;
+  const unsigned char* table =
+      image_ + GetUInt32BE(image_, kHeaderBlockTableOffset);
+  out_block_table->resize(num_entries);
+  for (size_t i = 0; i < num_entries; ++i)
+    (*out_block_table)[i] = GetUInt32BE(table, i);
+}
+
+void ReadonlyFsReader::ParseIndexedImage(const unsigned char* image) {
+  ALOG_ASSERT(AlignTo(image, util::GetPageSize()) == image);
+  const uint32_t version = GetUInt32BE(image, kHeaderVersion);
+  ALOG_ASSERT(version == kFormatVersion2 || version == kFormatVersion3,
+              "Unknown image format version %u", version);
+  compressed_ = (version == kFormatVersion3);
+
+  image_ = image;
+  num_files_ = GetUInt32BE(image, kHeaderNumFiles);
+  num_dirs_ = GetUInt32BE(image, kHeaderNumDirs);
+  files_ = image + GetUInt32BE(image, kHeaderFilesOffset);
+  dirs_ = image + GetUInt32BE(image, kHeaderDirsOffset);
+  children_ = image + GetUInt32BE(image, kHeaderChildrenOffset);
+  strings_ = reinterpret_cast<const char*>(
+      image + GetUInt32BE(image, kHeaderStringsOffset));
+  content_offset_ = GetUInt32BE(image, kHeaderContentOffset);
+
+  // The root directory always exists.
+  ALOG_ASSERT(num_dirs_ > 0);
+  ALOG_ASSERT(files_ + num_files_ * kFileWords * sizeof(uint32_t) <= dirs_);
+  ALOG_ASSERT(dirs_ + num_dirs_ * kDirWords * sizeof(uint32_t) <= children_);
+  ALOG_ASSERT(children_ + GetUInt32BE(image, kHeaderNumChildren) *
+              kChildWords * sizeof(uint32_t) <=
+              reinterpret_cast<const unsigned char*>(strings_));
+  ALOG_ASSERT(reinterpret_cast<const unsigned char*>(strings_) <=
+              image + content_offset_);
+}
+
+void ReadonlyFsReader::ListFiles(FileToMemory* out_files) const {
+  out_files->clear();
+  if (!image_) {
+    *out_files = file_objects_;
+    return;
+  }
+  for (size_t i = 0; i < num_files_; ++i) {
+    const unsigned char* record = files_ + i * kFileWords * sizeof(uint32_t);
+    Metadata metadata;
+    GetMetadataFromRecord(record, &metadata);
+    out_files->insert(std::make_pair(
+        GetString(GetUInt32BE(record, kFileName)), metadata));
+  }
+}
+
+// static
+uint32_t ReadonlyFsReader::GetUInt32BE(const unsigned char* record,
+                                       size_t index) {
+  ALOG_ASSERT(AlignTo(record, 4) == record);
+  return ntohl(reinterpret_cast<const uint32_t*>(record)[index]);
+}
+
+const char* ReadonlyFsReader::GetString(uint32_t offset) const {
+  ALOG_ASSERT(offset != kNoString);
+  return strings_ + offset;
+}
+
+const unsigned char* ReadonlyFsReader::FindRecord(const unsigned char* table,
+                                                  size_t num_records,
+                                                  size_t record_words,
+                                                  const char* name) const {
+  const size_t record_size = record_words * sizeof(uint32_t);
+  size_t low = 0;
+  size_t high = num_records;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const unsigned char* record = table + mid * record_size;
+    // Names in the table are sorted in byte order, which is what strcmp()
+    // uses.
+    const int result = strcmp(GetString(GetUInt32BE(record, 0)), name);
+    if (!result)
+      return record;
+    if (result < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return NULL;
+}
+
+void ReadonlyFsReader::GetMetadataFromRecord(const unsigned char* record,
+                                             Metadata* metadata) const {
+  // The offset value in the image is relative to the beginning of the content.
+  // To convert it to the file offset, add |content_offset_|.
+  metadata->offset =
+      static_cast<off_t>(GetUInt32BE(record, kFileOffset)) + content_offset_;
+  metadata->size = GetUInt32BE(record, kFileSize);
+  metadata->mtime = static_cast<time_t>(GetUInt32BE(record, kFileMtime));
+  metadata->file_type = static_cast<FileType>(GetUInt32BE(record, kFileType));
+  const uint32_t link_target = GetUInt32BE(record, kFileLinkTarget);
+  if (link_target == kNoString)
+    metadata->link_target.clear();
+  else
+    metadata->link_target = GetString(link_target);
+}
+
+const unsigned char* ReadonlyFsReader::FindDirectory(
+    const std::string& dirname) const {
+  if (util::EndsWithSlash(dirname))
+    return FindRecord(dirs_, num_dirs_, kDirWords, dirname.c_str());
+  std::string dirname_slash = dirname;
+  util::EnsurePathEndsWithSlash(&dirname_slash);
+  return FindRecord(dirs_, num_dirs_, kDirWords, dirname_slash.c_str());
+}
+
 // static
 const unsigned char* ReadonlyFsReader::ReadUInt32BE(
     const unsigned char* p, uint32_t* out_result) {
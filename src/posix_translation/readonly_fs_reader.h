@@ -8,6 +8,7 @@
 #include <time.h>
 
 #include <string>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/containers/hash_tables.h"
@@ -18,13 +19,34 @@
 
 namespace posix_translation {
 
+// A reader for the image generated by create_readonly_fs_image.py. The
+// version 1, 2, and 3 formats are supported. A version 1 image is parsed
+// into heap structures at construction time. A version 2 image has a sorted
+// index and is queried in place, so construction is O(1) regardless of the
+// number of files, but the index part of the image must stay mapped while the
+// reader is alive. A version 3 image is a version 2 image whose content is
+// compressed block by block.
 // Note: This class is not thread-safe.
 class ReadonlyFsReader {
  public:
-  // ReadonlyFsReader does not own the |filesystem_image| pointer.
+  // The number of bytes GetIndexSize() needs to inspect.
+  static const size_t kImageHeaderSize = 40;
+  // The size of each compressed block before compression.
+  static const size_t kCompressedBlockSize = 64 * 1024;
+
+  // ReadonlyFsReader does not own the |filesystem_image| pointer. For a
+  // version 2 image, the first GetIndexSize() bytes of |filesystem_image| must
+  // outlive the reader.
   explicit ReadonlyFsReader(const unsigned char* filesystem_image);
   ~ReadonlyFsReader();
 
+  // Returns the size of the index at the beginning of a version 2 image whose
+  // first kImageHeaderSize bytes are |image_header|. The index must stay
+  // mapped while a ReadonlyFsReader for the image is alive. Returns 0 for a
+  // version 1 image, which can be unmapped right after the reader is
+  // constructed.
+  static size_t GetIndexSize(const unsigned char* image_header);
+
   // File type constants, which should be consistent with ones in
   // create_readonly_fs_image.py.
   enum FileType {
@@ -59,12 +81,29 @@ class ReadonlyFsReader {
   // Returns a list of files in the |name| directory. NULL if |name| is unknown.
   Dir* OpenDirectory(const std::string& name);
 
+  // Returns true if the content of files is compressed. Metadata::offset of a
+  // compressed image is the offset in the image as if the content were not
+  // compressed. Use GetCompressedBlockTable() to locate the actual data.
+  bool IsCompressed() const { return compressed_; }
+
+  // Writes the offset of the content in the image, the size of the content
+  // before compression, and the block table of a compressed image. The N-th
+  // entry of |out_block_table| is the offset of the N-th block relative to the
+  // content, and the last entry is the size of the compressed content. A block
+  // whose compressed size is the same as its original size is not compressed.
+  void GetCompressedBlockTable(off_t* out_content_offset,
+                               size_t* out_content_size,
+                               std::vector<uint32_t>* out_block_table) const;
+
  private:
   friend class ReadonlyFsReaderTest;
   FRIEND_TEST(ReadonlyFsReaderTest, TestAlignTo);
   FRIEND_TEST(ReadonlyFsReaderTest, TestParseImage);
   FRIEND_TEST(ReadonlyFsReaderTest, TestParseImageProd);
 
+  // A hash_map from a file name to its metadata such as the size of the file.
+  typedef base::hash_map<std::string, Metadata> FileToMemory;  // NOLINT
+
   template<typename T>
   static T* AlignTo(T* p, size_t boundary) {
     uintptr_t u = reinterpret_cast<uintptr_t>(p);
@@ -72,20 +111,61 @@ class ReadonlyFsReader {
     return reinterpret_cast<T*>(u);
   }
 
-  // Parses |filesystem_image| and update member variables.
+  // Parses a version 1 |filesystem_image| and update member variables.
   void ParseImage(const unsigned char* filesystem_image);
 
+  // Validates the header of a version 2 |filesystem_image| and update member
+  // variables. Unlike ParseImage(), this does not look at each file.
+  void ParseIndexedImage(const unsigned char* filesystem_image);
+
+  // Writes all files in the image to |out_files|. For testing.
+  void ListFiles(FileToMemory* out_files) const;
+
+  // Returns the |index|-th 4-byte big-endian integer of the 4B-aligned
+  // |record|.
+  static uint32_t GetUInt32BE(const unsigned char* record, size_t index);
+
+  // Returns the string at |offset| in the string table of the version 2 image.
+  const char* GetString(uint32_t offset) const;
+
+  // Binary-searches the version 2 |table| sorted by name for |name|. Each
+  // record in the table is |record_words| integers long and starts with the
+  // offset of its name. Returns the record or NULL if not found.
+  const unsigned char* FindRecord(const unsigned char* table,
+                                  size_t num_records,
+                                  size_t record_words,
+                                  const char* name) const;
+
+  // Converts a version 2 file table |record| to Metadata.
+  void GetMetadataFromRecord(const unsigned char* record,
+                             Metadata* metadata) const;
+
+  // Returns the dir table record of |dirname| in the version 2 image. Both
+  // "/usr/bin/" and "/usr/bin" forms are accepted as |dirname|.
+  const unsigned char* FindDirectory(const std::string& dirname) const;
+
   // Reads 4-byte big-endian integer from a next 4B boundary of |p|, assigns the
   // integer to |out_result|, and returns |p| + padding-to-the-boundary +
   // sizeof(uint32_t).
   static const unsigned char* ReadUInt32BE(const unsigned char* p,
                                            uint32_t* out_result);
 
-  // A hash_map from a file name to its metadata such as the size of the file.
-  typedef base::hash_map<std::string, Metadata> FileToMemory;  // NOLINT
+  // Used only for version 1 images.
   FileToMemory file_objects_;
   DirectoryManager file_names_;
 
+  // Used only for version 2 images. Point into the index of the image.
+  // |image_| is NULL for version 1 images.
+  const unsigned char* image_;
+  const unsigned char* files_;
+  const unsigned char* dirs_;
+  const unsigned char* children_;
+  const char* strings_;
+  size_t num_files_;
+  size_t num_dirs_;
+  off_t content_offset_;
+  bool compressed_;
+
   DISALLOW_COPY_AND_ASSIGN(ReadonlyFsReader);
 };
 
@@ -3,6 +3,8 @@
 // found in the LICENSE file.
 
 #include <arpa/inet.h>  // htonl
+#include <errno.h>
+#include <string.h>
 
 #include <string>
 
@@ -32,14 +34,22 @@ class ReadonlyFsReaderTest : public FileSystemTestCommon {
     std::string prod_filename = PROD_READONLY_FS_IMAGE;
     std::string test_filename = ARC_TARGET_PATH
         "/posix_translation_fs_images/test_readonly_fs_image.img";
+    std::string test_v1_filename = ARC_TARGET_PATH
+        "/posix_translation_fs_images/test_readonly_fs_image_v1.img";
 
     ASSERT_TRUE(prod_image_.Init(prod_filename));
     ASSERT_TRUE(test_image_.Init(test_filename));
+    ASSERT_TRUE(test_v1_image_.Init(test_v1_filename));
 
     reader_.reset(new ReadonlyFsReader(
         reinterpret_cast<const unsigned char*>(test_image_.data())));
     reader_prod_.reset(new ReadonlyFsReader(
         reinterpret_cast<const unsigned char*>(prod_image_.data())));
+    reader_v1_.reset(new ReadonlyFsReader(
+        reinterpret_cast<const unsigned char*>(test_v1_image_.data())));
+    reader_->ListFiles(&files_);
+    reader_prod_->ListFiles(&prod_files_);
+    reader_v1_->ListFiles(&v1_files_);
   }
 
   const ReadonlyFsReader::Metadata* FindFile(
@@ -74,8 +84,13 @@ class ReadonlyFsReaderTest : public FileSystemTestCommon {
   pp::CompletionCallbackFactory<ReadonlyFsReaderTest> cc_factory_;
   scoped_ptr<ReadonlyFsReader> reader_;
   scoped_ptr<ReadonlyFsReader> reader_prod_;
+  scoped_ptr<ReadonlyFsReader> reader_v1_;
+  ReadonlyFsReader::FileToMemory files_;
+  ReadonlyFsReader::FileToMemory prod_files_;
+  ReadonlyFsReader::FileToMemory v1_files_;
   MmappedFile prod_image_;
   MmappedFile test_image_;
+  MmappedFile test_v1_image_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ReadonlyFsReaderTest);
@@ -331,10 +346,10 @@ TEST_F(ReadonlyFsReaderTest, TestOpenReadCloseDir) {
 }
 
 TEST_F(ReadonlyFsReaderTest, TestParseImage) {
-  EXPECT_EQ(kNumTestFiles, reader_->file_objects_.size());
+  EXPECT_EQ(kNumTestFiles, files_.size());
   ReadonlyFsReader::FileToMemory::const_iterator it =
-    reader_->file_objects_.find(kTestFiles[0].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+    files_.find(kTestFiles[0].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[0].size, it->second.size);
   EXPECT_LT(0L, it->second.mtime);
   const char* file_head = test_image_.data() + it->second.offset;
@@ -343,8 +358,8 @@ TEST_F(ReadonlyFsReaderTest, TestParseImage) {
   EXPECT_EQ('3', file_head[2]);
   EXPECT_EQ('\n', file_head[3]);
 
-  it = reader_->file_objects_.find(kTestFiles[1].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+  it = files_.find(kTestFiles[1].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[1].size, it->second.size);
   EXPECT_LT(0L, it->second.mtime);
   file_head = test_image_.data() + it->second.offset;
@@ -355,43 +370,43 @@ TEST_F(ReadonlyFsReaderTest, TestParseImage) {
     else
       ASSERT_EQ('X', file_head[i]) << i;
   }
-  it = reader_->file_objects_.find(kTestFiles[2].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+  it = files_.find(kTestFiles[2].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[2].size, it->second.size);
   EXPECT_LT(0L, it->second.mtime);
   file_head = test_image_.data() + it->second.offset;
   EXPECT_EQ('Z', file_head[0]);
 
-  it = reader_->file_objects_.find(kTestFiles[3].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+  it = files_.find(kTestFiles[3].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[3].size, it->second.size);  // empty file
   EXPECT_LT(0L, it->second.mtime);
 
-  it = reader_->file_objects_.find(kTestFiles[4].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+  it = files_.find(kTestFiles[4].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[4].size, it->second.size);  // empty file
   EXPECT_LT(0L, it->second.mtime);
 
-  it = reader_->file_objects_.find(kTestFiles[5].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+  it = files_.find(kTestFiles[5].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[5].size, it->second.size);
   EXPECT_LT(0L, it->second.mtime);
   file_head = test_image_.data() + it->second.offset;
   EXPECT_EQ('A', file_head[0]);
 
-  it = reader_->file_objects_.find(kTestFiles[6].filename);
-  ASSERT_TRUE(it != reader_->file_objects_.end());
+  it = files_.find(kTestFiles[6].filename);
+  ASSERT_TRUE(it != files_.end());
   ASSERT_EQ(kTestFiles[6].size, it->second.size);  // empty file
   EXPECT_LT(0L, it->second.mtime);
 
-  it = reader_->file_objects_.find("test/a.odex");
-  EXPECT_TRUE(it == reader_->file_objects_.end());
-  it = reader_->file_objects_.find("/test/a.ode");
-  EXPECT_TRUE(it == reader_->file_objects_.end());
-  it = reader_->file_objects_.find("/test");
-  EXPECT_TRUE(it == reader_->file_objects_.end());
-  it = reader_->file_objects_.find("does_not_exist");
-  EXPECT_TRUE(it == reader_->file_objects_.end());
+  it = files_.find("test/a.odex");
+  EXPECT_TRUE(it == files_.end());
+  it = files_.find("/test/a.ode");
+  EXPECT_TRUE(it == files_.end());
+  it = files_.find("/test");
+  EXPECT_TRUE(it == files_.end());
+  it = files_.find("does_not_exist");
+  EXPECT_TRUE(it == files_.end());
 }
 
 // Test if the production rootfs img is valid.
@@ -399,32 +414,32 @@ TEST_F(ReadonlyFsReaderTest, TestParseImageProd) {
   // Note: Do not check files that are not open sourced.
   // Otherwise nacl-i686-weird builder will fail.
 
-  EXPECT_GT(reader_prod_->file_objects_.size(), 0U);
+  EXPECT_GT(prod_files_.size(), 0U);
   // These files should exist in the image.
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_, "/proc/version"));
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_, "/proc/meminfo"));
+  EXPECT_TRUE(FindFile(prod_files_, "/proc/version"));
+  EXPECT_TRUE(FindFile(prod_files_, "/proc/meminfo"));
   const ReadonlyFsReader::Metadata* metadata =
-      FindFile(reader_prod_->file_objects_, "/proc/loadavg");
+      FindFile(prod_files_, "/proc/loadavg");
   ASSERT_TRUE(metadata);
   EXPECT_EQ(27U, metadata->size);
 
   const char* file_head = prod_image_.data() + metadata->offset;
   EXPECT_EQ(std::string("0.00 0.00 0.00 1/279 22477\n"),
             std::string(file_head, metadata->size));
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_, "/system/bin/sh"));
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_,
+  EXPECT_TRUE(FindFile(prod_files_, "/system/bin/sh"));
+  EXPECT_TRUE(FindFile(prod_files_,
                        "/system/usr/share/zoneinfo/tzdata"));
   // libRS.so is a canned library not built at all by ARC.
   // - ARM version is always provided.
   // - x86 version is provided only when NDK direct execution is enabled
   //   under x86.
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_,
+  EXPECT_TRUE(FindFile(prod_files_,
                        "/vendor/lib-armeabi-v7a/libRS.so"));
 #if defined(__i386__) && defined(USE_NDK_DIRECT_EXECUTION)
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_,
+  EXPECT_TRUE(FindFile(prod_files_,
                        "/vendor/lib-x86/libRS.so"));
 #else
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_,
+  EXPECT_FALSE(FindFile(prod_files_,
                         "/vendor/lib-x86/libRS.so"));
 #endif
   // libutils.so is needed by libRS.so. It is built by ARC, but we do not have
@@ -434,27 +449,27 @@ TEST_F(ReadonlyFsReaderTest, TestParseImageProd) {
   // - x86 version is never provided in favor of a native version in
   //   /system/lib.
 #if !defined(__arm__)
-  EXPECT_TRUE(FindFile(reader_prod_->file_objects_,
+  EXPECT_TRUE(FindFile(prod_files_,
                        "/vendor/lib-armeabi-v7a/libutils.so"));
 #else
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_,
+  EXPECT_FALSE(FindFile(prod_files_,
                         "/vendor/lib-armeabi-v7a/libutils.so"));
 #endif
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_,
+  EXPECT_FALSE(FindFile(prod_files_,
                         "/vendor/lib-x86/libutils.so"));
   // libstdc++.so is needed by libRS.so. Since it is built by ARC and NDK
   // trampolines for it exist, we do not need a canned binary in favor of
   // a native version in /system/lib.
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_,
+  EXPECT_FALSE(FindFile(prod_files_,
                         "/vendor/lib-armeabi-v7a/libstdc++.so"));
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_,
+  EXPECT_FALSE(FindFile(prod_files_,
                         "/vendor/lib-x86/libstdc++.so"));
   // These files should NOT exist in the image.
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_, "root/proc/version"));
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_, "intermediates/"));
+  EXPECT_FALSE(FindFile(prod_files_, "root/proc/version"));
+  EXPECT_FALSE(FindFile(prod_files_, "intermediates/"));
 
-  EXPECT_FALSE(FindFile(reader_prod_->file_objects_, "dexopt"));
-  EXPECT_FALSE(FindNonVendorLibraries(reader_prod_->file_objects_));
+  EXPECT_FALSE(FindFile(prod_files_, "dexopt"));
+  EXPECT_FALSE(FindNonVendorLibraries(prod_files_));
   // These directories should exist in the image.
   EXPECT_TRUE(reader_prod_->IsDirectory("/cache"));
   EXPECT_TRUE(reader_prod_->IsDirectory("/data"));
@@ -477,4 +492,67 @@ TEST_F(ReadonlyFsReaderTest, TestParseImageProd) {
   EXPECT_FALSE(reader_prod_->IsDirectory("/tmp"));
 }
 
+// Test if the reader still supports the version 1 image format.
+TEST_F(ReadonlyFsReaderTest, TestParseImageV1) {
+  EXPECT_EQ(0U, ReadonlyFsReader::GetIndexSize(
+      reinterpret_cast<const unsigned char*>(test_v1_image_.data())));
+  EXPECT_LT(0U, ReadonlyFsReader::GetIndexSize(
+      reinterpret_cast<const unsigned char*>(test_image_.data())));
+
+  // Both images have the same content. Only the metadata part differs.
+  ASSERT_EQ(kNumTestFiles, v1_files_.size());
+  ASSERT_EQ(files_.size(), v1_files_.size());
+  for (size_t i = 0; i < kNumTestFiles; ++i) {
+    ReadonlyFsReader::Metadata metadata;
+    ASSERT_TRUE(reader_v1_->GetMetadata(kTestFiles[i].filename, &metadata))
+        << kTestFiles[i].filename;
+    EXPECT_EQ(kTestFiles[i].size, metadata.size);
+    EXPECT_EQ(kTestFiles[i].link_target ? kTestFiles[i].link_target : "",
+              metadata.link_target);
+    ReadonlyFsReader::Metadata metadata_v2;
+    ASSERT_TRUE(reader_->GetMetadata(kTestFiles[i].filename, &metadata_v2));
+    EXPECT_EQ(metadata.offset, metadata_v2.offset);
+    EXPECT_EQ(metadata.size, metadata_v2.size);
+    EXPECT_EQ(metadata.file_type, metadata_v2.file_type);
+    EXPECT_EQ(metadata.link_target, metadata_v2.link_target);
+    EXPECT_EQ(0, memcmp(test_v1_image_.data() + metadata.offset,
+                        test_image_.data() + metadata_v2.offset,
+                        metadata.size));
+  }
+
+  EXPECT_TRUE(reader_v1_->Exist("/"));
+  EXPECT_TRUE(reader_v1_->Exist("/test/dir/empty.odex"));
+  EXPECT_FALSE(reader_v1_->Exist("/test/dir/empty.odexa"));
+  EXPECT_TRUE(reader_v1_->IsDirectory("/test/emptydir"));
+  EXPECT_FALSE(reader_v1_->IsDirectory("/test/emptyfile"));
+
+  static const Dir* kNullDir = NULL;
+  scoped_ptr<Dir> dirp(reader_v1_->OpenDirectory("/test/dir"));
+  ASSERT_NE(kNullDir, dirp.get());
+  dirent entry;
+  ASSERT_TRUE(dirp->GetNext(&entry));
+  EXPECT_EQ(std::string("."), entry.d_name);
+  ASSERT_TRUE(dirp->GetNext(&entry));
+  EXPECT_EQ(std::string(".."), entry.d_name);
+  ASSERT_TRUE(dirp->GetNext(&entry));
+  EXPECT_EQ(std::string("c.odex"), entry.d_name);
+  ASSERT_TRUE(dirp->GetNext(&entry));
+  EXPECT_EQ(std::string("empty.odex"), entry.d_name);
+  ASSERT_FALSE(dirp->GetNext(&entry));
+}
+
+TEST_F(ReadonlyFsReaderTest, TestOpenDirectoryErrors) {
+  static const Dir* kNullDir = NULL;
+  errno = 0;
+  scoped_ptr<Dir> dirp(reader_->OpenDirectory("/test/a.odex"));
+  EXPECT_EQ(kNullDir, dirp.get());
+  EXPECT_EQ(ENOTDIR, errno);
+  errno = 0;
+  dirp.reset(reader_->OpenDirectory("/test/dirX"));
+  EXPECT_EQ(kNullDir, dirp.get());
+  EXPECT_EQ(ENOENT, errno);
+  dirp.reset(reader_->OpenDirectory("/test/emptydir/"));
+  EXPECT_NE(kNullDir, dirp.get());
+}
+
 }  // namespace posix_translation
@@ -143,6 +143,21 @@ ssize_t ReadonlyMemoryFile::pread(void* buf, size_t count, off64_t offset) {
   return read_size;
 }
 
+bool ReadonlyMemoryFile::GetContentBuffer(off64_t offset, size_t count,
+                                          const void** out_buf,
+                                          size_t* out_size) {
+  const Content& content = GetContent();
+  const ssize_t read_max = content.size() - offset;
+  if (read_max <= 0) {
+    *out_buf = NULL;
+    *out_size = 0;
+    return true;
+  }
+  *out_buf = &content[0] + offset;
+  *out_size = std::min<size_t>(count, read_max);
+  return true;
+}
+
 ssize_t ReadonlyMemoryFile::read(void* buf, size_t count) {
   const ssize_t read_size = this->pread(buf, count, pos_);
   if (read_size > 0)
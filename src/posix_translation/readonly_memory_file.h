@@ -48,6 +48,9 @@ class ReadonlyMemoryFile : public FileStream {
   virtual ssize_t pread(void* buf, size_t count, off64_t offset) OVERRIDE;
   virtual ssize_t read(void* buf, size_t count) OVERRIDE;
   virtual ssize_t write(const void* buf, size_t count) OVERRIDE;
+  virtual bool GetContentBuffer(off64_t offset, size_t count,
+                                const void** out_buf,
+                                size_t* out_size) OVERRIDE;
 
   // Although this class does not support select, override the function
   // just in case.
@@ -6,7 +6,12 @@
 
 """Generates a read-only file system image.
 
-Image file format:
+Two image formats are supported. The version 2 format (default) has an index
+which ReadonlyFsReader can query in place without building any heap
+structures at startup. The version 1 format is kept for compatibility and can
+be generated with --format-version=1.
+
+Version 1 image file format:
 
 [Number of files]     ; 32bit unsigned, big endian
 [Offset of file #1]   ; 32bit unsigned, big endian (always 0x00000000)
@@ -43,6 +48,65 @@ EOF
   can return page aligned address on both 4k-page and 64k-page environments.
 * The image file itself should be mapped on a native (4k or 64k) page
   boundary.
+
+Version 2 image file format:
+
+[Magic]               ; 32bit unsigned, big endian, 0x41524f46 ('AROF')
+[Format version]      ; 32bit unsigned, big endian, always 2
+[Number of files]     ; 32bit unsigned, big endian
+[Number of dirs]      ; 32bit unsigned, big endian
+[Number of children]  ; 32bit unsigned, big endian
+[Offset of files]     ; 32bit unsigned, big endian, from the image start
+[Offset of dirs]      ; 32bit unsigned, big endian, from the image start
+[Offset of children]  ; 32bit unsigned, big endian, from the image start
+[Offset of strings]   ; 32bit unsigned, big endian, from the image start
+[Offset of content]   ; 32bit unsigned, big endian, from the image start
+[File table]          ; Number of files entries, sorted by full path
+[Dir table]           ; Number of dirs entries, sorted by full path
+[Children table]      ; Number of children entries, grouped by dir
+[String table]        ; Zero terminated strings
+[Zero padding to a 64k page boundary]
+[Content of file #1]  ; Same as the version 1 format
+...
+
+A file table entry consists of six 32bit unsigned big endian integers: the
+offset of the full path in the string table, the offset of the content
+(relative to the beginning of the content of file #1), the size, the mtime,
+the type, and the offset of the link target in the string table (0xffffffff
+if the file is not a symlink). Empty directories are not in the file table.
+
+A dir table entry consists of three 32bit unsigned big endian integers: the
+offset of the full path ending with a slash (e.g. "/system/") in the string
+table, the index of the first child in the children table, and the number of
+children.
+
+A children table entry consists of two 32bit unsigned big endian integers: the
+offset of the name of the child in the string table, and its dirent type
+(DT_REG, DT_DIR, or DT_LNK). Names of child directories end with a slash.
+Children of a directory are sorted by name.
+
+* All offsets in the string table are relative to the beginning of the table.
+* Paths are sorted in byte order so that the reader can binary-search them
+  with strcmp().
+
+Version 3 (compressed) image file format:
+
+The same as the version 2 format except that the format version is 3, the
+header has the following three additional fields, and the content is stored
+as a sequence of independently compressed 64k blocks. Generate it with
+--compress.
+
+[Number of blocks]        ; 32bit unsigned, big endian
+[Offset of block table]   ; 32bit unsigned, big endian, from the image start
+[Size of content]         ; 32bit unsigned, big endian, before compression
+
+The block table is in the metadata part and consists of (Number of blocks + 1)
+32bit unsigned big endian integers. The N-th integer is the offset of the
+N-th compressed block relative to the beginning of the content, and the last
+integer is the size of the compressed content. A block is compressed with
+zlib unless compression does not make it smaller, in which case it is stored
+as is. File offsets in the file table are offsets in the uncompressed
+content, which is why files are still 64k aligned there.
 """
 
 import argparse
@@ -52,6 +116,7 @@ import re
 import struct
 import sys
 import time
+import zlib
 
 
 _PAGE_SIZE = 64 * 1024  # NaCl uses 64k page.
@@ -62,6 +127,17 @@ _REGULAR_FILE = 0
 _SYMBOLIC_LINK = 1
 _EMPTY_DIRECTORY = 2
 
+# Constants for the version 2 format, which should be consistent with ones in
+# readonly_fs_reader.cc.
+_IMAGE_MAGIC = 0x41524f46  # 'AROF'
+_FORMAT_VERSION_2 = 2
+_FORMAT_VERSION_3 = 3
+_BLOCK_SIZE = _PAGE_SIZE
+_NO_STRING = 0xffffffff
+_DT_DIR = 4
+_DT_REG = 8
+_DT_LNK = 10
+
 
 def _normalize_path(input_filename):
   """Remove leading dots and adds / if the first character is not /."""
@@ -88,6 +164,144 @@ def _update_metadata(metadata, content, filename, file_size, file_mtime,
     metadata.fromstring(link_target.encode('utf_8') + '\0')
 
 
+class _StringTable(object):
+  """Holds zero terminated strings for the version 2 format."""
+
+  def __init__(self):
+    self._data = array.array('B')
+    self._offsets = {}
+
+  def add(self, string):
+    """Adds |string| if needed and returns its offset in the table."""
+    encoded = string.encode('utf_8')
+    if encoded not in self._offsets:
+      self._offsets[encoded] = self._data.buffer_info()[1]
+      self._data.fromstring(encoded + '\0')
+    return self._offsets[encoded]
+
+  def data(self):
+    return self._data
+
+
+def _split_path(path):
+  """Splits '/path/to/file' into '/path/to/' and 'file'."""
+  index = path.rfind('/')
+  return path[:index + 1], path[index + 1:]
+
+
+def _add_directory(dirs, dirname):
+  """Adds |dirname| (ending with a slash) and its parents to |dirs|."""
+  if dirname in dirs:
+    return
+  dirs[dirname] = {}
+  if dirname == '/':
+    return
+  parent, name = _split_path(dirname[:-1])
+  _add_directory(dirs, parent)
+  dirs[parent][name + '/'] = _DT_DIR
+
+
+def _compress_content(content):
+  """Compresses |content| block by block for the version 3 format.
+
+  Returns a tuple of the block table (a list of offsets) and the compressed
+  content.
+  """
+  block_table = []
+  compressed = array.array('B')
+  data = content.tostring()
+  for offset in xrange(0, len(data), _BLOCK_SIZE):
+    block = data[offset:offset + _BLOCK_SIZE]
+    compressed_block = zlib.compress(block, 9)
+    if len(compressed_block) >= len(block):
+      compressed_block = block  # Store incompressible blocks as is.
+    block_table.append(compressed.buffer_info()[1])
+    compressed.fromstring(compressed_block)
+  block_table.append(compressed.buffer_info()[1])
+  return block_table, compressed
+
+
+def _create_index(files, block_table=None, content_size=0):
+  """Creates the metadata part of the version 2 or 3 image.
+
+  |files| is a list of (path, offset, size, mtime, type, link_target) tuples.
+  |block_table| is the list of compressed block offsets for the version 3
+  format, or None for the version 2 format.
+  """
+  strings = _StringTable()
+  dirs = {}
+  _add_directory(dirs, '/')
+  file_entries = []
+  for path, offset, size, mtime, file_type, link_target in files:
+    if file_type == _EMPTY_DIRECTORY:
+      _add_directory(dirs, path + '/')
+      continue
+    parent, name = _split_path(path)
+    _add_directory(dirs, parent)
+    dirs[parent][name] = _DT_LNK if file_type == _SYMBOLIC_LINK else _DT_REG
+    file_entries.append((path.encode('utf_8'), offset, size, mtime, file_type,
+                         link_target))
+  file_entries.sort(key=lambda entry: entry[0])
+
+  file_table = array.array('B')
+  for path, offset, size, mtime, file_type, link_target in file_entries:
+    link_offset = _NO_STRING
+    if link_target:
+      link_offset = strings.add(link_target)
+    file_table.fromstring(struct.pack('>IIIIII', strings.add(path), offset,
+                                      size, mtime, file_type, link_offset))
+
+  dir_table = array.array('B')
+  children_table = array.array('B')
+  num_children = 0
+  for dirname in sorted(dirs.keys(), key=lambda d: d.encode('utf_8')):
+    children = sorted(dirs[dirname].iteritems(),
+                      key=lambda child: child[0].encode('utf_8'))
+    dir_table.fromstring(struct.pack('>III', strings.add(dirname),
+                                     num_children, len(children)))
+    for name, dirent_type in children:
+      children_table.fromstring(struct.pack('>II', strings.add(name),
+                                            dirent_type))
+    num_children += len(children)
+
+  block_table_data = array.array('B')
+  if block_table is not None:
+    for offset in block_table:
+      block_table_data.fromstring(struct.pack('>I', offset))
+
+  header_size = (13 if block_table is not None else 10) * 4
+  files_offset = header_size
+  dirs_offset = files_offset + file_table.buffer_info()[1]
+  children_offset = dirs_offset + dir_table.buffer_info()[1]
+  block_table_offset = children_offset + children_table.buffer_info()[1]
+  strings_offset = block_table_offset + block_table_data.buffer_info()[1]
+  string_data = strings.data()
+  _pad_array(string_data, 4)
+  content_offset = strings_offset + string_data.buffer_info()[1]
+  if content_offset % _PAGE_SIZE:
+    content_offset += _PAGE_SIZE - (content_offset % _PAGE_SIZE)
+
+  metadata = array.array('B')
+  format_version = (_FORMAT_VERSION_3 if block_table is not None else
+                    _FORMAT_VERSION_2)
+  metadata.fromstring(struct.pack('>IIIIIIIIII', _IMAGE_MAGIC,
+                                  format_version, len(file_entries),
+                                  len(dirs), num_children, files_offset,
+                                  dirs_offset, children_offset, strings_offset,
+                                  content_offset))
+  if block_table is not None:
+    metadata.fromstring(struct.pack('>III', len(block_table) - 1,
+                                    block_table_offset, content_size))
+  metadata.extend(file_table)
+  metadata.extend(dir_table)
+  metadata.extend(children_table)
+  metadata.extend(block_table_data)
+  metadata.extend(string_data)
+  _pad_array(metadata, _PAGE_SIZE)
+  assert metadata.buffer_info()[1] == content_offset
+  return metadata
+
+
 def _update_content(content, filename, size):
   """Adds the content of the |filename| to |content|."""
   with open(filename, 'r') as f:
@@ -159,9 +373,12 @@ def _get_metadata(filename, input_filenames, symlink_map, empty_dirs,
 
 
 def _generate_readonly_image(input_filenames, symlink_map, empty_dirs,
-                             empty_files, verbose, output_filename):
+                             empty_files, format_version, compress, verbose,
+                             output_filename):
   metadata = array.array('B')
   content = array.array('B')
+  # A list of files for the version 2 index.
+  files = []
 
   input_filenames.extend(symlink_map.keys())
   input_filenames.extend(empty_dirs)
@@ -180,12 +397,25 @@ def _generate_readonly_image(input_filenames, symlink_map, empty_dirs,
     if verbose:
       print _format_message(i, num_files, size, mtime, file_type, filename,
                             link_target)
-    _update_metadata(metadata, content, filename, size, mtime, file_type,
-                     link_target)
+    if format_version == _FORMAT_VERSION_2:
+      files.append((_normalize_path(filename), content.buffer_info()[1], size,
+                    int(mtime), file_type, link_target))
+    else:
+      _update_metadata(metadata, content, filename, size, mtime, file_type,
+                       link_target)
     if file_type == _REGULAR_FILE and size > 0:
       _update_content(content, filename, size)
     if i < num_files - 1:
       _pad_array(content, _PAGE_SIZE)
+  if compress:
+    content_size = content.buffer_info()[1]
+    block_table, content = _compress_content(content)
+    if verbose:
+      print 'VERBOSE: Compressed %d bytes into %d bytes (%d blocks)' % (
+          content_size, content.buffer_info()[1], len(block_table) - 1)
+    metadata = _create_index(files, block_table, content_size)
+  elif format_version == _FORMAT_VERSION_2:
+    metadata = _create_index(files)
   _pad_array(metadata, _PAGE_SIZE)
   image = metadata + content
   _write_image(image, output_filename)
@@ -201,6 +431,13 @@ def main(args):
                       required=True, help='List of empty directories.')
   parser.add_argument('-f', '--empty-files', metavar='EMPTY_FILES',
                       required=True, help='List of empty files.')
+  parser.add_argument('--format-version', metavar='VERSION', type=int,
+                      choices=[1, _FORMAT_VERSION_2],
+                      default=_FORMAT_VERSION_2,
+                      help='Version of the image format to generate.')
+  parser.add_argument('--compress', action='store_true',
+                      help='Compress the content of files. Requires the '
+                      'version 2 format, and generates the version 3 format.')
   parser.add_argument('-v', '--verbose', action='store_true',
                       help='Emit verbose output.')
   parser.add_argument(dest='input', metavar='INPUT', nargs='+',
@@ -210,9 +447,13 @@ def main(args):
   empty_dirs = args.empty_dirs.split(',') if args.empty_dirs else []
   empty_files = args.empty_files.split(',') if args.empty_files else []
   symlink_map = dict([x.split(':') for x in args.symlink_map.split(',')])
+  if args.compress and args.format_version != _FORMAT_VERSION_2:
+    parser.error('--compress requires --format-version=%d' %
+                 _FORMAT_VERSION_2)
 
   _generate_readonly_image(args.input, symlink_map, empty_dirs, empty_files,
-                           args.verbose, args.output)
+                           args.format_version, args.compress, args.verbose,
+                           args.output)
   return 0
 
 
@@ -13,6 +13,8 @@ $ mkdir /tmp/test_image
 $ ./src/posix_translation/scripts/create_test_fs_image.py /tmp/test_image
 $ ls -s /tmp/test_image
  384 test_readonly_image.img
+ 384 test_readonly_image_v1.img
+  68 test_readonly_image_compressed.img
 $ ./src/posix_translation/scripts/dump_readonly_fs_image.py \
     /tmp/test_image/test_readonly_image.img
 [file] /test/a.odex 4 bytes at 0x00000000 (page 0, "Sat May 10 11:12:13 2014")
@@ -91,18 +93,26 @@ def main(args):
     pass
   expected_file_size += page_size  # For the metadata at the beginning.
 
-  subprocess.call('%s %s %s -o %s/test_readonly_fs_image.img -s "%s" -d "%s" '
-                  '-f "%s" %s' %
-                  (run_python, py_script, extra_args, outdir,
-                   encoded_symlink_map, encoded_empty_dirs,
-                   encoded_empty_files, ' '.join(files)),
-                  shell=True)
+  # Generate the same image in both the current and the legacy format so that
+  # ReadonlyFsReaderTest can verify the reader is backward compatible.
+  images = [('test_readonly_fs_image.img', ''),
+            ('test_readonly_fs_image_v1.img', '--format-version=1'),
+            ('test_readonly_fs_image_compressed.img', '--compress')]
+  for image, format_args in images:
+    subprocess.call('%s %s %s %s -o %s/%s -s "%s" -d "%s" -f "%s" %s' %
+                    (run_python, py_script, format_args, extra_args, outdir,
+                     image, encoded_symlink_map, encoded_empty_dirs,
+                     encoded_empty_files, ' '.join(files)),
+                    shell=True)
   subprocess.call('rm -rf %s' % workdir, shell=True)
 
-  # Check the output image size. This ensures that empty files don't consume
-  # 64KB pages.
-  file_size = os.path.getsize('%s/test_readonly_fs_image.img' % outdir)
-  assert file_size == expected_file_size
+  # Check the output image sizes. This ensures that empty files don't consume
+  # 64KB pages. The compressed image is much smaller than that.
+  for image, format_args in images:
+    if format_args == '--compress':
+      continue
+    file_size = os.path.getsize('%s/%s' % (outdir, image))
+    assert file_size == expected_file_size
 
   return 0
 
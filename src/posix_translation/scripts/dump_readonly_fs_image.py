@@ -19,6 +19,7 @@ import struct
 import sys
 import time
 import traceback
+import zlib
 
 
 _PAGE_SIZE = 64 * 1024  # NaCl 64bit uses 64k page.
@@ -29,6 +30,13 @@ _REGULAR_FILE = 0
 _SYMBOLIC_LINK = 1
 _EMPTY_DIRECTORY = 2
 
+# Constants for the version 2 format, which should be consistent with ones in
+# create_readonly_fs_image.py.
+_IMAGE_MAGIC = 0x41524f46  # 'AROF'
+_NO_STRING = 0xffffffff
+_FORMAT_VERSION_3 = 3
+_BLOCK_SIZE = 64 * 1024
+
 
 def _read_integer(image, offset):
   # Reads a 4-byte big endian integer from the next word boundary of
@@ -98,6 +106,51 @@ def _find_file(image, num_files, index, dump_filename, verbose):
   return dump_offset, dump_size, dump_mtime
 
 
+def _find_file_v2(image, dump_filename, verbose):
+  # Same as _find_file, but for the version 2 format.
+  (num_files, files_offset, strings_offset, content_offset) = (
+      struct.unpack_from('>I', image, 8)[0],
+      struct.unpack_from('>I', image, 20)[0],
+      struct.unpack_from('>I', image, 32)[0],
+      struct.unpack_from('>I', image, 36)[0])
+  if verbose:
+    print 'VERBOSE: Image contains %d files.' % num_files
+  for i in xrange(num_files):
+    (name_offset, offset, size, mtime, filetype, link_offset) = (
+        struct.unpack_from('>IIIIII', image, files_offset + i * 24))
+    filename, _ = _read_string(image, strings_offset + name_offset)
+    link_target = None
+    if link_offset != _NO_STRING:
+      link_target, _ = _read_string(image, strings_offset + link_offset)
+    if not dump_filename or verbose:
+      print _format_message(offset, size, mtime, filetype, filename,
+                            link_target)
+    if dump_filename == filename:
+      return offset + content_offset, size, mtime
+  return -1, -1, -1
+
+
+def _read_compressed(image, offset, size):
+  # Reads |size| bytes at |offset| of the uncompressed content of the version
+  # 3 image.
+  (num_blocks, block_table_offset, content_size) = struct.unpack_from(
+      '>III', image, 40)
+  content_offset = struct.unpack_from('>I', image, 36)[0]
+  result = ''
+  block = offset / _BLOCK_SIZE
+  while len(result) < size and block < num_blocks:
+    (start, end) = struct.unpack_from('>II', image,
+                                      block_table_offset + block * 4)
+    data = image[content_offset + start:content_offset + end].tostring()
+    if len(data) < min(_BLOCK_SIZE, content_size - block * _BLOCK_SIZE):
+      data = zlib.decompress(data)
+    if not result:
+      data = data[offset % _BLOCK_SIZE:]
+    result += data
+    block += 1
+  return result[:size]
+
+
 def _read_image(image_filename, dump_filename, verbose):
   # Parses the metadata part of image_filename. If dump_filename is None, prints
   # the metadata in human-readable form. If dump_filename is not None, prints
@@ -111,6 +164,22 @@ def _read_image(image_filename, dump_filename, verbose):
       print 'VERBOSE: Image %s opened (size=%d)' % (image_filename, size)
 
     try:
+      if struct.unpack_from('>I', image, 0)[0] == _IMAGE_MAGIC:
+        dump_offset, dump_size, _ = _find_file_v2(image, dump_filename,
+                                                  verbose)
+        if not dump_filename:
+          return
+        if dump_offset == -1:
+          print '%s is not in image' % dump_filename
+          sys.exit(-1)
+        if struct.unpack_from('>I', image, 4)[0] == _FORMAT_VERSION_3:
+          content_offset = struct.unpack_from('>I', image, 36)[0]
+          sys.stdout.write(_read_compressed(
+              image, dump_offset - content_offset, dump_size))
+          return
+        image[dump_offset:dump_offset + dump_size].tofile(sys.stdout)
+        return
+
       index = 0
       num_files, index = _read_integer(image, index)
 
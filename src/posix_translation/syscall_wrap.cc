@@ -20,10 +20,12 @@
 #include "common/export.h"
 
 // Returns >=0 on success, -errno on error.
-extern "C" int __nacl_futex(volatile void* addr,
-                            int op,
-                            int val,
-                            const timespec* timeout);
+extern "C" int __nacl_futex_ex(volatile void* addr,
+                               int op,
+                               int val,
+                               const timespec* timeout,
+                               volatile void* addr2,
+                               int val3);
 
 namespace {
 
@@ -34,25 +36,56 @@ int HandleSyscallGettid() {
 int HandleSyscallFutex(va_list ap) {
   volatile int* addr = va_arg(ap, int*);
   int op = va_arg(ap, int);
-  if (op != FUTEX_WAIT && op != FUTEX_WAIT_PRIVATE &&
-      op != FUTEX_WAKE && op != FUTEX_WAKE_PRIVATE) {
-    ARC_STRACE_REPORT("Unsupported operation: op=%s",
-                      arc::GetFutexOpStr(op).c_str());
-    ALOGE("syscall(__NR_futex) with op=%s is not supported",
-          arc::GetFutexOpStr(op).c_str());
-    errno = ENOSYS;
-    return -1;
+  bool returns_count;
+  // Callers pass only four arguments for FUTEX_WAIT and FUTEX_WAKE, so
+  // |addr2| and |val3| must not be read for them.
+  bool has_addr2_and_val3;
+  switch (op) {
+    case FUTEX_WAIT:
+    case FUTEX_WAIT_PRIVATE:
+      returns_count = false;
+      has_addr2_and_val3 = false;
+      break;
+    case FUTEX_WAKE:
+    case FUTEX_WAKE_PRIVATE:
+      returns_count = true;
+      has_addr2_and_val3 = false;
+      break;
+    case FUTEX_REQUEUE:
+    case FUTEX_REQUEUE_PRIVATE:
+    case FUTEX_CMP_REQUEUE:
+    case FUTEX_CMP_REQUEUE_PRIVATE:
+    case FUTEX_WAKE_OP:
+    case FUTEX_WAKE_OP_PRIVATE:
+      returns_count = true;
+      has_addr2_and_val3 = true;
+      break;
+    default:
+      ARC_STRACE_REPORT("Unsupported operation: op=%s",
+                        arc::GetFutexOpStr(op).c_str());
+      ALOGE("syscall(__NR_futex) with op=%s is not supported",
+            arc::GetFutexOpStr(op).c_str());
+      errno = ENOSYS;
+      return -1;
   }
   int val = va_arg(ap, int);
+  // This is an integer for the requeue and wake-op operations.
   timespec* timeout = va_arg(ap, timespec*);
+  volatile int* addr2 = NULL;
+  int val3 = 0;
+  if (has_addr2_and_val3) {
+    addr2 = va_arg(ap, int*);
+    val3 = va_arg(ap, int);
+  }
 
   // TODO(crbug.com/241955): Stringify |timeout|.
-  ARC_STRACE_REPORT("addr=%p, op=%s, val=%d, timeout=%p",
-                    addr, arc::GetFutexOpStr(op).c_str(), val, timeout);
+  ARC_STRACE_REPORT("addr=%p, op=%s, val=%d, timeout=%p, addr2=%p, val3=%d",
+                    addr, arc::GetFutexOpStr(op).c_str(), val, timeout,
+                    addr2, val3);
 
-  const int result = __nacl_futex(addr, op, val, timeout);
-  if (result >= 0 && (op == FUTEX_WAKE || op == FUTEX_WAKE_PRIVATE))
-    return result;  // woken threads
+  const int result = __nacl_futex_ex(addr, op, val, timeout, addr2, val3);
+  if (result >= 0 && returns_count)
+    return result;  // woken (or requeued) threads
 
   if (result) {
     errno = -result;
@@ -95,6 +95,60 @@ TEST(SyscallWrapTest, QEMU_DISABLED_TestFutexWakePrivate) {
   EXPECT_EQ(0, pthread_join(th, NULL));
 }
 
+static void* WaitForRequeue(void* ftx) {
+  EXPECT_EQ(0, __wrap_syscall(
+      __NR_futex, ftx, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0));
+  return NULL;
+}
+
+TEST(SyscallWrapTest, QEMU_DISABLED_TestFutexCmpRequeue) {
+  int ftx = 0;
+  int ftx2 = 0;
+
+  // The value does not match.
+  errno = 0;
+  EXPECT_EQ(-1, __wrap_syscall(
+      __NR_futex, &ftx, FUTEX_CMP_REQUEUE_PRIVATE, 0, INT_MAX, &ftx2, 1));
+  EXPECT_EQ(EAGAIN, errno);
+
+  pthread_t th;
+  pthread_create(&th, NULL, WaitForRequeue, &ftx);
+  // Move the waiter to |ftx2| without waking it.
+  int moved;
+  do {
+    moved = __wrap_syscall(
+        __NR_futex, &ftx, FUTEX_CMP_REQUEUE_PRIVATE, 0, INT_MAX, &ftx2, 0);
+    EXPECT_LE(0, moved);
+    EXPECT_GE(1, moved);
+  } while (moved == 0);
+  // The waiter is no longer on |ftx|.
+  EXPECT_EQ(0, __wrap_syscall(
+      __NR_futex, &ftx, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0));
+  EXPECT_EQ(1, __wrap_syscall(
+      __NR_futex, &ftx2, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0));
+  EXPECT_EQ(0, pthread_join(th, NULL));
+}
+
+TEST(SyscallWrapTest, QEMU_DISABLED_TestFutexWakeOp) {
+  int ftx = 0;
+  int ftx2 = 1;
+
+  pthread_t th;
+  pthread_create(&th, NULL, WaitForRequeue, &ftx);
+  // Set |ftx2| to 5 and wake a waiter on |ftx|. The waiters on |ftx2| are
+  // woken only if the old value of |ftx2| is 0, which is not the case.
+  int woken;
+  do {
+    woken = __wrap_syscall(
+        __NR_futex, &ftx, FUTEX_WAKE_OP_PRIVATE, 1, 1, &ftx2,
+        FUTEX_OP(FUTEX_OP_SET, 5, FUTEX_OP_CMP_EQ, 0));
+    EXPECT_LE(0, woken);
+    EXPECT_GE(1, woken);
+  } while (woken == 0);
+  EXPECT_EQ(5, ftx2);
+  EXPECT_EQ(0, pthread_join(th, NULL));
+}
+
 TEST(SyscallWrapTest, TestFutexFd) {
   errno = 0;
   EXPECT_EQ(-1, __wrap_syscall(__NR_futex, NULL, FUTEX_FD, 0, NULL, NULL, 0));
@@ -6,6 +6,7 @@
 
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
 #include <string.h>
 
 #include <algorithm>
@@ -98,13 +99,149 @@ class TCPSocket::SocketWrapper
   DISALLOW_COPY_AND_ASSIGN(SocketWrapper);
 };
 
+// Runs the Pepper calls of all TCPSockets, and their completions, on the
+// main thread. Instead of posting a task per call, sockets with pending calls
+// are queued and one main thread task runs all of them with a single
+// acquisition of the filesystem-wise giant mutex, so many busy sockets do not
+// flood the main thread's task queue. Likewise, the completion callbacks only
+// queue their results, and one main thread task handles all the completions
+// queued so far, including the reads they re-issue, with a single
+// acquisition of the mutex.
+//
+// |pending_sockets_| is guarded by the filesystem-wise giant mutex. A socket
+// stays there only while it has pending tasks. |completions_| is only
+// accessed on the main thread, where the completion callbacks run. Both are
+// cleared for a socket when it is closed, so the raw pointers are always
+// valid.
+class TCPSocket::IOReactor {
+ public:
+  static IOReactor* GetInstance() {
+    pthread_once(&s_instance_once_, &CreateInstance);
+    return s_instance_;
+  }
+
+  void AddSocketLocked(TCPSocket* socket) {
+    VirtualFileSystem::GetVirtualFileSystem()->mutex().AssertAcquired();
+    pending_sockets_.push_back(socket);
+    if (wakeup_posted_)
+      return;
+    wakeup_posted_ = true;
+    pp::Module::Get()->core()->CallOnMainThread(
+        0, pp::CompletionCallback(&IOReactor::OnWakeup, this));
+  }
+
+  // Called by the completion callbacks on the main thread, without the
+  // filesystem-wise giant mutex.
+  void AddCompletion(TCPSocket* socket, PendingTask task, int32_t result,
+                     const pp::TCPSocket& accepted_socket) {
+    ALOG_ASSERT(pp::Module::Get()->core()->IsMainThread());
+    completions_.push_back(Completion());
+    Completion* completion = &completions_.back();
+    completion->socket = socket;
+    completion->task = task;
+    completion->result = result;
+    completion->accepted_socket = accepted_socket;
+    if (completion_wakeup_posted_)
+      return;
+    completion_wakeup_posted_ = true;
+    pp::Module::Get()->core()->CallOnMainThread(
+        0, pp::CompletionCallback(&IOReactor::OnCompletionWakeup, this));
+  }
+
+  void RemoveSocketLocked(TCPSocket* socket) {
+    VirtualFileSystem::GetVirtualFileSystem()->mutex().AssertAcquired();
+    ALOG_ASSERT(pp::Module::Get()->core()->IsMainThread());
+    pending_sockets_.erase(
+        std::remove(pending_sockets_.begin(), pending_sockets_.end(), socket),
+        pending_sockets_.end());
+    for (size_t i = 0; i < completions_.size(); ) {
+      if (completions_[i].socket == socket)
+        completions_.erase(completions_.begin() + i);
+      else
+        ++i;
+    }
+  }
+
+  int64_t num_wakeups() const { return num_wakeups_; }
+  int64_t num_sockets() const { return num_sockets_; }
+
+ private:
+  struct Completion {
+    TCPSocket* socket;
+    PendingTask task;
+    int32_t result;
+    // Only for kPendingAccept.
+    pp::TCPSocket accepted_socket;
+  };
+
+  IOReactor()
+      : wakeup_posted_(false), completion_wakeup_posted_(false),
+        num_wakeups_(0), num_sockets_(0) {}
+
+  static void CreateInstance() {
+    // Never deleted to avoid a static destructor.
+    s_instance_ = new IOReactor;
+  }
+
+  static void OnWakeup(void* user_data, int32_t result) {
+    ALOG_ASSERT(result == PP_OK);
+    VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
+    base::AutoLock lock(sys->mutex());
+    IOReactor* self = static_cast<IOReactor*>(user_data);
+    self->wakeup_posted_ = false;
+    // Tasks may queue sockets again, which then wait for the next wakeup.
+    std::vector<TCPSocket*> sockets;
+    sockets.swap(self->pending_sockets_);
+    ++self->num_wakeups_;
+    self->num_sockets_ += sockets.size();
+    for (size_t i = 0; i < sockets.size(); ++i) {
+      TCPSocket* socket = sockets[i];
+      const int tasks = socket->pending_tasks_;
+      socket->pending_tasks_ = 0;
+      socket->RunPendingTasksLocked(tasks);
+    }
+  }
+
+  static void OnCompletionWakeup(void* user_data, int32_t result) {
+    ALOG_ASSERT(result == PP_OK);
+    VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
+    base::AutoLock lock(sys->mutex());
+    IOReactor* self = static_cast<IOReactor*>(user_data);
+    self->completion_wakeup_posted_ = false;
+    std::vector<Completion> completions;
+    completions.swap(self->completions_);
+    ++self->num_wakeups_;
+    self->num_sockets_ += completions.size();
+    for (size_t i = 0; i < completions.size(); ++i) {
+      const Completion& completion = completions[i];
+      completion.socket->RunCompletionLocked(
+          completion.task, completion.result, completion.accepted_socket);
+    }
+  }
+
+  static pthread_once_t s_instance_once_;
+  static IOReactor* s_instance_;
+
+  std::vector<TCPSocket*> pending_sockets_;
+  std::vector<Completion> completions_;
+  bool wakeup_posted_;
+  bool completion_wakeup_posted_;
+  int64_t num_wakeups_;
+  int64_t num_sockets_;
+
+  DISALLOW_COPY_AND_ASSIGN(IOReactor);
+};
+
+pthread_once_t TCPSocket::IOReactor::s_instance_once_ = PTHREAD_ONCE_INIT;
+TCPSocket::IOReactor* TCPSocket::IOReactor::s_instance_ = NULL;
+
 TCPSocket::TCPSocket(int fd, int socket_family, int oflag)
     : SocketStream(socket_family, oflag), fd_(fd), factory_(this),
       socket_(new SocketWrapper(pp::TCPSocket(
           VirtualFileSystem::GetVirtualFileSystem()->instance()))),
       read_buf_(kBufSize), connect_state_(TCP_SOCKET_NEW), eof_(false),
       read_sent_(false), write_sent_(false), connect_error_(0),
-      no_delay_(0) {
+      pending_tasks_(0), no_delay_(0) {
   ALOG_ASSERT(socket_family == AF_INET || socket_family == AF_INET6);
 }
 
@@ -113,7 +250,7 @@ TCPSocket::TCPSocket(const pp::TCPSocket& socket)
       socket_(new SocketWrapper(socket)),
       read_buf_(kBufSize), connect_state_(TCP_SOCKET_NEW), eof_(false),
       read_sent_(false), write_sent_(false), connect_error_(0),
-      no_delay_(0) {
+      pending_tasks_(0), no_delay_(0) {
 }
 
 TCPSocket::~TCPSocket() {
@@ -123,6 +260,7 @@ TCPSocket::~TCPSocket() {
     // happens on error case of accept().
     CloseLocked();
   }
+  ALOG_ASSERT(!pending_tasks_);
 }
 
 void TCPSocket::MarkAsErrorLocked(int error) {
@@ -222,8 +360,7 @@ int TCPSocket::listen(int backlog) {
 
   // The listen() has actually been started. So, start "accept" as a background
   // task to support non-blocking ::accept().
-  pp::Module::Get()->core()->CallOnMainThread(
-      0, factory_.NewCallback(&TCPSocket::Accept));
+  PostTaskLocked(kPendingAccept);
   return 0;
 }
 
@@ -267,8 +404,7 @@ int TCPSocket::accept(sockaddr* addr, socklen_t* addrlen) {
 
   pp::TCPSocket accepted_socket = accepted_socket_;
   accepted_socket_ = pp::TCPSocket();
-  pp::Module::Get()->core()->CallOnMainThread(
-      0, factory_.NewCallback(&TCPSocket::Accept));
+  PostTaskLocked(kPendingAccept);
 
   // Before creating TCPSocket instance, extract the address to check an error.
   sockaddr_storage storage = {};
@@ -330,8 +466,8 @@ int TCPSocket::connect(const sockaddr* serv_addr, socklen_t addrlen) {
           address.DescribeAsString(true).AsString().c_str());
 
     connect_state_ = TCP_SOCKET_CONNECTING;
-    pp::Module::Get()->core()->CallOnMainThread(
-        0, factory_.NewCallback(&TCPSocket::Connect, address));
+    connect_address_ = address;
+    PostTaskLocked(kPendingConnect);
     if (!is_block()) {
       errno = EINPROGRESS;
       return -1;
@@ -486,10 +622,8 @@ ssize_t TCPSocket::send(const void* buf, size_t len, int flags) {
     out_buf_.insert(out_buf_.end(),
                     reinterpret_cast<const char*>(buf),
                     reinterpret_cast<const char*>(buf) + len);
-    if (!write_sent_) {
-      pp::Module::Get()->core()->CallOnMainThread(
-          0, factory_.NewCallback(&TCPSocket::Write));
-    }
+    if (!write_sent_)
+      PostTaskLocked(kPendingWrite);
     return len;
   }
 
@@ -735,49 +869,105 @@ void TCPSocket::PostReadTaskLocked() {
   }
   read_sent_ = true;
   if (!pp::Module::Get()->core()->IsMainThread()) {
-    pp::Module::Get()->core()->CallOnMainThread(
-        0, factory_.NewCallback(&TCPSocket::Read));
+    PostTaskLocked(kPendingRead);
   } else {
     // If on main Pepper thread call it directly.
     ReadLocked();
   }
 }
 
-void TCPSocket::Accept(int32_t result) {
-  ALOG_ASSERT(result == PP_OK);
+void TCPSocket::PostTaskLocked(PendingTask task) {
+  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
+  sys->mutex().AssertAcquired();
+  if (socket_->is_closed())
+    return;  // Close() has cancelled all tasks.
+  const bool is_queued = pending_tasks_ != 0;
+  pending_tasks_ |= task;
+  if (!is_queued)
+    IOReactor::GetInstance()->AddSocketLocked(this);
+}
+
+void TCPSocket::RunPendingTasksLocked(int tasks) {
+  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
+  sys->mutex().AssertAcquired();
+  if (tasks & kPendingAccept)
+    AcceptLocked();
+  if (tasks & kPendingConnect)
+    ConnectLocked();
+  if (tasks & kPendingRead)
+    ReadLocked();
+  if ((tasks & kPendingWrite) && !write_sent_)
+    WriteLocked();
+}
+
+void TCPSocket::RunCompletionLocked(PendingTask task, int32_t result,
+                                    const pp::TCPSocket& accepted_socket) {
+  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
+  sys->mutex().AssertAcquired();
+  switch (task) {
+    case kPendingAccept:
+      OnAcceptLocked(result, accepted_socket);
+      break;
+    case kPendingConnect:
+      OnConnectLocked(result);
+      break;
+    case kPendingRead:
+      OnReadLocked(result);
+      break;
+    case kPendingWrite:
+      OnWriteLocked(result);
+      break;
+  }
+}
+
+void TCPSocket::GetIOReactorStatsForTesting(int64_t* out_wakeups,
+                                            int64_t* out_sockets) {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
   base::AutoLock lock(sys->mutex());
+  IOReactor* reactor = IOReactor::GetInstance();
+  *out_wakeups = reactor->num_wakeups();
+  *out_sockets = reactor->num_sockets();
+}
 
+void TCPSocket::AcceptLocked() {
   int32_t pp_error = socket_->socket()->Accept(
       factory_.NewCallbackWithOutput(&TCPSocket::OnAccept));
   ALOG_ASSERT(pp_error == PP_OK_COMPLETIONPENDING);
 }
 
 void TCPSocket::OnAccept(int32_t result, const pp::TCPSocket& accepted_socket) {
+  IOReactor::GetInstance()->AddCompletion(
+      this, kPendingAccept, result, accepted_socket);
+}
+
+void TCPSocket::OnAcceptLocked(int32_t result,
+                               const pp::TCPSocket& accepted_socket) {
   // TODO(crbug.com/364744): Handle error cases.
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
+  sys->mutex().AssertAcquired();
   ALOG_ASSERT(accepted_socket_.is_null());
   accepted_socket_ = accepted_socket;
   sys->Broadcast();
   NotifyListeners();
 }
 
-void TCPSocket::Connect(int32_t result, const pp::NetAddress& address) {
-  ALOG_ASSERT(result == PP_OK);
-  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
+void TCPSocket::ConnectLocked() {
   // A closed socket means we are in destructor. On the other hand,
   // error should not happen in connect.
   ALOG_ASSERT(connect_state_ == TCP_SOCKET_CONNECTING);
   int32_t pp_error = socket_->socket()->Connect(
-      address, factory_.NewCallback(&TCPSocket::OnConnect));
+      connect_address_, factory_.NewCallback(&TCPSocket::OnConnect));
   ALOG_ASSERT(pp_error == PP_OK_COMPLETIONPENDING);
 }
 
 void TCPSocket::OnConnect(int32_t result) {
+  IOReactor::GetInstance()->AddCompletion(
+      this, kPendingConnect, result, pp::TCPSocket());
+}
+
+void TCPSocket::OnConnectLocked(int32_t result) {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
+  sys->mutex().AssertAcquired();
   // A closed socket means we are in destructor. On the other hand,
   // error should not happen in connect.
   ALOG_ASSERT(connect_state_ == TCP_SOCKET_CONNECTING);
@@ -791,13 +981,6 @@ void TCPSocket::OnConnect(int32_t result) {
   sys->Broadcast();
 }
 
-void TCPSocket::Read(int32_t result) {
-  ALOG_ASSERT(result == PP_OK);
-  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
-  ReadLocked();
-}
-
 void TCPSocket::ReadLocked() {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
   sys->mutex().AssertAcquired();
@@ -808,14 +991,19 @@ void TCPSocket::ReadLocked() {
     return;
   }
 
+  // Do not read more than |in_buf_| can take so that a slow reader pushes
+  // back on the peer instead of growing the buffer.
+  ALOG_ASSERT(in_buf_.size() < kBufSize);
+  const size_t size = std::min(read_buf_.size(), kBufSize - in_buf_.size());
   pp::CompletionCallback callback = factory_.NewCallback(&TCPSocket::OnRead);
   int32_t pp_error = socket_->socket()->Read(
-      &read_buf_[0], read_buf_.size(),
+      &read_buf_[0], size,
       callback);
   if (pp_error >= 0) {
     // This usually only happens on tests. We need to cancel the original
     // callback to avoid leaks, and to use OnReadLocked instead of OnRead in
-    // order to avoid re-acquiring sys->mutex() and crashing.
+    // order to handle the result without waiting for the next IOReactor
+    // wakeup.
     callback.Run(PP_ERROR_USERCANCEL);
     OnReadLocked(pp_error);
   } else {
@@ -829,9 +1017,8 @@ void TCPSocket::OnRead(int32_t result) {
     // on the same thread that requested the read.
     return;
   }
-  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
-  OnReadLocked(result);
+  IOReactor::GetInstance()->AddCompletion(
+      this, kPendingRead, result, pp::TCPSocket());
 }
 
 void TCPSocket::OnReadLocked(int32_t result) {
@@ -858,14 +1045,6 @@ void TCPSocket::OnReadLocked(int32_t result) {
   sys->Broadcast();
 }
 
-void TCPSocket::Write(int32_t result) {
-  VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
-  if (!write_sent_) {
-    WriteLocked();
-  }
-}
-
 void TCPSocket::WriteLocked() {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
   sys->mutex().AssertAcquired();
@@ -895,8 +1074,13 @@ void TCPSocket::WriteLocked() {
 }
 
 void TCPSocket::OnWrite(int32_t result) {
+  IOReactor::GetInstance()->AddCompletion(
+      this, kPendingWrite, result, pp::TCPSocket());
+}
+
+void TCPSocket::OnWriteLocked(int32_t result) {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  base::AutoLock lock(sys->mutex());
+  sys->mutex().AssertAcquired();
 
   write_sent_ = false;
   if (IsTerminated()) {
@@ -922,9 +1106,10 @@ void TCPSocket::OnWrite(int32_t result) {
 
 void TCPSocket::CloseLocked() {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
-  // Wait for write operations to complete
+  // Wait for write operations, including queued ones, to complete
   // TODO(crbug.com/351755): Refactor code so that close can't hang for ever.
-  while (write_sent_ && is_connected()) {
+  while ((write_sent_ || (pending_tasks_ & kPendingWrite)) &&
+         is_connected()) {
     sys->Wait();
   }
 
@@ -943,6 +1128,9 @@ void TCPSocket::Close(int32_t result, int32_t* pres) {
   VirtualFileSystem* sys = VirtualFileSystem::GetVirtualFileSystem();
   base::AutoLock lock(sys->mutex());
   factory_.CancelAll();
+  // Also drop the completions which are queued but not run yet.
+  IOReactor::GetInstance()->RemoveSocketLocked(this);
+  pending_tasks_ = 0;
   socket_->Close();
   *pres = PP_OK;
   // Don't access any member variable after sys->Browadcast() is called.
@@ -15,13 +15,10 @@
 #include "base/memory/scoped_ptr.h"
 #include "posix_translation/socket_stream.h"
 #include "ppapi/cpp/completion_callback.h"
+#include "ppapi/cpp/net_address.h"
 #include "ppapi/cpp/tcp_socket.h"
 #include "ppapi/utility/completion_callback_factory.h"
 
-namespace pp {
-class NetAddress;
-}  // namespace pp
-
 namespace posix_translation {
 
 class TCPSocket : public SocketStream {
@@ -70,6 +67,7 @@ class TCPSocket : public SocketStream {
   friend class PepperTCPSocketTest;
 
   class SocketWrapper;
+  class IOReactor;
 
   enum ConnectState {
     TCP_SOCKET_NEW,
@@ -79,6 +77,14 @@ class TCPSocket : public SocketStream {
     TCP_SOCKET_ERROR,
   };
 
+  // Pepper calls waiting for the next IOReactor wakeup on the main thread.
+  enum PendingTask {
+    kPendingAccept = 1 << 0,
+    kPendingConnect = 1 << 1,
+    kPendingRead = 1 << 2,
+    kPendingWrite = 1 << 3,
+  };
+
   // This is a constructor to create a TCPSocket for accepting a connection.
   // TODO(hidehiko): Unify this overloaded constructor with the one declared
   // as public above.
@@ -97,25 +103,39 @@ class TCPSocket : public SocketStream {
   void MarkAsErrorLocked(int error);
 
   void PostReadTaskLocked();
-
-  void Accept(int32_t result);
+  // Queues |task| to be run on the main thread by IOReactor.
+  void PostTaskLocked(PendingTask task);
+  // Called by IOReactor on the main thread with the pending tasks.
+  void RunPendingTasksLocked(int tasks);
+  // Called by IOReactor on the main thread with the result of the Pepper
+  // call for |task|, which the On*() callbacks below queued.
+  void RunCompletionLocked(PendingTask task, int32_t result,
+                           const pp::TCPSocket& accepted_socket);
+
+  void AcceptLocked();
   void OnAccept(int32_t result, const pp::TCPSocket& socket);
+  void OnAcceptLocked(int32_t result, const pp::TCPSocket& socket);
 
-  void Connect(int32_t result, const pp::NetAddress& address);
+  void ConnectLocked();
   void OnConnect(int32_t result);
+  void OnConnectLocked(int32_t result);
 
-  void Read(int32_t result);
   void ReadLocked();
   void OnRead(int32_t result);
   void OnReadLocked(int32_t result);
 
-  void Write(int32_t result);
   void WriteLocked();
   void OnWrite(int32_t result);
+  void OnWriteLocked(int32_t result);
 
   void CloseLocked();
   void Close(int32_t result, int32_t* pres);
 
+  // Returns the number of IOReactor wakeups, and the number of sockets and
+  // completions they ran tasks for, so far.
+  static void GetIOReactorStatsForTesting(int64_t* out_wakeups,
+                                          int64_t* out_sockets);
+
   static const size_t kBufSize = 64 * 1024;
 
   int fd_;
@@ -131,6 +151,10 @@ class TCPSocket : public SocketStream {
   bool read_sent_;
   bool write_sent_;
   int connect_error_;
+  // Bitmask of PendingTask.
+  int pending_tasks_;
+  // The address for the pending kPendingConnect task.
+  pp::NetAddress connect_address_;
 
   // The socket accepted on background, which will be returned when accept()
   // is called.
@@ -73,6 +73,8 @@ class PepperTCPSocketTest
   // functions so run them in a real ARM device.
   DECLARE_BACKGROUND_TEST(QEMU_DISABLED_NonBlockingConnectSuccess);
   DECLARE_BACKGROUND_TEST(QEMU_DISABLED_NonBlockingConnectFail);
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_BatchedConnect);
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_ReadManyConnections);
 
  protected:
   static const PP_Resource kTCPSocketResource = 74;
@@ -120,6 +122,42 @@ class PepperTCPSocketTest
     return 0;
   }
 
+  // Fills the whole buffer as if the peer sends data without pause. Like the
+  // real Pepper, the completion callback runs later on the main thread.
+  int32_t OnReadFull(PP_Resource tcp_socket, char* buffer, int32_t len,
+                     PP_CompletionCallback callback) {
+    memset(buffer, 'x', len);
+    bg_.CallOnMainThread(0, callback, len);
+    return PP_OK_COMPLETIONPENDING;
+  }
+
+  // Expects |num_sockets| sockets to be created and connected successfully.
+  // Their first reads are kept pending.
+  void ExpectConnectSuccessForSockets(int num_sockets) {
+    EXPECT_CALL(*ppb_tcpsocket_, Create(kInstanceNumber)).
+        Times(num_sockets).
+        WillRepeatedly(Return(kTCPSocketResource));
+    EXPECT_CALL(*ppb_tcpsocket_, Connect(kTCPSocketResource, _, _)).
+        Times(num_sockets).
+        WillRepeatedly(WithArgs<2>(
+            Invoke(&default_executor_,
+                   &CompletionCallbackExecutor::ExecuteOnMainThread)));
+    EXPECT_CALL(*ppb_tcpsocket_, Read(kTCPSocketResource, _, _, _)).
+        Times(num_sockets).
+        WillRepeatedly(DoAll(
+            WithArgs<3>(
+                Invoke(this, &PepperTCPSocketTest::AddPendingCallback)),
+            Return(static_cast<int32_t>(PP_OK_COMPLETIONPENDING))));
+  }
+
+  // Waits until the tasks posted to the main thread so far have run.
+  void WaitForMainThread() {
+    base::WaitableEvent event(true, false);
+    bg_.CallOnMainThread(
+        0, PP_MakeCompletionCallback(&SignalEvent, &event), 0);
+    event.Wait();
+  }
+
   void ExpectTCPSocketInstance() {
     // Create and release.
     EXPECT_CALL(*ppb_tcpsocket_, Create(kInstanceNumber)).
@@ -374,6 +412,10 @@ TEST_BACKGROUND_F(PepperTCPSocketTest,
       0, PP_MakeCompletionCallback(&SignalEvent, &event2), 0);
   event1.Signal();
   event2.Wait();
+  // The connect completion callback is posted after |event2|, and queues
+  // another task which handles it.
+  WaitForMainThread();
+  WaitForMainThread();
 
   // Here, the connection is established. So, now it should be writable.
   ExpectPollEvent(sockfd, POLLOUT, 0);
@@ -417,6 +459,10 @@ TEST_BACKGROUND_F(PepperTCPSocketTest,
       0, PP_MakeCompletionCallback(&SignalEvent, &event2), 0);
   event1.Signal();
   event2.Wait();
+  // The connect completion callback is posted after |event2|, and queues
+  // another task which handles it.
+  WaitForMainThread();
+  WaitForMainThread();
 
   // On error, all POLLIN, POLLOUT and POLLERR are raised.
   ExpectPollEvent(sockfd, POLLIN | POLLOUT | POLLERR, 0);
@@ -426,4 +472,94 @@ TEST_BACKGROUND_F(PepperTCPSocketTest,
   EXPECT_EQ(0, file_system_->close(sockfd));
 }
 
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST_BACKGROUND_F(PepperTCPSocketTest, QEMU_DISABLED_BatchedConnect) {
+  static const int kNumSockets = 8;
+  ExpectConnectSuccessForSockets(kNumSockets);
+
+  int sockfds[kNumSockets];
+  for (int i = 0; i < kNumSockets; ++i) {
+    sockfds[i] = file_system_->socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(-1, sockfds[i]);
+    ASSERT_EQ(0, set_non_block(sockfds[i]));
+  }
+
+  // Block the main thread while all connects are queued.
+  base::WaitableEvent event(true, false);
+  bg_.CallOnMainThread(
+      0, PP_MakeCompletionCallback(&WaitEvent, &event), 0);
+  int64_t wakeups_before;
+  int64_t sockets_before;
+  TCPSocket::GetIOReactorStatsForTesting(&wakeups_before, &sockets_before);
+  for (int i = 0; i < kNumSockets; ++i)
+    EXPECT_ERROR(EINPROGRESS, connect(sockfds[i]));
+
+  // One main thread task issues all the connects. The completion callbacks
+  // are posted after it, and queue a task which handles all of them after
+  // themselves, so wait three times.
+  event.Signal();
+  WaitForMainThread();
+  WaitForMainThread();
+  WaitForMainThread();
+  int64_t wakeups_after;
+  int64_t sockets_after;
+  TCPSocket::GetIOReactorStatsForTesting(&wakeups_after, &sockets_after);
+  EXPECT_EQ(wakeups_before + 2, wakeups_after);
+  EXPECT_EQ(sockets_before + 2 * kNumSockets, sockets_after);
+
+  for (int i = 0; i < kNumSockets; ++i) {
+    ExpectPollEvent(sockfds[i], POLLOUT, 0);
+    EXPECT_EQ(0, file_system_->close(sockfds[i]));
+  }
+}
+
+// TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+// functions so run them in a real ARM device.
+TEST_BACKGROUND_F(PepperTCPSocketTest, QEMU_DISABLED_ReadManyConnections) {
+  static const int kNumSockets = 8;
+  static const int kRounds = 10;
+  static const size_t kChunkSize = 1024;
+  EXPECT_CALL(*ppb_tcpsocket_, Create(kInstanceNumber)).
+      Times(kNumSockets).
+      WillRepeatedly(Return(kTCPSocketResource));
+  EXPECT_CALL(*ppb_tcpsocket_, Connect(kTCPSocketResource, _, _)).
+      Times(kNumSockets).
+      WillRepeatedly(WithArgs<2>(
+          Invoke(&default_executor_,
+                 &CompletionCallbackExecutor::ExecuteOnMainThread)));
+  ON_CALL(*ppb_tcpsocket_, Read(kTCPSocketResource, _, _, _)).
+      WillByDefault(Invoke(this, &PepperTCPSocketTest::OnReadFull));
+
+  int sockfds[kNumSockets];
+  for (int i = 0; i < kNumSockets; ++i) {
+    sockfds[i] = file_system_->socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(-1, sockfds[i]);
+    ASSERT_EQ(0, connect(sockfds[i]));
+  }
+
+  int64_t wakeups_before;
+  int64_t sockets_before;
+  TCPSocket::GetIOReactorStatsForTesting(&wakeups_before, &sockets_before);
+  std::vector<char> buf(kChunkSize);
+  for (int round = 0; round < kRounds; ++round) {
+    for (int i = 0; i < kNumSockets; ++i) {
+      ASSERT_EQ(static_cast<ssize_t>(kChunkSize),
+                recv(sockfds[i], &buf[0], kChunkSize, 0));
+      EXPECT_EQ(kChunkSize,
+                static_cast<size_t>(std::count(buf.begin(), buf.end(), 'x')));
+    }
+  }
+  // The read completions are delivered through the reactor, which handles
+  // at least one socket per wakeup.
+  int64_t wakeups_after;
+  int64_t sockets_after;
+  TCPSocket::GetIOReactorStatsForTesting(&wakeups_after, &sockets_after);
+  EXPECT_LT(wakeups_before, wakeups_after);
+  EXPECT_LE(wakeups_after - wakeups_before, sockets_after - sockets_before);
+
+  for (int i = 0; i < kNumSockets; ++i)
+    EXPECT_EQ(0, file_system_->close(sockfds[i]));
+}
+
 }  // namespace posix_translation
@@ -5,6 +5,7 @@
 #include "posix_translation/virtual_file_system.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <netdb.h>
 #include <pthread.h>
@@ -41,6 +42,7 @@
 #include "posix_translation/directory_file_stream.h"
 #include "posix_translation/epoll_stream.h"
 #include "posix_translation/fd_to_file_stream_map.h"
+#include "posix_translation/io_stats.h"
 #include "posix_translation/local_socket.h"
 #include "posix_translation/memory_region.h"
 #include "posix_translation/mount_point_manager.h"
@@ -75,6 +77,10 @@ const char kVirtualFileSystemHandlerStr[] ALLOW_UNUSED = "VirtualFileSystem";
 
 const int kPreopenPendingFd = -2;
 
+// The size of the temporary buffer for sendfile() and splice() when the
+// source stream does not have its content in memory.
+const size_t kTransferChunkSize = 64 * 1024;
+
 void FillPermissionInfoToStat(const PermissionInfo& permission,
                               struct stat* out) {
   // Files created by apps should not allow other users to read them.
@@ -113,6 +119,57 @@ bool IsEligibleForPreopen(int oflag) {
   return (oflag & ~(O_LARGEFILE | O_CLOEXEC)) == 0;
 }
 
+// A condition variable for a blocking poll() or select() call. It is
+// registered to all the streams the call waits for, so that it is signaled
+// only when one of them changes its state, rather than whenever any stream in
+// the process calls VirtualFileSystem::Broadcast(). If any of the streams
+// does not support listeners, this falls back to the global condition
+// variable.
+class PollWaiter {
+ public:
+  PollWaiter(base::Lock* mutex, base::ConditionVariable* global_cond)
+      : cond_(mutex), global_cond_(global_cond), use_global_cond_(false) {
+  }
+
+  ~PollWaiter() {
+    RemoveFromStreams();
+  }
+
+  // Registers the waiter to |stream|. NULL is ignored.
+  void AddStream(scoped_refptr<FileStream> stream) {
+    if (use_global_cond_ || !stream)
+      return;
+    if (!stream->AddPollWaiter(&cond_)) {
+      ARC_STRACE_REPORT("Falling back to the global condition variable for "
+                        "%s", stream->GetStreamType());
+      RemoveFromStreams();
+      use_global_cond_ = true;
+      return;
+    }
+    streams_.push_back(stream);
+  }
+
+  // Returns true if it is timed out. See VirtualFileSystem::WaitUntil().
+  bool WaitUntil(const base::TimeTicks& time_limit) {
+    return internal::WaitUntil(use_global_cond_ ? global_cond_ : &cond_,
+                               time_limit);
+  }
+
+ private:
+  void RemoveFromStreams() {
+    for (size_t i = 0; i < streams_.size(); ++i)
+      streams_[i]->RemovePollWaiter(&cond_);
+    streams_.clear();
+  }
+
+  base::ConditionVariable cond_;
+  base::ConditionVariable* global_cond_;
+  bool use_global_cond_;
+  std::vector<scoped_refptr<FileStream> > streams_;
+
+  DISALLOW_COPY_AND_ASSIGN(PollWaiter);
+};
+
 // The current VirtualFileSystemInterface exposed to plugins via
 // GetVirtualFileSystemInterface().
 VirtualFileSystemInterface* g_current_file_system = NULL;
@@ -256,7 +313,7 @@ ino_t VirtualFileSystem::GetInodeUncheckedLocked(const std::string& path) {
                       static_cast<int64_t>(next_inode_), path.c_str());
   inodes_[path] = next_inode_;
   // Note: Do not try to reuse returned inode numbers. Doing this would
-  // break MemoryRegion::IsWriteMapped().
+  // break MemoryRegion::IsCurrentlyMapped().
   return next_inode_++;
 }
 
@@ -300,7 +357,8 @@ std::string VirtualFileSystem::GetMemoryMapAsStringLocked() {
 std::string VirtualFileSystem::GetIPCStatsAsString() {
 #if defined(DEBUG_POSIX_TRANSLATION)
   base::AutoLock lock(mutex_);
-  return ipc_stats::GetIPCStatsAsStringLocked();
+  return ipc_stats::GetIPCStatsAsStringLocked() + ", " +
+      host_resolver_.GetCacheStatsAsString();
 #else
   return "unknown";
 #endif
@@ -311,17 +369,15 @@ int VirtualFileSystem::StatForTesting(
   return stat(pathname, out);
 }
 
+bool VirtualFileSystem::IsWriteMappedLocked(void* addr, size_t length) {
+  mutex_.AssertAcquired();
+  return memory_region_->IsWriteMappedByAddr(addr, length);
+}
+
 bool VirtualFileSystem::IsMemoryRangeAvailableLocked(void* addr,
                                                      size_t length) {
   mutex_.AssertAcquired();
-  if (!memory_region_->AddFileStreamByAddr(
-          addr, length, kBadInode, PROT_NONE, 0, NULL)) {
-    return false;
-  }
-  const int result =
-      memory_region_->RemoveFileStreamsByAddr(addr, length, true);
-  ALOG_ASSERT(!result);
-  return true;
+  return memory_region_->IsMemoryRangeAvailable(addr, length);
 }
 
 int VirtualFileSystem::AddFileStreamLocked(scoped_refptr<FileStream> stream) {
@@ -414,8 +470,7 @@ void* VirtualFileSystem::mmap(void* addr, size_t length, int prot, int flags,
     memory_region_->RemoveFileStreamsByAddr(addr, length, false);
 
   bool result = memory_region_->AddFileStreamByAddr(
-      new_addr, length, offset /* for printing debug info */, prot, flags,
-      stream);
+      new_addr, length, offset, prot, flags, stream);
   if (!result) {
     if (flags & MAP_FIXED) {
       ALOG_ASSERT(!abort_on_unexpected_memory_maps_,
@@ -546,19 +601,61 @@ ssize_t VirtualFileSystem::read(int fd, void* buf, size_t count) {
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
   scoped_refptr<FileStream> stream = fd_to_stream_->GetStream(fd);
-  if (stream)
-    return stream->read(buf, count);
+  if (stream) {
+    const int64_t start_time = IOStats::GetStartTime();
+    const ssize_t result = stream->read(buf, count);
+    IOStats::Record(stream->GetIOStatsSlot(), IOStats::kRead, result,
+                    start_time);
+    return result;
+  }
   errno = EBADF;
   return -1;
 }
 
+bool VirtualFileSystem::TryLockFreeRead(int fd, void* buf, size_t count,
+                                        ssize_t* out_result) {
+  IOStats::Slot* io_stats_slot = NULL;
+  const FileStream::LockFreeOps* ops =
+      fd_to_stream_->GetLockFreeOps(fd, &io_stats_slot);
+  if (!ops || !ops->read)
+    return false;
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = ops->read(buf, count);
+  if (result < 0)
+    return false;
+  IOStats::Record(io_stats_slot, IOStats::kRead, result, start_time);
+  *out_result = result;
+  return true;
+}
+
+bool VirtualFileSystem::TryLockFreeWrite(int fd, const void* buf, size_t count,
+                                         ssize_t* out_result) {
+  IOStats::Slot* io_stats_slot = NULL;
+  const FileStream::LockFreeOps* ops =
+      fd_to_stream_->GetLockFreeOps(fd, &io_stats_slot);
+  if (!ops || !ops->write)
+    return false;
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = ops->write(buf, count);
+  if (result < 0)
+    return false;
+  IOStats::Record(io_stats_slot, IOStats::kWrite, result, start_time);
+  *out_result = result;
+  return true;
+}
+
 ssize_t VirtualFileSystem::write(int fd, const void* buf, size_t count) {
   base::AutoLock lock(mutex_);
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
   scoped_refptr<FileStream> stream = fd_to_stream_->GetStream(fd);
-  if (stream)
-    return stream->write(buf, count);
+  if (stream) {
+    const int64_t start_time = IOStats::GetStartTime();
+    const ssize_t result = stream->write(buf, count);
+    IOStats::Record(stream->GetIOStatsSlot(), IOStats::kWrite, result,
+                    start_time);
+    return result;
+  }
   errno = EBADF;
   return -1;
 }
@@ -611,8 +708,13 @@ int VirtualFileSystem::readv(int fd, const struct iovec* iov, int count) {
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
   scoped_refptr<FileStream> stream = fd_to_stream_->GetStream(fd);
-  if (stream)
-    return stream->readv(iov, count);
+  if (stream) {
+    const int64_t start_time = IOStats::GetStartTime();
+    const ssize_t result = stream->readv(iov, count);
+    IOStats::Record(stream->GetIOStatsSlot(), IOStats::kRead, result,
+                    start_time);
+    return result;
+  }
   errno = EBADF;
   return -1;
 }
@@ -653,8 +755,13 @@ int VirtualFileSystem::writev(int fd, const struct iovec* iov, int count) {
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
   scoped_refptr<FileStream> stream = fd_to_stream_->GetStream(fd);
-  if (stream)
-    return stream->writev(iov, count);
+  if (stream) {
+    const int64_t start_time = IOStats::GetStartTime();
+    const ssize_t result = stream->writev(iov, count);
+    IOStats::Record(stream->GetIOStatsSlot(), IOStats::kWrite, result,
+                    start_time);
+    return result;
+  }
   errno = EBADF;
   return -1;
 }
@@ -757,11 +864,14 @@ int VirtualFileSystem::poll(struct pollfd* fds, nfds_t nfds, int timeout) {
   base::AutoLock lock(mutex_);
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
-  if (timeout != 0) {
+  if (timeout != 0 && !IsPollReadyLocked(fds, nfds, false)) {
     const base::TimeTicks time_limit =  internal::TimeOutToTimeLimit(
         base::TimeDelta::FromMilliseconds(std::max(0, timeout)));
+    PollWaiter waiter(&mutex_, &cond_);
+    for (nfds_t i = 0; i < nfds; ++i)
+      waiter.AddStream(fd_to_stream_->GetStream(fds[i].fd));
     while (!IsPollReadyLocked(fds, nfds, false)) {
-      if (WaitUntil(time_limit)) {
+      if (waiter.WaitUntil(time_limit)) {
         // timedout, or spurious wakeup, or real wakeup. Either way, we can
         // just break since |timeout| has expired.
         break;
@@ -778,8 +888,13 @@ ssize_t VirtualFileSystem::pread(int fd, void* buf, size_t count,
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
   scoped_refptr<FileStream> stream = fd_to_stream_->GetStream(fd);
-  if (stream)
-    return stream->pread(buf, count, offset);
+  if (stream) {
+    const int64_t start_time = IOStats::GetStartTime();
+    const ssize_t result = stream->pread(buf, count, offset);
+    IOStats::Record(stream->GetIOStatsSlot(), IOStats::kRead, result,
+                    start_time);
+    return result;
+  }
   errno = EBADF;
   return -1;
 }
@@ -790,8 +905,13 @@ ssize_t VirtualFileSystem::pwrite(int fd, const void* buf, size_t count,
   ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
 
   scoped_refptr<FileStream> stream = fd_to_stream_->GetStream(fd);
-  if (stream)
-    return stream->pwrite(buf, count, offset);
+  if (stream) {
+    const int64_t start_time = IOStats::GetStartTime();
+    const ssize_t result = stream->pwrite(buf, count, offset);
+    IOStats::Record(stream->GetIOStatsSlot(), IOStats::kWrite, result,
+                    start_time);
+    return result;
+  }
   errno = EBADF;
   return -1;
 }
@@ -1260,6 +1380,7 @@ int VirtualFileSystem::OpenLocked(
     return -1;
   }
   stream->set_permission(permission);
+  stream->SetIOStatsHandlerName(handler->name());
   fd_to_stream_->AddFileStream(fd, stream);
   if (!IsEligibleForPreopen(oflag)) {
     // We must invalidate the preopen cache when a file is opened with
@@ -1337,13 +1458,21 @@ int VirtualFileSystem::select(int nfds, fd_set* readfds, fd_set* writefds,
     const base::TimeTicks time_limit = timeout ?
         internal::TimeOutToTimeLimit(internal::TimeValToTimeDelta(*timeout)) :
         base::TimeTicks();
+    PollWaiter waiter(&mutex_, &cond_);
+    for (int i = 0; i < nfds; ++i) {
+      if ((readfds && FD_ISSET(i, readfds)) ||
+          (writefds && FD_ISSET(i, writefds)) ||
+          (exceptfds && FD_ISSET(i, exceptfds))) {
+        waiter.AddStream(fd_to_stream_->GetStream(i));
+      }
+    }
     while (!(IsSelectReadyLocked(
                  nfds, readfds, SELECT_READY_READ, false) ||
              IsSelectReadyLocked(
                  nfds, writefds, SELECT_READY_WRITE, false) ||
              IsSelectReadyLocked(
                  nfds, exceptfds, SELECT_READY_EXCEPTION, false))) {
-      if (WaitUntil(time_limit)) {
+      if (waiter.WaitUntil(time_limit)) {
         // timedout, or spurious wakeup, or real wakeup. Either way, we can
         // just break since |timeout| has expired.
         break;
@@ -1514,6 +1643,133 @@ int VirtualFileSystem::socketpair(int socket_family, int socket_type,
   return 0;
 }
 
+ssize_t VirtualFileSystem::splice(int fd_in, off64_t* off_in, int fd_out,
+                                  off64_t* off_out, size_t len,
+                                  unsigned int flags) {
+  base::AutoLock lock(mutex_);
+  ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
+
+  scoped_refptr<FileStream> in = fd_to_stream_->GetStream(fd_in);
+  scoped_refptr<FileStream> out = fd_to_stream_->GetStream(fd_out);
+  if (!in || !out) {
+    errno = EBADF;
+    return -1;
+  }
+  if (in.get() == out.get()) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (off_in)
+    return TransferLocked(in, off_in, out, off_out, len);
+
+  // Read a seekable |in| at its current position with pread() so that the
+  // bytes which |out| does not take stay in |in|.
+  const int saved_errno = errno;
+  off64_t position = in->lseek(0, SEEK_CUR);
+  errno = saved_errno;
+  if (position < 0)
+    return TransferLocked(in, NULL, out, off_out, len);
+  const ssize_t result = TransferLocked(in, &position, out, off_out, len);
+  if (result > 0)
+    in->lseek(position, SEEK_SET);
+  return result;
+}
+
+ssize_t VirtualFileSystem::TransferLocked(scoped_refptr<FileStream> in,
+                                          off64_t* in_offset,
+                                          scoped_refptr<FileStream> out,
+                                          off64_t* out_offset,
+                                          size_t count) {
+  mutex_.AssertAcquired();
+  std::vector<char> buf;
+  size_t total = 0;
+  bool has_error = false;
+  while (total < count && !has_error) {
+    size_t chunk_size = std::min(count - total, kTransferChunkSize);
+    if (!in_offset) {
+      // The bytes read from an unseekable |in| cannot be put back, so never
+      // take more than |out| accepts right now. If nothing is moved yet, wait
+      // for |in| to have data and |out| to have room, unless the one which
+      // is not ready is non-blocking. Reading |in| then does not release the
+      // mutex, so the room in |out| does not change before it is written.
+      if (!in->IsSelectReadReady() || !out->IsSelectWriteReady()) {
+        if (total)
+          break;
+        if (((in->oflag() & O_NONBLOCK) && !in->IsSelectReadReady()) ||
+            ((out->oflag() & O_NONBLOCK) && !out->IsSelectWriteReady())) {
+          errno = EAGAIN;
+          has_error = true;
+          break;
+        }
+        PollWaiter waiter(&mutex_, &cond_);
+        waiter.AddStream(in);
+        waiter.AddStream(out);
+        while (!in->IsSelectReadReady() || !out->IsSelectWriteReady())
+          waiter.WaitUntil(base::TimeTicks());
+      }
+      size_t writable_size;
+      if (out->GetWritableSize(&writable_size))
+        chunk_size = std::min(chunk_size, writable_size);
+      if (!chunk_size)
+        break;
+    }
+    const int64_t read_start_time = IOStats::GetStartTime();
+    const void* data = NULL;
+    size_t content_size = 0;
+    ssize_t size;
+    bool stop_on_short_read = false;
+    // Hand the content of |in| directly to |out| only when |out| is ready,
+    // since |out| may release the mutex while waiting, and the content can
+    // change meanwhile.
+    if (in_offset && out->IsSelectWriteReady() &&
+        in->GetContentBuffer(*in_offset, chunk_size, &data, &content_size)) {
+      size = content_size;
+    } else {
+      // A short read means that |in| has nothing more for now. Reading again
+      // would block on an empty pipe or socket, which splice() does not do.
+      stop_on_short_read = true;
+      if (buf.size() < chunk_size)
+        buf.resize(chunk_size);
+      size = in_offset ? in->pread(&buf[0], chunk_size, *in_offset) :
+          in->read(&buf[0], chunk_size);
+      data = &buf[0];
+    }
+    IOStats::Record(in->GetIOStatsSlot(), IOStats::kRead, size,
+                    read_start_time);
+    if (size <= 0) {
+      has_error = size < 0;
+      break;
+    }
+
+    // When |in| is read at an offset, the bytes which |out| does not take
+    // are simply not consumed. Otherwise |out| has room for all of them as
+    // checked above.
+    const int64_t write_start_time = IOStats::GetStartTime();
+    const ssize_t written = out_offset ?
+        out->pwrite(data, size, *out_offset) : out->write(data, size);
+    IOStats::Record(out->GetIOStatsSlot(), IOStats::kWrite, written,
+                    write_start_time);
+    if (written <= 0) {
+      has_error = written < 0;
+      break;
+    }
+    ALOG_ASSERT(in_offset || written == size,
+                "Lost %zd bytes spliced from an unseekable stream",
+                size - written);
+    if (out_offset)
+      *out_offset += written;
+    if (in_offset)
+      *in_offset += written;
+    total += written;
+    if (written < size ||
+        (stop_on_short_read && static_cast<size_t>(size) < chunk_size))
+      break;
+  }
+  if (!total && has_error)
+    return -1;
+  return total;
+}
+
 int VirtualFileSystem::connect(int fd, const sockaddr* serv_addr,
                                socklen_t addrlen) {
   base::AutoLock lock(mutex_);
@@ -1641,7 +1897,36 @@ ssize_t VirtualFileSystem::send(int sockfd, const void* buf, size_t len,
     errno = EBADF;
     return -1;
   }
-  return stream->send(buf, len, flags);
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = stream->send(buf, len, flags);
+  IOStats::Record(stream->GetIOStatsSlot(), IOStats::kWrite, result, start_time);
+  return result;
+}
+
+ssize_t VirtualFileSystem::sendfile(int out_fd, int in_fd, off64_t* offset,
+                                    size_t count) {
+  base::AutoLock lock(mutex_);
+  ARC_STRACE_REPORT_HANDLER(kVirtualFileSystemHandlerStr);
+
+  scoped_refptr<FileStream> in = fd_to_stream_->GetStream(in_fd);
+  scoped_refptr<FileStream> out = fd_to_stream_->GetStream(out_fd);
+  if (!in || !out) {
+    errno = EBADF;
+    return -1;
+  }
+  if (offset)
+    return TransferLocked(in, offset, out, NULL, count);
+
+  // Without |offset|, sendfile() reads from and updates the file position.
+  off64_t position = in->lseek(0, SEEK_CUR);
+  if (position < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  const ssize_t result = TransferLocked(in, &position, out, NULL, count);
+  if (result > 0)
+    in->lseek(position, SEEK_SET);
+  return result;
 }
 
 ssize_t VirtualFileSystem::sendto(
@@ -1655,7 +1940,10 @@ ssize_t VirtualFileSystem::sendto(
     errno = EBADF;
     return -1;
   }
-  return stream->sendto(buf, len, flags, dest_addr, addrlen);
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = stream->sendto(buf, len, flags, dest_addr, addrlen);
+  IOStats::Record(stream->GetIOStatsSlot(), IOStats::kWrite, result, start_time);
+  return result;
 }
 
 int VirtualFileSystem::sendmsg(
@@ -1668,7 +1956,10 @@ int VirtualFileSystem::sendmsg(
     errno = EBADF;
     return -1;
   }
-  return stream->sendmsg(msg, flags);
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = stream->sendmsg(msg, flags);
+  IOStats::Record(stream->GetIOStatsSlot(), IOStats::kWrite, result, start_time);
+  return result;
 }
 
 ssize_t VirtualFileSystem::recv(int sockfd, void* buf, size_t len, int flags) {
@@ -1680,7 +1971,10 @@ ssize_t VirtualFileSystem::recv(int sockfd, void* buf, size_t len, int flags) {
     errno = EBADF;
     return -1;
   }
-  return stream->recv(buf, len, flags);
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = stream->recv(buf, len, flags);
+  IOStats::Record(stream->GetIOStatsSlot(), IOStats::kRead, result, start_time);
+  return result;
 }
 
 ssize_t VirtualFileSystem::recvfrom(
@@ -1694,7 +1988,10 @@ ssize_t VirtualFileSystem::recvfrom(
     errno = EBADF;
     return -1;
   }
-  return stream->recvfrom(buffer, len, flags, addr, addrlen);
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = stream->recvfrom(buffer, len, flags, addr, addrlen);
+  IOStats::Record(stream->GetIOStatsSlot(), IOStats::kRead, result, start_time);
+  return result;
 }
 
 int VirtualFileSystem::recvmsg(
@@ -1707,7 +2004,10 @@ int VirtualFileSystem::recvmsg(
     errno = EBADF;
     return -1;
   }
-  return stream->recvmsg(msg, flags);
+  const int64_t start_time = IOStats::GetStartTime();
+  const ssize_t result = stream->recvmsg(msg, flags);
+  IOStats::Record(stream->GetIOStatsSlot(), IOStats::kRead, result, start_time);
+  return result;
 }
 
 int VirtualFileSystem::getsockopt(int sockfd, int level, int optname,
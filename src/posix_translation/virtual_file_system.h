@@ -172,6 +172,8 @@ class VirtualFileSystem : public VirtualFileSystemInterface {
   int select(int nfds, fd_set* readfds, fd_set* writefds,
              fd_set* exceptfds, struct timeval* timeout);
   ssize_t send(int sockfd, const void* buf, size_t len, int flags);
+  // Unlike Linux, |in_fd| can be any stream which supports lseek().
+  ssize_t sendfile(int out_fd, int in_fd, off64_t* offset, size_t count);
   ssize_t sendto(int sockfd, const void* buf, size_t len, int flags,
                  const sockaddr* dest_addr, socklen_t addrlen);
   int sendmsg(int sockfd, const struct msghdr* msg, int flags);
@@ -181,6 +183,9 @@ class VirtualFileSystem : public VirtualFileSystemInterface {
   int socket(int socket_family, int socket_type, int protocol);
   int socketpair(int socket_family, int socket_type, int protocol,
                  int sv[2]);
+  // Unlike Linux, neither stream has to be a pipe. |flags| is ignored.
+  ssize_t splice(int fd_in, off64_t* off_in, int fd_out, off64_t* off_out,
+                 size_t len, unsigned int flags);
   int stat(const std::string& pathname, struct stat* out);
   int statfs(const std::string& pathname, struct statfs* out);
   int statvfs(const std::string& pathname,
@@ -243,6 +248,15 @@ class VirtualFileSystem : public VirtualFileSystemInterface {
   // Checks if |fd| is managed by posix_translation.
   bool IsKnownDescriptor(int fd);
 
+  // Try to read from or write to |fd| without taking the mutex. These
+  // succeed only when the stream for |fd| provides FileStream::LockFreeOps
+  // and the operation does not fail. Returns true and sets |out_result| on
+  // success. Otherwise, returns false and the caller must fall back to
+  // read() or write(), which also report errors properly.
+  bool TryLockFreeRead(int fd, void* buf, size_t count, ssize_t* out_result);
+  bool TryLockFreeWrite(int fd, const void* buf, size_t count,
+                        ssize_t* out_result);
+
   // Return an inode number for the |path|. If it's not assigned yet, assign
   // a new number and return it.
   ino_t GetInodeLocked(const std::string& path);
@@ -270,6 +284,10 @@ class VirtualFileSystem : public VirtualFileSystemInterface {
 
   scoped_refptr<FileStream> GetStreamLocked(int fd);
 
+  // Returns true if any memory region in [addr, addr+length) is or was mapped
+  // with PROT_WRITE.
+  bool IsWriteMappedLocked(void* addr, size_t length);
+
   AbstractSocketNamespace* GetAbstractSocketNamespace() {
     return &abstract_socket_namespace_;
   }
@@ -367,6 +385,13 @@ class VirtualFileSystem : public VirtualFileSystemInterface {
   // format.
   std::string GetMemoryMapAsStringLocked();
 
+  // Moves up to |count| bytes from |in| to |out| for sendfile() and splice().
+  // Reads |in| at |*in_offset| and advances it, or reads at the current
+  // position if |in_offset| is NULL. The same goes for |out|.
+  ssize_t TransferLocked(scoped_refptr<FileStream> in, off64_t* in_offset,
+                         scoped_refptr<FileStream> out, off64_t* out_offset,
+                         size_t count);
+
   // Resolves symlinks in path in-place.
   // TODO(satorux): Write a unit test for this function once gmock is gone
   // from virtual_file_system_test.cc crbug.com/335430.
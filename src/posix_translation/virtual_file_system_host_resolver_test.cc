@@ -42,6 +42,7 @@ class FileSystemHostResolverTest
   DECLARE_BACKGROUND_TEST(TestGetAddrInfoIPv6NumberNullHint);
   DECLARE_BACKGROUND_TEST(TestGetAddrInfoIPv6NumberAF_INET6);
   DECLARE_BACKGROUND_TEST(TestGetAddrInfoIPv6NumberAF_UNSPEC);
+  DECLARE_BACKGROUND_TEST(TestGetAddrInfoCached);
   // TODO(crbug.com/247201): Add tests for failure cases for the various API's
   // invoked by the getaddrinfo() implementation.
 
@@ -370,4 +371,37 @@ TEST_BACKGROUND_F(FileSystemHostResolverTest,
   file_system_->freeaddrinfo(res);
 }
 
+TEST_BACKGROUND_F(FileSystemHostResolverTest, TestGetAddrInfoCached) {
+  // Only the first lookup should make an IPC.
+  ExpectResolve("example.com", 0);
+  ExpectGetCanonicalName("resolve.example.com");
+  ExpectGetNetAddressCount(1);
+  const in_addr kReturnAddr = {0x12345678};
+  ExpectGetNetAddressIPv4(0, 101, kReturnAddr);
+
+  for (int i = 0; i < 2; ++i) {
+    addrinfo* res = NULL;
+    EXPECT_EQ(0, file_system_->getaddrinfo("example.com", NULL, NULL, &res));
+    ASSERT_TRUE(res != NULL);
+    EXPECT_TRUE(res[0].ai_next == NULL);
+    EXPECT_STREQ("resolve.example.com", res[0].ai_canonname);
+    struct sockaddr_in* addr = reinterpret_cast<struct sockaddr_in*>(
+        res[0].ai_addr);
+    EXPECT_EQ(AF_INET, addr->sin_family);
+    EXPECT_EQ(101, addr->sin_port);
+    EXPECT_EQ(kReturnAddr.s_addr, addr->sin_addr.s_addr);
+    file_system_->freeaddrinfo(res);
+  }
+
+  // The cached result is shared with lookups for other services.
+  addrinfo* res = NULL;
+  EXPECT_EQ(0, file_system_->getaddrinfo("example.com", "80", NULL, &res));
+  ASSERT_TRUE(res != NULL);
+  struct sockaddr_in* addr = reinterpret_cast<struct sockaddr_in*>(
+      res[0].ai_addr);
+  EXPECT_EQ(htons(80), addr->sin_port);
+  EXPECT_EQ(kReturnAddr.s_addr, addr->sin_addr.s_addr);
+  file_system_->freeaddrinfo(res);
+}
+
 }  // namespace posix_translation
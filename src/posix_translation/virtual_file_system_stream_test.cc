@@ -4,10 +4,13 @@
 
 #include <string.h>
 
+#include <vector>
+
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
 #include "gtest/gtest.h"
 #include "posix_translation/dir.h"
+#include "posix_translation/io_stats.h"
 #include "posix_translation/test_util/file_system_background_test_common.h"
 #include "posix_translation/test_util/virtual_file_system_test_common.h"
 #include "posix_translation/virtual_file_system.h"
@@ -204,6 +207,7 @@ class FileSystemStreamTest
   DECLARE_BACKGROUND_TEST(TestGetSockName);
   DECLARE_BACKGROUND_TEST(TestGetSockOpt);
   DECLARE_BACKGROUND_TEST(TestIOCtl);
+  DECLARE_BACKGROUND_TEST(TestIOStats);
   DECLARE_BACKGROUND_TEST(TestListen);
   DECLARE_BACKGROUND_TEST(TestLSeek);
   DECLARE_BACKGROUND_TEST(TestPRead);
@@ -617,6 +621,31 @@ TEST_BACKGROUND_F(FileSystemStreamTest, TestWrite) {
   EXPECT_ERROR(file_system_->write(0, buf, count), EBADF);
 }
 
+TEST_BACKGROUND_F(FileSystemStreamTest, TestIOStats) {
+  IOStats::ResetForTest();
+  char buf[16];
+  stream_->content_ = "0123456789";
+  EXPECT_EQ(5, file_system_->read(fd_, buf, 5));
+  EXPECT_EQ(10, file_system_->recv(fd_, buf, sizeof(buf), 0));
+  EXPECT_EQ(3, file_system_->write(fd_, "abc", 3));
+  // Calls for unknown descriptors are not recorded.
+  EXPECT_ERROR(file_system_->read(0, buf, sizeof(buf)), EBADF);
+
+  std::vector<IOStats::Entry> entries;
+  IOStats::GetSnapshot(&entries);
+  ASSERT_EQ(1U, entries.size());
+  // |stream_| is not opened by a handler.
+  EXPECT_EQ("", entries[0].handler_name);
+  EXPECT_EQ("test", entries[0].stream_type);
+  const IOStats::Counters& read = entries[0].counters[IOStats::kRead];
+  EXPECT_EQ(2U, read.calls);
+  EXPECT_EQ(0U, read.errors);
+  EXPECT_EQ(15U, read.bytes);
+  const IOStats::Counters& write = entries[0].counters[IOStats::kWrite];
+  EXPECT_EQ(1U, write.calls);
+  EXPECT_EQ(3U, write.bytes);
+}
+
 TEST_BACKGROUND_F(FileSystemStreamTest, TestWriteV) {
   // Test that the content in the vector is written to the stream via the
   // logic in file_stream.cc.
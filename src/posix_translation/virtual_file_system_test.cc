@@ -2,19 +2,27 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdarg.h>
 #include <stdlib.h>  // posix_memalign
 #include <string.h>
 
 #include <algorithm>
 #include <set>
+#include <string>
+#include <vector>
 
 #include "base/compiler_specific.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "posix_translation/address_util.h"
 #include "posix_translation/dir.h"
+#include "posix_translation/file_stream_pool.h"
+#include "posix_translation/readonly_memory_file.h"
 #include "posix_translation/test_util/file_system_background_test_common.h"
 #include "posix_translation/test_util/virtual_file_system_test_common.h"
 #include "posix_translation/virtual_file_system.h"
@@ -112,6 +120,22 @@ class TestFileStream : public FileStream {
   bool is_munmap_called_;
 };
 
+// A read-only file whose content is given to the constructor.
+class TestMemoryFile : public ReadonlyMemoryFile {
+ public:
+  explicit TestMemoryFile(const std::string& content)
+      : ReadonlyMemoryFile("/test_memory_file", 0, 0),
+        content_(content.begin(), content.end()) {
+  }
+
+ private:
+  virtual const Content& GetContent() OVERRIDE {
+    return content_;
+  }
+
+  const Content content_;
+};
+
 // Stub-ish implementation of FileSystemHandler, that simply returns the
 // stream given to the constructor when open() is called.
 class TestFileSystemHandler : public FileSystemHandler {
@@ -138,6 +162,115 @@ class TestFileSystemHandler : public FileSystemHandler {
 // A dummy file path used in tests.
 const char kTestPath[] = "/test.file";
 
+// Calls poll() with POLLIN for |fd| on a separate thread, blocking until the
+// fd becomes readable or hung up.
+class PollThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  PollThread(VirtualFileSystem* file_system, int fd)
+      : file_system_(file_system), fd_(fd), result_(-1), revents_(0),
+        thread_(this, "poll_thread") {}
+
+  void Start() {
+    thread_.Start();
+  }
+
+  void Join() {
+    thread_.Join();
+  }
+
+  int result() const { return result_; }
+  int16_t revents() const { return revents_; }
+
+ private:
+  // base::DelegateSimpleThread::Delegate override.
+  virtual void Run() OVERRIDE {
+    struct pollfd pfd = {};
+    pfd.fd = fd_;
+    pfd.events = POLLIN;
+    result_ = file_system_->poll(&pfd, 1, -1);
+    revents_ = pfd.revents;
+  }
+
+  VirtualFileSystem* file_system_;
+  const int fd_;
+  int result_;
+  int16_t revents_;
+  base::DelegateSimpleThread thread_;
+};
+
+// Calls a blocking read() for |fd| with a buffer of |size| bytes on a
+// separate thread.
+class ReadThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  ReadThread(VirtualFileSystem* file_system, int fd, size_t size)
+      : file_system_(file_system), fd_(fd), result_(-1), buf_(size),
+        thread_(this, "read_thread") {}
+
+  void Start() {
+    thread_.Start();
+  }
+
+  void Join() {
+    thread_.Join();
+  }
+
+  ssize_t result() const { return result_; }
+  std::string data() const {
+    return std::string(buf_.begin(), buf_.begin() + std::max<ssize_t>(
+        result_, 0));
+  }
+
+ private:
+  // base::DelegateSimpleThread::Delegate override.
+  virtual void Run() OVERRIDE {
+    result_ = file_system_->read(fd_, &buf_[0], buf_.size());
+  }
+
+  VirtualFileSystem* file_system_;
+  const int fd_;
+  ssize_t result_;
+  std::vector<char> buf_;
+  base::DelegateSimpleThread thread_;
+};
+
+// Reads a byte from |in_fd| and writes it back to |out_fd| |count| times on
+// a separate thread.
+class EchoThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  EchoThread(VirtualFileSystem* file_system, int in_fd, int out_fd, int count)
+      : file_system_(file_system), in_fd_(in_fd), out_fd_(out_fd),
+        count_(count), echoed_(0), thread_(this, "echo_thread") {}
+
+  void Start() {
+    thread_.Start();
+  }
+
+  void Join() {
+    thread_.Join();
+  }
+
+  int echoed() const { return echoed_; }
+
+ private:
+  // base::DelegateSimpleThread::Delegate override.
+  virtual void Run() OVERRIDE {
+    char c;
+    for (; echoed_ < count_; ++echoed_) {
+      if (file_system_->read(in_fd_, &c, 1) != 1 ||
+          file_system_->write(out_fd_, &c, 1) != 1) {
+        break;
+      }
+    }
+  }
+
+  VirtualFileSystem* file_system_;
+  const int in_fd_;
+  const int out_fd_;
+  const int count_;
+  int echoed_;
+  base::DelegateSimpleThread thread_;
+};
+
 }  // namespace
 
 // This class is used to test event-related functions such as epoll_*(),
@@ -165,14 +298,46 @@ class FileSystemTest : public FileSystemBackgroundTestCommon<FileSystemTest> {
   DECLARE_BACKGROUND_TEST(TestAnonymousMmap);
   DECLARE_BACKGROUND_TEST(TestNoMunmap);
   DECLARE_BACKGROUND_TEST(TestPipe);
+  // TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+  // functions so run them in a real ARM device.
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_TestPipeBlockingRead);
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_TestSeqpacketBlockingRead);
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_TestPipePingPong);
+  DECLARE_BACKGROUND_TEST(TestSocketChurn);
   DECLARE_BACKGROUND_TEST(TestPoll);
+  // TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+  // functions so run them in a real ARM device.
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_TestPollWakeUp);
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_TestPollWithIdlePollers);
   DECLARE_BACKGROUND_TEST(TestSelect);
+  DECLARE_BACKGROUND_TEST(TestSendfile);
   DECLARE_BACKGROUND_TEST(TestSocket);
   DECLARE_BACKGROUND_TEST(TestSocketpair);
+  DECLARE_BACKGROUND_TEST(TestSplice);
+  // TODO(crbug.com/362175): qemu-arm cannot reliably emulate threading
+  // functions so run them in a real ARM device.
+  DECLARE_BACKGROUND_TEST(QEMU_DISABLED_TestSpliceToFullSocket);
 
  protected:
   int GetOpenFD(int flags);
 
+  int fcntl(int fd, int cmd, ...) {
+    va_list ap;
+    va_start(ap, cmd);
+    const int result = file_system_->fcntl(fd, cmd, ap);
+    va_end(ap);
+    return result;
+  }
+
+  // Fills the buffer of the socket |fd| and then frees |free_size| bytes of
+  // it by reading from |peer_fd|.
+  void FillSocket(int fd, int peer_fd, size_t free_size) {
+    std::vector<char> buf(1024 * 1024, 'x');
+    ASSERT_LT(0, file_system_->write(fd, &buf[0], buf.size()));
+    ASSERT_EQ(static_cast<ssize_t>(free_size),
+              file_system_->read(peer_fd, &buf[0], free_size));
+  }
+
   virtual void SetUp() OVERRIDE {
     FileSystemBackgroundTestCommon<FileSystemTest>::SetUp();
     factory_.GetMock(&ppb_tcpsocket_);
@@ -724,6 +889,240 @@ TEST_BACKGROUND_F(FileSystemTest, TestSocketpair) {
   EXPECT_EQ(0, file_system_->close(sockets[1]));
 }
 
+TEST_BACKGROUND_F(FileSystemTest, TestSendfile) {
+  int sockets[2];
+  ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+  const int fd = GetFirstUnusedDescriptor();
+  AddFileStream(fd, new TestMemoryFile("0123456789"));
+  char buf[16];
+
+  // Without an offset, the file position is used and advanced.
+  EXPECT_EQ(4, file_system_->sendfile(sockets[0], fd, NULL, 4));
+  EXPECT_EQ(4, file_system_->lseek(fd, 0, SEEK_CUR));
+  EXPECT_EQ(4, file_system_->read(sockets[1], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("0123", buf, 4));
+
+  // With an offset, only the offset is advanced.
+  off64_t offset = 8;
+  EXPECT_EQ(2, file_system_->sendfile(sockets[0], fd, &offset, 100));
+  EXPECT_EQ(10, offset);
+  EXPECT_EQ(4, file_system_->lseek(fd, 0, SEEK_CUR));
+  EXPECT_EQ(2, file_system_->read(sockets[1], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("89", buf, 2));
+  EXPECT_EQ(0, file_system_->sendfile(sockets[0], fd, &offset, 100));
+
+  // The rest of the file from the current position.
+  EXPECT_EQ(6, file_system_->sendfile(sockets[0], fd, NULL, 100));
+  EXPECT_EQ(10, file_system_->lseek(fd, 0, SEEK_CUR));
+  EXPECT_EQ(6, file_system_->read(sockets[1], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("456789", buf, 6));
+
+  // A socket does not have a file position.
+  errno = 0;
+  EXPECT_EQ(-1, file_system_->sendfile(sockets[0], sockets[1], NULL, 4));
+  EXPECT_EQ(EINVAL, errno);
+  errno = 0;
+  EXPECT_EQ(-1, file_system_->sendfile(
+      sockets[0], GetFirstUnusedDescriptor(), NULL, 4));
+  EXPECT_EQ(EBADF, errno);
+
+  EXPECT_EQ(0, file_system_->close(fd));
+  EXPECT_EQ(0, file_system_->close(sockets[0]));
+  EXPECT_EQ(0, file_system_->close(sockets[1]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, TestSplice) {
+  int pipefd[2];
+  int sockets[2];
+  ASSERT_EQ(0, file_system_->pipe2(pipefd, 0));
+  ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+  char buf[16];
+
+  // Only the available bytes are moved without blocking for more.
+  EXPECT_EQ(6, file_system_->write(pipefd[1], "abcdef", 6));
+  EXPECT_EQ(6, file_system_->splice(pipefd[0], NULL, sockets[0], NULL, 100,
+                                    0));
+  EXPECT_EQ(6, file_system_->read(sockets[1], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("abcdef", buf, 6));
+
+  // A seekable source is read at its position, which is then advanced.
+  const int fd = GetFirstUnusedDescriptor();
+  AddFileStream(fd, new TestMemoryFile("0123456789"));
+  EXPECT_EQ(3, file_system_->lseek(fd, 3, SEEK_SET));
+  EXPECT_EQ(4, file_system_->splice(fd, NULL, pipefd[1], NULL, 4, 0));
+  EXPECT_EQ(7, file_system_->lseek(fd, 0, SEEK_CUR));
+  EXPECT_EQ(4, file_system_->read(pipefd[0], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("3456", buf, 4));
+
+  off64_t offset = 1;
+  EXPECT_EQ(2, file_system_->splice(fd, &offset, pipefd[1], NULL, 2, 0));
+  EXPECT_EQ(3, offset);
+  EXPECT_EQ(7, file_system_->lseek(fd, 0, SEEK_CUR));
+  EXPECT_EQ(2, file_system_->read(pipefd[0], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("12", buf, 2));
+
+  errno = 0;
+  EXPECT_EQ(-1, file_system_->splice(sockets[0], NULL, sockets[0], NULL, 4,
+                                     0));
+  EXPECT_EQ(EINVAL, errno);
+  errno = 0;
+  EXPECT_EQ(-1, file_system_->splice(GetFirstUnusedDescriptor(), NULL,
+                                     sockets[0], NULL, 4, 0));
+  EXPECT_EQ(EBADF, errno);
+
+  EXPECT_EQ(0, file_system_->close(fd));
+  EXPECT_EQ(0, file_system_->close(pipefd[0]));
+  EXPECT_EQ(0, file_system_->close(pipefd[1]));
+  EXPECT_EQ(0, file_system_->close(sockets[0]));
+  EXPECT_EQ(0, file_system_->close(sockets[1]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, QEMU_DISABLED_TestSpliceToFullSocket) {
+  int pipefd[2];
+  int sockets[2];
+  ASSERT_EQ(0, file_system_->pipe2(pipefd, 0));
+  ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+  ASSERT_EQ(0, fcntl(sockets[0], F_SETFL, O_NONBLOCK));
+  char buf[16];
+
+  // Only the bytes the socket has room for are taken from the pipe. The
+  // rest stay in the pipe.
+  FillSocket(sockets[0], sockets[1], 4);
+  EXPECT_EQ(8, file_system_->write(pipefd[1], "abcdefgh", 8));
+  EXPECT_EQ(4, file_system_->splice(pipefd[0], NULL, sockets[0], NULL, 100,
+                                    0));
+  errno = 0;
+  EXPECT_EQ(-1, file_system_->splice(pipefd[0], NULL, sockets[0], NULL, 100,
+                                     0));
+  EXPECT_EQ(EAGAIN, errno);
+  EXPECT_EQ(4, file_system_->read(pipefd[0], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("efgh", buf, 4));
+
+  // A blocking socket waits for room, which is made by |reader| here.
+  ASSERT_EQ(0, fcntl(sockets[0], F_SETFL, 0));
+  EXPECT_EQ(8, file_system_->write(pipefd[1], "ijklmnop", 8));
+  ReadThread reader(file_system_, sockets[1], 2);
+  reader.Start();
+  EXPECT_EQ(2, file_system_->splice(pipefd[0], NULL, sockets[0], NULL, 100,
+                                    0));
+  reader.Join();
+  EXPECT_EQ(2, reader.result());
+  EXPECT_EQ(6, file_system_->read(pipefd[0], buf, sizeof(buf)));
+  EXPECT_EQ(0, memcmp("klmnop", buf, 6));
+
+  EXPECT_EQ(0, file_system_->close(pipefd[0]));
+  EXPECT_EQ(0, file_system_->close(pipefd[1]));
+  EXPECT_EQ(0, file_system_->close(sockets[0]));
+  EXPECT_EQ(0, file_system_->close(sockets[1]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, QEMU_DISABLED_TestPipeBlockingRead) {
+  int pipefd[2];
+  ASSERT_EQ(0, file_system_->pipe2(pipefd, 0));
+
+  // The data which does not fit in the buffer of the blocked reader should be
+  // kept for the next read, whether or not it is handed off to the reader.
+  ReadThread reader(file_system_, pipefd[0], 4);
+  reader.Start();
+  EXPECT_EQ(8, file_system_->write(pipefd[1], "abcdefgh", 8));
+  reader.Join();
+  EXPECT_EQ(4, reader.result());
+  EXPECT_EQ("abcd", reader.data());
+
+  ReadThread reader2(file_system_, pipefd[0], 100);
+  reader2.Start();
+  reader2.Join();
+  EXPECT_EQ(4, reader2.result());
+  EXPECT_EQ("efgh", reader2.data());
+
+  // A blocked reader should see EOF when the write end is closed.
+  ReadThread reader3(file_system_, pipefd[0], 100);
+  reader3.Start();
+  EXPECT_EQ(0, file_system_->close(pipefd[1]));
+  reader3.Join();
+  EXPECT_EQ(0, reader3.result());
+
+  EXPECT_EQ(0, file_system_->close(pipefd[0]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, QEMU_DISABLED_TestSeqpacketBlockingRead) {
+  int sockets[2];
+  ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets));
+
+  // The rest of a datagram which does not fit in the buffer is discarded.
+  ReadThread reader(file_system_, sockets[1], 4);
+  reader.Start();
+  EXPECT_EQ(8, file_system_->write(sockets[0], "abcdefgh", 8));
+  reader.Join();
+  EXPECT_EQ(4, reader.result());
+  EXPECT_EQ("abcd", reader.data());
+
+  // Datagrams are received one by one, reusing the buffers of consumed
+  // datagrams.
+  char buf[16];
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(2, file_system_->write(sockets[0], "xy", 2));
+    EXPECT_EQ(3, file_system_->write(sockets[0], "123", 3));
+    EXPECT_EQ(2, file_system_->read(sockets[1], buf, sizeof(buf)));
+    EXPECT_EQ(0, memcmp("xy", buf, 2));
+    EXPECT_EQ(3, file_system_->read(sockets[1], buf, sizeof(buf)));
+    EXPECT_EQ(0, memcmp("123", buf, 3));
+  }
+
+  EXPECT_EQ(0, file_system_->close(sockets[0]));
+  EXPECT_EQ(0, file_system_->close(sockets[1]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, QEMU_DISABLED_TestPipePingPong) {
+  static const int kRoundTrips = 100;
+  int ping[2];
+  int pong[2];
+  ASSERT_EQ(0, file_system_->pipe2(ping, 0));
+  ASSERT_EQ(0, file_system_->pipe2(pong, 0));
+
+  // Each byte should be handed off to the blocked echo thread and back.
+  EchoThread echo(file_system_, ping[0], pong[1], kRoundTrips);
+  echo.Start();
+  char c = 'a';
+  int i = 0;
+  for (; i < kRoundTrips; ++i) {
+    if (file_system_->write(ping[1], &c, 1) != 1 ||
+        file_system_->read(pong[0], &c, 1) != 1) {
+      break;
+    }
+    EXPECT_EQ('a', c);
+  }
+  // Unblock the echo thread in case the loop above failed.
+  EXPECT_EQ(0, file_system_->close(ping[1]));
+  echo.Join();
+  EXPECT_EQ(kRoundTrips, i);
+  EXPECT_EQ(kRoundTrips, echo.echoed());
+
+  EXPECT_EQ(0, file_system_->close(ping[0]));
+  EXPECT_EQ(0, file_system_->close(pong[0]));
+  EXPECT_EQ(0, file_system_->close(pong[1]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, TestSocketChurn) {
+  static const int kIterations = 100;
+  FileStreamPool::Stats before;
+  FileStreamPool::GetStats(&before);
+  int i = 0;
+  for (; i < kIterations; ++i) {
+    int sockets[2];
+    if (file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+      break;
+    EXPECT_EQ(0, file_system_->close(sockets[0]));
+    EXPECT_EQ(0, file_system_->close(sockets[1]));
+  }
+  FileStreamPool::Stats after;
+  FileStreamPool::GetStats(&after);
+  EXPECT_EQ(kIterations, i);
+  // Only the first iterations should need the heap.
+  EXPECT_LT(after.heap_allocations - before.heap_allocations,
+            after.pooled_allocations - before.pooled_allocations);
+}
+
 TEST_BACKGROUND_F(FileSystemTest, TestPoll) {
   struct pollfd fds[3] = {};
 
@@ -804,6 +1203,72 @@ TEST_BACKGROUND_F(FileSystemTest, TestPoll) {
   EXPECT_EQ(0, fds[2].revents);
 }
 
+TEST_BACKGROUND_F(FileSystemTest, QEMU_DISABLED_TestPollWakeUp) {
+  int sockets[2];
+  ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+  // A blocked poller should be woken up when the peer writes data.
+  PollThread reader(file_system_, sockets[1]);
+  reader.Start();
+  char c = 'a';
+  EXPECT_EQ(1, file_system_->write(sockets[0], &c, 1));
+  reader.Join();
+  EXPECT_EQ(1, reader.result());
+  EXPECT_EQ(POLLIN, reader.revents());
+  EXPECT_EQ(1, file_system_->read(sockets[1], &c, 1));
+
+  // It should also be woken up when the peer is closed.
+  PollThread hangup_reader(file_system_, sockets[1]);
+  hangup_reader.Start();
+  EXPECT_EQ(0, file_system_->close(sockets[0]));
+  hangup_reader.Join();
+  EXPECT_EQ(1, hangup_reader.result());
+  EXPECT_TRUE(hangup_reader.revents() & POLLHUP);
+
+  EXPECT_EQ(0, file_system_->close(sockets[1]));
+}
+
+TEST_BACKGROUND_F(FileSystemTest, QEMU_DISABLED_TestPollWithIdlePollers) {
+  static const size_t kIdlePollers = 4;
+  static const int kRoundTrips = 10;
+
+  // Keep threads blocked in poll() on sockets which never become ready. They
+  // should not be woken up by unrelated writes.
+  std::vector<int> idle_sockets(kIdlePollers * 2);
+  ScopedVector<PollThread> idle_pollers;
+  for (size_t i = 0; i < kIdlePollers; ++i) {
+    ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0,
+                                          &idle_sockets[i * 2]));
+    idle_pollers.push_back(
+        new PollThread(file_system_, idle_sockets[i * 2 + 1]));
+    idle_pollers.back()->Start();
+  }
+
+  int sockets[2];
+  ASSERT_EQ(0, file_system_->socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+  struct pollfd pfd = {};
+  pfd.fd = sockets[1];
+  pfd.events = POLLIN;
+  char c = 'a';
+  for (int i = 0; i < kRoundTrips; ++i) {
+    ASSERT_EQ(1, file_system_->write(sockets[0], &c, 1));
+    ASSERT_EQ(1, file_system_->poll(&pfd, 1, -1));
+    ASSERT_EQ(1, file_system_->read(sockets[1], &c, 1));
+  }
+
+  // Wake up the idle pollers by hanging up their peers.
+  for (size_t i = 0; i < kIdlePollers; ++i)
+    EXPECT_EQ(0, file_system_->close(idle_sockets[i * 2]));
+  for (size_t i = 0; i < kIdlePollers; ++i) {
+    idle_pollers[i]->Join();
+    EXPECT_EQ(1, idle_pollers[i]->result());
+    EXPECT_TRUE(idle_pollers[i]->revents() & POLLHUP);
+    EXPECT_EQ(0, file_system_->close(idle_sockets[i * 2 + 1]));
+  }
+  EXPECT_EQ(0, file_system_->close(sockets[0]));
+  EXPECT_EQ(0, file_system_->close(sockets[1]));
+}
+
 TEST_BACKGROUND_F(FileSystemTest, TestSelect) {
   fd_set readfds;
   fd_set writefds;